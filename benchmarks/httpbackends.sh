@@ -0,0 +1,124 @@
+#!/bin/sh
+# Qt vs. epoll backend under the same load: starts the example server with each backend in turn,
+# runs httpload against it and prints one JSON object per run (with "backend" and "scenario" added).
+# Scenarios: keep-alive /ping at several connection counts, pipelined /ping and, if httpload has OpenSSL,
+# HTTPS with a new (resumed) handshake per request. The HTTPS run uses a self-signed certificate.
+#
+# Usage: httpbackends.sh <build-dir> [--duration 10] [--threads 4] [--port 18080]
+#        cmake -B build -DHTTPSERVER_BUILD_BENCHMARKS=ON && cmake --build build && benchmarks/httpbackends.sh build
+
+set -eu
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <build-dir> [--duration 10] [--threads 4] [--port 18080]" >&2
+    exit 1
+fi
+
+build=$(cd "$1" && pwd)
+shift
+
+duration=10
+threads=4
+port=18080
+
+while [ $# -ge 2 ]; do
+    case "$1" in
+        --duration) duration=$2 ;;
+        --threads) threads=$2 ;;
+        --port) port=$2 ;;
+        *) echo "Unknown option $1" >&2; exit 1 ;;
+    esac
+    shift 2
+done
+
+server="$build/HttpServer"
+load="$build/benchmarks/httpload"
+
+for binary in "$server" "$load"; do
+    if [ ! -x "$binary" ]; then
+        echo "Missing $binary, build with -DHTTPSERVER_BUILD_BENCHMARKS=ON" >&2
+        exit 1
+    fi
+done
+
+# The server reads certs/ from its working directory and writes access.log there
+workdir=$(mktemp -d)
+pid=
+
+cleanup()
+{
+    if [ -n "$pid" ]; then
+        kill "$pid" 2>/dev/null || true
+        wait "$pid" 2>/dev/null || true
+    fi
+
+    rm -rf "$workdir"
+}
+
+trap cleanup EXIT INT TERM
+
+# HTTPS only if httpload has OpenSSL and a certificate can be made
+tls=false
+
+if ! "$load" 127.0.0.1 1 / --tls --duration 0 2>&1 | grep -q "Built without OpenSSL" && command -v openssl >/dev/null 2>&1; then
+    mkdir -p "$workdir/certs"
+
+    if openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=localhost" \
+        -keyout "$workdir/certs/privatekey.key" -out "$workdir/certs/certificate.crt" >/dev/null 2>&1; then
+        tls=true
+    fi
+fi
+
+start_server()
+{
+    (cd "$workdir" && exec "$server" --backend "$1" --port "$port" $2 >/dev/null 2>&1) &
+    pid=$!
+
+    # Ready once the port accepts connections
+    for _ in $(seq 50); do
+        if "$load" 127.0.0.1 "$port" /ping --connections 1 --threads 1 --duration 0 >/dev/null 2>&1; then
+            return 0
+        fi
+
+        sleep 0.1
+    done
+
+    echo "Server with backend $1 did not start" >&2
+    exit 1
+}
+
+stop_server()
+{
+    kill "$pid"
+    wait "$pid" 2>/dev/null || true
+    pid=
+}
+
+# Runs httpload and labels its JSON output
+run()
+{
+    backend=$1
+    scenario=$2
+    shift 2
+
+    "$load" 127.0.0.1 "$port" "$@" --threads "$threads" --duration "$duration" \
+        | sed "1s/^{/{\n  \"backend\": \"$backend\",\n  \"scenario\": \"$scenario\",/"
+}
+
+for backend in qt epoll; do
+    start_server "$backend" --http
+
+    for connections in 1 64 512; do
+        run "$backend" "ping_keepalive_$connections" /ping --connections "$connections"
+    done
+
+    run "$backend" "ping_pipeline_16" /ping --connections 64 --pipeline 16
+
+    stop_server
+
+    if [ "$tls" = true ]; then
+        start_server "$backend" ""
+        run "$backend" "ping_tls_close" /ping --connections 64 --tls --close
+        stop_server
+    fi
+done
@@ -0,0 +1,781 @@
+// Closed-loop load generator: every connection sends a request, waits for the complete response
+// and sends the next one. Connections are spread over threads, each running its own epoll loop.
+// With --close every request uses a new connection (and TLS handshake, resumed if the server allows).
+// With --pipeline N every connection sends N requests at once and waits for all N responses.
+// Latency is measured from sending the request (the batch when pipelining), with --close from connecting.
+//
+// Usage: httpload <host> <port> <target> [--connections 64] [--threads 4] [--duration 10] [--pipeline 1] [--tls] [--close]
+//        httpload 127.0.0.1 8080 /ping --connections 128 --threads 8
+//        httpload 127.0.0.1 8080 /ping --connections 16 --pipeline 16
+// Prints one JSON object. HTTPS needs the build with OpenSSL (HTTPLOAD_HAVE_OPENSSL).
+
+#ifdef HTTPLOAD_HAVE_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+#ifndef HTTPLOAD_HAVE_OPENSSL
+typedef void SSL;
+typedef void SSL_CTX;
+typedef void SSL_SESSION;
+#endif
+
+
+struct Options
+{
+    std::string host;
+    std::string port;
+    std::string target;
+
+    int connections = 64;
+    int threads = 4;
+    double duration = 10.0;
+
+    // Requests sent back to back on a connection
+    int pipeline = 1;
+
+    bool tls = false;
+    bool keepAlive = true;
+};
+
+struct Result
+{
+    unsigned long long requests = 0;
+    unsigned long long errors = 0;
+    unsigned long long bytes = 0;
+    unsigned long long handshakes = 0;
+    unsigned long long resumed = 0;
+
+    // µs
+    std::vector<unsigned int> latencies;
+};
+
+
+// https://datatracker.ietf.org/doc/html/rfc9112#section-6
+// Finds the end of one response: Content-Length, chunked or the end of the connection
+class ResponseParser
+{
+public:
+    enum STATE
+    {
+        HEAD,
+        LENGTH,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILERS,
+        UNTIL_CLOSE,
+        DONE,
+        ERROR,
+    };
+
+    void reset()
+    {
+        m_state = HEAD;
+        m_line.clear();
+        m_remaining = 0;
+        m_close = false;
+    }
+
+    STATE getState() const { return m_state; }
+
+    // Connection: close or read until close -> the connection cannot be reused
+    bool isClose() const { return m_close; }
+
+    // Returns the bytes used, the rest belongs to the next (pipelined) response
+    size_t append(const char* data, size_t size)
+    {
+        size_t i = 0;
+
+        while (i < size && m_state != DONE && m_state != ERROR)
+        {
+            if (m_state == LENGTH || m_state == CHUNK_DATA || m_state == UNTIL_CLOSE)
+            {
+                const size_t count = m_state == UNTIL_CLOSE ? size - i : std::min<size_t>(size - i, m_remaining);
+
+                i += count;
+
+                if (m_state == UNTIL_CLOSE)
+                    continue;
+
+                m_remaining -= count;
+
+                if (m_remaining == 0)
+                    m_state = m_state == LENGTH ? DONE : CHUNK_DATA_END;
+
+                continue;
+            }
+
+            const char c = data[i++];
+
+            if (m_state == HEAD)
+            {
+                m_line += c;
+
+                if (m_line.size() >= 4 && m_line.compare(m_line.size() - 4, 4, "\r\n\r\n") == 0)
+                    parseHead();
+
+                continue;
+            }
+
+            if (c != '\n')
+            {
+                if (c != '\r')
+                    m_line += c;
+
+                continue;
+            }
+
+            if (m_state == CHUNK_SIZE)
+            {
+                char* end = nullptr;
+                m_remaining = std::strtoull(m_line.c_str(), &end, 16);
+
+                if (end == m_line.c_str())
+                    m_state = ERROR;
+                else
+                    m_state = m_remaining > 0 ? CHUNK_DATA : TRAILERS;
+            }
+            else if (m_state == CHUNK_DATA_END)
+                m_state = m_line.empty() ? CHUNK_SIZE : ERROR;
+            else if (m_line.empty())
+                m_state = DONE;
+
+            m_line.clear();
+        }
+
+        return i;
+    }
+
+    // End of the connection
+    void finish()
+    {
+        m_state = m_state == UNTIL_CLOSE ? DONE : ERROR;
+    }
+
+private:
+    STATE m_state = HEAD;
+    std::string m_line;
+    unsigned long long m_remaining = 0;
+    bool m_close = false;
+
+    void parseHead()
+    {
+        for (char& c : m_line)
+            c = char(tolower(c));
+
+        const int status = m_line.compare(0, 5, "http/") == 0 && m_line.size() > 12 ? std::atoi(m_line.c_str() + 9) : 0;
+
+        m_close = m_line.find("\nconnection: close") != std::string::npos;
+
+        const size_t idxLength = m_line.find("\ncontent-length:");
+
+        if (status < 200)
+            m_state = ERROR;
+        else if (status == 204 || status == 304)
+            m_state = DONE;
+        else if (m_line.find("\ntransfer-encoding: chunked") != std::string::npos)
+            m_state = CHUNK_SIZE;
+        else if (idxLength != std::string::npos)
+        {
+            m_remaining = std::strtoull(m_line.c_str() + idxLength + 16, nullptr, 10);
+            m_state = m_remaining > 0 ? LENGTH : DONE;
+        }
+        else
+        {
+            m_state = UNTIL_CLOSE;
+            m_close = true;
+        }
+
+        m_line.clear();
+    }
+};
+
+
+class Worker
+{
+public:
+    Worker(const Options& options, const addrinfo* address, SSL_CTX* context, int connectionCount) :
+        m_options(options),
+        m_address(address),
+        m_context(context),
+        m_connections(connectionCount)
+    {
+        std::string request = "GET " + options.target + " HTTP/1.1\r\nHost: " + options.host + "\r\n";
+
+        if (!options.keepAlive)
+            request += "Connection: close\r\n";
+
+        request += "\r\n";
+
+        for (int i = 0; i < options.pipeline; ++i)
+            m_request += request;
+    }
+
+    void run(Clock::time_point end)
+    {
+        m_end = end;
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+        if (m_epollFd < 0)
+            return;
+
+        for (Connection& connection : m_connections)
+            startConnection(connection);
+
+        epoll_event events[256];
+
+        while (Clock::now() < m_end)
+        {
+            const int count = epoll_wait(m_epollFd, events, 256, 100);
+
+            for (int i = 0; i < count; ++i)
+                advance(*static_cast<Connection*>(events[i].data.ptr));
+
+            // Failed connections are replaced once per iteration
+            const auto now = Clock::now();
+
+            for (Connection& connection : m_connections)
+            {
+                if (connection.fd < 0 && now < m_end)
+                    startConnection(connection);
+            }
+        }
+
+        // Responses still in flight are not counted
+        for (Connection& connection : m_connections)
+        {
+            closeConnection(connection);
+
+#ifdef HTTPLOAD_HAVE_OPENSSL
+            SSL_SESSION_free(connection.session);
+#endif
+        }
+
+        close(m_epollFd);
+    }
+
+    const Result& getResult() const { return m_result; }
+
+private:
+    enum STATE
+    {
+        CONNECTING,
+        HANDSHAKE,
+        SENDING,
+        RECEIVING,
+        CLOSED,
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        STATE state = CLOSED;
+        unsigned int events = 0;
+
+        SSL* ssl = nullptr;
+        SSL_SESSION* session = nullptr;
+
+        size_t sent = 0;
+        int outstanding = 0;
+        ResponseParser parser;
+        Clock::time_point start;
+    };
+
+    // Result of read() / write() on plain or TLS connections
+    enum IO_RESULT
+    {
+        IO_WAIT_READ = -1,
+        IO_WAIT_WRITE = -2,
+        IO_ERROR = -3,
+    };
+
+    const Options& m_options;
+    const addrinfo* m_address;
+    SSL_CTX* m_context;
+
+    std::vector<Connection> m_connections;
+
+    // Options::pipeline requests
+    std::string m_request;
+
+    int m_epollFd = -1;
+    Clock::time_point m_end;
+
+    Result m_result;
+    char m_buffer[64 * 1024];
+
+    void startConnection(Connection& connection)
+    {
+        connection.start = Clock::now();
+        connection.sent = 0;
+        connection.events = 0;
+
+        connection.fd = socket(m_address->ai_family, m_address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, m_address->ai_protocol);
+
+        if (connection.fd < 0)
+        {
+            ++m_result.errors;
+            return;
+        }
+
+        const int on = 1;
+        setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        connection.state = CONNECTING;
+
+        if (connect(connection.fd, m_address->ai_addr, m_address->ai_addrlen) < 0 && errno != EINPROGRESS)
+        {
+            ++m_result.errors;
+
+            close(connection.fd);
+            connection.fd = -1;
+            return;
+        }
+
+        epoll_event event = {};
+        event.events = EPOLLOUT;
+        event.data.ptr = &connection;
+
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, connection.fd, &event);
+        connection.events = EPOLLOUT;
+    }
+
+    void closeConnection(Connection& connection)
+    {
+        if (connection.fd < 0)
+            return;
+
+#ifdef HTTPLOAD_HAVE_OPENSSL
+        if (connection.ssl)
+        {
+            // Kept for the next connection, TLS 1.3 tickets arrive after the handshake
+            if (connection.state == SENDING || connection.state == CLOSED)
+            {
+                SSL_SESSION* const session = SSL_get1_session(connection.ssl);
+
+                if (session)
+                {
+                    SSL_SESSION_free(connection.session);
+                    connection.session = session;
+                }
+            }
+
+            SSL_shutdown(connection.ssl);
+            SSL_free(connection.ssl);
+            connection.ssl = nullptr;
+        }
+#endif
+
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+
+        connection.fd = -1;
+    }
+
+    // Replaced by run()
+    void failConnection(Connection& connection)
+    {
+        ++m_result.errors;
+
+        connection.state = CONNECTING;
+        closeConnection(connection);
+    }
+
+    void waitFor(Connection& connection, unsigned int events)
+    {
+        if (connection.events == events)
+            return;
+
+        epoll_event event = {};
+        event.events = events;
+        event.data.ptr = &connection;
+
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+
+    void responseDone(Connection& connection)
+    {
+        const auto now = Clock::now();
+
+        ++m_result.requests;
+        m_result.latencies.push_back((unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(now - connection.start).count());
+
+        // Pipelined responses of the batch still to come
+        if (--connection.outstanding > 0 && !connection.parser.isClose())
+        {
+            connection.parser.reset();
+            return;
+        }
+
+        if (!m_options.keepAlive || connection.parser.isClose())
+        {
+            connection.state = CLOSED;
+            closeConnection(connection);
+
+            if (now < m_end)
+                startConnection(connection);
+
+            return;
+        }
+
+        connection.state = SENDING;
+        connection.sent = 0;
+        connection.start = now;
+    }
+
+    long receive(Connection& connection, char* data, size_t size)
+    {
+#ifdef HTTPLOAD_HAVE_OPENSSL
+        if (connection.ssl)
+        {
+            const int result = SSL_read(connection.ssl, data, int(size));
+
+            if (result > 0)
+                return result;
+
+            const int error = SSL_get_error(connection.ssl, result);
+
+            if (error == SSL_ERROR_ZERO_RETURN)
+                return 0;
+
+            return error == SSL_ERROR_WANT_READ ? IO_WAIT_READ : error == SSL_ERROR_WANT_WRITE ? IO_WAIT_WRITE : IO_ERROR;
+        }
+#endif
+
+        const ssize_t result = recv(connection.fd, data, size, 0);
+
+        if (result >= 0)
+            return result;
+
+        return errno == EAGAIN || errno == EWOULDBLOCK ? IO_WAIT_READ : IO_ERROR;
+    }
+
+    long transmit(Connection& connection, const char* data, size_t size)
+    {
+#ifdef HTTPLOAD_HAVE_OPENSSL
+        if (connection.ssl)
+        {
+            const int result = SSL_write(connection.ssl, data, int(size));
+
+            if (result > 0)
+                return result;
+
+            const int error = SSL_get_error(connection.ssl, result);
+
+            return error == SSL_ERROR_WANT_READ ? IO_WAIT_READ : error == SSL_ERROR_WANT_WRITE ? IO_WAIT_WRITE : IO_ERROR;
+        }
+#endif
+
+        const ssize_t result = send(connection.fd, data, size, MSG_NOSIGNAL);
+
+        if (result >= 0)
+            return result;
+
+        return errno == EAGAIN || errno == EWOULDBLOCK ? IO_WAIT_WRITE : IO_ERROR;
+    }
+
+    // Handles a result < 0 of receive() / transmit()
+    void waitOrFail(Connection& connection, long result)
+    {
+        if (result == IO_WAIT_READ)
+            waitFor(connection, EPOLLIN);
+        else if (result == IO_WAIT_WRITE)
+            waitFor(connection, EPOLLOUT);
+        else
+            failConnection(connection);
+    }
+
+    // Runs the connection until it has to wait for the socket
+    void advance(Connection& connection)
+    {
+        while (connection.fd >= 0)
+        {
+            if (connection.state == CONNECTING)
+            {
+                int error = 0;
+                socklen_t length = sizeof(error);
+
+                if (getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+                {
+                    failConnection(connection);
+                    return;
+                }
+
+                connection.state = m_options.tls ? HANDSHAKE : SENDING;
+
+#ifdef HTTPLOAD_HAVE_OPENSSL
+                if (m_options.tls)
+                {
+                    connection.ssl = SSL_new(m_context);
+                    SSL_set_fd(connection.ssl, connection.fd);
+                    SSL_set_tlsext_host_name(connection.ssl, m_options.host.c_str());
+
+                    if (connection.session)
+                        SSL_set_session(connection.ssl, connection.session);
+                }
+#endif
+            }
+            else if (connection.state == HANDSHAKE)
+            {
+#ifdef HTTPLOAD_HAVE_OPENSSL
+                const int result = SSL_connect(connection.ssl);
+
+                if (result != 1)
+                {
+                    const int error = SSL_get_error(connection.ssl, result);
+                    waitOrFail(connection, error == SSL_ERROR_WANT_READ ? IO_WAIT_READ : error == SSL_ERROR_WANT_WRITE ? IO_WAIT_WRITE : IO_ERROR);
+                    return;
+                }
+
+                ++m_result.handshakes;
+
+                if (SSL_session_reused(connection.ssl))
+                    ++m_result.resumed;
+#endif
+
+                connection.state = SENDING;
+            }
+            else if (connection.state == SENDING)
+            {
+                const long result = transmit(connection, m_request.data() + connection.sent, m_request.size() - connection.sent);
+
+                if (result < 0)
+                {
+                    waitOrFail(connection, result);
+                    return;
+                }
+
+                connection.sent += result;
+
+                if (connection.sent == m_request.size())
+                {
+                    connection.state = RECEIVING;
+                    connection.outstanding = m_options.pipeline;
+                    connection.parser.reset();
+                }
+            }
+            else if (connection.state == RECEIVING)
+            {
+                const long result = receive(connection, m_buffer, sizeof(m_buffer));
+
+                if (result < 0)
+                {
+                    waitOrFail(connection, result);
+                    return;
+                }
+
+                m_result.bytes += result;
+
+                // One read may hold several pipelined responses
+                size_t offset = 0;
+
+                do
+                {
+                    if (result == 0)
+                        connection.parser.finish();
+                    else
+                        offset += connection.parser.append(m_buffer + offset, result - offset);
+
+                    if (connection.parser.getState() == ResponseParser::ERROR)
+                    {
+                        failConnection(connection);
+                        return;
+                    }
+
+                    if (connection.parser.getState() != ResponseParser::DONE)
+                        break;
+
+                    responseDone(connection);
+                }
+                while (connection.state == RECEIVING && offset < size_t(result));
+
+                // A new connection continues once it is connected
+                if (connection.state != SENDING && connection.state != RECEIVING)
+                    return;
+            }
+            else
+                return;
+        }
+    }
+};
+
+
+static double getPercentile(const std::vector<unsigned int>& sorted, double percentile)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    const size_t index = std::min(sorted.size() - 1, size_t(percentile / 100.0 * double(sorted.size())));
+
+    return sorted[index];
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <host> <port> <target> [--connections 64] [--threads 4] [--duration 10] [--pipeline 1] [--tls] [--close]\n", argv[0]);
+        return 1;
+    }
+
+    Options options;
+    options.host = argv[1];
+    options.port = argv[2];
+    options.target = argv[3];
+
+    for (int i = 4; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc)
+            options.connections = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+            options.duration = std::max(0.1, atof(argv[++i]));
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+            options.pipeline = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--tls") == 0)
+            options.tls = true;
+        else if (strcmp(argv[i], "--close") == 0)
+            options.keepAlive = false;
+    }
+
+    options.threads = std::min(options.threads, options.connections);
+
+    // Every request closes the connection
+    if (!options.keepAlive)
+        options.pipeline = 1;
+
+    SSL_CTX* context = nullptr;
+
+    if (options.tls)
+    {
+#ifdef HTTPLOAD_HAVE_OPENSSL
+        // Certificates are not verified, the server usually runs with a self-signed one
+        context = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_verify(context, SSL_VERIFY_NONE, nullptr);
+#else
+        fprintf(stderr, "Built without OpenSSL, --tls is not available\n");
+        return 1;
+#endif
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address = nullptr;
+
+    if (getaddrinfo(options.host.c_str(), options.port.c_str(), &hints, &address) != 0 || !address)
+    {
+        fprintf(stderr, "Cannot resolve %s:%s\n", options.host.c_str(), options.port.c_str());
+        return 1;
+    }
+
+    std::vector<Worker*> workers;
+
+    for (int i = 0; i < options.threads; ++i)
+    {
+        const int count = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+        workers.push_back(new Worker(options, address, context, count));
+    }
+
+    const auto start = Clock::now();
+    const auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+
+    std::vector<std::thread> threads;
+
+    for (Worker* const worker : workers)
+        threads.emplace_back([worker, end]() { worker->run(end); });
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Result total;
+
+    for (Worker* const worker : workers)
+    {
+        const Result& result = worker->getResult();
+
+        total.requests += result.requests;
+        total.errors += result.errors;
+        total.bytes += result.bytes;
+        total.handshakes += result.handshakes;
+        total.resumed += result.resumed;
+        total.latencies.insert(total.latencies.end(), result.latencies.begin(), result.latencies.end());
+
+        delete worker;
+    }
+
+    std::sort(total.latencies.begin(), total.latencies.end());
+
+    double mean = 0.0;
+
+    for (const unsigned int latency : total.latencies)
+        mean += latency;
+
+    if (!total.latencies.empty())
+        mean /= double(total.latencies.size());
+
+    printf("{\n");
+    printf("  \"target\": \"%s\",\n", options.target.c_str());
+    printf("  \"tls\": %s,\n", options.tls ? "true" : "false");
+    printf("  \"keep_alive\": %s,\n", options.keepAlive ? "true" : "false");
+    printf("  \"connections\": %d,\n", options.connections);
+    printf("  \"pipeline\": %d,\n", options.pipeline);
+    printf("  \"threads\": %d,\n", options.threads);
+    printf("  \"seconds\": %.3f,\n", seconds);
+    printf("  \"requests\": %llu,\n", total.requests);
+    printf("  \"errors\": %llu,\n", total.errors);
+    printf("  \"requests_per_sec\": %.1f,\n", seconds > 0.0 ? double(total.requests) / seconds : 0.0);
+    printf("  \"received_mb_per_sec\": %.2f,\n", seconds > 0.0 ? double(total.bytes) / seconds / (1024.0 * 1024.0) : 0.0);
+
+    if (options.tls)
+    {
+        printf("  \"tls_handshakes\": %llu,\n", total.handshakes);
+        printf("  \"tls_resumed\": %llu,\n", total.resumed);
+    }
+
+    printf("  \"latency_us\": {\n");
+    printf("    \"mean\": %.1f,\n", mean);
+    printf("    \"p50\": %.0f,\n", getPercentile(total.latencies, 50.0));
+    printf("    \"p90\": %.0f,\n", getPercentile(total.latencies, 90.0));
+    printf("    \"p99\": %.0f,\n", getPercentile(total.latencies, 99.0));
+    printf("    \"p999\": %.0f,\n", getPercentile(total.latencies, 99.9));
+    printf("    \"max\": %.0f\n", total.latencies.empty() ? 0.0 : double(total.latencies.back()));
+    printf("  }\n");
+    printf("}\n");
+
+    freeaddrinfo(address);
+
+#ifdef HTTPLOAD_HAVE_OPENSSL
+    SSL_CTX_free(context);
+#endif
+
+    return total.requests > 0 ? 0 : 2;
+}
@@ -0,0 +1,338 @@
+// Micro-benchmarks of the request parser, response serialization, route lookup and JSON bodies
+// (HttpJsonDocument/HttpJsonWriter against QJsonDocument on documents of about 1 KB, 100 KB and 10 MB).
+// Every case is repeated until one run takes at least MIN_SECONDS, the best of RUNS runs is reported.
+//
+// Usage: httpmicro [filter]
+//        httpmicro router
+// Prints one JSON object, cases are selected by a substring of their name.
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+#include "httpjson.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "httprouter.h"
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+// Content of the JSON documents, with escapes and non-ASCII text in every record
+struct Record
+{
+    qint64 id = 0;
+    QString name;
+    QString email;
+    bool active = false;
+    double score = 0.0;
+    QList<QString> tags;
+};
+
+static constexpr double MIN_SECONDS = 0.2;
+static constexpr int RUNS = 3;
+
+// Results are summed up here, so the compiler cannot drop the work
+static volatile quint64 g_sink = 0;
+
+static bool g_first = true;
+
+
+static double timeRun(const std::function<quint64()>& function, quint64 iterations)
+{
+    quint64 sink = 0;
+
+    const auto start = Clock::now();
+
+    for (quint64 i = 0; i < iterations; ++i)
+        sink += function();
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    g_sink = g_sink + sink;
+
+    return seconds;
+}
+
+static QList<Record> makeRecords(int count)
+{
+    QList<Record> records;
+    records.reserve(count);
+
+    for (int i = 0; i < count; ++i)
+        records.append(Record{ i, QString("Üser \"%1\"").arg(i), QString("user%1@example.com").arg(i), i % 3 != 0, i * 0.25, { "alpha", "beta" } });
+
+    return records;
+}
+
+// Keys in the order QJsonDocument writes them (sorted), like writeJson()
+static QByteArray writeQJson(const QList<Record>& records)
+{
+    QJsonArray items;
+
+    for (const Record& record : records)
+    {
+        QJsonObject item;
+        item["active"] = record.active;
+        item["email"] = record.email;
+        item["id"] = record.id;
+        item["name"] = record.name;
+        item["score"] = record.score;
+        item["tags"] = QJsonArray::fromStringList(record.tags);
+
+        items.append(item);
+    }
+
+    QJsonObject root;
+    root["function"] = "secret";
+    root["items"] = items;
+    root["password"] = "asdf1234";
+
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+static QByteArray writeJson(const QList<Record>& records)
+{
+    QByteArray json;
+    HttpJsonWriter writer(json);
+
+    writer.beginObject();
+    writer.writeKey("function");
+    writer.writeString("secret");
+    writer.writeKey("items");
+    writer.beginArray();
+
+    for (const Record& record : records)
+    {
+        writer.beginObject();
+        writer.writeKey("active");
+        writer.writeBool(record.active);
+        writer.writeKey("email");
+        writer.writeString(record.email);
+        writer.writeKey("id");
+        writer.writeInteger(record.id);
+        writer.writeKey("name");
+        writer.writeString(record.name);
+        writer.writeKey("score");
+        writer.writeDouble(record.score);
+        writer.writeKey("tags");
+        writer.beginArray();
+
+        for (const QString& tag : record.tags)
+            writer.writeString(tag);
+
+        writer.endArray();
+        writer.endObject();
+    }
+
+    writer.endArray();
+    writer.writeKey("password");
+    writer.writeString("asdf1234");
+    writer.endObject();
+
+    return json;
+}
+
+static void run(const char* filter, const char* name, const std::function<quint64()>& function)
+{
+    if (filter && !strstr(name, filter))
+        return;
+
+    quint64 iterations = 1;
+    double seconds = timeRun(function, iterations);
+
+    while (seconds < MIN_SECONDS && iterations < (quint64(1) << 32))
+    {
+        iterations *= 2;
+        seconds = timeRun(function, iterations);
+    }
+
+    for (int i = 1; i < RUNS; ++i)
+        seconds = std::min(seconds, timeRun(function, iterations));
+
+    const double nsPerOp = seconds * 1e9 / double(iterations);
+
+    printf("%s    { \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f }",
+           g_first ? "" : ",\n", name, (unsigned long long)iterations, nsPerOp, 1e9 / nsPerOp);
+
+    g_first = false;
+    fflush(stdout);
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* const filter = argc > 1 ? argv[1] : nullptr;
+
+    const QByteArray minimalRequest = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    const QByteArray browserRequest =
+        "GET /api/v1/users/12345/posts?sort=desc&limit=20 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+        "Referer: https://www.example.com/\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; consent=1\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "Priority: u=0, i\r\n"
+        "\r\n";
+
+    const QByteArray postRequest = "POST /echo HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/octet-stream\r\nContent-Length: 1024\r\n\r\n"
+                                 + QByteArray(1024, 'x');
+
+    printf("{\n  \"benchmarks\": [\n");
+
+    // Parser, the request is reused like on a connection
+    HttpRequest request;
+
+    run(filter, "request_parse_minimal", [&]() { request.setData(minimalRequest); return quint64(request.getParseState()); });
+    run(filter, "request_parse_browser", [&]() { request.setData(browserRequest); return quint64(request.getParseState()); });
+    run(filter, "request_parse_post_1k", [&]() { request.setData(postRequest); return quint64(request.getBodySize()); });
+
+    // Like reads from a socket
+    run(filter, "request_parse_browser_split_64", [&]()
+    {
+        request.reset();
+
+        for (qsizetype pos = 0; pos < browserRequest.size(); pos += 64)
+            request.appendData(browserRequest.constData() + pos, qMin<qsizetype>(64, browserRequest.size() - pos));
+
+        return quint64(request.getParseState());
+    });
+
+    // Header checks done by the server for every request
+    HttpRequest parsed(browserRequest);
+
+    run(filter, "request_header_lookup", [&]()
+    {
+        return quint64(parsed.getHeaderView("Host").size() + parsed.getHeaderView("Connection").size()
+                     + parsed.getHeaderView("Accept-Encoding").size() + parsed.getHeaderView("Cache-Control").size());
+    });
+
+    run(filter, "request_header_lookup_known", [&]()
+    {
+        return quint64(parsed.getHeaderView(HttpHeaders::HOST).size() + parsed.getHeaderView(HttpHeaders::CONNECTION).size()
+                     + parsed.getHeaderView(HttpHeaders::ACCEPT_ENCODING).size() + parsed.getHeaderView(HttpHeaders::CACHE_CONTROL).size());
+    });
+
+    run(filter, "request_header_lookup_unknown", [&]() { return quint64(parsed.getHeaderView("Sec-Fetch-Mode").size()); });
+
+    // Serialization
+    const QByteArray smallBody = "Pong";
+    const QByteArray largeBody(64 * 1024, 'x');
+
+    HttpResponse smallResponse(HttpResponse::OK);
+    smallResponse.setHeader("Content-Type", "text/plain; charset=utf-8");
+    smallResponse.setHeader("Connection", "keep-alive");
+    smallResponse.setHeader("Keep-Alive", "timeout=5, max=100");
+    smallResponse.setBody(smallBody);
+
+    HttpResponse largeResponse = smallResponse;
+    largeResponse.setBody(largeBody);
+
+    run(filter, "response_raw_small", [&]() { return quint64(smallResponse.getRawData().size()); });
+    run(filter, "response_raw_64k", [&]() { return quint64(largeResponse.getRawData().size()); });
+    run(filter, "response_raw_head", [&]() { return quint64(smallResponse.getRawHead().size()); });
+
+    // Route lookup in a router of typical size
+    HttpRouter router;
+    const HttpRouter::Callback callback = [](const HttpRequest&, const QString&) { return HttpResponse(HttpResponse::OK); };
+
+    const QList<QString> listResources = { "users", "posts", "comments", "groups", "files", "events", "tags", "orders", "items", "sessions" };
+
+    for (const QString& resource : listResources)
+    {
+        router.addRoute(HttpRequest::GET, "/api/v1/" + resource, callback);
+        router.addRoute(HttpRequest::POST, "/api/v1/" + resource, callback);
+        router.addRoute(HttpRequest::GET, "/api/v1/" + resource + "/{id}", callback);
+        router.addRoute(HttpRequest::PUT, "/api/v1/" + resource + "/{id}", callback);
+        router.addRoute(HttpRequest::DELETE, "/api/v1/" + resource + "/{id}", callback);
+        router.addRoute(HttpRequest::GET, "/api/v1/" + resource + "/{id}/posts/{postId}", callback);
+    }
+
+    router.addRoute(HttpRequest::GET, "/", callback);
+    router.addRoute(HttpRequest::GET, "/api/v1/status", callback);
+    router.addRoute(HttpRequest::GET, "/static/*path", callback);
+
+    const QString staticPath = "/api/v1/status";
+    const QString paramPath = "/api/v1/users/12345/posts/42";
+    const QString wildcardPath = "/static/css/main.css";
+    const QString missPath = "/api/v2/unknown/path";
+
+    run(filter, "router_match_static", [&]() { HttpRouter::Match match; return quint64(router.match(HttpRequest::GET, staticPath, match)); });
+    run(filter, "router_match_param", [&]() { HttpRouter::Match match; return quint64(router.match(HttpRequest::GET, paramPath, match)); });
+    run(filter, "router_match_wildcard", [&]() { HttpRouter::Match match; return quint64(router.match(HttpRequest::GET, wildcardPath, match)); });
+    run(filter, "router_match_miss", [&]() { HttpRouter::Match match; return quint64(router.match(HttpRequest::GET, missPath, match)); });
+
+    // JSON bodies: two fields looked up by a handler, all records read, the same document written
+    const struct
+    {
+        const char* suffix;
+        int records;
+    } jsonSizes[] = { { "1k", 9 }, { "100k", 900 }, { "10m", 90000 } };
+
+    for (const auto& size : jsonSizes)
+    {
+        const QList<Record> records = makeRecords(size.records);
+        const QByteArray json = writeQJson(records);
+
+        run(filter, QByteArray("json_field_qt_").append(size.suffix).constData(), [&]()
+        {
+            const QJsonDocument document = QJsonDocument::fromJson(json);
+
+            return quint64(document["function"].toString() == "secret") + quint64(document["password"].toString().size());
+        });
+
+        run(filter, QByteArray("json_field_index_").append(size.suffix).constData(), [&]()
+        {
+            const HttpJsonDocument document(json);
+
+            return quint64(document["function"].equals("secret")) + quint64(document["password"].toString().size());
+        });
+
+        run(filter, QByteArray("json_walk_qt_").append(size.suffix).constData(), [&]()
+        {
+            const QJsonDocument document = QJsonDocument::fromJson(json);
+            double sum = 0.0;
+
+            for (const QJsonValue& item : document["items"].toArray())
+                sum += item["score"].toDouble() + item["name"].toString().size();
+
+            return quint64(sum);
+        });
+
+        run(filter, QByteArray("json_walk_index_").append(size.suffix).constData(), [&]()
+        {
+            const HttpJsonDocument document(json);
+            double sum = 0.0;
+
+            for (const HttpJsonValue item : document["items"])
+                sum += item["score"].toDouble() + item["name"].toString().size();
+
+            return quint64(sum);
+        });
+
+        run(filter, QByteArray("json_write_qt_").append(size.suffix).constData(), [&]() { return quint64(writeQJson(records).size()); });
+        run(filter, QByteArray("json_write_writer_").append(size.suffix).constData(), [&]() { return quint64(writeJson(records).size()); });
+    }
+
+    printf("\n  ]\n}\n");
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+// Slowloris-style client: opens many connections and trickles request headers, one header line
+// per interval, so the request is never complete. Meanwhile a normal request is sent once per second
+// to check that the server still answers. Shows whether header timeouts and the connection limit hold.
+//
+// Usage: httpslow <host> <port> [--connections 1000] [--interval 1000] [--duration 30]
+//        httpslow 127.0.0.1 8080 --connections 5000 --interval 500 --duration 20
+// Interval in ms, duration in s. Prints one JSON object.
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+
+    return values[std::min(values.size() - 1, size_t(fraction * double(values.size())))];
+}
+
+// With a paused listener the backlog fills up and connect() would wait for the SYN retries
+static int connectTo(const addrinfo* address, int timeout = 2000)
+{
+    const int fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK, address->ai_protocol);
+
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+    {
+        pollfd pfd = { fd, POLLOUT, 0 };
+        int error = 0;
+        socklen_t errorSize = sizeof(error);
+
+        if (errno != EINPROGRESS || poll(&pfd, 1, timeout) <= 0
+            || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0 || error != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    return fd;
+}
+
+// Seconds until the status line of a complete request arrives, -1 on failure
+static double probe(const addrinfo* address, const std::string& host)
+{
+    const auto start = Clock::now();
+    const int fd = connectTo(address);
+
+    if (fd < 0)
+        return -1.0;
+
+    const std::string request = "GET / HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+    double result = -1.0;
+
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == ssize_t(request.size()))
+    {
+        pollfd pfd = { fd, POLLIN, 0 };
+        char buffer[64];
+
+        if (poll(&pfd, 1, 5000) > 0 && recv(fd, buffer, sizeof(buffer), 0) > 0)
+            result = secondsSince(start);
+    }
+
+    close(fd);
+
+    return result;
+}
+
+
+struct SlowConnection
+{
+    int fd = -1;
+    Clock::time_point opened;
+    int linesSent = 0;
+    bool got408 = false;
+};
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <host> <port> [--connections 1000] [--interval 1000] [--duration 30]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string host = argv[1];
+    const std::string port = argv[2];
+    int connections = 1000;
+    int interval = 1000;
+    int duration = 30;
+
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--connections") == 0)
+            connections = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--interval") == 0)
+            interval = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--duration") == 0)
+            duration = std::max(1, atoi(argv[i + 1]));
+    }
+
+    // One descriptor per connection
+    rlimit limit = {};
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address = nullptr;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address)
+    {
+        fprintf(stderr, "Cannot resolve %s:%s\n", host.c_str(), port.c_str());
+        return 1;
+    }
+
+    const std::string requestStart = "GET / HTTP/1.1\r\nHost: " + host + "\r\n";
+
+    std::vector<SlowConnection> slow;
+    slow.reserve(connections);
+
+    int connectFailures = 0;
+
+    for (int i = 0; i < connections; ++i)
+    {
+        SlowConnection connection;
+        connection.fd = connectTo(address);
+        connection.opened = Clock::now();
+
+        if (connection.fd < 0 || send(connection.fd, requestStart.data(), requestStart.size(), MSG_NOSIGNAL) < 0)
+        {
+            if (connection.fd >= 0)
+                close(connection.fd);
+
+            ++connectFailures;
+            continue;
+        }
+
+        slow.push_back(connection);
+    }
+
+    const auto start = Clock::now();
+    auto lastTrickle = start;
+    auto lastProbe = start - std::chrono::seconds(1);
+
+    std::vector<double> closeTimes;
+    std::vector<double> probeTimes;
+    int probeFailures = 0;
+    int got408 = 0;
+
+    std::vector<pollfd> pfds;
+    std::vector<size_t> indices;
+
+    while (secondsSince(start) < duration)
+    {
+        if (secondsSince(lastProbe) >= 1.0)
+        {
+            lastProbe = Clock::now();
+
+            const double seconds = probe(address, host);
+
+            if (seconds < 0.0)
+                ++probeFailures;
+            else
+                probeTimes.push_back(seconds);
+        }
+
+        const bool trickle = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - lastTrickle).count() >= interval;
+
+        if (trickle)
+            lastTrickle = Clock::now();
+
+        pfds.clear();
+        indices.clear();
+
+        for (size_t i = 0; i < slow.size(); ++i)
+        {
+            SlowConnection& connection = slow[i];
+
+            if (connection.fd < 0)
+                continue;
+
+            if (trickle)
+            {
+                const std::string line = "X-Slow-" + std::to_string(connection.linesSent++) + ": 1\r\n";
+                send(connection.fd, line.data(), line.size(), MSG_NOSIGNAL);
+            }
+
+            pfds.push_back({ connection.fd, POLLIN, 0 });
+            indices.push_back(i);
+        }
+
+        if (pfds.empty())
+        {
+            usleep(10000);
+            continue;
+        }
+
+        if (poll(pfds.data(), pfds.size(), 10) <= 0)
+            continue;
+
+        for (size_t i = 0; i < pfds.size(); ++i)
+        {
+            const pollfd& pfd = pfds[i];
+
+            if (!pfd.revents)
+                continue;
+
+            SlowConnection* const connection = &slow[indices[i]];
+
+            char buffer[4096];
+            const ssize_t size = recv(pfd.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+            if (size > 0)
+            {
+                if (size >= 12 && memcmp(buffer + 9, "408", 3) == 0)
+                    connection->got408 = true;
+
+                continue;
+            }
+
+            if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                continue;
+
+            // Closed by the server
+            closeTimes.push_back(std::chrono::duration<double>(Clock::now() - connection->opened).count());
+
+            if (connection->got408)
+                ++got408;
+
+            close(connection->fd);
+            connection->fd = -1;
+        }
+    }
+
+    int stillOpen = 0;
+
+    for (SlowConnection& connection : slow)
+    {
+        if (connection.fd >= 0)
+        {
+            ++stillOpen;
+            close(connection.fd);
+        }
+    }
+
+    freeaddrinfo(address);
+
+    printf("{\n");
+    printf("  \"connections\": %d,\n", connections);
+    printf("  \"connect_failures\": %d,\n", connectFailures);
+    printf("  \"closed_by_server\": %zu,\n", closeTimes.size());
+    printf("  \"closed_with_408\": %d,\n", got408);
+    printf("  \"still_open\": %d,\n", stillOpen);
+    printf("  \"close_after_s\": { \"p50\": %.3f, \"max\": %.3f },\n", percentile(closeTimes, 0.5), percentile(closeTimes, 1.0));
+    printf("  \"probes\": %zu,\n", probeTimes.size() + probeFailures);
+    printf("  \"probe_failures\": %d,\n", probeFailures);
+    printf("  \"probe_latency_ms\": { \"p50\": %.2f, \"max\": %.2f }\n", percentile(probeTimes, 0.5) * 1000.0, percentile(probeTimes, 1.0) * 1000.0);
+    printf("}\n");
+
+    return 0;
+}
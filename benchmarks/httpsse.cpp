@@ -0,0 +1,336 @@
+// Server-Sent Events fan-out client: opens many subscriptions (GET /events as in the example API, on plain HTTP),
+// some of which never read, then publishes events with POST /events and measures the time until every reading
+// subscriber has received each one. Shows the fan-out latency and whether slow subscribers are cut off.
+//
+// Usage: httpsse <host> <port> [--subscribers 1000] [--slow 0] [--events 20] [--size 1024] [--path /events]
+//        httpsse 127.0.0.1 8080 --subscribers 5000 --slow 50 --size 65536
+// Prints one JSON object.
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+
+    return values[std::min(values.size() - 1, size_t(fraction * double(values.size())))];
+}
+
+static int connectTo(const addrinfo* address, int receiveBuffer = 0)
+{
+    const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+    if (fd < 0)
+        return -1;
+
+    // Small buffers let slow subscribers reach the high-water mark of the server sooner
+    if (receiveBuffer > 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+    if (connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    return fd;
+}
+
+// Waits for the headers of the event stream, the rest of the read is dropped
+static bool subscribe(int fd, const std::string& host, const std::string& path)
+{
+    const std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nAccept: text/event-stream\r\n\r\n";
+
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size()))
+        return false;
+
+    std::string response;
+    char buffer[4096];
+
+    while (response.find("\r\n\r\n") == std::string::npos)
+    {
+        pollfd pfd = { fd, POLLIN, 0 };
+
+        if (poll(&pfd, 1, 5000) <= 0)
+            return false;
+
+        const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (size <= 0)
+            return false;
+
+        response.append(buffer, size);
+    }
+
+    return response.compare(0, 12, "HTTP/1.1 200") == 0;
+}
+
+static bool publish(const addrinfo* address, const std::string& host, const std::string& path, const std::string& data)
+{
+    const int fd = connectTo(address);
+
+    if (fd < 0)
+        return false;
+
+    const std::string request = "POST " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n"
+                                "Content-Length: " + std::to_string(data.size()) + "\r\n\r\n" + data;
+
+    bool result = false;
+
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == ssize_t(request.size()))
+    {
+        char buffer[256];
+        result = recv(fd, buffer, sizeof(buffer), 0) >= 12 && memcmp(buffer + 9, "200", 3) == 0;
+    }
+
+    close(fd);
+
+    return result;
+}
+
+
+struct Subscriber
+{
+    int fd = -1;
+
+    // Bytes after the headers, each event ends with an empty line
+    std::string pending;
+    int events = 0;
+};
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <host> <port> [--subscribers 1000] [--slow 0] [--events 20] [--size 1024] [--path /events]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string host = argv[1];
+    const std::string port = argv[2];
+    std::string path = "/events";
+    int subscriberCount = 1000;
+    int slowCount = 0;
+    int eventCount = 20;
+    int eventSize = 1024;
+
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--subscribers") == 0)
+            subscriberCount = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--slow") == 0)
+            slowCount = std::max(0, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--events") == 0)
+            eventCount = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--size") == 0)
+            eventSize = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--path") == 0)
+            path = argv[i + 1];
+    }
+
+    rlimit limit = {};
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address = nullptr;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address)
+    {
+        fprintf(stderr, "Cannot resolve %s:%s\n", host.c_str(), port.c_str());
+        return 1;
+    }
+
+    std::vector<Subscriber> subscribers;
+    std::vector<int> slow;
+    int connectFailures = 0;
+
+    for (int i = 0; i < subscriberCount + slowCount; ++i)
+    {
+        const bool isSlow = i >= subscriberCount;
+        const int fd = connectTo(address, isSlow ? 4096 : 0);
+
+        if (fd < 0 || !subscribe(fd, host, path))
+        {
+            if (fd >= 0)
+                close(fd);
+
+            ++connectFailures;
+            continue;
+        }
+
+        if (isSlow)
+            slow.push_back(fd);
+        else
+        {
+            Subscriber subscriber;
+            subscriber.fd = fd;
+            subscribers.push_back(subscriber);
+        }
+    }
+
+    // No line breaks, so every event is a single data line
+    const std::string data(eventSize, 'x');
+
+    std::vector<double> fanoutTimes;
+    std::vector<pollfd> pfds;
+    std::vector<size_t> indices;
+    int missed = 0;
+    int publishFailures = 0;
+
+    for (int e = 1; e <= eventCount; ++e)
+    {
+        const auto start = Clock::now();
+
+        if (!publish(address, host, path, data))
+        {
+            ++publishFailures;
+            continue;
+        }
+
+        size_t remaining = 0;
+
+        for (const Subscriber& subscriber : subscribers)
+        {
+            if (subscriber.fd >= 0 && subscriber.events < e)
+                ++remaining;
+        }
+
+        while (remaining > 0 && secondsSince(start) < 10.0)
+        {
+            pfds.clear();
+            indices.clear();
+
+            for (size_t i = 0; i < subscribers.size(); ++i)
+            {
+                if (subscribers[i].fd >= 0 && subscribers[i].events < e)
+                {
+                    pfds.push_back({ subscribers[i].fd, POLLIN, 0 });
+                    indices.push_back(i);
+                }
+            }
+
+            if (poll(pfds.data(), pfds.size(), 100) <= 0)
+                continue;
+
+            for (size_t i = 0; i < pfds.size(); ++i)
+            {
+                if (!pfds[i].revents)
+                    continue;
+
+                Subscriber& subscriber = subscribers[indices[i]];
+
+                char buffer[65536];
+                const ssize_t size = recv(subscriber.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+                if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    continue;
+
+                if (size <= 0)
+                {
+                    close(subscriber.fd);
+                    subscriber.fd = -1;
+                    --remaining;
+                    continue;
+                }
+
+                subscriber.pending.append(buffer, size);
+
+                size_t end;
+
+                while ((end = subscriber.pending.find("\n\n")) != std::string::npos)
+                {
+                    // Keep-alive comments and the retry field are not events
+                    if (subscriber.pending.find("data: ") < end)
+                        ++subscriber.events;
+
+                    subscriber.pending.erase(0, end + 2);
+                }
+
+                if (subscriber.events >= e)
+                    --remaining;
+            }
+        }
+
+        missed += int(remaining);
+
+        if (remaining == 0)
+            fanoutTimes.push_back(secondsSince(start));
+    }
+
+    // Slow subscribers the server has closed read as EOF once their buffer is drained
+    int slowClosed = 0;
+
+    for (const int fd : slow)
+    {
+        char buffer[65536];
+        ssize_t size;
+
+        while ((size = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+            ;
+
+        if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            ++slowClosed;
+
+        close(fd);
+    }
+
+    for (const Subscriber& subscriber : subscribers)
+    {
+        if (subscriber.fd >= 0)
+            close(subscriber.fd);
+    }
+
+    freeaddrinfo(address);
+
+    printf("{\n");
+    printf("  \"subscribers\": %d,\n", subscriberCount);
+    printf("  \"slow_subscribers\": %d,\n", slowCount);
+    printf("  \"connect_failures\": %d,\n", connectFailures);
+    printf("  \"events\": %d,\n", eventCount);
+    printf("  \"event_bytes\": %d,\n", eventSize);
+    printf("  \"publish_failures\": %d,\n", publishFailures);
+    printf("  \"missed_deliveries\": %d,\n", missed);
+    printf("  \"slow_closed_by_server\": %d,\n", slowClosed);
+    printf("  \"fanout_ms\": { \"p50\": %.2f, \"max\": %.2f }\n", percentile(fanoutTimes, 0.5) * 1000.0, percentile(fanoutTimes, 1.0) * 1000.0);
+    printf("}\n");
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+// Time to first byte, duration and throughput of one large (e.g. streamed) response.
+// Chunked bodies are decoded, so only the payload is counted.
+// With --pid the resident memory of the server process is sampled while the body is read.
+//
+// Usage: httpstream <host> <port> <target> [--pid <server pid>]
+//        httpstream 127.0.0.1 8080 "/stream?size=1073741824" --pid $(pidof HttpServer)
+// Prints one JSON object.
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// VmRSS or VmHWM (peak) in kB, -1 if not available
+static long readMemory(int pid, const char* field)
+{
+    std::ifstream file("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, strlen(field), field) == 0)
+            return std::strtol(line.c_str() + strlen(field) + 1, nullptr, 10);
+    }
+
+    return -1;
+}
+
+// https://datatracker.ietf.org/doc/html/rfc9112#section-7.1
+// Incremental decoder, counts the payload of the chunks
+class ChunkedDecoder
+{
+public:
+    // False on invalid data
+    bool append(const char* data, size_t size)
+    {
+        for (size_t i = 0; i < size && !m_done; )
+        {
+            if (m_state == DATA)
+            {
+                const size_t count = std::min<size_t>(size - i, m_remaining);
+
+                m_payload += count;
+                m_remaining -= count;
+                i += count;
+
+                if (m_remaining == 0)
+                    m_state = DATA_END;
+
+                continue;
+            }
+
+            const char c = data[i++];
+
+            if (c != '\n')
+            {
+                if (c != '\r')
+                    m_line += c;
+
+                continue;
+            }
+
+            if (m_state == SIZE)
+            {
+                char* end = nullptr;
+                m_remaining = std::strtoull(m_line.c_str(), &end, 16);
+
+                if (end == m_line.c_str())
+                    return false;
+
+                m_state = m_remaining > 0 ? DATA : TRAILERS;
+            }
+            else if (m_state == DATA_END)
+            {
+                if (!m_line.empty())
+                    return false;
+
+                m_state = SIZE;
+            }
+            else if (m_line.empty())
+                m_done = true;
+
+            m_line.clear();
+        }
+
+        return true;
+    }
+
+    bool isDone() const { return m_done; }
+    unsigned long long getPayload() const { return m_payload; }
+
+private:
+    enum STATE
+    {
+        SIZE,
+        DATA,
+        DATA_END,
+        TRAILERS,
+    };
+
+    STATE m_state = SIZE;
+    std::string m_line;
+    unsigned long long m_remaining = 0;
+    unsigned long long m_payload = 0;
+    bool m_done = false;
+};
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <host> <port> <target> [--pid <server pid>]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string host = argv[1];
+    const std::string port = argv[2];
+    const std::string target = argv[3];
+    int pid = 0;
+
+    for (int i = 4; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--pid") == 0 && i + 1 < argc)
+            pid = atoi(argv[++i]);
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address = nullptr;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address)
+    {
+        fprintf(stderr, "Cannot resolve %s:%s\n", host.c_str(), port.c_str());
+        return 1;
+    }
+
+    const long rssBefore = pid > 0 ? readMemory(pid, "VmRSS:") : -1;
+    long rssMax = rssBefore;
+
+    const auto start = Clock::now();
+
+    const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+    if (fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+    {
+        fprintf(stderr, "Cannot connect to %s:%s\n", host.c_str(), port.c_str());
+        return 1;
+    }
+
+    freeaddrinfo(address);
+
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    const std::string request = "GET " + target + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size()))
+    {
+        fprintf(stderr, "Cannot send request\n");
+        return 1;
+    }
+
+    static char buffer[256 * 1024];
+
+    std::string head;
+    bool headDone = false;
+    bool chunked = false;
+    long long contentLength = -1;
+
+    ChunkedDecoder decoder;
+    unsigned long long payload = 0;
+    unsigned long long received = 0;
+
+    double firstByte = -1.0;
+    auto lastSample = Clock::now();
+    bool valid = true;
+
+    while (true)
+    {
+        const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (size <= 0)
+            break;
+
+        if (firstByte < 0.0)
+            firstByte = secondsSince(start);
+
+        received += size;
+
+        const char* body = buffer;
+        size_t bodySize = size;
+
+        if (!headDone)
+        {
+            head.append(buffer, size);
+
+            const size_t end = head.find("\r\n\r\n");
+
+            if (end == std::string::npos)
+                continue;
+
+            headDone = true;
+
+            // Header names are case-insensitive, the server writes them as registered
+            for (char& c : head)
+                c = char(tolower(c));
+
+            chunked = head.find("\ntransfer-encoding: chunked") != std::string::npos;
+
+            const size_t idxLength = head.find("\ncontent-length:");
+
+            if (idxLength != std::string::npos && idxLength < end)
+                contentLength = std::atoll(head.c_str() + idxLength + 16);
+
+            const size_t headSize = end + 4 - (head.size() - size);
+            body = buffer + headSize;
+            bodySize = size - headSize;
+        }
+
+        if (chunked)
+        {
+            valid = valid && decoder.append(body, bodySize);
+            payload = decoder.getPayload();
+
+            if (decoder.isDone())
+                break;
+        }
+        else
+            payload += bodySize;
+
+        if (pid > 0 && secondsSince(lastSample) >= 0.1)
+        {
+            lastSample = Clock::now();
+            rssMax = std::max(rssMax, readMemory(pid, "VmRSS:"));
+        }
+    }
+
+    const double seconds = secondsSince(start);
+    close(fd);
+
+    const bool complete = headDone && valid && (chunked ? decoder.isDone() : contentLength < 0 || (long long)payload == contentLength);
+
+    printf("{\n");
+    printf("  \"target\": \"%s\",\n", target.c_str());
+    printf("  \"chunked\": %s,\n", chunked ? "true" : "false");
+    printf("  \"complete\": %s,\n", complete ? "true" : "false");
+    printf("  \"payload_bytes\": %llu,\n", payload);
+    printf("  \"received_bytes\": %llu,\n", received);
+    printf("  \"ttfb_ms\": %.3f,\n", firstByte * 1000.0);
+    printf("  \"seconds\": %.6f,\n", seconds);
+    printf("  \"mb_per_sec\": %.1f", seconds > 0.0 ? payload / seconds / (1024.0 * 1024.0) : 0.0);
+
+    if (pid > 0)
+    {
+        printf(",\n  \"server_rss_before_kb\": %ld,\n", rssBefore);
+        printf("  \"server_rss_max_kb\": %ld,\n", rssMax);
+        printf("  \"server_peak_rss_kb\": %ld", readMemory(pid, "VmHWM:"));
+    }
+
+    printf("\n}\n");
+
+    return complete ? 0 : 2;
+}
@@ -0,0 +1,348 @@
+// WebSocket idle and fan-out client: opens many WebSocket connections to a broadcasting route
+// (e.g. /chat as in the example API, on plain HTTP), leaves them idle and reads the memory the server
+// reports per session from /metrics, plus the RSS of the server process if its pid is given.
+// Afterwards one connection sends messages and the time until all others received each is measured.
+//
+// Usage: httpwsidle <host> <port> [--connections 1000] [--path /chat] [--messages 10] [--pid 0]
+//        httpwsidle 127.0.0.1 8080 --connections 10000 --pid $(pidof HttpServer)
+// Prints one JSON object.
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+
+    return values[std::min(values.size() - 1, size_t(fraction * double(values.size())))];
+}
+
+static int connectTo(const addrinfo* address)
+{
+    const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    return fd;
+}
+
+// Reads until the end of the headers, the rest of the read is dropped
+static std::string readHeaders(int fd)
+{
+    std::string result;
+    char buffer[4096];
+
+    while (result.find("\r\n\r\n") == std::string::npos)
+    {
+        pollfd pfd = { fd, POLLIN, 0 };
+
+        if (poll(&pfd, 1, 5000) <= 0)
+            break;
+
+        const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+
+        if (size <= 0)
+            break;
+
+        result.append(buffer, size);
+    }
+
+    return result;
+}
+
+// Fixed key, the server does not care whether it is random
+static int openWebSocket(const addrinfo* address, const std::string& host, const std::string& path)
+{
+    const int fd = connectTo(address);
+
+    if (fd < 0)
+        return -1;
+
+    const std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\n"
+                                "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size())
+        || readHeaders(fd).compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Value of an unlabeled metric, -1 if not found
+static double readMetric(const addrinfo* address, const std::string& host, const std::string& name)
+{
+    const int fd = connectTo(address);
+
+    if (fd < 0)
+        return -1.0;
+
+    const std::string request = "GET /metrics HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+    std::string response;
+
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == ssize_t(request.size()))
+    {
+        char buffer[16384];
+        ssize_t size;
+
+        while ((size = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+            response.append(buffer, size);
+    }
+
+    close(fd);
+
+    const size_t pos = response.find("\n" + name + " ");
+
+    if (pos == std::string::npos)
+        return -1.0;
+
+    return atof(response.c_str() + pos + name.size() + 2);
+}
+
+// Resident set size of a process in KiB, -1 if unknown
+static long readRss(int pid)
+{
+    if (pid <= 0)
+        return -1;
+
+    FILE* file = fopen(("/proc/" + std::to_string(pid) + "/status").c_str(), "r");
+
+    if (!file)
+        return -1;
+
+    char line[256];
+    long result = -1;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "VmRSS:", 6) == 0)
+        {
+            result = atol(line + 6);
+            break;
+        }
+    }
+
+    fclose(file);
+
+    return result;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <host> <port> [--connections 1000] [--path /chat] [--messages 10] [--pid 0]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string host = argv[1];
+    const std::string port = argv[2];
+    std::string path = "/chat";
+    int connections = 1000;
+    int messages = 10;
+    int pid = 0;
+
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--connections") == 0)
+            connections = std::max(2, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--path") == 0)
+            path = argv[i + 1];
+        else if (strcmp(argv[i], "--messages") == 0)
+            messages = std::max(0, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--pid") == 0)
+            pid = atoi(argv[i + 1]);
+    }
+
+    rlimit limit = {};
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address = nullptr;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address)
+    {
+        fprintf(stderr, "Cannot resolve %s:%s\n", host.c_str(), port.c_str());
+        return 1;
+    }
+
+    const long rssBefore = readRss(pid);
+
+    std::vector<int> sockets;
+    sockets.reserve(connections);
+
+    int connectFailures = 0;
+    const auto connectStart = Clock::now();
+
+    for (int i = 0; i < connections; ++i)
+    {
+        const int fd = openWebSocket(address, host, path);
+
+        if (fd < 0)
+            ++connectFailures;
+        else
+            sockets.push_back(fd);
+    }
+
+    const double connectSeconds = secondsSince(connectStart);
+
+    // Let the server settle before reading the idle state
+    sleep(1);
+
+    const long rssAfter = readRss(pid);
+    const double serverSessions = readMetric(address, host, "httpserver_websocket_connections");
+    const double serverMemory = readMetric(address, host, "httpserver_websocket_memory_bytes");
+    const double serverPerSession = readMetric(address, host, "httpserver_websocket_memory_per_connection_bytes");
+
+    // Fan-out: the first socket sends, all others receive. Client frames are masked with a zero key.
+    std::vector<double> fanoutTimes;
+    int incomplete = 0;
+
+    const size_t payloadSize = 64;
+    const size_t frameSize = 2 + payloadSize;
+
+    std::vector<size_t> received(sockets.size());
+    std::vector<pollfd> pfds;
+    std::vector<size_t> indices;
+
+    for (int m = 0; m < messages && sockets.size() > 1; ++m)
+    {
+        std::string frame;
+        frame += char(0x81);
+        frame += char(0x80 | payloadSize);
+        frame.append(4, '\0');
+        frame.append(payloadSize, 'x');
+
+        std::fill(received.begin(), received.end(), 0);
+
+        const auto start = Clock::now();
+
+        if (send(sockets[0], frame.data(), frame.size(), MSG_NOSIGNAL) != ssize_t(frame.size()))
+            break;
+
+        size_t remaining = sockets.size() - 1;
+
+        while (remaining > 0 && secondsSince(start) < 10.0)
+        {
+            pfds.clear();
+            indices.clear();
+
+            for (size_t i = 1; i < sockets.size(); ++i)
+            {
+                if (received[i] < frameSize)
+                {
+                    pfds.push_back({ sockets[i], POLLIN, 0 });
+                    indices.push_back(i);
+                }
+            }
+
+            if (poll(pfds.data(), pfds.size(), 100) <= 0)
+                continue;
+
+            for (size_t i = 0; i < pfds.size(); ++i)
+            {
+                if (!pfds[i].revents)
+                    continue;
+
+                const size_t index = indices[i];
+
+                char buffer[4096];
+                const ssize_t size = recv(pfds[i].fd, buffer, std::min(sizeof(buffer), frameSize - received[index]), MSG_DONTWAIT);
+
+                if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    continue;
+
+                // Closed by the server, counted as missed
+                if (size <= 0)
+                {
+                    received[index] = frameSize;
+                    --remaining;
+                    ++incomplete;
+                    continue;
+                }
+
+                received[index] += size;
+
+                if (received[index] == frameSize)
+                    --remaining;
+            }
+        }
+
+        if (remaining > 0)
+            incomplete += int(remaining);
+        else
+            fanoutTimes.push_back(secondsSince(start));
+    }
+
+    for (const int fd : sockets)
+        close(fd);
+
+    freeaddrinfo(address);
+
+    printf("{\n");
+    printf("  \"connections\": %d,\n", connections);
+    printf("  \"connect_failures\": %d,\n", connectFailures);
+    printf("  \"connect_s\": %.3f,\n", connectSeconds);
+    printf("  \"server_sessions\": %.0f,\n", serverSessions);
+    printf("  \"server_session_memory_bytes\": %.0f,\n", serverMemory);
+    printf("  \"server_memory_per_session_bytes\": %.0f,\n", serverPerSession);
+
+    if (rssBefore >= 0 && rssAfter >= 0 && !sockets.empty())
+        printf("  \"rss_per_connection_bytes\": %.0f,\n", double(rssAfter - rssBefore) * 1024.0 / double(sockets.size()));
+
+    printf("  \"messages\": %d,\n", messages);
+    printf("  \"missed_deliveries\": %d,\n", incomplete);
+    printf("  \"fanout_ms\": { \"p50\": %.2f, \"max\": %.2f }\n", percentile(fanoutTimes, 0.5) * 1000.0, percentile(fanoutTimes, 1.0) * 1000.0);
+    printf("}\n");
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+// Handshakes per second against a running server, full vs. resumed.
+// Only the TCP connect and the TLS handshake are timed. A request is sent afterwards,
+// so TLS 1.3 session tickets (sent after the handshake) are received for the next resumption.
+//
+// Usage: tlshandshake <host> <port> [count] [--tls12]
+// Prints one JSON object.
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+
+struct Result
+{
+    int handshakes = 0;
+    int resumed = 0;
+    int failed = 0;
+    double seconds = 0.0;
+};
+
+
+static int connectTo(const addrinfo* address)
+{
+    const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    return fd;
+}
+
+static void exchangeRequest(SSL* ssl, const std::string& host)
+{
+    const std::string request = "GET /ping HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+
+    if (SSL_write(ssl, request.data(), int(request.size())) <= 0)
+        return;
+
+    char buffer[16 * 1024];
+
+    while (SSL_read(ssl, buffer, sizeof(buffer)) > 0)
+    {
+
+    }
+}
+
+static Result run(SSL_CTX* context, const addrinfo* address, const std::string& host, int count, bool resume)
+{
+    Result result;
+    SSL_SESSION* session = nullptr;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        const int fd = connectTo(address);
+
+        if (fd < 0)
+        {
+            ++result.failed;
+            continue;
+        }
+
+        SSL* const ssl = SSL_new(context);
+        SSL_set_fd(ssl, fd);
+        SSL_set_tlsext_host_name(ssl, host.c_str());
+
+        if (resume && session)
+            SSL_set_session(ssl, session);
+
+        const bool ok = SSL_connect(ssl) == 1;
+
+        const auto end = std::chrono::steady_clock::now();
+
+        if (ok)
+        {
+            ++result.handshakes;
+            result.seconds += std::chrono::duration<double>(end - start).count();
+
+            if (SSL_session_reused(ssl))
+                ++result.resumed;
+
+            exchangeRequest(ssl, host);
+
+            if (resume)
+            {
+                SSL_SESSION* const newSession = SSL_get1_session(ssl);
+
+                if (newSession)
+                {
+                    SSL_SESSION_free(session);
+                    session = newSession;
+                }
+            }
+
+            SSL_shutdown(ssl);
+        }
+        else
+        {
+            ++result.failed;
+            ERR_clear_error();
+        }
+
+        SSL_free(ssl);
+        close(fd);
+    }
+
+    SSL_SESSION_free(session);
+
+    return result;
+}
+
+static void printResult(const char* name, const Result& result, bool last)
+{
+    const double rate = result.seconds > 0.0 ? result.handshakes / result.seconds : 0.0;
+
+    printf("  \"%s\": { \"handshakes\": %d, \"resumed\": %d, \"failed\": %d, \"seconds\": %.6f, \"handshakes_per_sec\": %.1f }%s\n",
+           name, result.handshakes, result.resumed, result.failed, result.seconds, rate, last ? "" : ",");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <host> <port> [count] [--tls12]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string host = argv[1];
+    const std::string port = argv[2];
+    const int count = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 1000;
+
+    bool tls12 = false;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--tls12") == 0)
+            tls12 = true;
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* address = nullptr;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address)
+    {
+        fprintf(stderr, "Cannot resolve %s:%s\n", host.c_str(), port.c_str());
+        return 1;
+    }
+
+    // Certificates are not verified, only the handshake cost is of interest
+    SSL_CTX* const context = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(context, SSL_VERIFY_NONE, nullptr);
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_CLIENT);
+
+    if (tls12)
+        SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION);
+
+    const Result full = run(context, address, host, count, false);
+    const Result resumed = run(context, address, host, count, true);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"tls_handshake\",\n");
+    printf("  \"host\": \"%s\",\n", host.c_str());
+    printf("  \"port\": %s,\n", port.c_str());
+    printf("  \"protocol\": \"%s\",\n", tls12 ? "TLSv1.2" : "TLSv1.3");
+    printf("  \"count\": %d,\n", count);
+    printResult("full", full, false);
+    printResult("resumed", resumed, true);
+    printf("}\n");
+
+    SSL_CTX_free(context);
+    freeaddrinfo(address);
+
+    return full.failed + resumed.failed > 0 ? 2 : 0;
+}
@@ -0,0 +1,597 @@
+#include "http2hpack.h"
+
+#include <cstring>
+
+
+namespace
+{
+
+// https://datatracker.ietf.org/doc/html/rfc7541#appendix-A
+struct StaticEntry
+{
+    const char* name;
+    const char* value;
+};
+
+constexpr StaticEntry STATIC_TABLE[] =
+{
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+constexpr quint64 STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// https://datatracker.ietf.org/doc/html/rfc7541#appendix-B
+// Codes of the bytes 0 - 255 and EOS (256), aligned to the least significant bit
+constexpr quint32 HUFFMAN_CODES[257] =
+{
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff,
+};
+
+constexpr quint8 HUFFMAN_LENGTHS[257] =
+{
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+constexpr int HUFFMAN_EOS = 256;
+
+// Binary tree of the code, built once. Decoding walks it bit by bit.
+struct HuffmanNode
+{
+    qint16 children[2] = { -1, -1 };
+    qint16 symbol = -1;
+};
+
+struct HuffmanTree
+{
+    QList<HuffmanNode> nodes;
+
+    HuffmanTree()
+    {
+        nodes.reserve(2 * 257);
+        nodes.append(HuffmanNode());
+
+        for (int symbol = 0; symbol <= HUFFMAN_EOS; ++symbol)
+        {
+            int node = 0;
+
+            for (int bit = HUFFMAN_LENGTHS[symbol] - 1; bit >= 0; --bit)
+            {
+                const int branch = (HUFFMAN_CODES[symbol] >> bit) & 1;
+
+                if (nodes.at(node).children[branch] < 0)
+                {
+                    nodes[node].children[branch] = qint16(nodes.size());
+                    nodes.append(HuffmanNode());
+                }
+
+                node = nodes.at(node).children[branch];
+            }
+
+            nodes[node].symbol = qint16(symbol);
+        }
+    }
+};
+
+const HuffmanTree& getHuffmanTree()
+{
+    static const HuffmanTree tree;
+    return tree;
+}
+
+bool isEqual(const char* literal, QByteArrayView data)
+{
+    const size_t size = strlen(literal);
+    return size == size_t(data.size()) && memcmp(literal, data.data(), size) == 0;
+}
+
+// Changes with nearly every response, indexing would only evict useful entries
+bool isVolatile(QByteArrayView name)
+{
+    return name == "content-length" || name == "etag" || name == "last-modified" || name == "age" || name == "content-range";
+}
+
+// https://datatracker.ietf.org/doc/html/rfc7541#section-7.1.3
+bool isSensitive(QByteArrayView name)
+{
+    return name == "set-cookie" || name == "authorization";
+}
+
+}
+
+
+void Http2Hpack::Table::setMaxSize(qsizetype size)
+{
+    m_maxSize = size;
+    evict(m_maxSize);
+}
+
+void Http2Hpack::Table::add(const QByteArray& name, const QByteArray& value)
+{
+    // https://datatracker.ietf.org/doc/html/rfc7541#section-4.4
+    // -> An entry larger than the table empties it
+    const qsizetype size = name.size() + value.size() + ENTRY_OVERHEAD;
+
+    evict(m_maxSize - size);
+
+    if (size > m_maxSize)
+        return;
+
+    m_entries.prepend(qMakePair(name, value));
+    m_size += size;
+}
+
+bool Http2Hpack::Table::get(quint64 index, QByteArray& name, QByteArray& value) const
+{
+    if (index == 0)
+        return false;
+
+    if (index <= STATIC_TABLE_SIZE)
+    {
+        const StaticEntry& entry = STATIC_TABLE[index - 1];
+
+        name = QByteArray::fromRawData(entry.name, qsizetype(strlen(entry.name)));
+        value = QByteArray::fromRawData(entry.value, qsizetype(strlen(entry.value)));
+        return true;
+    }
+
+    index -= STATIC_TABLE_SIZE + 1;
+
+    if (index >= quint64(m_entries.size()))
+        return false;
+
+    name = m_entries.at(qsizetype(index)).first;
+    value = m_entries.at(qsizetype(index)).second;
+    return true;
+}
+
+quint64 Http2Hpack::Table::find(QByteArrayView name, QByteArrayView value, bool& valueMatch) const
+{
+    quint64 result = 0;
+    valueMatch = false;
+
+    for (quint64 i = 0; i < STATIC_TABLE_SIZE; ++i)
+    {
+        if (!isEqual(STATIC_TABLE[i].name, name))
+            continue;
+
+        if (isEqual(STATIC_TABLE[i].value, value))
+        {
+            valueMatch = true;
+            return i + 1;
+        }
+
+        if (result == 0)
+            result = i + 1;
+    }
+
+    for (qsizetype i = 0; i < m_entries.size(); ++i)
+    {
+        if (m_entries.at(i).first != name)
+            continue;
+
+        if (m_entries.at(i).second == value)
+        {
+            valueMatch = true;
+            return STATIC_TABLE_SIZE + 1 + quint64(i);
+        }
+
+        if (result == 0)
+            result = STATIC_TABLE_SIZE + 1 + quint64(i);
+    }
+
+    return result;
+}
+
+void Http2Hpack::Table::evict(qsizetype maxSize)
+{
+    while (m_size > qMax<qsizetype>(0, maxSize) && !m_entries.isEmpty())
+    {
+        const auto& entry = m_entries.last();
+        m_size -= entry.first.size() + entry.second.size() + ENTRY_OVERHEAD;
+        m_entries.removeLast();
+    }
+}
+
+bool Http2Hpack::Decoder::decode(QByteArrayView block, HeaderList& headers, qsizetype maxListSize)
+{
+    const uchar* pos = reinterpret_cast<const uchar*>(block.data());
+    const uchar* const end = pos + block.size();
+
+    qsizetype listSize = 0;
+    bool fieldSeen = false;
+
+    while (pos < end)
+    {
+        const uchar first = *pos;
+
+        QByteArray name;
+        QByteArray value;
+
+        // https://datatracker.ietf.org/doc/html/rfc7541#section-6.1
+        if (first & 0x80)
+        {
+            quint64 index = 0;
+
+            if (!decodeInteger(pos, end, 7, index) || !m_table.get(index, name, value))
+                return false;
+        }
+
+        // https://datatracker.ietf.org/doc/html/rfc7541#section-6.3
+        // -> Only at the start of a block
+        else if ((first & 0xe0) == 0x20)
+        {
+            quint64 size = 0;
+
+            if (fieldSeen || !decodeInteger(pos, end, 5, size) || size > quint64(m_maxTableSize))
+                return false;
+
+            m_table.setMaxSize(qsizetype(size));
+            continue;
+        }
+
+        // https://datatracker.ietf.org/doc/html/rfc7541#section-6.2
+        // -> With incremental indexing (01), without indexing (0000) or never indexed (0001)
+        else
+        {
+            const bool indexing = (first & 0xc0) == 0x40;
+
+            quint64 index = 0;
+
+            if (!decodeInteger(pos, end, indexing ? 6 : 4, index))
+                return false;
+
+            if (index > 0)
+            {
+                QByteArray unused;
+
+                if (!m_table.get(index, name, unused))
+                    return false;
+            }
+            else if (!decodeString(pos, end, name))
+                return false;
+
+            if (!decodeString(pos, end, value))
+                return false;
+
+            if (indexing)
+                m_table.add(name, value);
+        }
+
+        listSize += name.size() + value.size() + ENTRY_OVERHEAD;
+
+        if (listSize > maxListSize)
+            return false;
+
+        headers.append(qMakePair(name, value));
+        fieldSeen = true;
+    }
+
+    return true;
+}
+
+void Http2Hpack::Encoder::setMaxTableSize(qsizetype size)
+{
+    // Larger tables than the default are not used, they would only cost memory
+    size = qMin(size, DEFAULT_TABLE_SIZE);
+
+    if (size == m_table.getMaxSize())
+        return;
+
+    m_minTableSize = m_minTableSize < 0 ? size : qMin(m_minTableSize, size);
+    m_table.setMaxSize(size);
+}
+
+void Http2Hpack::Encoder::beginBlock(QByteArray& block)
+{
+    // https://datatracker.ietf.org/doc/html/rfc7541#section-4.2
+    if (m_minTableSize < 0)
+        return;
+
+    if (m_minTableSize < m_table.getMaxSize())
+        encodeInteger(block, 0x20, 5, quint64(m_minTableSize));
+
+    encodeInteger(block, 0x20, 5, quint64(m_table.getMaxSize()));
+    m_minTableSize = -1;
+}
+
+void Http2Hpack::Encoder::encode(QByteArray& block, const QByteArray& name, const QByteArray& value)
+{
+    bool valueMatch = false;
+    const quint64 index = m_table.find(name, value, valueMatch);
+
+    if (index > 0 && valueMatch)
+    {
+        encodeInteger(block, 0x80, 7, index);
+        return;
+    }
+
+    const bool sensitive = isSensitive(name);
+    const bool indexing = !sensitive && !isVolatile(name);
+
+    if (indexing)
+        encodeInteger(block, 0x40, 6, index);
+    else
+        encodeInteger(block, sensitive ? 0x10 : 0x00, 4, index);
+
+    if (index == 0)
+        encodeString(block, name);
+
+    encodeString(block, value);
+
+    if (indexing)
+        m_table.add(name, value);
+}
+
+bool Http2Hpack::decodeHuffman(QByteArrayView data, QByteArray& result)
+{
+    const QList<HuffmanNode>& nodes = getHuffmanTree().nodes;
+
+    // The code is at least 5 bits per symbol
+    result.reserve(result.size() + data.size() * 8 / 5);
+
+    int node = 0;
+    int bits = 0;
+    bool allOnes = true;
+
+    for (const char c : data)
+    {
+        for (int bit = 7; bit >= 0; --bit)
+        {
+            const int branch = (uchar(c) >> bit) & 1;
+
+            node = nodes.at(node).children[branch];
+
+            if (node < 0)
+                return false;
+
+            allOnes = allOnes && branch;
+            ++bits;
+
+            const int symbol = nodes.at(node).symbol;
+
+            if (symbol < 0)
+                continue;
+
+            if (symbol == HUFFMAN_EOS)
+                return false;
+
+            result.append(char(symbol));
+
+            node = 0;
+            bits = 0;
+            allOnes = true;
+        }
+    }
+
+    // Padding is the start of EOS
+    return bits < 8 && allOnes;
+}
+
+void Http2Hpack::encodeHuffman(QByteArrayView data, QByteArray& result)
+{
+    quint64 bits = 0;
+    int count = 0;
+
+    for (const char c : data)
+    {
+        const uchar symbol = uchar(c);
+
+        bits = (bits << HUFFMAN_LENGTHS[symbol]) | HUFFMAN_CODES[symbol];
+        count += HUFFMAN_LENGTHS[symbol];
+
+        while (count >= 8)
+        {
+            count -= 8;
+            result.append(char(bits >> count));
+        }
+
+        bits &= (quint64(1) << count) - 1;
+    }
+
+    if (count > 0)
+        result.append(char((bits << (8 - count)) | (0xff >> count)));
+}
+
+qsizetype Http2Hpack::getHuffmanSize(QByteArrayView data)
+{
+    qsizetype bits = 0;
+
+    for (const char c : data)
+        bits += HUFFMAN_LENGTHS[uchar(c)];
+
+    return (bits + 7) / 8;
+}
+
+bool Http2Hpack::decodeInteger(const uchar*& pos, const uchar* end, int prefixBits, quint64& value)
+{
+    if (pos >= end)
+        return false;
+
+    const quint64 mask = (quint64(1) << prefixBits) - 1;
+
+    value = *pos++ & mask;
+
+    if (value < mask)
+        return true;
+
+    for (int shift = 0; pos < end && shift <= 56; shift += 7)
+    {
+        const uchar byte = *pos++;
+
+        value += quint64(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+void Http2Hpack::encodeInteger(QByteArray& target, uchar flags, int prefixBits, quint64 value)
+{
+    const quint64 mask = (quint64(1) << prefixBits) - 1;
+
+    if (value < mask)
+    {
+        target.append(char(flags | value));
+        return;
+    }
+
+    target.append(char(flags | mask));
+    value -= mask;
+
+    while (value >= 0x80)
+    {
+        target.append(char(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+
+    target.append(char(value));
+}
+
+bool Http2Hpack::decodeString(const uchar*& pos, const uchar* end, QByteArray& value)
+{
+    if (pos >= end)
+        return false;
+
+    const bool huffman = *pos & 0x80;
+    quint64 length = 0;
+
+    if (!decodeInteger(pos, end, 7, length) || length > quint64(end - pos))
+        return false;
+
+    const QByteArrayView data(pos, qsizetype(length));
+    pos += length;
+
+    value.clear();
+
+    if (huffman)
+        return decodeHuffman(data, value);
+
+    value = data.toByteArray();
+    return true;
+}
+
+void Http2Hpack::encodeString(QByteArray& target, QByteArrayView value)
+{
+    const qsizetype huffmanSize = getHuffmanSize(value);
+
+    if (huffmanSize < value.size())
+    {
+        encodeInteger(target, 0x80, 7, quint64(huffmanSize));
+        encodeHuffman(value, target);
+    }
+    else
+    {
+        encodeInteger(target, 0x00, 7, quint64(value.size()));
+        target.append(value);
+    }
+}
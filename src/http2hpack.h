@@ -0,0 +1,92 @@
+#ifndef HTTP2HPACK_H
+#define HTTP2HPACK_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QPair>
+
+
+// https://datatracker.ietf.org/doc/html/rfc7541
+// Header compression of HTTP/2. Each direction of a connection has its own dynamic table,
+// so a connection needs one Decoder and one Encoder.
+class Http2Hpack
+{
+public:
+    typedef QList<QPair<QByteArray, QByteArray>> HeaderList;
+
+    // https://datatracker.ietf.org/doc/html/rfc7541#section-2.3
+    // Static table (1 - 61) followed by the dynamic table, newest entry first
+    class Table
+    {
+    public:
+        void setMaxSize(qsizetype size);
+        qsizetype getMaxSize() const { return m_maxSize; }
+
+        void add(const QByteArray& name, const QByteArray& value);
+        bool get(quint64 index, QByteArray& name, QByteArray& value) const;
+
+        // 0 if not even the name is found
+        quint64 find(QByteArrayView name, QByteArrayView value, bool& valueMatch) const;
+
+    private:
+        HeaderList m_entries;
+        qsizetype m_size = 0;
+        qsizetype m_maxSize = DEFAULT_TABLE_SIZE;
+
+        void evict(qsizetype maxSize);
+    };
+
+    class Decoder
+    {
+    public:
+        // SETTINGS_HEADER_TABLE_SIZE sent to the peer, upper bound of its size updates
+        void setMaxTableSize(qsizetype size) { m_maxTableSize = size; }
+
+        // Appends the fields of a complete header block. False is a compression error, which ends the connection,
+        // also if the fields exceed maxListSize (SETTINGS_MAX_HEADER_LIST_SIZE, counted like the table size).
+        bool decode(QByteArrayView block, HeaderList& headers, qsizetype maxListSize);
+
+    private:
+        Table m_table;
+        qsizetype m_maxTableSize = DEFAULT_TABLE_SIZE;
+    };
+
+    class Encoder
+    {
+    public:
+        // SETTINGS_HEADER_TABLE_SIZE of the peer, the change is signalled at the start of the next block
+        void setMaxTableSize(qsizetype size);
+
+        // Names have to be lowercase
+        void beginBlock(QByteArray& block);
+        void encode(QByteArray& block, const QByteArray& name, const QByteArray& value);
+
+    private:
+        Table m_table;
+
+        // Smallest size since the last block, the decoder has to evict down to it
+        qsizetype m_minTableSize = -1;
+    };
+
+    // https://datatracker.ietf.org/doc/html/rfc7541#section-5.2
+    // Decoding fails on EOS and on padding longer than 7 bits or not all ones
+    static bool decodeHuffman(QByteArrayView data, QByteArray& result);
+    static void encodeHuffman(QByteArrayView data, QByteArray& result);
+    static qsizetype getHuffmanSize(QByteArrayView data);
+
+private:
+    static constexpr qsizetype DEFAULT_TABLE_SIZE = 4096;
+
+    // https://datatracker.ietf.org/doc/html/rfc7541#section-4.1
+    static constexpr qsizetype ENTRY_OVERHEAD = 32;
+
+    // https://datatracker.ietf.org/doc/html/rfc7541#section-5.1
+    static bool decodeInteger(const uchar*& pos, const uchar* end, int prefixBits, quint64& value);
+    static void encodeInteger(QByteArray& target, uchar flags, int prefixBits, quint64 value);
+
+    static bool decodeString(const uchar*& pos, const uchar* end, QByteArray& value);
+    static void encodeString(QByteArray& target, QByteArrayView value);
+};
+
+#endif // HTTP2HPACK_H
@@ -0,0 +1,1033 @@
+#include "http2session.h"
+
+#include <QDir>
+#include <QTemporaryFile>
+#include <QtEndian>
+
+#include "httpserver.h"
+
+
+Http2Session::Http2Session(HttpServer* server, QObject* context, const QString& logInfo, const HttpAccessLog::Peer& peer, bool secure) :
+    m_server(server),
+    m_context(context),
+    m_logInfo(logInfo),
+    m_peer(peer),
+    m_secure(secure)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-3.4
+    // -> The server preface is a SETTINGS frame, sent without waiting for the client
+    QByteArray settings;
+
+    const auto appendSetting = [&settings](SETTING id, quint32 value)
+    {
+        settings.append(char(id >> 8));
+        settings.append(char(id));
+        appendUInt32(settings, value);
+    };
+
+    appendSetting(SETTINGS_ENABLE_PUSH, 0);
+    appendSetting(SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    appendSetting(SETTINGS_INITIAL_WINDOW_SIZE, STREAM_WINDOW_SIZE);
+    appendSetting(SETTINGS_MAX_HEADER_LIST_SIZE, MAX_HEADER_LIST_SIZE);
+
+    appendFrame(FRAME_SETTINGS, 0, 0, settings);
+
+    // The connection window can only be changed by WINDOW_UPDATE
+    QByteArray increment;
+    appendUInt32(increment, CONNECTION_WINDOW_SIZE - DEFAULT_WINDOW_SIZE);
+
+    appendFrame(FRAME_WINDOW_UPDATE, 0, 0, increment);
+}
+
+Http2Session::~Http2Session()
+{
+    qDeleteAll(m_streams);
+}
+
+bool Http2Session::receive(const char* data, qsizetype size)
+{
+    if (m_failed)
+        return false;
+
+    m_input.append(data, size);
+
+    qsizetype pos = 0;
+
+    if (!m_prefaceReceived)
+    {
+        const QByteArrayView preface = getPreface();
+
+        if (m_input.size() < preface.size())
+            return preface.startsWith(m_input) || connectionError(ERROR_PROTOCOL, "Invalid preface");
+
+        if (!m_input.startsWith(preface))
+            return connectionError(ERROR_PROTOCOL, "Invalid preface");
+
+        m_prefaceReceived = true;
+        pos = preface.size();
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-4.1
+    while (m_input.size() - pos >= FRAME_HEADER_SIZE)
+    {
+        const uchar* header = reinterpret_cast<const uchar*>(m_input.constData() + pos);
+
+        const qsizetype length = (qsizetype(header[0]) << 16) | (qsizetype(header[1]) << 8) | header[2];
+        const quint8 type = header[3];
+        const quint8 flags = header[4];
+        const quint32 streamId = qFromBigEndian<quint32>(header + 5) & 0x7fffffff;
+
+        // Our SETTINGS_MAX_FRAME_SIZE is the default
+        if (length > DEFAULT_FRAME_SIZE)
+            return connectionError(ERROR_FRAME_SIZE, "Frame too large");
+
+        if (m_input.size() - pos - FRAME_HEADER_SIZE < length)
+            break;
+
+        const QByteArrayView payload(m_input.constData() + pos + FRAME_HEADER_SIZE, length);
+        pos += FRAME_HEADER_SIZE + length;
+
+        if (!processFrame(type, flags, streamId, payload))
+        {
+            m_input.clear();
+            return false;
+        }
+    }
+
+    m_input.remove(0, pos);
+
+    return true;
+}
+
+QByteArray Http2Session::takeOutput(qint64 maxSize)
+{
+    // DATA frames in turns of one frame per stream, as long as the windows of the client allow
+    while (!m_failed && m_output.size() < maxSize && m_sendWindow > 0 && !m_sendQueue.isEmpty())
+    {
+        Stream* stream = m_streams.value(m_sendQueue.takeFirst());
+
+        // Reset in the meantime
+        if (!stream)
+            continue;
+
+        stream->queued = false;
+
+        // Queued again by WINDOW_UPDATE
+        if (stream->sendWindow <= 0)
+            continue;
+
+        if (stream->dataOffset == stream->data.size() && stream->fileRemaining == 0 && stream->producer)
+        {
+            stream->data = stream->producer();
+            stream->dataOffset = 0;
+
+            if (stream->data.isEmpty())
+                stream->producer = nullptr;
+        }
+
+        const qint64 size = qMin(qMin(m_sendWindow, stream->sendWindow), m_peerMaxFrameSize);
+        QByteArrayView chunk;
+
+        if (stream->dataOffset < stream->data.size())
+        {
+            chunk = QByteArrayView(stream->data).sliced(stream->dataOffset, qMin<qint64>(size, stream->data.size() - stream->dataOffset));
+            stream->dataOffset += chunk.size();
+        }
+        else if (stream->fileRemaining > 0)
+        {
+            chunk = QByteArrayView(reinterpret_cast<const char*>(stream->file->data) + stream->fileOffset, qMin(size, stream->fileRemaining));
+            stream->fileOffset += chunk.size();
+            stream->fileRemaining -= chunk.size();
+        }
+
+        const bool endStream = !stream->hasBody();
+
+        appendFrame(FRAME_DATA, endStream ? FLAG_END_STREAM : 0, stream->id, chunk);
+
+        m_sendWindow -= chunk.size();
+        stream->sendWindow -= chunk.size();
+
+        if (endStream)
+            closeStream(stream);
+        else
+            queueStream(stream);
+    }
+
+    QByteArray result;
+    result.swap(m_output);
+
+    return result;
+}
+
+void Http2Session::goAway()
+{
+    if (m_goAwaySent || m_failed)
+        return;
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.8
+    QByteArray payload;
+    appendUInt32(payload, m_lastStreamId);
+    appendUInt32(payload, ERROR_NONE);
+
+    appendFrame(FRAME_GOAWAY, 0, 0, payload);
+
+    m_goAwaySent = true;
+}
+
+bool Http2Session::processFrame(quint8 type, quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-3.4
+    // -> The client preface ends with SETTINGS
+    if (!m_settingsReceived && (type != FRAME_SETTINGS || (flags & FLAG_ACK)))
+        return connectionError(ERROR_PROTOCOL, "Expected SETTINGS");
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.10
+    if (m_headerStreamId != 0 && type != FRAME_CONTINUATION)
+        return connectionError(ERROR_PROTOCOL, "Expected CONTINUATION");
+
+    switch (type)
+    {
+    case FRAME_DATA:
+        return handleData(flags, streamId, payload);
+
+    case FRAME_HEADERS:
+        return handleHeaders(flags, streamId, payload);
+
+    case FRAME_PRIORITY:
+        // Deprecated, only checked
+        if (streamId == 0)
+            return connectionError(ERROR_PROTOCOL, "PRIORITY without stream");
+
+        if (payload.size() != 5)
+            resetStream(streamId, ERROR_FRAME_SIZE);
+
+        return true;
+
+    case FRAME_RST_STREAM:
+        if (streamId == 0 || streamId > m_lastStreamId)
+            return connectionError(ERROR_PROTOCOL, "RST_STREAM on idle stream");
+
+        if (payload.size() != 4)
+            return connectionError(ERROR_FRAME_SIZE, "Invalid RST_STREAM");
+
+        delete m_streams.take(streamId);
+        return true;
+
+    case FRAME_SETTINGS:
+        return handleSettings(flags, streamId, payload);
+
+    case FRAME_PUSH_PROMISE:
+        return connectionError(ERROR_PROTOCOL, "PUSH_PROMISE from client");
+
+    case FRAME_PING:
+        if (streamId != 0)
+            return connectionError(ERROR_PROTOCOL, "PING on stream");
+
+        if (payload.size() != 8)
+            return connectionError(ERROR_FRAME_SIZE, "Invalid PING");
+
+        if (!(flags & FLAG_ACK))
+            appendFrame(FRAME_PING, FLAG_ACK, 0, payload);
+
+        return true;
+
+    case FRAME_GOAWAY:
+        if (streamId != 0)
+            return connectionError(ERROR_PROTOCOL, "GOAWAY on stream");
+
+        if (payload.size() < 8)
+            return connectionError(ERROR_FRAME_SIZE, "Invalid GOAWAY");
+
+        // Streams in progress are completed
+        m_goAwayReceived = true;
+        return true;
+
+    case FRAME_WINDOW_UPDATE:
+        return handleWindowUpdate(streamId, payload);
+
+    case FRAME_CONTINUATION:
+        return handleContinuation(flags, streamId, payload);
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-5.5
+    // -> Unknown frame types are ignored
+    return true;
+}
+
+bool Http2Session::handleData(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    if (streamId == 0)
+        return connectionError(ERROR_PROTOCOL, "DATA without stream");
+
+    // Padding counts for flow control
+    const qint64 frameSize = payload.size();
+
+    if (!removePadding(flags, payload))
+        return connectionError(ERROR_PROTOCOL, "Invalid padding");
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.9
+    if (frameSize > m_receiveWindow)
+        return connectionError(ERROR_FLOW_CONTROL, "Connection window exceeded");
+
+    m_receiveWindow -= frameSize;
+
+    if (m_receiveWindow < CONNECTION_WINDOW_SIZE / 2)
+    {
+        QByteArray increment;
+        appendUInt32(increment, CONNECTION_WINDOW_SIZE - m_receiveWindow);
+        appendFrame(FRAME_WINDOW_UPDATE, 0, 0, increment);
+
+        m_receiveWindow = CONNECTION_WINDOW_SIZE;
+    }
+
+    Stream* stream = m_streams.value(streamId);
+
+    // Closed by us, the client may not know yet
+    if (!stream)
+    {
+        if (streamId > m_lastStreamId)
+            return connectionError(ERROR_PROTOCOL, "DATA on idle stream");
+
+        return true;
+    }
+
+    if (stream->requestEnded)
+    {
+        resetStream(streamId, ERROR_STREAM_CLOSED);
+        return true;
+    }
+
+    if (frameSize > stream->receiveWindow)
+    {
+        resetStream(streamId, ERROR_FLOW_CONTROL);
+        return true;
+    }
+
+    stream->receiveWindow -= frameSize;
+
+    // Answered already (invalid request), the rest of the body is not needed
+    if (stream->dispatched)
+    {
+        if (flags & FLAG_END_STREAM)
+            stream->requestEnded = true;
+
+        return true;
+    }
+
+    if (stream->bufferBody)
+    {
+        stream->bodySize += payload.size();
+
+        // https://datatracker.ietf.org/doc/html/rfc9110#section-15.5.14
+        // -> The parser rejects the length, answered with 413
+        const qint64 maxBodySize = stream->request.getMaxBodySize();
+
+        if (maxBodySize > 0 && stream->bodySize > maxBodySize)
+        {
+            stream->request.appendData("Content-Length: " + QByteArray::number(stream->bodySize) + "\r\n\r\n");
+            stream->bufferBody = false;
+            stream->body.clear();
+            stream->bodyFile.reset();
+
+            dispatchRequest(stream);
+            return true;
+        }
+
+        if (!appendBody(stream, payload))
+        {
+            resetStream(streamId, ERROR_INTERNAL);
+            return true;
+        }
+    }
+    else
+    {
+        // https://datatracker.ietf.org/doc/html/rfc9113#section-8.1.1
+        // -> More data than Content-Length is malformed
+        if (stream->request.appendData(payload) < payload.size())
+        {
+            resetStream(streamId, ERROR_PROTOCOL);
+            return true;
+        }
+
+        if (stream->request.getParseState() == HttpRequest::ERROR)
+        {
+            dispatchRequest(stream);
+            return true;
+        }
+    }
+
+    if (flags & FLAG_END_STREAM)
+    {
+        endRequest(stream);
+        return true;
+    }
+
+    if (stream->receiveWindow < STREAM_WINDOW_SIZE / 2)
+    {
+        QByteArray increment;
+        appendUInt32(increment, STREAM_WINDOW_SIZE - stream->receiveWindow);
+        appendFrame(FRAME_WINDOW_UPDATE, 0, streamId, increment);
+
+        stream->receiveWindow = STREAM_WINDOW_SIZE;
+    }
+
+    return true;
+}
+
+bool Http2Session::handleHeaders(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    // Client-initiated streams are odd
+    if (streamId == 0 || !(streamId & 1))
+        return connectionError(ERROR_PROTOCOL, "Invalid stream for HEADERS");
+
+    if (!removePadding(flags, payload))
+        return connectionError(ERROR_PROTOCOL, "Invalid padding");
+
+    // Stream dependency and weight are ignored
+    if (flags & FLAG_PRIORITY)
+    {
+        if (payload.size() < 5)
+            return connectionError(ERROR_FRAME_SIZE, "Invalid HEADERS");
+
+        payload = payload.sliced(5);
+    }
+
+    m_headerStreamId = streamId;
+    m_headerEndStream = flags & FLAG_END_STREAM;
+    m_headerBlock = payload.toByteArray();
+
+    if (flags & FLAG_END_HEADERS)
+        return finishHeaderBlock();
+
+    return true;
+}
+
+bool Http2Session::handleContinuation(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    if (m_headerStreamId == 0 || streamId != m_headerStreamId)
+        return connectionError(ERROR_PROTOCOL, "Unexpected CONTINUATION");
+
+    // Compressed fields are not larger than the decoded ones, except for pathological encodings
+    if (m_headerBlock.size() + payload.size() > MAX_HEADER_LIST_SIZE)
+        return connectionError(ERROR_ENHANCE_YOUR_CALM, "Header block too large");
+
+    m_headerBlock.append(payload);
+
+    if (flags & FLAG_END_HEADERS)
+        return finishHeaderBlock();
+
+    return true;
+}
+
+bool Http2Session::finishHeaderBlock()
+{
+    const quint32 streamId = m_headerStreamId;
+    m_headerStreamId = 0;
+
+    // Decoded in any case, the dynamic table is shared by all streams
+    Http2Hpack::HeaderList headers;
+    const bool decoded = m_decoder.decode(m_headerBlock, headers, MAX_HEADER_LIST_SIZE);
+
+    m_headerBlock.clear();
+
+    if (!decoded)
+        return connectionError(ERROR_COMPRESSION, "Cannot decode header block");
+
+    Stream* stream = m_streams.value(streamId);
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-8.1
+    // -> Trailers end the request, their fields are not used
+    if (stream)
+    {
+        if (stream->requestEnded)
+            resetStream(streamId, ERROR_STREAM_CLOSED);
+        else if (!m_headerEndStream)
+            resetStream(streamId, ERROR_PROTOCOL);
+        else if (stream->dispatched)
+            stream->requestEnded = true;
+        else
+            endRequest(stream);
+
+        return true;
+    }
+
+    if (streamId <= m_lastStreamId)
+        return connectionError(ERROR_STREAM_CLOSED, "HEADERS on closed stream");
+
+    // Not processed after GOAWAY, the client retries them on a new connection
+    if (m_goAwaySent)
+        return true;
+
+    m_lastStreamId = streamId;
+
+    if (m_streams.size() >= MAX_CONCURRENT_STREAMS)
+    {
+        resetStream(streamId, ERROR_REFUSED_STREAM);
+        return true;
+    }
+
+    stream = new Stream();
+    stream->id = streamId;
+    stream->sendWindow = m_peerInitialWindow;
+    stream->receiveWindow = STREAM_WINDOW_SIZE;
+    stream->request.setBodyLimits(m_server->getMaxBodySize(), m_server->getBodySpillThreshold());
+
+    m_streams.insert(streamId, stream);
+
+    if (!startRequest(stream, headers, m_headerEndStream))
+        resetStream(streamId, ERROR_PROTOCOL);
+
+    return true;
+}
+
+bool Http2Session::handleSettings(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.5
+    if (streamId != 0)
+        return connectionError(ERROR_PROTOCOL, "SETTINGS on stream");
+
+    if (flags & FLAG_ACK)
+    {
+        if (!payload.isEmpty())
+            return connectionError(ERROR_FRAME_SIZE, "Invalid SETTINGS acknowledgement");
+
+        return true;
+    }
+
+    if (payload.size() % 6 != 0)
+        return connectionError(ERROR_FRAME_SIZE, "Invalid SETTINGS");
+
+    const uchar* data = reinterpret_cast<const uchar*>(payload.data());
+
+    for (qsizetype pos = 0; pos < payload.size(); pos += 6)
+    {
+        const quint16 id = qFromBigEndian<quint16>(data + pos);
+        const quint32 value = qFromBigEndian<quint32>(data + pos + 2);
+
+        switch (id)
+        {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            m_encoder.setMaxTableSize(value);
+            break;
+
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                return connectionError(ERROR_PROTOCOL, "Invalid SETTINGS_ENABLE_PUSH");
+            break;
+
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW_SIZE)
+                return connectionError(ERROR_FLOW_CONTROL, "Invalid SETTINGS_INITIAL_WINDOW_SIZE");
+
+            // https://datatracker.ietf.org/doc/html/rfc9113#section-6.9.2
+            // -> Applies to the windows of open streams as well, which may become negative
+            const qint64 delta = qint64(value) - m_peerInitialWindow;
+            m_peerInitialWindow = value;
+
+            bool overflow = false;
+
+            for (Stream* stream : std::as_const(m_streams))
+            {
+                stream->sendWindow += delta;
+                overflow = overflow || stream->sendWindow > MAX_WINDOW_SIZE;
+
+                if (stream->responseStarted && stream->hasBody())
+                    queueStream(stream);
+            }
+
+            if (overflow)
+                return connectionError(ERROR_FLOW_CONTROL, "Stream window too large");
+
+            break;
+        }
+
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < DEFAULT_FRAME_SIZE || value > MAX_FRAME_SIZE)
+                return connectionError(ERROR_PROTOCOL, "Invalid SETTINGS_MAX_FRAME_SIZE");
+
+            m_peerMaxFrameSize = value;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    m_settingsReceived = true;
+
+    appendFrame(FRAME_SETTINGS, FLAG_ACK, 0);
+
+    return true;
+}
+
+bool Http2Session::handleWindowUpdate(quint32 streamId, QByteArrayView payload)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.9
+    if (payload.size() != 4)
+        return connectionError(ERROR_FRAME_SIZE, "Invalid WINDOW_UPDATE");
+
+    const qint64 increment = qFromBigEndian<quint32>(payload.data()) & 0x7fffffff;
+
+    if (streamId == 0)
+    {
+        if (increment == 0)
+            return connectionError(ERROR_PROTOCOL, "Invalid WINDOW_UPDATE");
+
+        if (m_sendWindow + increment > MAX_WINDOW_SIZE)
+            return connectionError(ERROR_FLOW_CONTROL, "Connection window too large");
+
+        m_sendWindow += increment;
+        return true;
+    }
+
+    Stream* stream = m_streams.value(streamId);
+
+    if (!stream)
+    {
+        if (streamId > m_lastStreamId)
+            return connectionError(ERROR_PROTOCOL, "WINDOW_UPDATE on idle stream");
+
+        return true;
+    }
+
+    if (increment == 0)
+        resetStream(streamId, ERROR_PROTOCOL);
+    else if (stream->sendWindow + increment > MAX_WINDOW_SIZE)
+        resetStream(streamId, ERROR_FLOW_CONTROL);
+    else
+    {
+        stream->sendWindow += increment;
+
+        if (stream->responseStarted && stream->hasBody())
+            queueStream(stream);
+    }
+
+    return true;
+}
+
+bool Http2Session::removePadding(quint8 flags, QByteArrayView& payload)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.1
+    if (!(flags & FLAG_PADDED))
+        return true;
+
+    if (payload.isEmpty())
+        return false;
+
+    const qsizetype padding = uchar(payload.front());
+
+    if (padding >= payload.size())
+        return false;
+
+    payload = payload.sliced(1, payload.size() - 1 - padding);
+
+    return true;
+}
+
+bool Http2Session::startRequest(Stream* stream, const Http2Hpack::HeaderList& headers, bool endStream)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-8.3.1
+    // The pseudo-header fields become the request line and Host, so the request is handled like HTTP/1.1.
+    // False for a malformed request (section 8.1.1).
+    QByteArray method;
+    QByteArray scheme;
+    QByteArray authority;
+    QByteArray path;
+    QByteArray cookie;
+
+    QByteArray fields;
+    bool regularSeen = false;
+    bool hasContentLength = false;
+
+    for (const auto& header : headers)
+    {
+        const QByteArray& name = header.first;
+        const QByteArray& value = header.second;
+
+        if (name.isEmpty() || value.contains('\r') || value.contains('\n') || value.contains('\0'))
+            return false;
+
+        if (name.startsWith(':'))
+        {
+            QByteArray* target = nullptr;
+
+            if (name == ":method")
+                target = &method;
+            else if (name == ":scheme")
+                target = &scheme;
+            else if (name == ":authority")
+                target = &authority;
+            else if (name == ":path")
+                target = &path;
+
+            if (regularSeen || !target || !target->isNull() || value.isEmpty())
+                return false;
+
+            *target = value;
+            continue;
+        }
+
+        regularSeen = true;
+
+        for (const char c : name)
+        {
+            if ((c >= 'A' && c <= 'Z') || c == ':' || c == ' ' || c == '\r' || c == '\n' || c == '\0')
+                return false;
+        }
+
+        // https://datatracker.ietf.org/doc/html/rfc9113#section-8.2.2
+        if (name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade")
+            return false;
+
+        if (name == "te" && value != "trailers")
+            return false;
+
+        // https://datatracker.ietf.org/doc/html/rfc9113#section-8.2.3
+        if (name == "cookie")
+        {
+            if (!cookie.isEmpty())
+                cookie += "; ";
+
+            cookie += value;
+            continue;
+        }
+
+        // :authority takes precedence
+        if (name == "host" && !authority.isEmpty())
+            continue;
+
+        if (name == "content-length")
+            hasContentLength = true;
+
+        fields += name + ": " + value + "\r\n";
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-8.5
+    if (method == "CONNECT")
+    {
+        if (authority.isEmpty() || !scheme.isNull() || !path.isNull())
+            return false;
+
+        path = authority;
+    }
+    else if (method.isEmpty() || scheme.isEmpty() || path.isEmpty())
+        return false;
+
+    QByteArray head;
+    head.reserve(method.size() + path.size() + authority.size() + cookie.size() + fields.size() + 64);
+    head += method + " " + path + " HTTP/2\r\n";
+
+    if (!authority.isEmpty())
+        head += "Host: " + authority + "\r\n";
+
+    if (!cookie.isEmpty())
+        head += "Cookie: " + cookie + "\r\n";
+
+    head += fields;
+
+    // Without a length the head stays open until END_STREAM, see endRequest()
+    if (endStream || hasContentLength)
+        head += "\r\n";
+    else
+        stream->bufferBody = true;
+
+    stream->request.appendData(head);
+
+    if (stream->request.getParseState() == HttpRequest::ERROR)
+    {
+        dispatchRequest(stream);
+        return true;
+    }
+
+    if (endStream)
+        endRequest(stream);
+
+    return true;
+}
+
+bool Http2Session::appendBody(Stream* stream, QByteArrayView data)
+{
+    const qint64 spillThreshold = stream->request.getBodySpillThreshold();
+
+    if (!stream->bodyFile && spillThreshold > 0 && stream->bodySize > spillThreshold)
+    {
+        stream->bodyFile = std::make_unique<QTemporaryFile>(QDir::tempPath() + "/HttpServer-XXXXXX.body");
+
+        if (!stream->bodyFile->open() || stream->bodyFile->write(stream->body) != stream->body.size())
+        {
+            qWarning() << "Cannot create file for request body:" << stream->bodyFile->errorString();
+            return false;
+        }
+
+        stream->body.clear();
+    }
+
+    if (!stream->bodyFile)
+    {
+        stream->body.append(data);
+        return true;
+    }
+
+    if (stream->bodyFile->write(data.data(), data.size()) != data.size())
+    {
+        qWarning() << "Cannot write request body:" << stream->bodyFile->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+void Http2Session::endRequest(Stream* stream)
+{
+    stream->requestEnded = true;
+
+    if (stream->bufferBody)
+    {
+        stream->request.appendData("Content-Length: " + QByteArray::number(stream->bodySize) + "\r\n\r\n");
+
+        if (stream->bodyFile)
+        {
+            // Above the threshold the request spills it again, only one part is in memory at a time
+            stream->bodyFile->seek(0);
+
+            while (!stream->bodyFile->atEnd() && stream->request.getParseState() == HttpRequest::BODY)
+            {
+                const QByteArray data = stream->bodyFile->read(BODY_READ_SIZE);
+
+                if (data.isEmpty())
+                {
+                    qWarning() << "Cannot read request body:" << stream->bodyFile->errorString();
+                    break;
+                }
+
+                stream->request.appendData(data);
+            }
+        }
+        else
+            stream->request.appendData(stream->body);
+
+        stream->bufferBody = false;
+        stream->body.clear();
+        stream->bodyFile.reset();
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-8.1.1
+    // -> Less data than Content-Length is malformed
+    if (stream->request.getParseState() != HttpRequest::COMPLETE && stream->request.getParseState() != HttpRequest::ERROR)
+    {
+        resetStream(stream->id, ERROR_PROTOCOL);
+        return;
+    }
+
+    dispatchRequest(stream);
+}
+
+void Http2Session::dispatchRequest(Stream* stream)
+{
+    stream->dispatched = true;
+    stream->requestTimer.start();
+
+    HttpResponse response;
+
+    if (stream->request.getParseState() == HttpRequest::ERROR)
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Request invalid!";
+
+        response = HttpServer::getParseErrorResponse(stream->request);
+    }
+
+    // Redirect HTTP to HTTPS
+    else if (!m_secure && m_server->m_enableHttpRedirection)
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Redirecting HTTP to HTTPS";
+
+        response = m_server->getRedirectResponse(stream->request);
+    }
+
+    // Handle HTTP/2 Request, the response cache is only used for HTTP/1.x
+    else
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Handling HTTP/2 Request";
+
+        QFuture<HttpResponse> pending;
+
+        if (!m_server->handleHttpRequest(stream->request, m_logInfo, response, pending, stream->routeMetrics))
+        {
+            if (!pending.isFinished())
+            {
+                const quint32 streamId = stream->id;
+
+                // Called in the thread of the connection, not at all if it is deleted before
+                pending.then(m_context, [this, streamId](HttpResponse result)
+                             {
+                                 Stream* stream = m_streams.value(streamId);
+
+                                 // Reset by the client in the meantime
+                                 if (!stream)
+                                     return;
+
+                                 sendResponse(stream, result);
+
+                                 if (m_outputCallback)
+                                     m_outputCallback();
+                             });
+
+                return;
+            }
+
+            response = pending.result();
+        }
+    }
+
+    sendResponse(stream, response);
+}
+
+void Http2Session::sendResponse(Stream* stream, HttpResponse& response)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-7
+    // -> Event streams take over an HTTP/1.1 connection, the client retries with that
+    if (response.getEventSource())
+    {
+        resetStream(stream->id, ERROR_HTTP_1_1_REQUIRED);
+        return;
+    }
+
+    // Connection headers are added for HTTP/1.x and dropped below
+    m_server->finishResponse(stream->request, response, 1);
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-8.3.2
+    QByteArray block;
+    m_encoder.beginBlock(block);
+    m_encoder.encode(block, QByteArrayLiteral(":status"), QByteArray::number(response.getStatus()));
+
+    for (const auto& header : response.getFinalHeaders())
+    {
+        const QByteArray name = header.first.toLower();
+
+        // https://datatracker.ietf.org/doc/html/rfc9113#section-8.2.2
+        if (name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade")
+            continue;
+
+        m_encoder.encode(block, name, header.second);
+    }
+
+    if (response.hasBodyFile())
+    {
+        stream->file = response.getBodyFile();
+        stream->fileOffset = response.getBodyFileOffset();
+        stream->fileRemaining = response.getBodyFileLength();
+    }
+    else if (response.hasBodyProducer())
+        stream->producer = response.getBodyProducer();
+    else if (!response.getOmitBody())
+        stream->data = response.getBody();
+
+    stream->responseStarted = true;
+
+    const bool endStream = !stream->hasBody();
+
+    // Split at the frame size of the client, nothing else may be sent in between
+    qsizetype offset = 0;
+
+    do
+    {
+        const qsizetype size = qMin<qsizetype>(block.size() - offset, m_peerMaxFrameSize);
+        quint8 flags = offset + size == block.size() ? FLAG_END_HEADERS : 0;
+
+        if (offset == 0 && endStream)
+            flags |= FLAG_END_STREAM;
+
+        appendFrame(offset == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream->id, QByteArrayView(block).sliced(offset, size));
+
+        offset += size;
+    }
+    while (offset < block.size());
+
+    m_server->recordResponse(m_peer, stream->request, stream->routeMetrics, response.getStatus(), response.getBodySize(), stream->requestTimer);
+
+    if (endStream)
+        closeStream(stream);
+    else
+        queueStream(stream);
+}
+
+void Http2Session::queueStream(Stream* stream)
+{
+    if (stream->queued)
+        return;
+
+    stream->queued = true;
+    m_sendQueue.append(stream->id);
+}
+
+void Http2Session::resetStream(quint32 streamId, ERROR_CODE error)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.4
+    QByteArray payload;
+    appendUInt32(payload, error);
+
+    appendFrame(FRAME_RST_STREAM, 0, streamId, payload);
+
+    delete m_streams.take(streamId);
+}
+
+void Http2Session::closeStream(Stream* stream)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-8.1
+    // -> A response before the complete request stops the client from sending the rest
+    if (!stream->requestEnded)
+    {
+        resetStream(stream->id, ERROR_NONE);
+        return;
+    }
+
+    delete m_streams.take(stream->id);
+}
+
+bool Http2Session::connectionError(ERROR_CODE error, const char* reason)
+{
+    qCDebug(lcHttpServer) << m_logInfo << "HTTP/2 connection error:" << reason;
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-5.4.1
+    if (!m_failed)
+    {
+        QByteArray payload;
+        appendUInt32(payload, m_lastStreamId);
+        appendUInt32(payload, error);
+
+        appendFrame(FRAME_GOAWAY, 0, 0, payload);
+    }
+
+    m_failed = true;
+
+    qDeleteAll(m_streams);
+    m_streams.clear();
+    m_sendQueue.clear();
+
+    return false;
+}
+
+void Http2Session::appendFrame(FRAME_TYPE type, quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    const qsizetype size = payload.size();
+
+    const char header[FRAME_HEADER_SIZE] =
+    {
+        char(size >> 16), char(size >> 8), char(size),
+        char(type),
+        char(flags),
+        char((streamId >> 24) & 0x7f), char(streamId >> 16), char(streamId >> 8), char(streamId),
+    };
+
+    m_output.append(header, FRAME_HEADER_SIZE);
+    m_output.append(payload);
+}
+
+void Http2Session::appendUInt32(QByteArray& target, quint32 value)
+{
+    target.append(char(value >> 24));
+    target.append(char(value >> 16));
+    target.append(char(value >> 8));
+    target.append(char(value));
+}
@@ -0,0 +1,233 @@
+#ifndef HTTP2SESSION_H
+#define HTTP2SESSION_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <functional>
+#include <memory>
+
+#include "http2hpack.h"
+#include "httpaccesslog.h"
+#include "httpfilecache.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+class HttpServer;
+class HttpRouteMetrics;
+class QTemporaryFile;
+
+
+// https://datatracker.ietf.org/doc/html/rfc9113
+// HTTP/2 on one connection, independent of the socket: input is passed to receive(), the frames to send
+// are taken with takeOutput(). Each stream is turned into an HttpRequest and dispatched like an HTTP/1.1
+// request, the response is sent as HEADERS and DATA frames within the flow control windows of the client.
+// Server push and priorities are not supported.
+class Http2Session
+{
+public:
+    // Async responses are continued in the thread of context, which has to outlive the session
+    Http2Session(HttpServer* server, QObject* context, const QString& logInfo, const HttpAccessLog::Peer& peer, bool secure);
+    ~Http2Session();
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-3.4
+    static QByteArrayView getPreface() { return "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"; }
+
+    // Called after an async response added output
+    void setOutputCallback(const std::function<void()>& callback) { m_outputCallback = callback; }
+
+    // False after a connection error, the GOAWAY frame is still in the output
+    bool receive(const char* data, qsizetype size);
+
+    // Pending control frames, then DATA frames until maxSize is reached or the windows are used up
+    QByteArray takeOutput(qint64 maxSize);
+
+    // Graceful shutdown, streams already started are completed
+    void goAway();
+
+    // No stream in progress
+    bool isIdle() const { return m_streams.isEmpty(); }
+
+    // Response bodies waiting for the socket or the flow control windows of the client, not for a handler
+    bool isSending() const { return !m_sendQueue.isEmpty(); }
+
+    // The connection can be closed once the output is written
+    bool isFinished() const { return m_failed || ((m_goAwaySent || m_goAwayReceived) && m_streams.isEmpty()); }
+
+private:
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6
+    enum FRAME_TYPE
+    {
+        FRAME_DATA = 0x0,
+        FRAME_HEADERS = 0x1,
+        FRAME_PRIORITY = 0x2,
+        FRAME_RST_STREAM = 0x3,
+        FRAME_SETTINGS = 0x4,
+        FRAME_PUSH_PROMISE = 0x5,
+        FRAME_PING = 0x6,
+        FRAME_GOAWAY = 0x7,
+        FRAME_WINDOW_UPDATE = 0x8,
+        FRAME_CONTINUATION = 0x9,
+    };
+
+    enum FLAG
+    {
+        FLAG_END_STREAM = 0x1,
+        FLAG_ACK = 0x1,
+        FLAG_END_HEADERS = 0x4,
+        FLAG_PADDED = 0x8,
+        FLAG_PRIORITY = 0x20,
+    };
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-6.5.2
+    enum SETTING
+    {
+        SETTINGS_HEADER_TABLE_SIZE = 0x1,
+        SETTINGS_ENABLE_PUSH = 0x2,
+        SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+        SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+        SETTINGS_MAX_FRAME_SIZE = 0x5,
+        SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+    };
+
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-7
+    enum ERROR_CODE
+    {
+        ERROR_NONE = 0x0,
+        ERROR_PROTOCOL = 0x1,
+        ERROR_INTERNAL = 0x2,
+        ERROR_FLOW_CONTROL = 0x3,
+        ERROR_SETTINGS_TIMEOUT = 0x4,
+        ERROR_STREAM_CLOSED = 0x5,
+        ERROR_FRAME_SIZE = 0x6,
+        ERROR_REFUSED_STREAM = 0x7,
+        ERROR_CANCEL = 0x8,
+        ERROR_COMPRESSION = 0x9,
+        ERROR_CONNECT = 0xa,
+        ERROR_ENHANCE_YOUR_CALM = 0xb,
+        ERROR_INADEQUATE_SECURITY = 0xc,
+        ERROR_HTTP_1_1_REQUIRED = 0xd,
+    };
+
+    static constexpr qsizetype FRAME_HEADER_SIZE = 9;
+    static constexpr qint64 DEFAULT_WINDOW_SIZE = 65535;
+    static constexpr qint64 MAX_WINDOW_SIZE = 0x7fffffff;
+    static constexpr qint64 DEFAULT_FRAME_SIZE = 16384;
+    static constexpr qint64 MAX_FRAME_SIZE = 16777215;
+
+    // Sent in our SETTINGS. The windows are replenished once half of them is used.
+    static constexpr int MAX_CONCURRENT_STREAMS = 100;
+    static constexpr qint64 STREAM_WINDOW_SIZE = 1024 * 1024;
+    static constexpr qint64 CONNECTION_WINDOW_SIZE = 4 * 1024 * 1024;
+    static constexpr qsizetype MAX_HEADER_LIST_SIZE = 64 * 1024;
+
+    // Spilled bodies are passed to the request in parts of this size
+    static constexpr qint64 BODY_READ_SIZE = 64 * 1024;
+
+    struct Stream
+    {
+        quint32 id = 0;
+
+        // Request line and headers are passed to the parser as soon as the header block is complete.
+        // Without Content-Length the body is collected until END_STREAM, then passed on with the length.
+        // Above the spill threshold of the request it is collected in a temporary file instead of memory.
+        HttpRequest request;
+        bool requestEnded = false;
+        bool bufferBody = false;
+        QByteArray body;
+        std::unique_ptr<QTemporaryFile> bodyFile;
+        qint64 bodySize = 0;
+        bool dispatched = false;
+
+        qint64 sendWindow = 0;
+        qint64 receiveWindow = 0;
+
+        // Since the request was dispatched, for the latency in the metrics and access log
+        QElapsedTimer requestTimer;
+        HttpRouteMetrics* routeMetrics = nullptr;
+
+        // Body of the response still to be sent, in this order
+        bool responseStarted = false;
+        QByteArray data;
+        qsizetype dataOffset = 0;
+
+        HttpFileCache::FilePtr file;
+        qint64 fileOffset = 0;
+        qint64 fileRemaining = 0;
+
+        HttpResponse::BodyProducer producer;
+
+        // In m_sendQueue
+        bool queued = false;
+
+        bool hasBody() const { return dataOffset < data.size() || fileRemaining > 0 || producer; }
+    };
+
+    HttpServer* m_server = nullptr;
+    QObject* m_context = nullptr;
+    QString m_logInfo;
+    HttpAccessLog::Peer m_peer;
+    bool m_secure = false;
+
+    std::function<void()> m_outputCallback;
+
+    QByteArray m_input;
+    QByteArray m_output;
+
+    bool m_prefaceReceived = false;
+    bool m_settingsReceived = false;
+    bool m_failed = false;
+    bool m_goAwaySent = false;
+    bool m_goAwayReceived = false;
+
+    QHash<quint32, Stream*> m_streams;
+    quint32 m_lastStreamId = 0;
+
+    // Header block split over HEADERS and CONTINUATION frames, nothing else may come in between
+    quint32 m_headerStreamId = 0;
+    bool m_headerEndStream = false;
+    QByteArray m_headerBlock;
+
+    Http2Hpack::Decoder m_decoder;
+    Http2Hpack::Encoder m_encoder;
+
+    // Settings of the client
+    qint64 m_peerInitialWindow = DEFAULT_WINDOW_SIZE;
+    qint64 m_peerMaxFrameSize = DEFAULT_FRAME_SIZE;
+
+    qint64 m_sendWindow = DEFAULT_WINDOW_SIZE;
+    qint64 m_receiveWindow = CONNECTION_WINDOW_SIZE;
+
+    // Streams with body data waiting for their turn, one frame each
+    QList<quint32> m_sendQueue;
+
+    bool processFrame(quint8 type, quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool handleData(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool handleHeaders(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool handleContinuation(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool handleSettings(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool handleWindowUpdate(quint32 streamId, QByteArrayView payload);
+    bool finishHeaderBlock();
+
+    static bool removePadding(quint8 flags, QByteArrayView& payload);
+
+    bool startRequest(Stream* stream, const Http2Hpack::HeaderList& headers, bool endStream);
+    bool appendBody(Stream* stream, QByteArrayView data);
+    void endRequest(Stream* stream);
+    void dispatchRequest(Stream* stream);
+    void sendResponse(Stream* stream, HttpResponse& response);
+
+    void queueStream(Stream* stream);
+    void resetStream(quint32 streamId, ERROR_CODE error);
+    void closeStream(Stream* stream);
+    bool connectionError(ERROR_CODE error, const char* reason);
+
+    void appendFrame(FRAME_TYPE type, quint8 flags, quint32 streamId, QByteArrayView payload = QByteArrayView());
+    static void appendUInt32(QByteArray& target, quint32 value);
+};
+
+#endif // HTTP2SESSION_H
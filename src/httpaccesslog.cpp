@@ -0,0 +1,269 @@
+#include "httpaccesslog.h"
+
+#include <QDateTime>
+#include <QTimeZone>
+
+#include <cstdio>
+#include <cstring>
+
+
+Q_LOGGING_CATEGORY(lcHttpServer, "httpserver", QtInfoMsg)
+
+
+HttpAccessLog::Peer HttpAccessLog::Peer::fromAddress(const QHostAddress& address, quint16 port)
+{
+    Peer result;
+    result.port = port;
+
+    bool isIpv4 = false;
+    const quint32 ipv4 = address.toIPv4Address(&isIpv4);
+
+    // Also for IPv4-mapped addresses of a dual stack socket
+    if (isIpv4)
+    {
+        result.ipv4 = true;
+        memcpy(result.address, &ipv4, sizeof(ipv4));
+    }
+    else
+    {
+        const Q_IPV6ADDR ipv6 = address.toIPv6Address();
+        memcpy(result.address, &ipv6, sizeof(ipv6));
+    }
+
+    return result;
+}
+
+QHostAddress HttpAccessLog::Peer::getAddress() const
+{
+    if (ipv4)
+    {
+        quint32 value = 0;
+        memcpy(&value, address, sizeof(value));
+
+        return QHostAddress(value);
+    }
+
+    return QHostAddress(address);
+}
+
+
+HttpAccessLog::HttpAccessLog()
+{
+
+}
+
+HttpAccessLog::~HttpAccessLog()
+{
+    close();
+
+    delete[] m_slots;
+}
+
+bool HttpAccessLog::open(const QString& fileName)
+{
+    if (isOpen())
+        return true;
+
+    bool ok = false;
+
+    if (fileName == "-")
+        ok = m_file.open(stderr, QIODevice::WriteOnly);
+    else
+    {
+        m_file.setFileName(fileName);
+        ok = m_file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    if (!ok)
+    {
+        qWarning() << "Cannot open access log:" << fileName << m_file.errorString();
+        return false;
+    }
+
+    // Kept until destruction, a connection may still push while the log is closed
+    if (!m_slots)
+    {
+        quint64 capacity = 1;
+
+        while (capacity < quint64(m_capacity))
+            capacity <<= 1;
+
+        m_slots = new Slot[capacity];
+        m_mask = capacity - 1;
+
+        for (quint64 i = 0; i < capacity; ++i)
+            m_slots[i].sequence.storeRelaxed(i);
+    }
+
+    m_stopping.storeRelaxed(0);
+
+    m_thread = QThread::create([this]() { run(); });
+    m_thread->setObjectName("HttpAccessLog");
+    m_thread->start(QThread::LowPriority);
+
+    m_open.storeRelease(1);
+
+    return true;
+}
+
+void HttpAccessLog::close()
+{
+    if (!isOpen())
+        return;
+
+    m_open.storeRelaxed(0);
+    m_stopping.storeRelease(1);
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+
+    m_file.close();
+}
+
+void HttpAccessLog::setCapacity(int records)
+{
+    if (!m_slots)
+        m_capacity = qMax(2, records);
+}
+
+void HttpAccessLog::log(const Peer& peer, const HttpRequest& request, int status, qint64 bytes, qint64 latency)
+{
+    if (!isOpen())
+        return;
+
+    Record record;
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.latency = latency;
+    record.bytes = bytes;
+    record.peer = peer;
+    record.status = qint16(status);
+    record.method = qint8(request.getMethod());
+
+    const QByteArrayView target = request.getTargetView();
+    record.targetSize = quint16(qMin<qsizetype>(target.size(), TARGET_SIZE));
+    memcpy(record.target, target.data(), record.targetSize);
+
+    if (!push(record))
+        m_dropped.fetchAndAddRelaxed(1);
+}
+
+bool HttpAccessLog::push(const Record& record)
+{
+    quint64 position = m_tail.loadRelaxed();
+
+    forever
+    {
+        Slot& slot = m_slots[position & m_mask];
+        const qint64 difference = qint64(slot.sequence.loadAcquire() - position);
+
+        if (difference == 0)
+        {
+            // Slot is claimed once the tail moved on, position is updated if another thread was first
+            if (m_tail.testAndSetRelaxed(position, position + 1, position))
+            {
+                slot.record = record;
+                slot.sequence.storeRelease(position + 1);
+
+                return true;
+            }
+        }
+        else if (difference < 0)
+            return false;   // Full
+        else
+            position = m_tail.loadRelaxed();
+    }
+}
+
+bool HttpAccessLog::pop(Record& record)
+{
+    // Single consumer -> the head needs no atomic update
+    Slot& slot = m_slots[m_head & m_mask];
+
+    if (slot.sequence.loadAcquire() != m_head + 1)
+        return false;
+
+    record = slot.record;
+    slot.sequence.storeRelease(m_head + m_mask + 1);
+    ++m_head;
+
+    return true;
+}
+
+void HttpAccessLog::run()
+{
+    QByteArray buffer;
+
+    while (!m_stopping.loadAcquire())
+    {
+        writeRecords(buffer);
+
+        QThread::msleep(FLUSH_INTERVAL);
+    }
+
+    // Records pushed before close()
+    writeRecords(buffer);
+}
+
+void HttpAccessLog::writeRecords(QByteArray& buffer)
+{
+    Record record;
+
+    buffer.resize(0);
+
+    while (pop(record))
+        appendRecord(buffer, record);
+
+    if (buffer.isEmpty())
+        return;
+
+    // One write per batch
+    m_file.write(buffer);
+    m_file.flush();
+}
+
+void HttpAccessLog::appendRecord(QByteArray& buffer, const Record& record)
+{
+    // {"time":"2024-01-01T12:00:00.000Z","peer":"127.0.0.1:51234","method":"GET","target":"/","status":200,"bytes":4,"latency_us":35}
+    buffer += "{\"time\":\"";
+    buffer += QDateTime::fromMSecsSinceEpoch(record.time, QTimeZone::UTC).toString(Qt::ISODateWithMs).toLatin1();
+    buffer += "\",\"peer\":\"";
+
+    if (record.peer.ipv4)
+        buffer += record.peer.getAddress().toString().toLatin1() + ':';
+    else
+        buffer += '[' + record.peer.getAddress().toString().toLatin1() + "]:";
+
+    buffer += QByteArray::number(record.peer.port);
+    buffer += "\",\"method\":\"";
+    buffer += HttpRequest::getStringFromMethod(static_cast<HttpRequest::METHOD>(record.method)).toLatin1();
+    buffer += "\",\"target\":\"";
+
+    // https://datatracker.ietf.org/doc/html/rfc8259#section-7
+    for (int i = 0; i < record.targetSize; ++i)
+    {
+        const uchar c = uchar(record.target[i]);
+
+        if (c == '"' || c == '\\')
+        {
+            buffer += '\\';
+            buffer += char(c);
+        }
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            char escaped[8];
+            qsnprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            buffer += escaped;
+        }
+        else
+            buffer += char(c);
+    }
+
+    buffer += "\",\"status\":";
+    buffer += QByteArray::number(record.status);
+    buffer += ",\"bytes\":";
+    buffer += record.bytes < 0 ? QByteArray("null") : QByteArray::number(record.bytes);
+    buffer += ",\"latency_us\":";
+    buffer += QByteArray::number(record.latency);
+    buffer += "}\n";
+}
@@ -0,0 +1,107 @@
+#ifndef HTTPACCESSLOG_H
+#define HTTPACCESSLOG_H
+
+#include <QAtomicInteger>
+#include <QFile>
+#include <QHostAddress>
+#include <QLoggingCategory>
+#include <QThread>
+
+#include "httprequest.h"
+
+
+// Debug output of the server, disabled by default.
+// Enabled at runtime with QT_LOGGING_RULES="httpserver.debug=true", compiled out with QT_NO_DEBUG_OUTPUT.
+Q_DECLARE_LOGGING_CATEGORY(lcHttpServer)
+
+
+// One JSON line per request (peer, method, target, status, bytes, latency).
+// Records are copied into a bounded lock-free ring by the connection threads and
+// formatted and written by a background thread. If the writer falls behind, records are dropped
+// instead of blocking a connection.
+class HttpAccessLog
+{
+public:
+    // Address of the client, copied into each record without allocating
+    struct Peer
+    {
+        quint8 address[16] = {};
+        bool ipv4 = false;
+        quint16 port = 0;
+
+        static Peer fromAddress(const QHostAddress& address, quint16 port);
+        QHostAddress getAddress() const;
+    };
+
+    HttpAccessLog();
+    ~HttpAccessLog();
+
+    // Appends to the file, "-" = stderr. Starts the writer thread.
+    bool open(const QString& fileName);
+    void close();
+
+    bool isOpen() const { return m_open.loadRelaxed() != 0; }
+
+    // Records waiting for the writer, rounded up to a power of 2. Has to be set before open().
+    void setCapacity(int records);
+    int getCapacity() const { return m_capacity; }
+
+    quint64 getDroppedCount() const { return m_dropped.loadRelaxed(); }
+
+    // Thread-safe and lock-free. Latency in µs, bytes of the body (-1 if streamed).
+    void log(const Peer& peer, const HttpRequest& request, int status, qint64 bytes, qint64 latency);
+
+private:
+    static constexpr int TARGET_SIZE = 256;
+    static constexpr int FLUSH_INTERVAL = 50;
+
+    struct Record
+    {
+        qint64 time = 0;
+        qint64 latency = 0;
+        qint64 bytes = 0;
+
+        Peer peer;
+
+        qint16 status = 0;
+        qint8 method = 0;
+
+        // Raw target, truncated
+        quint16 targetSize = 0;
+        char target[TARGET_SIZE];
+    };
+
+    // https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+    // -> sequence tells whether the slot is free for the producer at that position or filled for the consumer
+    struct Slot
+    {
+        QAtomicInteger<quint64> sequence = 0;
+        Record record;
+    };
+
+    int m_capacity = 4096;
+
+    Slot* m_slots = nullptr;
+    quint64 m_mask = 0;
+
+    alignas(64) QAtomicInteger<quint64> m_tail = 0;
+    alignas(64) quint64 m_head = 0;
+
+    QAtomicInteger<quint64> m_dropped = 0;
+
+    QAtomicInt m_open = 0;
+    QAtomicInt m_stopping = 0;
+
+    QFile m_file;
+    QThread* m_thread = nullptr;
+
+    bool push(const Record& record);
+    bool pop(Record& record);
+
+    void run();
+    void writeRecords(QByteArray& buffer);
+
+    static void appendRecord(QByteArray& buffer, const Record& record);
+};
+
+#endif // HTTPACCESSLOG_H
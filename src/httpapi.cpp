@@ -1,15 +1,14 @@
 #include "httpapi.h"
 
-#include <QJsonDocument>
 #include <QFile>
 #include <QSslCertificate>
 #include <QSslKey>
 
 
-HttpAPI::HttpAPI(QObject* parent) :
+HttpAPI::HttpAPI(HttpServer::BACKEND backend, quint16 port, bool redirectHttp, QObject* parent) :
     QObject(parent)
 {
-    m_server = new HttpServer(QHostAddress::Any, 8080, this);
+    m_server = new HttpServer(QHostAddress::Any, port, backend, this);
 
     QFile fileCert("certs/certificate.crt");
     QFile fileKey("certs/privatekey.key");
@@ -28,30 +27,48 @@ HttpAPI::HttpAPI(QObject* parent) :
         qDebug() << "Cannot open PrivateKey!";
 
     m_server->setSslConfig(sslCert, sslKey, QSsl::TlsV1_2OrLater);
-    m_server->setEnableHttpRedirection(true);
+    m_server->setEnableHttpRedirection(redirectHttp);
 
-    auto cbGet = [this](const HttpRequest& request, const QString& logInfo) { return cbGET(request, logInfo); };
-    auto cbPost = [this](const HttpRequest& request, const QString& logInfo) { return cbPOST(request, logInfo); };
+    m_server->getAccessLog()->open("access.log");
 
-    QStringList targetsGET;
-    targetsGET << "/";
-    targetsGET << "/ping";
-    targetsGET << "/test";
+    // Shed requests queued for more than 100 ms (normal priority) while the queue stays above 50 ms
+    m_server->getLoadShedder()->setTarget(50);
 
-    QStringList targetsPOST;
-    targetsPOST << "/";
-    targetsPOST << "/echo";
-    targetsPOST << "/test";
+    // Static responses, served from the response cache
+    HttpRouteOptions cacheOptions;
+    cacheOptions.cacheTtl = 10000;
 
-    for (const auto& itTarget : targetsGET)
-    {
-        m_server->setCallback(HttpRequest::GET, itTarget, cbGet);
-    }
+    // Health check, never shed
+    HttpRouteOptions pingOptions = cacheOptions;
+    pingOptions.priority = HttpRouteOptions::CRITICAL;
 
-    for (const auto& itTarget : targetsPOST)
-    {
-        m_server->setCallback(HttpRequest::POST, itTarget, cbPost);
-    }
+    m_server->setCallback(HttpRequest::GET, "/", [this](const HttpRequest& request, const QString& logInfo) { return cbHome(request, logInfo); }, cacheOptions);
+    m_server->setCallback(HttpRequest::GET, "/ping", [this](const HttpRequest& request, const QString& logInfo) { return cbPing(request, logInfo); }, pingOptions);
+    m_server->setCallback(HttpRequest::GET, "/test", [this](const HttpRequest& request, const QString& logInfo) { return cbTestGET(request, logInfo); });
+    m_server->addMetricsRoute("/metrics");
+    m_server->setCallback(HttpRequest::GET, "/stream", [this](const HttpRequest& request, const QString& logInfo) { return cbStream(request, logInfo); });
+
+    // Every message goes to all other participants
+    HttpWebSocketHandler chat;
+    chat.onOpen = [this](HttpWebSocket* socket, const HttpRequest&) { m_chat.join(socket); };
+    chat.onMessage = [this](HttpWebSocket* socket, const QByteArray& message, bool binary) { m_chat.broadcast(message, binary, socket); };
+
+    m_server->setWebSocketCallback("/chat", chat);
+
+    m_server->setEventSourceCallback("/events", &m_events);
+
+    m_server->setCallback(HttpRequest::POST, "/", [this](const HttpRequest& request, const QString& logInfo) { return cbHome(request, logInfo); });
+    m_server->setCallback(HttpRequest::POST, "/echo", [this](const HttpRequest& request, const QString& logInfo) { return cbEcho(request, logInfo); });
+    m_server->setCallback(HttpRequest::POST, "/test", [this](const HttpRequest& request, const QString& logInfo) { return cbTestPOST(request, logInfo); });
+
+    // The body is published to all subscribers
+    m_server->setCallback(HttpRequest::POST, "/events", [this](const HttpRequest& request, const QString&)
+                          {
+                              HttpResponse response(HttpResponse::OK);
+                              response.setBody(QByteArray::number(m_events.publish(request.getBody())));
+
+                              return response;
+                          });
 }
 
 HttpAPI::~HttpAPI()
@@ -73,42 +90,6 @@ void HttpAPI::stop()
     m_server->stop();
 }
 
-HttpResponse HttpAPI::cbGET(const HttpRequest& request, const QString& logInfo)
-{
-    HttpResponse response;
-
-    const QString& target = request.getTarget();
-
-    if (target == "/")
-        response = cbHome(request, logInfo);
-    else if (target == "/ping")
-        response = cbPing(request, logInfo);
-    else if (target == "/test")
-        response = cbTestGET(request, logInfo);
-    else
-        response.setStatus(HttpResponse::NOT_FOUND);
-
-    return response;
-}
-
-HttpResponse HttpAPI::cbPOST(const HttpRequest &request, const QString& logInfo)
-{
-    HttpResponse response;
-
-    const QString& target = request.getTarget();
-
-    if (target == "/")
-        response = cbHome(request, logInfo);
-    else if (target == "/echo")
-        response = cbEcho(request, logInfo);
-    else if (target == "/test")
-        response = cbTestPOST(request, logInfo);
-    else
-        response.setStatus(HttpResponse::NOT_FOUND);
-
-    return response;
-}
-
 HttpResponse HttpAPI::cbHome(const HttpRequest &request, const QString& logInfo)
 {
     QString strBody = "Home";
@@ -161,29 +142,38 @@ HttpResponse HttpAPI::cbTestPOST(const HttpRequest &request, const QString& logI
 
     const QString contentType = request.getHeader("Content-Type", Qt::CaseInsensitive);
 
-    qDebug() << logInfo << "ContentType:" << contentType;
+    qCDebug(lcHttpServer) << logInfo << "ContentType:" << contentType;
 
-    const QJsonDocument json = QJsonDocument::fromJson(request.getBody());
+    // Only the two fields are decoded, the rest of the body is skipped over the index
+    const HttpJsonDocument json = request.getJsonBody();
 
-    if (json.isNull())
+    if (!json.isValid())
     {
-        qDebug() << logInfo << "JSON Request is invalid!";
+        qCDebug(lcHttpServer) << logInfo << "JSON Request is invalid!" << json.getErrorString() << "at" << json.getErrorOffset();
         response.setStatus(HttpResponse::BAD_REQUEST);
+        response.setHeader("Content-Type", "application/json");
+
+        HttpJsonWriter writer(response.getBodyBuffer());
+        writer.beginObject();
+        writer.writeKey("error");
+        writer.writeString(json.getErrorString());
+        writer.writeKey("offset");
+        writer.writeInteger(json.getErrorOffset());
+        writer.endObject();
+
         return response;
     }
 
-    const QJsonValue valFunction = json["function"];
+    const HttpJsonValue valFunction = json["function"];
 
-    if (valFunction == QJsonValue::Undefined || !valFunction.isString())
+    if (!valFunction.isString())
     {
-        qDebug() << logInfo << "JSON Function is invalid!";
+        qCDebug(lcHttpServer) << logInfo << "JSON Function is invalid!";
         response.setStatus(HttpResponse::BAD_REQUEST);
         return response;
     }
 
-    const QString strFunction = valFunction.toString();
-
-    if (strFunction == "hello")
+    if (valFunction.equals("hello"))
     {
         QString strBody = "Hello World!";
 
@@ -191,23 +181,23 @@ HttpResponse HttpAPI::cbTestPOST(const HttpRequest &request, const QString& logI
         response.setHeader("Content-Type", "text/plain; charset=utf-8");
         response.setBody(strBody.toUtf8());
     }
-    else if (strFunction == "echo")
+    else if (valFunction.equals("echo"))
     {
         response.setStatus(HttpResponse::OK);
         response.setHeader("Content-Type", request.getHeader("Content-Type"));
         response.setBody(request.getBody());
     }
-    else if (strFunction == "secret")
+    else if (valFunction.equals("secret"))
     {
-        const QJsonValue valPassword = json["password"];
+        const HttpJsonValue valPassword = json["password"];
 
-        if (valPassword == QJsonValue::Undefined || !valPassword.isString())
+        if (!valPassword.isString())
         {
             response.setStatus(HttpResponse::UNAUTHORIZED);
             return response;
         }
 
-        if (valPassword.toString() == "asdf1234")
+        if (valPassword.equals("asdf1234"))
         {
             QString strBody = "Password correct!";
 
@@ -223,3 +213,34 @@ HttpResponse HttpAPI::cbTestPOST(const HttpRequest &request, const QString& logI
 
     return response;
 }
+
+HttpResponse HttpAPI::cbStream(const HttpRequest& request, const QString& logInfo)
+{
+    // Generated text of ?size=<bytes> (default 1 MB), produced in 64 KB chunks as the client reads it
+    qint64 remaining = request.getTargetParameter("size").toLongLong();
+
+    if (remaining <= 0)
+        remaining = 1024 * 1024;
+
+    HttpResponse response;
+    response.setStatus(HttpResponse::OK);
+    response.setHeader("Content-Type", "text/plain; charset=utf-8");
+    response.setBodyProducer([remaining, line = qint64(0)]() mutable
+    {
+        QByteArray chunk;
+        chunk.reserve(64 * 1024);
+
+        while (remaining > 0 && chunk.size() < 64 * 1024)
+        {
+            const QByteArray text = "Line " + QByteArray::number(++line) + "\n";
+            const qsizetype size = qMin<qint64>(text.size(), remaining);
+
+            chunk.append(text.constData(), size);
+            remaining -= size;
+        }
+
+        return chunk;
+    });
+
+    return response;
+}
@@ -3,8 +3,10 @@
 
 #include <QObject>
 
+#include "httpeventsource.h"
 #include "httpserver.h"
 #include "httpresponse.h"
+#include "httpwebsocket.h"
 
 
 class HttpAPI : public QObject
@@ -12,7 +14,8 @@ class HttpAPI : public QObject
     Q_OBJECT
 
 public:
-    explicit HttpAPI(QObject* parent = nullptr);
+    // Plain HTTP is redirected to HTTPS unless redirectHttp is false
+    explicit HttpAPI(HttpServer::BACKEND backend = HttpServer::BACKEND_QT, quint16 port = 8080, bool redirectHttp = true, QObject* parent = nullptr);
     ~HttpAPI();
 
 public slots:
@@ -22,14 +25,18 @@ public slots:
 private:
     HttpServer* m_server = nullptr;
 
-    HttpResponse cbGET(const HttpRequest& request, const QString& logInfo);
-    HttpResponse cbPOST(const HttpRequest& request, const QString& logInfo);
+    // Sessions of /chat, in all worker threads
+    HttpWebSocketGroup m_chat;
+
+    // Subscribed by GET /events, fed by POST /events
+    HttpEventSource m_events;
 
     HttpResponse cbHome(const HttpRequest& request, const QString& logInfo);
     HttpResponse cbPing(const HttpRequest& request, const QString& logInfo);
     HttpResponse cbEcho(const HttpRequest& request, const QString& logInfo);
     HttpResponse cbTestGET(const HttpRequest& request, const QString& logInfo);
     HttpResponse cbTestPOST(const HttpRequest& request, const QString& logInfo);
+    HttpResponse cbStream(const HttpRequest& request, const QString& logInfo);
 };
 
 #endif // HTTPAPI_H
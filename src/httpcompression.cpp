@@ -0,0 +1,269 @@
+#include "httpcompression.h"
+
+#include <zlib.h>
+
+#ifdef HTTPSERVER_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+
+HttpCompression::HttpCompression()
+{
+    m_cache.setMaxCost(32 * 1024 * 1024);
+}
+
+void HttpCompression::setCacheSize(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.setMaxCost(bytes);
+}
+
+void HttpCompression::clearCache()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.clear();
+}
+
+void HttpCompression::compressResponse(const HttpRequest& request, HttpResponse& response)
+{
+    // Partial and error responses are sent as they are
+    if (!m_enabled || response.getStatus() != HttpResponse::OK)
+        return;
+
+    if (response.hasHeader(HttpHeaders::CONTENT_ENCODING) || response.hasHeader(HttpHeaders::CONTENT_RANGE) || response.hasHeader(HttpHeaders::TRANSFER_ENCODING))
+        return;
+
+    const qint64 bodySize = response.getBodySize();
+
+    if (bodySize < m_threshold || !isCompressible(response.getHeader(HttpHeaders::CONTENT_TYPE)))
+        return;
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-12.5.5
+    // -> Also required for the uncompressed response, caches would serve the wrong variant otherwise
+    const QByteArray vary = response.getHeader(HttpHeaders::VARY);
+
+    if (vary.isEmpty())
+        response.setRawHeader(QByteArrayLiteral("Vary"), QByteArrayLiteral("Accept-Encoding"));
+    else if (!vary.toLower().contains("accept-encoding"))
+        response.setRawHeader(QByteArrayLiteral("Vary"), vary + ", Accept-Encoding");
+
+    const ENCODING encoding = negotiate(request.getHeaderView(HttpHeaders::ACCEPT_ENCODING));
+
+    if (encoding == IDENTITY)
+        return;
+
+    QByteArray compressed;
+
+    if (response.getBodyFile())
+    {
+        if (bodySize > MAX_FILE_SIZE)
+            return;
+
+        compressed = compressFile(response, encoding);
+    }
+    else
+        compressed = compress(response.getBody(), encoding, m_level);
+
+    // Not worth it, e.g. already compressed data with a text content type
+    if (compressed.isEmpty() || compressed.size() >= bodySize)
+        return;
+
+    response.setBody(compressed);
+    response.setRawHeader(QByteArrayLiteral("Content-Encoding"), getEncodingName(encoding));
+
+    // Same as other servers: the compressed body is not byte-identical anymore,
+    // a weak ETag still matches If-None-Match of either variant
+    const QByteArray etag = response.getHeader(HttpHeaders::ETAG);
+
+    if (!etag.isEmpty() && !etag.startsWith("W/"))
+        response.setRawHeader(QByteArrayLiteral("ETag"), "W/" + etag);
+}
+
+HttpCompression::ENCODING HttpCompression::negotiate(QByteArrayView acceptEncoding)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-12.5.3
+    // Highest q-value wins, on equal values brotli > gzip > deflate
+    double qualities[BROTLI + 1] = { 0.0, -1.0, -1.0, -1.0 };
+    double wildcard = -1.0;
+
+    qsizetype pos = 0;
+
+    while (pos < acceptEncoding.size())
+    {
+        qsizetype end = acceptEncoding.indexOf(',', pos);
+
+        if (end < 0)
+            end = acceptEncoding.size();
+
+        const QByteArrayView item = acceptEncoding.sliced(pos, end - pos).trimmed();
+        pos = end + 1;
+
+        const qsizetype idxSemicolon = item.indexOf(';');
+        const QByteArrayView coding = (idxSemicolon < 0 ? item : item.first(idxSemicolon)).trimmed();
+
+        double quality = 1.0;
+
+        if (idxSemicolon >= 0)
+        {
+            const QByteArrayView parameter = item.sliced(idxSemicolon + 1).trimmed();
+
+            if (parameter.startsWith("q=") || parameter.startsWith("Q="))
+            {
+                bool ok = false;
+                quality = parameter.sliced(2).toDouble(&ok);
+
+                if (!ok)
+                    quality = 0.0;
+            }
+        }
+
+        if (coding.compare("gzip", Qt::CaseInsensitive) == 0 || coding.compare("x-gzip", Qt::CaseInsensitive) == 0)
+            qualities[GZIP] = quality;
+        else if (coding.compare("deflate", Qt::CaseInsensitive) == 0)
+            qualities[DEFLATE] = quality;
+        else if (coding.compare("br", Qt::CaseInsensitive) == 0)
+            qualities[BROTLI] = quality;
+        else if (coding == "*")
+            wildcard = quality;
+    }
+
+    ENCODING result = IDENTITY;
+    double best = 0.0;
+
+#ifdef HTTPSERVER_HAVE_BROTLI
+    const ENCODING order[] = { BROTLI, GZIP, DEFLATE };
+#else
+    const ENCODING order[] = { GZIP, DEFLATE };
+#endif
+
+    for (const ENCODING encoding : order)
+    {
+        const double quality = qualities[encoding] < 0.0 ? wildcard : qualities[encoding];
+
+        if (quality > best)
+        {
+            best = quality;
+            result = encoding;
+        }
+    }
+
+    return result;
+}
+
+QByteArray HttpCompression::compress(QByteArrayView data, ENCODING encoding, int level)
+{
+    if (encoding == GZIP || encoding == DEFLATE)
+    {
+        // HTTP "deflate" is the zlib format, gzip has its own header
+        z_stream stream = {};
+
+        if (deflateInit2(&stream, level, Z_DEFLATED, encoding == GZIP ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return QByteArray();
+
+        QByteArray result(deflateBound(&stream, data.size()), Qt::Uninitialized);
+
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = data.size();
+        stream.next_out = reinterpret_cast<Bytef*>(result.data());
+        stream.avail_out = result.size();
+
+        // Output buffer is large enough for a single call
+        const int status = deflate(&stream, Z_FINISH);
+        deflateEnd(&stream);
+
+        if (status != Z_STREAM_END)
+            return QByteArray();
+
+        result.resize(stream.total_out);
+
+        return result;
+    }
+
+#ifdef HTTPSERVER_HAVE_BROTLI
+    if (encoding == BROTLI)
+    {
+        size_t size = BrotliEncoderMaxCompressedSize(data.size());
+        QByteArray result(size, Qt::Uninitialized);
+
+        if (!BrotliEncoderCompress(level, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, data.size(),
+                                   reinterpret_cast<const uint8_t*>(data.data()), &size, reinterpret_cast<uint8_t*>(result.data())))
+            return QByteArray();
+
+        result.resize(size);
+
+        return result;
+    }
+#endif
+
+    return QByteArray();
+}
+
+QByteArray HttpCompression::getEncodingName(ENCODING encoding)
+{
+    switch (encoding)
+    {
+    case GZIP:
+        return QByteArrayLiteral("gzip");
+
+    case DEFLATE:
+        return QByteArrayLiteral("deflate");
+
+    case BROTLI:
+        return QByteArrayLiteral("br");
+
+    case IDENTITY:
+        break;
+    }
+
+    return QByteArrayLiteral("identity");
+}
+
+bool HttpCompression::isCompressible(QByteArrayView contentType)
+{
+    const qsizetype idxSemicolon = contentType.indexOf(';');
+    const QByteArrayView type = (idxSemicolon < 0 ? contentType : contentType.first(idxSemicolon)).trimmed();
+
+    if (type.startsWith("text/"))
+        return true;
+
+    for (const char* const compressible : { "application/json", "application/javascript", "application/xml", "application/wasm",
+                                            "image/svg+xml", "image/x-icon", "font/ttf", "font/otf" })
+    {
+        if (type.compare(compressible, Qt::CaseInsensitive) == 0)
+            return true;
+    }
+
+    // application/ld+json, application/rss+xml, ...
+    return type.endsWith("+json") || type.endsWith("+xml");
+}
+
+QByteArray HttpCompression::compressFile(const HttpResponse& response, ENCODING encoding)
+{
+    const HttpFileCache::File& file = *response.getBodyFile();
+
+    // The ETag changes with the file, so old versions are never returned
+    const QByteArray key = file.path.toUtf8() + '\n' + file.etag + '\n' + QByteArray::number(encoding) + '\n' + QByteArray::number(m_level);
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        const QByteArray* const cached = m_cache.object(key);
+
+        if (cached)
+            return *cached;
+    }
+
+    const QByteArray result = compress(QByteArrayView(reinterpret_cast<const char*>(file.data) + response.getBodyFileOffset(), response.getBodyFileLength()),
+                                       encoding, m_level);
+
+    if (!result.isEmpty())
+    {
+        QMutexLocker locker(&m_mutex);
+
+        m_cache.insert(key, new QByteArray(result), result.size());
+    }
+
+    return result;
+}
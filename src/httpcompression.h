@@ -0,0 +1,67 @@
+#ifndef HTTPCOMPRESSION_H
+#define HTTPCOMPRESSION_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCache>
+#include <QMutex>
+
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+// Compresses response bodies after the callback, negotiated by Accept-Encoding.
+// Compressed files are kept in a byte-bounded cache, so each version of a file is compressed once.
+// Cacheable routes are compressed once per Accept-Encoding variant by the response cache.
+class HttpCompression
+{
+public:
+    // https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/Content-Encoding
+    enum ENCODING
+    {
+        IDENTITY,
+        GZIP,
+        DEFLATE,
+        BROTLI,     // Only with HTTPSERVER_HAVE_BROTLI
+    };
+
+    HttpCompression();
+
+    void setEnabled(bool enable) { m_enabled = enable; }
+    bool isEnabled() const { return m_enabled; }
+
+    // Smaller bodies are sent uncompressed
+    void setThreshold(qint64 bytes) { m_threshold = bytes; }
+    qint64 getThreshold() const { return m_threshold; }
+
+    // 1 (fast) to 9 (small), also used as brotli quality
+    void setLevel(int level) { m_level = qBound(1, level, 9); }
+    int getLevel() const { return m_level; }
+
+    void setCacheSize(qint64 bytes);
+    void clearCache();
+
+    // Replaces the body and sets Content-Encoding and Vary
+    void compressResponse(const HttpRequest& request, HttpResponse& response);
+
+    static ENCODING negotiate(QByteArrayView acceptEncoding);
+    static QByteArray compress(QByteArrayView data, ENCODING encoding, int level);
+
+    static QByteArray getEncodingName(ENCODING encoding);
+    static bool isCompressible(QByteArrayView contentType);
+
+private:
+    // Larger files are sent uncompressed instead of being compressed into memory
+    static constexpr qint64 MAX_FILE_SIZE = 8 * 1024 * 1024;
+
+    bool m_enabled = true;
+    qint64 m_threshold = 1024;
+    int m_level = 6;
+
+    QCache<QByteArray, QByteArray> m_cache;
+    QMutex m_mutex;
+
+    QByteArray compressFile(const HttpResponse& response, ENCODING encoding);
+};
+
+#endif // HTTPCOMPRESSION_H
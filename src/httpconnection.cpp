@@ -0,0 +1,767 @@
+#include "httpconnection.h"
+
+#include "http2session.h"
+#include "httpeventsource.h"
+#include "httpserver.h"
+#include "httpwebsocket.h"
+#include "httpworker.h"
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#endif
+
+
+HttpConnection::HttpConnection(QSslSocket* socket, HttpServer* server, HttpWorker* worker) :
+    QObject(worker),
+    m_server(server),
+    m_worker(worker),
+    m_socket(socket),
+    m_timeout([this]() { timeout(); }),
+    m_logInfo(HttpServer::getLogInfo(socket)),
+    m_peer(HttpAccessLog::Peer::fromAddress(socket->peerAddress(), socket->peerPort()))
+{
+    m_socket->setParent(this);
+    m_request.setBodyLimits(m_server->getMaxBodySize(), m_server->getBodySpillThreshold());
+    m_server->m_metrics.addConnection();
+
+    connect(m_socket, &QSslSocket::readyRead, this, &HttpConnection::dataReceived);
+    connect(m_socket, &QSslSocket::bytesWritten, this, &HttpConnection::writeFile);
+    connect(m_socket, &QSslSocket::bytesWritten, this, &HttpConnection::writeStream);
+    connect(m_socket, &QSslSocket::disconnected, this, &HttpConnection::deleteLater);
+
+    // Clients that connect but never send anything
+    startTimeout(m_server->getIdleTimeout());
+}
+
+HttpConnection::~HttpConnection()
+{
+    delete m_http2;
+
+    // Before the socket, the session may still write a close frame
+    delete m_webSocket;
+    delete m_eventSubscriber;
+
+    m_server->m_metrics.removeConnection();
+    m_server->releaseConnection();
+}
+
+void HttpConnection::dataReceived()
+{
+    if (m_http2)
+    {
+        readHttp2();
+        return;
+    }
+
+    if (m_webSocket)
+    {
+        m_webSocket->readFrames();
+        startWebSocketTimeout();
+        return;
+    }
+
+    // Nothing is expected from a subscriber
+    if (m_eventSubscriber)
+    {
+        m_socket->skip(m_socket->bytesAvailable());
+        return;
+    }
+
+    // Continued once the file or stream is sent
+    if (m_file || m_producer || m_processing)
+        return;
+
+    // Socket is encrypted -> Handle HTTPS request
+    if (m_socket->isEncrypted())
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Encrypted -> HTTPS";
+
+        // https://datatracker.ietf.org/doc/html/rfc9113#section-3.2
+        // -> Negotiated by ALPN in the handshake
+        if (m_nextSequence == 0 && !m_request.isStarted() && m_server->m_enableHttp2
+            && m_socket->sslConfiguration().nextNegotiatedProtocol() == QSslConfiguration::ALPNProtocolHTTP2)
+            startHttp2();
+        else
+            readRequests();
+    }
+
+    // TLS Handshakes always starts with 22
+    // https://datatracker.ietf.org/doc/html/rfc5246
+    // -> enum ContentType is 22 for Handshake
+    else if (m_nextSequence == 0 && !m_request.isStarted() && m_socket->peek(1).startsWith(22))
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "TLS Handshake";
+
+        if (m_server->m_sslConfig.isNull())
+        {
+            qWarning() << m_logInfo << "SSL Config is invalid!";
+            m_socket->close();
+        }
+        else
+        {
+            m_socket->startServerEncryption();
+
+            // Handshake and request headers have to arrive within the header timeout
+            startTimeout(m_server->getHeaderTimeout());
+        }
+    }
+
+    // Socket is not encrypted and no TLS Handshake -> Handle HTTP request
+    else
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Unencrypted -> HTTP";
+
+        if (m_server->m_enableHttpRedirection && m_server->m_sslConfig.isNull())
+        {
+            qWarning() << m_logInfo << "SSL Config is invalid!";
+            m_socket->close();
+        }
+        else if (m_server->m_enableHttpRedirection || m_server->m_enableHttp)
+        {
+            // https://datatracker.ietf.org/doc/html/rfc9113#section-3.3
+            // -> Prior knowledge: the client starts with the preface instead of a request
+            if (m_server->m_enableHttp && m_server->m_enableHttp2 && m_nextSequence == 0 && !m_request.isStarted())
+            {
+                const QByteArrayView preface = Http2Session::getPreface();
+                const QByteArray start = m_socket->peek(preface.size());
+
+                // Wait for the rest before deciding
+                if (start.size() < preface.size() && preface.startsWith(start))
+                    return;
+
+                if (start == preface)
+                {
+                    startHttp2();
+                    return;
+                }
+            }
+
+            readRequests();
+        }
+        else
+            m_socket->close();
+    }
+}
+
+void HttpConnection::readRequests()
+{
+    // A read may contain several pipelined requests, or only part of one.
+    // Reading in blocks into a reused buffer avoids an allocation per readyRead
+    // and keeps memory flat while large bodies are spilled to disk.
+    m_readBuffer.resize(READ_BUFFER_SIZE);
+    m_processing = true;
+
+    bool started = m_request.isStarted();
+
+    while (!m_inputClosed && !m_file && !m_producer && m_responses.size() < MAX_PIPELINE_DEPTH && m_socket->isOpen())
+    {
+        if (m_readOffset == m_readSize)
+        {
+            const qint64 size = m_socket->read(m_readBuffer.data(), m_readBuffer.size());
+
+            if (size <= 0)
+                break;
+
+            m_server->m_metrics.addBytesReceived(size);
+
+            m_readOffset = 0;
+            m_readSize = size;
+        }
+
+        m_readOffset += m_request.appendData(m_readBuffer.constData() + m_readOffset, m_readSize - m_readOffset);
+
+        // Interim responses are ordered as well, behind queued responses the client sends the body without it
+        // https://datatracker.ietf.org/doc/html/rfc9110#section-10.1.1
+        if (m_request.takeContinueExpectation() && m_responses.isEmpty())
+        {
+            m_writeBuffer.append(QByteArrayLiteral("HTTP/1.1 100 Continue\r\n\r\n"));
+            flushWriteBuffer();
+        }
+
+        if (m_request.isComplete() || m_request.getParseState() == HttpRequest::ERROR)
+        {
+            dispatchRequest();
+
+            m_request.reset();
+            started = false;
+        }
+    }
+
+    m_processing = false;
+
+    flushWriteBuffer();
+
+    // Files, streams, WebSocket sessions and event streams have their own timeout
+    if (!m_socket->isOpen() || m_file || m_producer || m_webSocket || m_eventSubscriber)
+        return;
+
+    // The header timeout runs from the first byte of the request, the body timeout from the last read
+    if (m_request.getParseState() == HttpRequest::BODY)
+        startTimeout(m_server->getBodyTimeout());
+    else if (m_request.isStarted())
+    {
+        if (!started)
+            startTimeout(m_server->getHeaderTimeout());
+    }
+
+    // Waiting for the server is not idle
+    else if (!m_responses.isEmpty())
+        m_timeout.stop();
+    else
+        startTimeout(m_server->getKeepAliveTimeout());
+}
+
+void HttpConnection::dispatchRequest()
+{
+    const quint64 sequence = m_nextSequence++;
+
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-9.6
+    // -> Requests behind the last one of the connection are not processed
+    if (!m_server->isKeepAlive(m_request, m_requestCount + m_responses.size() + 1))
+        m_inputClosed = true;
+
+    m_requestTimer.start();
+    m_routeMetrics = nullptr;
+
+    HttpResponse response;
+
+    if (m_request.getParseState() == HttpRequest::ERROR)
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Request invalid!";
+
+        response = HttpServer::getParseErrorResponse(m_request);
+    }
+
+    // Redirect HTTP to HTTPS
+    else if (!m_socket->isEncrypted() && m_server->m_enableHttpRedirection)
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Redirecting HTTP to HTTPS";
+
+        response = m_server->getRedirectResponse(m_request);
+    }
+
+    // Cached response, already serialized -> only if no earlier response is pending
+    else if (m_responses.isEmpty() && sendCachedResponse(m_request))
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Cached response";
+        return;
+    }
+
+    // Handle HTTP(S) Request
+    else
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Handling Request";
+
+        QFuture<HttpResponse> pending;
+
+        if (!m_server->handleHttpRequest(m_request, m_logInfo, response, pending, m_routeMetrics))
+        {
+            if (!pending.isFinished())
+            {
+                queueResponse(sequence, HttpResponse(), false);
+
+                // Called in the thread of the connection, not at all if it is deleted before
+                pending.then(this, [this, sequence](HttpResponse result) { responseReady(sequence, result); });
+
+                return;
+            }
+
+            response = pending.result();
+        }
+    }
+
+    if (m_responses.isEmpty())
+        sendResponse(m_request, response);
+    else
+        queueResponse(sequence, response, true);
+}
+
+void HttpConnection::queueResponse(quint64 sequence, const HttpResponse& response, bool ready)
+{
+    // m_request is reused for the next request
+    QueuedResponse item;
+    item.sequence = sequence;
+    item.ready = ready;
+    item.request = m_request;
+    item.response = response;
+    item.requestTimer = m_requestTimer;
+    item.routeMetrics = m_routeMetrics;
+
+    m_responses.append(item);
+}
+
+void HttpConnection::responseReady(quint64 sequence, const HttpResponse& response)
+{
+    // Dropped if the connection is closed by an earlier response
+    for (QueuedResponse& item : m_responses)
+    {
+        if (item.sequence == sequence)
+        {
+            item.response = response;
+            item.ready = true;
+            break;
+        }
+    }
+
+    continueResponses();
+}
+
+void HttpConnection::sendQueuedResponses()
+{
+    // Up to the first one still pending, or until a file or streamed body has to be sent first
+    while (!m_responses.isEmpty() && m_responses.first().ready && !m_file && !m_producer && m_socket->isOpen())
+    {
+        QueuedResponse item = m_responses.takeFirst();
+
+        m_requestTimer = item.requestTimer;
+        m_routeMetrics = item.routeMetrics;
+
+        sendResponse(item.request, item.response);
+    }
+}
+
+void HttpConnection::continueResponses()
+{
+    // Nested in readRequests() or sendQueuedResponses(), which carry on themselves
+    if (m_processing)
+        return;
+
+    m_processing = true;
+    sendQueuedResponses();
+    m_processing = false;
+
+    flushWriteBuffer();
+
+    if (!m_socket->isOpen() || m_file || m_producer || m_webSocket || m_eventSubscriber)
+        return;
+
+    // Requests left in the buffer or the socket while the responses were pending
+    if (m_readOffset < m_readSize || m_socket->bytesAvailable() > 0)
+        QMetaObject::invokeMethod(this, &HttpConnection::dataReceived, Qt::QueuedConnection);
+}
+
+void HttpConnection::flushWriteBuffer()
+{
+    if (m_writeBuffer.isEmpty())
+        return;
+
+    m_socket->write(m_writeBuffer);
+    m_writeBuffer.clear();
+}
+
+void HttpConnection::startTimeout(int msec)
+{
+    m_worker->startTimeout(&m_timeout, msec);
+}
+
+void HttpConnection::timeout()
+{
+    // Idle HTTP/2 connections are closed gracefully, stalled ones are aborted
+    if (m_http2)
+    {
+        if (m_http2->isIdle() && m_socket->bytesToWrite() == 0)
+        {
+            qCDebug(lcHttpServer) << m_logInfo << "HTTP/2 Keep-Alive Timeout";
+
+            m_http2->goAway();
+            writeHttp2();
+        }
+        else
+        {
+            qCDebug(lcHttpServer) << m_logInfo << "HTTP/2 Idle Timeout";
+
+            m_socket->abort();
+        }
+
+        return;
+    }
+
+    // Silent WebSocket clients are pinged once, closed if they do not answer either
+    if (m_webSocket)
+    {
+        if (m_webSocket->checkAlive())
+            startTimeout(m_webSocket->getPingInterval());
+        else
+        {
+            qCDebug(lcHttpServer) << m_logInfo << "WebSocket Timeout";
+
+            m_socket->abort();
+        }
+
+        return;
+    }
+
+    if (m_eventSubscriber)
+    {
+        m_eventSubscriber->sendKeepAlive();
+        startTimeout(m_eventSubscriber->getKeepAliveInterval());
+        return;
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-15.5.9
+    // -> A partly received request is answered, idle connections and handshakes are just closed
+    // -> Only if no earlier response is pending, it has to be sent in order
+    if (m_request.isStarted() && !m_request.isComplete() && m_responses.isEmpty() && !m_file && !m_producer
+        && (m_socket->isEncrypted() || m_socket->mode() == QSslSocket::UnencryptedMode))
+    {
+        qCDebug(lcHttpServer) << m_logInfo << "Request Timeout";
+
+        m_requestTimer.start();
+        m_routeMetrics = nullptr;
+
+        HttpResponse response(HttpResponse::REQUEST_TIMEOUT);
+        sendResponse(m_request, response);
+        flushWriteBuffer();
+
+        m_request.reset();
+        return;
+    }
+
+    qCDebug(lcHttpServer) << m_logInfo << "Idle Timeout";
+
+    // Unwritten data of a stalled client would keep the socket open
+    if (m_socket->bytesToWrite() > 0 || m_file || m_producer)
+        m_socket->abort();
+    else
+        m_socket->close();
+}
+
+void HttpConnection::sendResponse(const HttpRequest& request, HttpResponse& response)
+{
+    ++m_requestCount;
+
+    const bool keepAlive = m_server->finishResponse(request, response, m_requestCount);
+
+    const QByteArray data = response.getRawData();
+    m_writeBuffer.append(data);
+
+    m_server->m_metrics.addBytesSent(data.size() + (response.hasBodyFile() ? response.getBodyFileLength() : 0));
+    recordResponse(request, response.getStatus(), response.getBodySize());
+
+    if (response.getStatus() == HttpResponse::SWITCHING_PROTOCOLS && response.getWebSocketHandler())
+    {
+        flushWriteBuffer();
+        startWebSocket(request, response);
+    }
+    else if (response.getEventSource() && !response.getOmitBody())
+    {
+        flushWriteBuffer();
+        startEventStream(request, response);
+    }
+    else if (response.hasBodyFile() && response.getBodyFileLength() > 0)
+    {
+        m_file = response.getBodyFile();
+        m_fileOffset = response.getBodyFileOffset();
+        m_fileRemaining = response.getBodyFileLength();
+        m_keepAliveAfterBody = keepAlive;
+
+        flushWriteBuffer();
+        writeFile();
+    }
+    else if (response.hasBodyProducer())
+    {
+        m_producer = response.getBodyProducer();
+        m_chunked = response.hasHeader(HttpHeaders::TRANSFER_ENCODING);
+        m_keepAliveAfterBody = keepAlive;
+
+        flushWriteBuffer();
+        writeStream();
+    }
+    else
+        responseFinished(keepAlive);
+}
+
+bool HttpConnection::sendCachedResponse(const HttpRequest& request)
+{
+    QByteArray data;
+    bool keepAlive = false;
+
+    const HttpResponseCache::EntryPtr entry = m_server->getCachedResponse(request, m_requestCount + 1, data, keepAlive);
+
+    if (!entry)
+        return false;
+
+    ++m_requestCount;
+
+    m_writeBuffer.append(data);
+
+    m_routeMetrics = entry->metrics;
+    m_server->m_metrics.addBytesSent(data.size());
+    recordResponse(request, entry->status, entry->body.size());
+    responseFinished(keepAlive);
+
+    return true;
+}
+
+void HttpConnection::recordResponse(const HttpRequest& request, int status, qint64 bytes)
+{
+    m_server->recordResponse(m_peer, request, m_routeMetrics, status, bytes, m_requestTimer);
+}
+
+void HttpConnection::responseFinished(bool keepAlive)
+{
+    if (keepAlive)
+    {
+        // A started request keeps its header or body timeout
+        if (m_request.isStarted())
+            return;
+
+        if (m_responses.isEmpty())
+            startTimeout(m_server->getKeepAliveTimeout());
+        else
+            m_timeout.stop();
+    }
+    else
+    {
+        // Pipelined requests behind it are not answered
+        m_responses.clear();
+        m_inputClosed = true;
+
+        flushWriteBuffer();
+        m_socket->close();
+
+        // Until the rest is written and the socket is disconnected
+        startTimeout(m_server->getIdleTimeout());
+    }
+}
+
+void HttpConnection::writeFile()
+{
+    if (!m_file)
+        return;
+
+    // Stalled clients are closed by the idle timeout
+    startTimeout(m_server->getIdleTimeout());
+
+#ifdef Q_OS_LINUX
+    // Plain HTTP: the kernel copies from the page cache to the socket.
+    // sendfile() bypasses the buffer of the socket, so that has to be written first.
+    if (!m_socket->isEncrypted())
+    {
+        // flush() may emit bytesWritten, which already continues here
+        if (m_socket->bytesToWrite() > 0)
+            m_socket->flush();
+
+        // Continued by bytesWritten
+        if (!m_file || m_socket->bytesToWrite() > 0)
+            return;
+
+        while (m_fileRemaining > 0)
+        {
+            const qint64 size = HttpFileCache::sendToSocket(m_socket->socketDescriptor(), *m_file, m_fileOffset, qMin(m_fileRemaining, FILE_CHUNK_SIZE));
+
+            if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                if (!m_writeNotifier)
+                {
+                    m_writeNotifier = new QSocketNotifier(m_socket->socketDescriptor(), QSocketNotifier::Write, this);
+                    connect(m_writeNotifier, &QSocketNotifier::activated, this, &HttpConnection::writeFile);
+                }
+
+                m_writeNotifier->setEnabled(true);
+                return;
+            }
+
+            // Error or file truncated in the meantime -> Content-Length cannot be kept
+            if (size <= 0)
+            {
+                qCDebug(lcHttpServer) << m_logInfo << "Cannot send file:" << m_file->path;
+
+                m_file.reset();
+                m_socket->abort();
+                return;
+            }
+
+            m_fileOffset += size;
+            m_fileRemaining -= size;
+        }
+
+        if (m_writeNotifier)
+            m_writeNotifier->setEnabled(false);
+    }
+    else
+#endif
+    {
+        // TLS has to encrypt in user space anyway -> write from the mapping, bounded by the socket buffer
+        while (m_fileRemaining > 0 && m_socket->bytesToWrite() < FILE_CHUNK_SIZE)
+        {
+            const qint64 size = qMin(m_fileRemaining, FILE_CHUNK_SIZE);
+
+            m_socket->write(reinterpret_cast<const char*>(m_file->data) + m_fileOffset, size);
+
+            m_fileOffset += size;
+            m_fileRemaining -= size;
+        }
+
+        if (m_fileRemaining > 0)
+            return;
+    }
+
+    m_file.reset();
+
+    responseFinished(m_keepAliveAfterBody);
+    continueResponses();
+}
+
+void HttpConnection::writeStream()
+{
+    if (!m_producer)
+        return;
+
+    // Stalled clients are closed by the idle timeout
+    startTimeout(m_server->getIdleTimeout());
+
+    // Paced by bytesWritten, so at most one chunk more than the limit is buffered
+    while (m_socket->bytesToWrite() < STREAM_BUFFER_SIZE)
+    {
+        const QByteArray data = m_producer();
+
+        if (m_chunked)
+        {
+            m_chunkBuffer.resize(0);
+            HttpResponse::appendChunk(m_chunkBuffer, data);
+            m_socket->write(m_chunkBuffer);
+
+            m_server->m_metrics.addBytesSent(m_chunkBuffer.size());
+        }
+        else if (!data.isEmpty())
+        {
+            m_socket->write(data);
+
+            m_server->m_metrics.addBytesSent(data.size());
+        }
+
+        if (data.isEmpty())
+        {
+            m_producer = nullptr;
+            m_chunkBuffer = QByteArray();
+
+            responseFinished(m_keepAliveAfterBody);
+            continueResponses();
+            return;
+        }
+    }
+}
+
+void HttpConnection::startHttp2()
+{
+    qCDebug(lcHttpServer) << m_logInfo << "HTTP/2";
+
+    m_http2 = new Http2Session(m_server, this, m_logInfo, m_peer, m_socket->isEncrypted());
+    m_http2->setOutputCallback([this]() { writeHttp2(); });
+
+    connect(m_socket, &QSslSocket::bytesWritten, this, &HttpConnection::writeHttp2);
+
+    readHttp2();
+}
+
+void HttpConnection::readHttp2()
+{
+    m_readBuffer.resize(READ_BUFFER_SIZE);
+
+    // Stops at a connection error, the GOAWAY frame is written below
+    while (m_socket->isOpen())
+    {
+        const qint64 size = m_socket->read(m_readBuffer.data(), m_readBuffer.size());
+
+        if (size <= 0)
+            break;
+
+        m_server->m_metrics.addBytesReceived(size);
+
+        if (!m_http2->receive(m_readBuffer.constData(), size))
+            break;
+    }
+
+    writeHttp2();
+}
+
+void HttpConnection::writeHttp2()
+{
+    if (!m_http2 || !m_socket->isOpen())
+        return;
+
+    // Paced by bytesWritten like streamed bodies, control frames are always taken
+    const QByteArray data = m_http2->takeOutput(STREAM_BUFFER_SIZE - m_socket->bytesToWrite());
+
+    if (!data.isEmpty())
+    {
+        m_socket->write(data);
+
+        m_server->m_metrics.addBytesSent(data.size());
+    }
+
+    if (m_http2->isFinished())
+    {
+        m_socket->close();
+
+        // Until the rest is written and the socket is disconnected
+        startTimeout(m_server->getIdleTimeout());
+    }
+    else if (m_http2->isIdle())
+        startTimeout(m_server->getKeepAliveTimeout());
+
+    // Stalled clients are closed by the idle timeout, handlers are waited for
+    else if (m_http2->isSending() || m_socket->bytesToWrite() > 0)
+        startTimeout(m_server->getIdleTimeout());
+    else
+        m_timeout.stop();
+}
+
+void HttpConnection::startWebSocket(const HttpRequest& request, const HttpResponse& response)
+{
+    qCDebug(lcHttpServer) << m_logInfo << "WebSocket";
+
+    // Nothing behind the handshake is HTTP
+    m_responses.clear();
+    m_inputClosed = true;
+    m_timeout.stop();
+
+    m_webSocket = new HttpWebSocket(m_socket, m_server, m_worker, response);
+
+    // Frames read along with the handshake
+    QByteArray rest;
+
+    if (m_readOffset < m_readSize)
+        rest = m_readBuffer.sliced(m_readOffset, m_readSize - m_readOffset);
+
+    // The session reads with a buffer of the thread, an idle connection keeps none
+    m_readBuffer = QByteArray();
+    m_readOffset = 0;
+    m_readSize = 0;
+    m_writeBuffer = QByteArray();
+
+    m_webSocket->start(request, rest);
+
+    startWebSocketTimeout();
+}
+
+void HttpConnection::startWebSocketTimeout()
+{
+    // Restarted by every read. The close handshake has to finish within the idle timeout.
+    if (m_webSocket->isOpen())
+        startTimeout(m_webSocket->getPingInterval());
+    else
+        startTimeout(m_server->getIdleTimeout());
+}
+
+void HttpConnection::startEventStream(const HttpRequest& request, const HttpResponse& response)
+{
+    qCDebug(lcHttpServer) << m_logInfo << "Event Stream";
+
+    // Nothing behind the request is read
+    m_responses.clear();
+    m_inputClosed = true;
+
+    m_eventSubscriber = new HttpEventSubscriber(m_socket, m_server, m_worker, response.getEventSource());
+
+    // An idle subscriber keeps no buffers
+    m_readBuffer = QByteArray();
+    m_readOffset = 0;
+    m_readSize = 0;
+    m_writeBuffer = QByteArray();
+
+    m_eventSubscriber->start(request);
+
+    startTimeout(m_eventSubscriber->getKeepAliveInterval());
+}
@@ -0,0 +1,143 @@
+#ifndef HTTPCONNECTION_H
+#define HTTPCONNECTION_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSocketNotifier>
+#include <QSslSocket>
+
+#include "httpaccesslog.h"
+#include "httpfilecache.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "httptimerwheel.h"
+
+
+class HttpServer;
+class HttpWorker;
+class HttpRouteMetrics;
+class Http2Session;
+class HttpWebSocket;
+class HttpEventSubscriber;
+
+
+class HttpConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HttpConnection(QSslSocket* socket, HttpServer* server, HttpWorker* worker);
+    ~HttpConnection();
+
+    QSslSocket* getSocket() const { return m_socket; }
+    const QString& getLogInfo() const { return m_logInfo; }
+
+private slots:
+    void dataReceived();
+    void writeFile();
+    void writeStream();
+    void writeHttp2();
+
+private:
+    HttpServer* m_server = nullptr;
+    HttpWorker* m_worker = nullptr;
+    QSslSocket* m_socket = nullptr;
+
+    // Idle, header, body or keep-alive timeout, whichever applies at the moment
+    HttpTimerWheel::Timer m_timeout;
+
+    QString m_logInfo;
+    HttpAccessLog::Peer m_peer;
+
+    // Since the request was read completely, for the latency in the metrics and access log
+    QElapsedTimer m_requestTimer;
+    HttpRouteMetrics* m_routeMetrics = nullptr;
+
+    static constexpr qint64 READ_BUFFER_SIZE = 64 * 1024;
+
+    // Bytes behind a complete request stay in the buffer for the next one
+    QByteArray m_readBuffer;
+    qsizetype m_readOffset = 0;
+    qsizetype m_readSize = 0;
+
+    HttpRequest m_request;
+    int m_requestCount = 0;
+
+    // Connection: close or an invalid request, nothing behind it is parsed
+    bool m_inputClosed = false;
+
+    // Pipelined requests are dispatched as soon as they are complete, their responses are written in request order.
+    // A response waits here while an earlier one is still pending (async callback, file or streamed body).
+    static constexpr int MAX_PIPELINE_DEPTH = 16;
+
+    struct QueuedResponse
+    {
+        quint64 sequence = 0;
+        bool ready = false;
+
+        HttpRequest request;
+        HttpResponse response;
+
+        QElapsedTimer requestTimer;
+        HttpRouteMetrics* routeMetrics = nullptr;
+    };
+
+    QList<QueuedResponse> m_responses;
+    quint64 m_nextSequence = 0;
+
+    // Responses of one read are written at once
+    QByteArray m_writeBuffer;
+
+    // Set while requests or queued responses are processed, nested calls leave the rest to the outer loop
+    bool m_processing = false;
+
+    // File body still being sent, further requests wait until it is done
+    static constexpr qint64 FILE_CHUNK_SIZE = 256 * 1024;
+
+    HttpFileCache::FilePtr m_file;
+    qint64 m_fileOffset = 0;
+    qint64 m_fileRemaining = 0;
+    QSocketNotifier* m_writeNotifier = nullptr;
+
+    // Streamed body, produced while less than STREAM_BUFFER_SIZE is waiting in the socket
+    static constexpr qint64 STREAM_BUFFER_SIZE = 64 * 1024;
+
+    HttpResponse::BodyProducer m_producer;
+    bool m_chunked = false;
+    QByteArray m_chunkBuffer;
+
+    bool m_keepAliveAfterBody = false;
+
+    // Set once the connection speaks HTTP/2, which replaces everything above for requests
+    Http2Session* m_http2 = nullptr;
+
+    // Set after a WebSocket handshake, the socket belongs to the session from then on
+    HttpWebSocket* m_webSocket = nullptr;
+
+    // Set after the headers of an event stream, the socket belongs to the subscriber from then on
+    HttpEventSubscriber* m_eventSubscriber = nullptr;
+
+    void readRequests();
+    void dispatchRequest();
+    void queueResponse(quint64 sequence, const HttpResponse& response, bool ready);
+    void responseReady(quint64 sequence, const HttpResponse& response);
+    void sendQueuedResponses();
+    void continueResponses();
+    void flushWriteBuffer();
+    void startTimeout(int msec);
+    void timeout();
+    void sendResponse(const HttpRequest& request, HttpResponse& response);
+    bool sendCachedResponse(const HttpRequest& request);
+    void responseFinished(bool keepAlive);
+    void recordResponse(const HttpRequest& request, int status, qint64 bytes);
+
+    void startHttp2();
+    void readHttp2();
+
+    void startWebSocket(const HttpRequest& request, const HttpResponse& response);
+    void startWebSocketTimeout();
+
+    void startEventStream(const HttpRequest& request, const HttpResponse& response);
+};
+
+#endif // HTTPCONNECTION_H
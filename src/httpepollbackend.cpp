@@ -0,0 +1,1022 @@
+#include "httpepollbackend.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <memory>
+#include <utility>
+
+#include "httpserver.h"
+#include "httptimerwheel.h"
+
+#ifdef HTTPSERVER_HAVE_OPENSSL
+#include "httptlscontext.h"
+#endif
+
+#ifdef Q_OS_LINUX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#endif
+
+
+// Responses of async callbacks, appended by the thread finishing the future.
+// Shared with the futures, which may finish after the loop is gone.
+struct HttpEpollBackend::ResponseQueue
+{
+    QMutex mutex;
+    int wakeFd = -1;
+    bool closed = false;
+
+    struct Item
+    {
+        int fd = -1;
+        quint64 connectionId = 0;
+        HttpResponse response;
+    };
+
+    QList<Item> items;
+};
+
+struct HttpEpollBackend::Loop
+{
+    int epollFd = -1;
+    int listenFd = -1;
+    int wakeFd = -1;
+
+    quint16 port = 0;
+
+    // wakeFd is also used by async responses
+    QAtomicInt stopping = 0;
+    std::shared_ptr<ResponseQueue> responses;
+
+    QHash<int, Connection*> connections;
+    quint64 nextConnectionId = 0;
+
+    // Time of the current iteration in ms
+    qint64 now = 0;
+    HttpTimerWheel timers;
+
+    // Listener removed from epoll at the connection limit
+    bool acceptPaused = false;
+};
+
+struct HttpEpollBackend::Connection
+{
+    int fd = -1;
+    quint64 id = 0;
+    QString logInfo;
+    HttpAccessLog::Peer peer;
+
+    // Decided by the first byte, like HttpConnection
+    bool tlsChecked = false;
+    HttpTlsSession* tls = nullptr;
+
+    HttpRequest request;
+    int requestCount = 0;
+
+    // Since the request was read completely, for the latency in the metrics and access log
+    QElapsedTimer requestTimer;
+    HttpRouteMetrics* routeMetrics = nullptr;
+
+    // Async callback still running for request. Input behind it is parsed once the response is sent,
+    // the socket is not read until then.
+    bool waitingForResponse = false;
+    QByteArray pendingInput;
+
+    QByteArray writeBuffer;
+    qsizetype writeOffset = 0;
+    bool closeAfterWrite = false;
+
+    // Responses in writeBuffer and bodies since it was last drained. Above the limits the input is
+    // held back in pendingInput and the socket not read until everything is sent.
+    int queuedResponses = 0;
+    bool inputPaused = false;
+
+    // Half-closed by the client, what was received before is still answered
+    bool inputClosed = false;
+
+    // File and streamed bodies are sent when writeBuffer reaches their position, which keeps pipelined responses in order
+    struct PendingBody
+    {
+        qsizetype position = 0;
+
+        HttpFileCache::FilePtr file;
+        qint64 offset = 0;
+        qint64 remaining = 0;
+
+        // The chunk is sent completely before the producer is called again
+        HttpResponse::BodyProducer producer;
+        bool chunked = false;
+        QByteArray chunk;
+        qsizetype chunkOffset = 0;
+    };
+
+    QList<PendingBody> bodies;
+
+    // Phase of the connection the timeout belongs to
+    enum TIMEOUT
+    {
+        TIMEOUT_NONE,           // Waiting for an async response
+        TIMEOUT_IDLE,           // Nothing received yet
+        TIMEOUT_HEADER,         // From the first byte of the request (or of the TLS handshake)
+        TIMEOUT_BODY,           // Restarted by every read
+        TIMEOUT_WRITE,          // Restarted by every write, uses the idle timeout
+        TIMEOUT_KEEP_ALIVE,     // Between requests
+    };
+
+    TIMEOUT timeoutPhase = TIMEOUT_NONE;
+    HttpTimerWheel::Timer timeout;
+};
+
+
+HttpEpollBackend::HttpEpollBackend(HttpServer* server) :
+    m_server(server)
+{
+
+}
+
+HttpEpollBackend::~HttpEpollBackend()
+{
+    stop();
+}
+
+bool HttpEpollBackend::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef Q_OS_LINUX
+
+bool HttpEpollBackend::start(const QHostAddress& address, quint16 port, int threadCount)
+{
+    if (isRunning())
+        return true;
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        Loop* const loop = new Loop();
+        loop->port = port;
+        loop->listenFd = createListener(address, port);
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (loop->listenFd < 0 || loop->epollFd < 0 || loop->wakeFd < 0)
+        {
+            qWarning() << "Cannot create epoll loop:" << strerror(errno);
+
+            for (const int fd : { loop->listenFd, loop->epollFd, loop->wakeFd })
+            {
+                if (fd >= 0)
+                    ::close(fd);
+            }
+
+            delete loop;
+            stop();
+            return false;
+        }
+
+        loop->responses = std::make_shared<ResponseQueue>();
+        loop->responses->wakeFd = loop->wakeFd;
+
+        epoll_event event = {};
+
+        // Edge-triggered, accept() is repeated until EAGAIN
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = loop->listenFd;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->listenFd, &event);
+
+        event.events = EPOLLIN;
+        event.data.fd = loop->wakeFd;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &event);
+
+        QThread* const thread = QThread::create([this, loop]() { run(loop); });
+        thread->setObjectName("HttpEpoll" + QString::number(i));
+
+        m_loops.append(loop);
+        m_threads.append(thread);
+
+        thread->start();
+    }
+
+    return true;
+}
+
+void HttpEpollBackend::stop()
+{
+    for (Loop* const loop : std::as_const(m_loops))
+    {
+        const quint64 value = 1;
+
+        loop->stopping.storeRelaxed(1);
+
+        if (::write(loop->wakeFd, &value, sizeof(value)) < 0)
+            qWarning() << "Cannot wake epoll loop:" << strerror(errno);
+    }
+
+    for (QThread* const thread : std::as_const(m_threads))
+    {
+        thread->wait();
+        delete thread;
+    }
+
+    for (Loop* const loop : std::as_const(m_loops))
+    {
+        {
+            QMutexLocker locker(&loop->responses->mutex);
+            loop->responses->closed = true;
+        }
+
+        ::close(loop->listenFd);
+        ::close(loop->epollFd);
+        ::close(loop->wakeFd);
+
+        delete loop;
+    }
+
+    m_threads.clear();
+    m_loops.clear();
+}
+
+int HttpEpollBackend::createListener(const QHostAddress& address, quint16 port)
+{
+    sockaddr_storage addr = {};
+    socklen_t addrLength = 0;
+
+    if (address.protocol() == QAbstractSocket::IPv4Protocol)
+    {
+        sockaddr_in* const addr4 = reinterpret_cast<sockaddr_in*>(&addr);
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        addr4->sin_addr.s_addr = htonl(address.toIPv4Address());
+        addrLength = sizeof(sockaddr_in);
+    }
+    else
+    {
+        // QHostAddress::Any -> dual stack
+        sockaddr_in6* const addr6 = reinterpret_cast<sockaddr_in6*>(&addr);
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+
+        if (address == QHostAddress::Any)
+            addr6->sin6_addr = in6addr_any;
+        else
+        {
+            const Q_IPV6ADDR ip6 = address.toIPv6Address();
+            memcpy(&addr6->sin6_addr, &ip6, sizeof(ip6));
+        }
+
+        addrLength = sizeof(sockaddr_in6);
+    }
+
+    const int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0)
+        return -1;
+
+    const int on = 1;
+    const int off = 0;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+    if (addr.ss_family == AF_INET6 && address == QHostAddress::Any)
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), addrLength) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void HttpEpollBackend::run(Loop* loop)
+{
+    // OpenSSL writes to the socket without MSG_NOSIGNAL, a closed peer would terminate the process otherwise.
+    // Only this thread is affected, the signal handling of the application is left alone.
+    sigset_t pipeSet;
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSet, nullptr);
+
+    // Reused for every read of this loop
+    QByteArray readBuffer(READ_BUFFER_SIZE, Qt::Uninitialized);
+    epoll_event events[MAX_EVENTS];
+
+    QElapsedTimer clock;
+    clock.start();
+
+    bool running = true;
+
+    while (running)
+    {
+        // Woken for the next timeout only, not periodically
+        const qint64 nextTimeout = loop->timers.getNextTimeout(clock.elapsed());
+        int waitTimeout = nextTimeout < 0 ? -1 : int(nextTimeout);
+
+        if (loop->acceptPaused && (waitTimeout < 0 || waitTimeout > RESUME_INTERVAL))
+            waitTimeout = RESUME_INTERVAL;
+
+        const int count = epoll_wait(loop->epollFd, events, MAX_EVENTS, waitTimeout);
+
+        if (count < 0 && errno != EINTR)
+        {
+            qWarning() << "epoll_wait failed:" << strerror(errno);
+            break;
+        }
+
+        loop->now = clock.elapsed();
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int fd = events[i].data.fd;
+
+            if (fd == loop->wakeFd)
+            {
+                quint64 value = 0;
+
+                // Resets the counter, the descriptor is level-triggered
+                if (::read(loop->wakeFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                    qWarning() << "Cannot read wake event:" << strerror(errno);
+
+                if (loop->stopping.loadRelaxed())
+                {
+                    running = false;
+                    break;
+                }
+
+                handleAsyncResponses(loop, readBuffer);
+                continue;
+            }
+
+            if (fd == loop->listenFd)
+            {
+                acceptConnections(loop);
+                continue;
+            }
+
+            Connection* const connection = loop->connections.value(fd, nullptr);
+
+            if (!connection)
+                continue;
+
+            bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP));
+
+            // The handshake may also continue on EPOLLOUT
+            if (ok && ((events[i].events & EPOLLIN) || isHandshaking(connection)))
+                ok = readConnection(loop, connection, readBuffer);
+
+            if (ok && (events[i].events & EPOLLOUT))
+                ok = writeConnection(connection);
+
+            // Continues with the input held back once the queued responses are sent
+            if (ok && connection->inputPaused && connection->queuedResponses == 0)
+                ok = readConnection(loop, connection, readBuffer);
+
+            if (ok)
+                updateTimeout(loop, connection);
+            else
+                closeConnection(loop, connection);
+        }
+
+        if (!running)
+            break;
+
+        // Connections timing out are closed from here
+        loop->timers.advance(loop->now);
+
+        if (loop->acceptPaused && !m_server->isAtConnectionLimit())
+            resumeAccepting(loop);
+    }
+
+    const QList<Connection*> listConnections = loop->connections.values();
+
+    for (Connection* const connection : listConnections)
+        closeConnection(loop, connection);
+}
+
+void HttpEpollBackend::acceptConnections(Loop* loop)
+{
+    forever
+    {
+        // Further connections wait in the backlog, resumed by run()
+        if (m_server->m_overflowPolicy == HttpServer::PAUSE_ACCEPTING && m_server->isAtConnectionLimit())
+        {
+            pauseAccepting(loop);
+            return;
+        }
+
+        sockaddr_storage addr = {};
+        socklen_t addrLength = sizeof(addr);
+
+        const int fd = accept4(loop->listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                qWarning() << "accept failed:" << strerror(errno);
+
+            return;
+        }
+
+        if (!m_server->m_enableHttp && !m_server->m_enableHttpRedirection && !m_server->m_tlsContext)
+        {
+            ::close(fd);
+            continue;
+        }
+
+        // REJECT, or another loop reached the limit in the meantime.
+        // Plain text, a TLS client only sees the connection closed.
+        if (!m_server->acquireConnection())
+        {
+            const QByteArray response = HttpServer::getOverloadResponse();
+
+            if (::send(fd, response.constData(), response.size(), MSG_NOSIGNAL | MSG_DONTWAIT) < 0)
+                qCDebug(lcHttpServer) << "Cannot send 503:" << strerror(errno);
+
+            ::close(fd);
+            continue;
+        }
+
+        const int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        const QHostAddress peerAddress(reinterpret_cast<sockaddr*>(&addr));
+        const quint16 peerPort = ntohs(addr.ss_family == AF_INET ? reinterpret_cast<sockaddr_in*>(&addr)->sin_port
+                                                                 : reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port);
+
+        Connection* const connection = new Connection();
+        connection->fd = fd;
+        connection->id = ++loop->nextConnectionId;
+        connection->request.setBodyLimits(m_server->getMaxBodySize(), m_server->getBodySpillThreshold());
+        connection->timeout.setCallback([this, loop, connection]() { timeoutConnection(loop, connection); });
+        connection->logInfo = QString::number(loop->port) + ":" + peerAddress.toString() + ":" + QString::number(peerPort);
+        connection->peer = HttpAccessLog::Peer::fromAddress(peerAddress, peerPort);
+
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+
+        if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            ::close(fd);
+            delete connection;
+
+            m_server->releaseConnection();
+            continue;
+        }
+
+        loop->connections.insert(fd, connection);
+        m_server->m_metrics.addConnection();
+
+        updateTimeout(loop, connection);
+    }
+}
+
+void HttpEpollBackend::pauseAccepting(Loop* loop)
+{
+    if (loop->acceptPaused)
+        return;
+
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, loop->listenFd, nullptr);
+    loop->acceptPaused = true;
+}
+
+void HttpEpollBackend::resumeAccepting(Loop* loop)
+{
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = loop->listenFd;
+
+    epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->listenFd, &event);
+    loop->acceptPaused = false;
+
+    // Edge-triggered, connections queued in the meantime would not be reported
+    acceptConnections(loop);
+}
+
+bool HttpEpollBackend::readConnection(Loop* loop, Connection* connection, QByteArray& buffer)
+{
+    if (!connection->tlsChecked)
+    {
+        char first = 0;
+        const ssize_t size = ::recv(connection->fd, &first, 1, MSG_PEEK);
+
+        if (size == 0)
+            return false;
+
+        if (size < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+        connection->tlsChecked = true;
+
+        // TLS Handshakes always starts with 22
+        if (first == 22)
+        {
+#ifdef HTTPSERVER_HAVE_OPENSSL
+            if (m_server->m_tlsContext)
+                connection->tls = m_server->m_tlsContext->createSession(connection->fd);
+#endif
+
+            if (!connection->tls)
+                return false;
+        }
+        else if (!m_server->m_enableHttp && !m_server->m_enableHttpRedirection)
+            return false;
+    }
+
+#ifdef HTTPSERVER_HAVE_OPENSSL
+    if (isHandshaking(connection))
+    {
+        const int result = connection->tls->handshake();
+
+        if (result != 1)
+            return result < 0 && errno == EAGAIN;
+
+        m_server->countHandshake(connection->tls->isResumed());
+    }
+#endif
+
+    forever
+    {
+        // Edge-triggered -> read until the socket is drained.
+        // Continued by handleAsyncResponses() while an async response is pending.
+        while (!connection->waitingForResponse && !connection->inputPaused && !connection->inputClosed)
+        {
+            const qint64 size = receive(connection, buffer.data(), buffer.size());
+
+            if (size == 0)
+            {
+                connection->inputClosed = true;
+                break;
+            }
+
+            if (size < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+
+                return false;
+            }
+
+            m_server->m_metrics.addBytesReceived(size);
+            processInput(loop, connection, buffer.constData(), size);
+        }
+
+        // Closed once the responses are sent, a partly received request is dropped.
+        // Pending async responses and held-back input are answered first.
+        if (connection->inputClosed && !connection->waitingForResponse && !connection->inputPaused)
+            connection->closeAfterWrite = true;
+
+        if (!writeConnection(connection))
+            return false;
+
+        // Otherwise continued by run() after the write that drains the queue
+        if (!connection->inputPaused || connection->queuedResponses > 0)
+            return true;
+
+        // Input held back, then whatever arrived on the socket in the meantime
+        connection->inputPaused = false;
+
+        const QByteArray input = std::exchange(connection->pendingInput, QByteArray());
+        processInput(loop, connection, input.constData(), input.size());
+    }
+}
+
+void HttpEpollBackend::processInput(Loop* loop, Connection* connection, const char* data, qsizetype size)
+{
+    qsizetype pos = 0;
+
+    // A read may contain several requests, or only part of one
+    while (pos < size && !connection->closeAfterWrite)
+    {
+        if (connection->waitingForResponse)
+        {
+            connection->pendingInput.append(data + pos, size - pos);
+            return;
+        }
+
+        // Like MAX_PIPELINE_DEPTH of HttpConnection, a client that pipelines without reading the responses is not buffered without limit
+        if (connection->queuedResponses >= MAX_PIPELINE_DEPTH || connection->writeBuffer.size() - connection->writeOffset >= MAX_QUEUED_OUTPUT)
+        {
+            connection->inputPaused = true;
+            connection->pendingInput.append(data + pos, size - pos);
+            return;
+        }
+
+        pos += connection->request.appendData(data + pos, size - pos);
+
+        if (connection->request.takeContinueExpectation())
+            connection->writeBuffer.append(QByteArrayLiteral("HTTP/1.1 100 Continue\r\n\r\n"));
+
+        if (connection->request.isComplete() || connection->request.getParseState() == HttpRequest::ERROR)
+        {
+            connection->requestTimer.start();
+            connection->routeMetrics = nullptr;
+
+            // The next request gets a timeout of its own
+            connection->timeoutPhase = Connection::TIMEOUT_NONE;
+
+            handleRequest(loop, connection);
+        }
+    }
+}
+
+bool HttpEpollBackend::writeConnection(Connection* connection)
+{
+    forever
+    {
+        const qsizetype end = connection->bodies.isEmpty() ? connection->writeBuffer.size() : connection->bodies.first().position;
+
+        while (connection->writeOffset < end)
+        {
+            const qint64 size = transmit(connection, connection->writeBuffer.constData() + connection->writeOffset, end - connection->writeOffset);
+
+            if (size < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                // Continued on the next EPOLLOUT
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            connection->writeOffset += size;
+        }
+
+        if (connection->bodies.isEmpty())
+            break;
+
+        Connection::PendingBody& pending = connection->bodies.first();
+
+        // Produced only as fast as the socket takes it
+        while (pending.producer || pending.chunkOffset < pending.chunk.size())
+        {
+            if (pending.chunkOffset == pending.chunk.size())
+            {
+                const QByteArray data = pending.producer();
+
+                pending.chunk.resize(0);
+                pending.chunkOffset = 0;
+
+                if (pending.chunked)
+                    HttpResponse::appendChunk(pending.chunk, data);
+                else
+                    pending.chunk = data;
+
+                m_server->m_metrics.addBytesSent(pending.chunk.size());
+
+                // The last chunk is still sent
+                if (data.isEmpty())
+                    pending.producer = nullptr;
+
+                continue;
+            }
+
+            const qint64 size = transmit(connection, pending.chunk.constData() + pending.chunkOffset, pending.chunk.size() - pending.chunkOffset);
+
+            if (size < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            pending.chunkOffset += size;
+        }
+
+        while (pending.remaining > 0)
+        {
+            const qint64 chunkSize = qMin(pending.remaining, FILE_CHUNK_SIZE);
+
+            // TLS encrypts in user space, so there is no sendfile()
+            const qint64 size = connection->tls ? transmit(connection, reinterpret_cast<const char*>(pending.file->data) + pending.offset, chunkSize)
+                                                : HttpFileCache::sendToSocket(connection->fd, *pending.file, pending.offset, chunkSize);
+
+            if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return true;
+
+            // Error or file truncated in the meantime
+            if (size <= 0)
+                return false;
+
+            pending.offset += size;
+            pending.remaining -= size;
+        }
+
+        connection->bodies.removeFirst();
+    }
+
+    connection->writeBuffer.resize(0);
+    connection->writeOffset = 0;
+    connection->queuedResponses = 0;
+
+    return !connection->closeAfterWrite;
+}
+
+void HttpEpollBackend::handleRequest(Loop* loop, Connection* connection)
+{
+    HttpRequest& request = connection->request;
+
+    const bool redirect = m_server->m_enableHttpRedirection && !connection->tls;
+
+    // Cached responses are complete, including the connection headers
+    if (request.getParseState() != HttpRequest::ERROR && !redirect)
+    {
+        bool keepAlive = false;
+
+        const qsizetype offset = connection->writeBuffer.size();
+        const HttpResponseCache::EntryPtr entry = m_server->getCachedResponse(request, connection->requestCount + 1, connection->writeBuffer, keepAlive);
+
+        if (entry)
+        {
+            ++connection->requestCount;
+            ++connection->queuedResponses;
+
+            connection->routeMetrics = entry->metrics;
+            m_server->m_metrics.addBytesSent(connection->writeBuffer.size() - offset);
+            recordResponse(connection, entry->status, entry->body.size());
+
+            if (!keepAlive)
+                connection->closeAfterWrite = true;
+
+            connection->request.reset();
+            return;
+        }
+    }
+
+    HttpResponse response;
+
+    if (request.getParseState() == HttpRequest::ERROR)
+        response = HttpServer::getParseErrorResponse(request);
+    else if (redirect)
+        response = m_server->getRedirectResponse(request);
+    else
+    {
+        QFuture<HttpResponse> pending;
+
+        if (!m_server->handleHttpRequest(request, connection->logInfo, response, pending, connection->routeMetrics))
+        {
+            if (!pending.isFinished())
+            {
+                connection->waitingForResponse = true;
+
+                const std::shared_ptr<ResponseQueue> queue = loop->responses;
+                const int fd = connection->fd;
+                const quint64 id = connection->id;
+
+                pending.then(QtFuture::Launch::Sync, [queue, fd, id](HttpResponse result)
+                {
+                    QMutexLocker locker(&queue->mutex);
+
+                    if (queue->closed)
+                        return;
+
+                    queue->items.append({ fd, id, result });
+
+                    const quint64 value = 1;
+
+                    if (::write(queue->wakeFd, &value, sizeof(value)) < 0)
+                        qWarning() << "Cannot wake epoll loop:" << strerror(errno);
+                });
+
+                return;
+            }
+
+            response = pending.result();
+        }
+    }
+
+    sendResponse(connection, response);
+}
+
+void HttpEpollBackend::sendResponse(Connection* connection, HttpResponse& response)
+{
+    ++connection->requestCount;
+    ++connection->queuedResponses;
+
+    // WebSocket sessions and event streams need the Qt backend
+    if (response.getStatus() == HttpResponse::SWITCHING_PROTOCOLS || response.getEventSource())
+        response = HttpResponse(HttpResponse::NOT_IMPLEMENTED);
+
+    if (!m_server->finishResponse(connection->request, response, connection->requestCount))
+        connection->closeAfterWrite = true;
+
+    const QByteArray data = response.getRawData();
+    connection->writeBuffer.append(data);
+
+    m_server->m_metrics.addBytesSent(data.size() + (response.hasBodyFile() ? response.getBodyFileLength() : 0));
+    recordResponse(connection, response.getStatus(), response.getBodySize());
+
+    if (response.hasBodyFile() && response.getBodyFileLength() > 0)
+    {
+        Connection::PendingBody pending;
+        pending.position = connection->writeBuffer.size();
+        pending.file = response.getBodyFile();
+        pending.offset = response.getBodyFileOffset();
+        pending.remaining = response.getBodyFileLength();
+
+        connection->bodies.append(pending);
+    }
+    else if (response.hasBodyProducer())
+    {
+        Connection::PendingBody pending;
+        pending.position = connection->writeBuffer.size();
+        pending.producer = response.getBodyProducer();
+        pending.chunked = response.hasHeader(HttpHeaders::TRANSFER_ENCODING);
+
+        connection->bodies.append(pending);
+    }
+
+    connection->request.reset();
+}
+
+void HttpEpollBackend::recordResponse(Connection* connection, int status, qint64 bytes)
+{
+    m_server->recordResponse(connection->peer, connection->request, connection->routeMetrics, status, bytes, connection->requestTimer);
+}
+
+void HttpEpollBackend::handleAsyncResponses(Loop* loop, QByteArray& buffer)
+{
+    QList<ResponseQueue::Item> items;
+
+    {
+        QMutexLocker locker(&loop->responses->mutex);
+        items.swap(loop->responses->items);
+    }
+
+    for (ResponseQueue::Item& item : items)
+    {
+        Connection* const connection = loop->connections.value(item.fd, nullptr);
+
+        // Closed in the meantime, the descriptor may belong to a new connection already
+        if (!connection || connection->id != item.connectionId)
+            continue;
+
+        connection->waitingForResponse = false;
+        sendResponse(connection, item.response);
+
+        // Input behind the request, then whatever arrived on the socket in the meantime
+        const QByteArray input = std::exchange(connection->pendingInput, QByteArray());
+        processInput(loop, connection, input.constData(), input.size());
+
+        if (readConnection(loop, connection, buffer))
+            updateTimeout(loop, connection);
+        else
+            closeConnection(loop, connection);
+    }
+}
+
+void HttpEpollBackend::closeConnection(Loop* loop, Connection* connection)
+{
+#ifdef HTTPSERVER_HAVE_OPENSSL
+    if (connection->tls)
+    {
+        connection->tls->shutdown();
+        delete connection->tls;
+    }
+#endif
+
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    ::close(connection->fd);
+
+    loop->connections.remove(connection->fd);
+    delete connection;
+
+    m_server->m_metrics.removeConnection();
+    m_server->releaseConnection();
+}
+
+void HttpEpollBackend::updateTimeout(Loop* loop, Connection* connection)
+{
+    Connection::TIMEOUT phase = Connection::TIMEOUT_IDLE;
+    int timeout = m_server->getIdleTimeout();
+
+    if (connection->waitingForResponse)
+    {
+        phase = Connection::TIMEOUT_NONE;
+        timeout = 0;
+    }
+    else if (connection->writeOffset < connection->writeBuffer.size() || !connection->bodies.isEmpty())
+        phase = Connection::TIMEOUT_WRITE;
+    else if (connection->request.getParseState() == HttpRequest::BODY)
+    {
+        phase = Connection::TIMEOUT_BODY;
+        timeout = m_server->getBodyTimeout();
+    }
+
+    // A TLS handshake counts towards the headers of the first request
+    else if (connection->request.isStarted() || (connection->tlsChecked && connection->requestCount == 0))
+    {
+        phase = Connection::TIMEOUT_HEADER;
+        timeout = m_server->getHeaderTimeout();
+    }
+    else if (connection->requestCount > 0)
+    {
+        phase = Connection::TIMEOUT_KEEP_ALIVE;
+        timeout = m_server->getKeepAliveTimeout();
+    }
+
+    // Progress restarts the body and write timeouts, the others run from the start of their phase
+    if (phase == connection->timeoutPhase && phase != Connection::TIMEOUT_BODY && phase != Connection::TIMEOUT_WRITE)
+        return;
+
+    connection->timeoutPhase = phase;
+
+    if (timeout > 0)
+        loop->timers.start(&connection->timeout, timeout, loop->now);
+    else
+        connection->timeout.stop();
+}
+
+void HttpEpollBackend::timeoutConnection(Loop* loop, Connection* connection)
+{
+    qCDebug(lcHttpServer) << connection->logInfo << "Timeout in phase" << connection->timeoutPhase;
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-15.5.9
+    // -> A partly received request is answered, idle connections and handshakes are just closed
+    if ((connection->timeoutPhase == Connection::TIMEOUT_HEADER || connection->timeoutPhase == Connection::TIMEOUT_BODY)
+        && connection->request.isStarted() && !isHandshaking(connection))
+    {
+        connection->requestTimer.start();
+        connection->routeMetrics = nullptr;
+
+        // Not kept alive, the request is incomplete
+        HttpResponse response(HttpResponse::REQUEST_TIMEOUT);
+        sendResponse(connection, response);
+
+        // The rest is written within the idle timeout, then the connection is closed
+        if (writeConnection(connection))
+        {
+            updateTimeout(loop, connection);
+            return;
+        }
+    }
+
+    closeConnection(loop, connection);
+}
+
+bool HttpEpollBackend::isHandshaking(const Connection* connection)
+{
+#ifdef HTTPSERVER_HAVE_OPENSSL
+    return connection->tls && !connection->tls->isHandshakeDone();
+#else
+    Q_UNUSED(connection);
+    return false;
+#endif
+}
+
+qint64 HttpEpollBackend::receive(Connection* connection, char* data, qint64 size)
+{
+#ifdef HTTPSERVER_HAVE_OPENSSL
+    if (connection->tls)
+        return connection->tls->read(data, size);
+#endif
+
+    return ::read(connection->fd, data, size);
+}
+
+qint64 HttpEpollBackend::transmit(Connection* connection, const char* data, qint64 size)
+{
+#ifdef HTTPSERVER_HAVE_OPENSSL
+    if (connection->tls)
+        return connection->tls->write(data, size);
+#endif
+
+    return ::send(connection->fd, data, size, MSG_NOSIGNAL);
+}
+
+#else
+
+bool HttpEpollBackend::start(const QHostAddress&, quint16, int)
+{
+    qWarning() << "epoll backend is only available on Linux!";
+    return false;
+}
+
+void HttpEpollBackend::stop()
+{
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef HTTPEPOLLBACKEND_H
+#define HTTPEPOLLBACKEND_H
+
+#include <QHostAddress>
+#include <QList>
+#include <QThread>
+
+
+class HttpServer;
+class HttpResponse;
+
+
+// Linux only: one epoll loop per thread, each with its own SO_REUSEPORT listener,
+// so the kernel balances new connections. Requests are parsed and dispatched to the
+// callbacks of the server directly in the loop thread. Async callbacks hand their
+// response back through the wake eventfd of the loop.
+// HTTPS needs OpenSSL (HttpTlsContext), sessions are resumed over all loops.
+class HttpEpollBackend
+{
+public:
+    explicit HttpEpollBackend(HttpServer* server);
+    ~HttpEpollBackend();
+
+    static bool isSupported();
+
+    bool start(const QHostAddress& address, quint16 port, int threadCount);
+    void stop();
+
+    bool isRunning() const { return !m_threads.isEmpty(); }
+
+private:
+    struct Loop;
+    struct Connection;
+    struct ResponseQueue;
+
+    static constexpr int MAX_EVENTS = 256;
+    static constexpr int READ_BUFFER_SIZE = 64 * 1024;
+    static constexpr int RESUME_INTERVAL = 100;   // ms, accepting is paused at the connection limit
+    static constexpr qint64 FILE_CHUNK_SIZE = 256 * 1024;
+
+    // Pipelined requests are not parsed (and the socket not read) while this many responses or bytes wait to be sent
+    static constexpr int MAX_PIPELINE_DEPTH = 16;
+    static constexpr qsizetype MAX_QUEUED_OUTPUT = 1024 * 1024;
+
+    HttpServer* m_server = nullptr;
+
+    QList<QThread*> m_threads;
+    QList<Loop*> m_loops;
+
+    static int createListener(const QHostAddress& address, quint16 port);
+
+    void run(Loop* loop);
+
+    void acceptConnections(Loop* loop);
+    void pauseAccepting(Loop* loop);
+    void resumeAccepting(Loop* loop);
+    bool readConnection(Loop* loop, Connection* connection, QByteArray& buffer);
+    void processInput(Loop* loop, Connection* connection, const char* data, qsizetype size);
+    bool writeConnection(Connection* connection);
+    void handleRequest(Loop* loop, Connection* connection);
+    void sendResponse(Connection* connection, HttpResponse& response);
+    void recordResponse(Connection* connection, int status, qint64 bytes);
+    void handleAsyncResponses(Loop* loop, QByteArray& buffer);
+    void closeConnection(Loop* loop, Connection* connection);
+
+    // Starts the timeout of the state the connection is in, see Connection::TIMEOUT
+    void updateTimeout(Loop* loop, Connection* connection);
+    void timeoutConnection(Loop* loop, Connection* connection);
+
+    // Plain or TLS, same conventions as read() / send()
+    static bool isHandshaking(const Connection* connection);
+    static qint64 receive(Connection* connection, char* data, qint64 size);
+    static qint64 transmit(Connection* connection, const char* data, qint64 size);
+};
+
+#endif // HTTPEPOLLBACKEND_H
@@ -0,0 +1,319 @@
+#include "httpeventsource.h"
+
+#include <QSslSocket>
+
+#include "httpserver.h"
+
+
+HttpEventSource::HttpEventSource() :
+    m_state(std::make_shared<HttpEventSourceState>())
+{
+
+}
+
+void HttpEventSource::setHistorySize(int count)
+{
+    QMutexLocker locker(&m_state->mutex);
+
+    m_state->historySize = qMax(0, count);
+    m_state->history.clear();
+    m_state->historyStart = 0;
+}
+
+int HttpEventSource::getHistorySize() const
+{
+    return m_state->historySize;
+}
+
+void HttpEventSource::setHighWaterMark(qint64 bytes)
+{
+    m_state->highWaterMark = qMax<qint64>(0, bytes);
+}
+
+qint64 HttpEventSource::getHighWaterMark() const
+{
+    return m_state->highWaterMark;
+}
+
+void HttpEventSource::setSlowConsumerPolicy(SLOW_CONSUMER_POLICY policy)
+{
+    m_state->policy = policy;
+}
+
+HttpEventSource::SLOW_CONSUMER_POLICY HttpEventSource::getSlowConsumerPolicy() const
+{
+    return m_state->policy;
+}
+
+void HttpEventSource::setKeepAliveInterval(int msec)
+{
+    m_state->keepAliveInterval = qMax(0, msec);
+}
+
+int HttpEventSource::getKeepAliveInterval() const
+{
+    return m_state->keepAliveInterval;
+}
+
+void HttpEventSource::setRetry(int msec)
+{
+    m_state->retry = qMax(0, msec);
+}
+
+int HttpEventSource::getRetry() const
+{
+    return m_state->retry;
+}
+
+HttpResponse HttpEventSource::subscribe(const HttpRequest& request) const
+{
+    if (request.getMethod() != HttpRequest::GET)
+    {
+        HttpResponse response(HttpResponse::METHOD_NOT_ALLOWED);
+        response.setRawHeader(HttpHeaders::ALLOW, QByteArrayLiteral("GET"));
+
+        return response;
+    }
+
+    // https://html.spec.whatwg.org/multipage/server-sent-events.html#parsing-an-event-stream
+    // -> Always UTF-8
+    HttpResponse response(HttpResponse::OK);
+    response.setRawHeader(HttpHeaders::CONTENT_TYPE, QByteArrayLiteral("text/event-stream"));
+    response.setRawHeader(HttpHeaders::CACHE_CONTROL, QByteArrayLiteral("no-store"));
+    response.setEventSource(m_state);
+
+    return response;
+}
+
+quint64 HttpEventSource::publish(QByteArrayView data, QByteArrayView event)
+{
+    // https://html.spec.whatwg.org/multipage/server-sent-events.html#event-stream-interpretation
+    // Everything but the id line is serialized before locking
+    QByteArray body;
+    body.reserve(data.size() + event.size() + 16);
+
+    if (!event.isEmpty())
+    {
+        body.append("event: ");
+        body.append(event);
+        body.append('\n');
+    }
+
+    qsizetype start = 0;
+
+    forever
+    {
+        qsizetype end = start;
+
+        while (end < data.size() && data[end] != '\n' && data[end] != '\r')
+            ++end;
+
+        body.append("data: ");
+        body.append(data.sliced(start, end - start));
+        body.append('\n');
+
+        if (end == data.size())
+            break;
+
+        // CRLF is one line break
+        start = end + ((data[end] == '\r' && end + 1 < data.size() && data[end + 1] == '\n') ? 2 : 1);
+
+        if (start == data.size())
+            break;
+    }
+
+    body.append('\n');
+
+    QMutexLocker locker(&m_state->mutex);
+
+    // Ids are assigned, stored and posted under the lock, so every thread delivers them in order
+    HttpEventSourceState::Event item;
+    item.id = ++m_state->lastId;
+
+    const QByteArray idLine = "id: " + QByteArray::number(item.id) + "\n";
+
+    item.frame.reserve(idLine.size() + body.size());
+    item.frame.append(idLine);
+    item.frame.append(body);
+
+    if (m_state->historySize > 0)
+    {
+        if (m_state->history.size() < m_state->historySize)
+            m_state->history.append(item);
+        else
+        {
+            m_state->history[m_state->historyStart] = item;
+            m_state->historyStart = (m_state->historyStart + 1) % m_state->history.size();
+        }
+    }
+
+    // Posted while locked: a context with subscribers is alive, they have to take the lock to leave before it can be deleted
+    for (auto it = m_state->subscribers.cbegin(); it != m_state->subscribers.cend(); ++it)
+    {
+        QObject* const context = it.key();
+
+        QMetaObject::invokeMethod(context, [state = m_state, context, id = item.id, frame = item.frame]()
+                                  {
+                                      QList<HttpEventSubscriber*> subscribers;
+
+                                      {
+                                          QMutexLocker locker(&state->mutex);
+                                          subscribers = state->subscribers.value(context);
+                                      }
+
+                                      // Subscribers are only deleted by the event loop of this thread
+                                      for (HttpEventSubscriber* const subscriber : std::as_const(subscribers))
+                                          subscriber->send(id, frame);
+                                  }, Qt::QueuedConnection);
+    }
+
+    return item.id;
+}
+
+int HttpEventSource::getSubscriberCount() const
+{
+    QMutexLocker locker(&m_state->mutex);
+
+    return m_state->subscriberCount;
+}
+
+quint64 HttpEventSource::getLastEventId() const
+{
+    QMutexLocker locker(&m_state->mutex);
+
+    return m_state->lastId;
+}
+
+quint64 HttpEventSource::getDroppedCount() const
+{
+    return m_state->dropped.loadRelaxed();
+}
+
+quint64 HttpEventSource::getDisconnectedCount() const
+{
+    return m_state->disconnected.loadRelaxed();
+}
+
+
+HttpEventSubscriber::HttpEventSubscriber(QSslSocket* socket, HttpServer* server, QObject* context, const std::shared_ptr<HttpEventSourceState>& source) :
+    m_socket(socket),
+    m_server(server),
+    m_context(context),
+    m_source(source)
+{
+    m_server->m_eventSubscriberCount.fetchAndAddRelaxed(1);
+}
+
+HttpEventSubscriber::~HttpEventSubscriber()
+{
+    if (m_subscribed)
+    {
+        QMutexLocker locker(&m_source->mutex);
+
+        const auto it = m_source->subscribers.find(m_context);
+
+        if (it != m_source->subscribers.end() && it->removeOne(this))
+        {
+            if (it->isEmpty())
+                m_source->subscribers.erase(it);
+
+            --m_source->subscriberCount;
+        }
+    }
+
+    m_server->m_eventSubscriberCount.fetchAndSubRelaxed(1);
+}
+
+void HttpEventSubscriber::start(const HttpRequest& request)
+{
+    // https://html.spec.whatwg.org/multipage/server-sent-events.html#the-last-event-id-header
+    bool resume = false;
+    const quint64 lastEventId = request.getHeaderView(QByteArrayView("Last-Event-ID")).trimmed().toULongLong(&resume);
+
+    QList<QByteArray> replay;
+
+    {
+        QMutexLocker locker(&m_source->mutex);
+
+        const QList<HttpEventSourceState::Event>& history = m_source->history;
+
+        // Ids in the history are consecutive, events older than the history are lost
+        if (resume && !history.isEmpty() && lastEventId < m_source->lastId)
+        {
+            const quint64 oldestId = history.at(m_source->historyStart).id;
+            const qsizetype first = lastEventId < oldestId ? 0 : qsizetype(lastEventId + 1 - oldestId);
+
+            for (qsizetype i = first; i < history.size(); ++i)
+                replay.append(history.at((m_source->historyStart + i) % history.size()).frame);
+        }
+
+        m_lastId = m_source->lastId;
+
+        m_source->subscribers[m_context].append(this);
+        ++m_source->subscriberCount;
+    }
+
+    m_subscribed = true;
+
+    if (m_source->retry > 0)
+        write("retry: " + QByteArray::number(m_source->retry) + "\n\n");
+
+    for (const QByteArray& frame : std::as_const(replay))
+    {
+        if (!write(frame))
+            break;
+    }
+}
+
+void HttpEventSubscriber::send(quint64 id, const QByteArray& frame)
+{
+    // Posted before the subscription, part of the replay
+    if (id <= m_lastId)
+        return;
+
+    m_lastId = id;
+
+    write(frame);
+}
+
+void HttpEventSubscriber::sendKeepAlive()
+{
+    // https://html.spec.whatwg.org/multipage/server-sent-events.html#authoring-notes
+    // -> Comment lines are ignored by the client, not needed while events are still being written
+    if (m_socket->bytesToWrite() == 0)
+        write(QByteArrayLiteral(":\n"));
+}
+
+bool HttpEventSubscriber::write(const QByteArray& data)
+{
+    if (m_closed || m_socket->state() != QAbstractSocket::ConnectedState)
+        return false;
+
+    // The socket buffer of a slow client grows by every event, the shared frames do not help there
+    if (m_socket->bytesToWrite() > m_source->highWaterMark)
+    {
+        if (m_source->policy == HttpEventSource::DISCONNECT)
+        {
+            qCDebug(lcHttpServer) << "Event subscriber too slow, closing";
+
+            m_source->disconnected.fetchAndAddRelaxed(1);
+            m_server->m_eventSubscribersDisconnected.fetchAndAddRelaxed(1);
+
+            m_closed = true;
+            m_socket->abort();
+        }
+        else
+        {
+            m_source->dropped.fetchAndAddRelaxed(1);
+            m_server->m_eventsDropped.fetchAndAddRelaxed(1);
+        }
+
+        return false;
+    }
+
+    m_socket->write(data);
+
+    m_server->m_metrics.addBytesSent(data.size());
+
+    return true;
+}
@@ -0,0 +1,149 @@
+#ifndef HTTPEVENTSOURCE_H
+#define HTTPEVENTSOURCE_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <memory>
+
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+class QSslSocket;
+class HttpServer;
+class HttpEventSubscriber;
+struct HttpEventSourceState;
+
+
+// https://html.spec.whatwg.org/multipage/server-sent-events.html
+// Channel of Server-Sent Events. Each event is serialized once, the buffer is shared by the history and
+// all subscribers, which receive it in their own thread (one posted delivery per thread and event).
+// Subscribers are HTTP/1.1 connections of the Qt backend that stay open after the headers, the body
+// has no length and ends with the connection. Reconnecting clients send Last-Event-ID and are caught up
+// from a bounded history. Publishing is thread-safe, settings have to be set before the first subscriber.
+class HttpEventSource
+{
+public:
+    // What happens to a subscriber with more than getHighWaterMark() bytes not yet written to the client
+    enum SLOW_CONSUMER_POLICY
+    {
+        DROP_EVENTS,    // Events are skipped while it is above the mark, the client sees a gap in the ids
+        DISCONNECT,     // Closed, the client reconnects with Last-Event-ID and catches up from the history
+    };
+
+    HttpEventSource();
+
+    HttpEventSource(const HttpEventSource&) = delete;
+    HttpEventSource& operator=(const HttpEventSource&) = delete;
+
+    // Events kept for replay, 0 = none. Clears the history.
+    void setHistorySize(int count);
+    int getHistorySize() const;
+
+    void setHighWaterMark(qint64 bytes);
+    qint64 getHighWaterMark() const;
+
+    void setSlowConsumerPolicy(SLOW_CONSUMER_POLICY policy);
+    SLOW_CONSUMER_POLICY getSlowConsumerPolicy() const;
+
+    // Comment line sent to every subscriber, so proxies do not close idle streams. 0 = never.
+    void setKeepAliveInterval(int msec);
+    int getKeepAliveInterval() const;
+
+    // https://html.spec.whatwg.org/multipage/server-sent-events.html#concept-event-stream-reconnection-time
+    // Sent once to each subscriber, 0 = the default of the client
+    void setRetry(int msec);
+    int getRetry() const;
+
+    // 200 text/event-stream, or 405 for other methods than GET. May be returned by any route,
+    // e.g. after checking a session cookie. The source has to outlive the route.
+    HttpResponse subscribe(const HttpRequest& request) const;
+
+    // Thread-safe, returns the id of the event (counting from 1).
+    // Line breaks in data start a new data line, event has to be a single line.
+    quint64 publish(QByteArrayView data, QByteArrayView event = QByteArrayView());
+
+    int getSubscriberCount() const;
+    quint64 getLastEventId() const;
+
+    // Events skipped for slow subscribers (DROP_EVENTS) and slow subscribers closed (DISCONNECT)
+    quint64 getDroppedCount() const;
+    quint64 getDisconnectedCount() const;
+
+private:
+    std::shared_ptr<HttpEventSourceState> m_state;
+};
+
+
+// History, settings and subscribers of an HttpEventSource, shared with the subscribers and queued deliveries
+struct HttpEventSourceState
+{
+    mutable QMutex mutex;
+
+    int historySize = 1000;
+    qint64 highWaterMark = 1024 * 1024;
+    HttpEventSource::SLOW_CONSUMER_POLICY policy = HttpEventSource::DISCONNECT;
+    int keepAliveInterval = 15000;
+    int retry = 0;
+
+    struct Event
+    {
+        quint64 id = 0;
+        QByteArray frame;
+    };
+
+    // Ring of the last historySize events, ids are consecutive from the one at historyStart
+    QList<Event> history;
+    qsizetype historyStart = 0;
+    quint64 lastId = 0;
+
+    // By the context (worker) of the subscribers, so an event posts one delivery per thread
+    QHash<QObject*, QList<HttpEventSubscriber*>> subscribers;
+    int subscriberCount = 0;
+
+    QAtomicInteger<quint64> dropped = 0;
+    QAtomicInteger<quint64> disconnected = 0;
+};
+
+
+// Connection side of a subscription, created by the connection once the headers are sent
+class HttpEventSubscriber
+{
+private:
+    friend class HttpConnection;
+    friend class HttpEventSource;
+
+    QSslSocket* m_socket = nullptr;
+    HttpServer* m_server = nullptr;
+
+    // Lives in the thread of the connection, deliveries are posted to it
+    QObject* m_context = nullptr;
+
+    std::shared_ptr<HttpEventSourceState> m_source;
+
+    // Deliveries queued before the subscription was complete are already part of the replay
+    quint64 m_lastId = 0;
+
+    bool m_subscribed = false;
+    bool m_closed = false;
+
+    HttpEventSubscriber(QSslSocket* socket, HttpServer* server, QObject* context, const std::shared_ptr<HttpEventSourceState>& source);
+    ~HttpEventSubscriber();
+
+    // Joins the source and replays the history after Last-Event-ID
+    void start(const HttpRequest& request);
+
+    void send(quint64 id, const QByteArray& frame);
+    void sendKeepAlive();
+    int getKeepAliveInterval() const { return m_source->keepAliveInterval; }
+
+    // False if the subscriber is too slow
+    bool write(const QByteArray& data);
+};
+
+#endif // HTTPEVENTSOURCE_H
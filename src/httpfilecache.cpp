@@ -0,0 +1,215 @@
+#include "httpfilecache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QLocale>
+#include <QMimeDatabase>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <csignal>
+#endif
+
+
+HttpFileCache::File::~File()
+{
+    if (mapped)
+        file.unmap(const_cast<uchar*>(data));
+}
+
+
+HttpFileCache::HttpFileCache(qint64 maxSize)
+{
+    m_cache.setMaxCost(maxSize);
+}
+
+HttpFileCache::FilePtr HttpFileCache::getFile(const QString& path)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    FilePtr cached;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        Item* const item = m_cache.object(path);
+
+        if (item)
+        {
+            if (now - item->checked < CHECK_INTERVAL)
+                return item->file;
+
+            cached = item->file;
+        }
+    }
+
+    // stat() and open() without holding the lock
+    if (cached)
+    {
+        const QFileInfo info(path);
+
+        if (info.exists() && info.size() == cached->size && info.lastModified() == cached->lastModified)
+        {
+            QMutexLocker locker(&m_mutex);
+
+            Item* const item = m_cache.object(path);
+
+            if (item && item->file == cached)
+                item->checked = now;
+
+            return cached;
+        }
+    }
+
+    const FilePtr file = openFile(path);
+
+    QMutexLocker locker(&m_mutex);
+
+    if (!file)
+        m_cache.remove(path);
+    else
+    {
+        Item* const item = new Item();
+        item->file = file;
+        item->checked = now;
+
+        // Every open file counts at least one page, so small files do not use up all descriptors.
+        // Deletes the item right away if it is too large.
+        m_cache.insert(path, item, file->size + 4096);
+    }
+
+    return file;
+}
+
+void HttpFileCache::setMaxSize(qint64 size)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.setMaxCost(size);
+}
+
+qint64 HttpFileCache::getMaxSize() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_cache.maxCost();
+}
+
+void HttpFileCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.clear();
+}
+
+QByteArray HttpFileCache::toHttpDate(const QDateTime& dateTime)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-5.6.7
+    return dateTime.toUTC().toString("ddd, dd MMM yyyy hh:mm:ss").toLatin1() + " GMT";
+}
+
+QDateTime HttpFileCache::fromHttpDate(QByteArrayView date)
+{
+    // Only IMF-fixdate, the obsolete formats are not sent by current clients
+    const QDateTime result = QLocale::c().toDateTime(QString::fromLatin1(date.trimmed()), "ddd, dd MMM yyyy hh:mm:ss 'GMT'");
+
+    if (!result.isValid())
+        return QDateTime();
+
+    return QDateTime(result.date(), result.time(), Qt::UTC);
+}
+
+#ifdef Q_OS_LINUX
+
+qint64 HttpFileCache::sendToSocket(int socketDescriptor, const File& file, qint64 offset, qint64 size)
+{
+    if (offset < 0 || size < 0 || offset + size > file.size)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    forever
+    {
+        ssize_t result = 0;
+
+        // Data is copied by the kernel directly from the page cache.
+        // sendfile() has no MSG_NOSIGNAL: SIGPIPE is blocked in this thread meanwhile, and taken if it was raised.
+        if (file.mapped)
+        {
+            sigset_t pipeSet;
+            sigset_t oldSet;
+            sigemptyset(&pipeSet);
+            sigaddset(&pipeSet, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+
+            off_t fileOffset = offset;
+            result = sendfile(socketDescriptor, file.getHandle(), &fileOffset, size);
+
+            if (result < 0 && errno == EPIPE)
+            {
+                const timespec noWait = {};
+                sigtimedwait(&pipeSet, nullptr, &noWait);
+                errno = EPIPE;
+            }
+
+            pthread_sigmask(SIG_SETMASK, &oldSet, nullptr);
+        }
+        else
+            result = ::send(socketDescriptor, file.data + offset, size, MSG_NOSIGNAL);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        return result;
+    }
+}
+
+#endif
+
+HttpFileCache::FilePtr HttpFileCache::openFile(const QString& path)
+{
+    QSharedPointer<File> result = QSharedPointer<File>::create();
+    result->path = path;
+    result->file.setFileName(path);
+
+    if (!result->file.open(QFile::ReadOnly))
+        return FilePtr();
+
+    const QFileInfo info(result->file);
+
+    if (!info.isFile())
+        return FilePtr();
+
+    result->size = result->file.size();
+    result->lastModified = info.lastModified();
+
+    if (result->size > 0)
+    {
+        result->data = result->file.map(0, result->size);
+        result->mapped = result->data != nullptr;
+
+        // E.g. special files, read once instead
+        if (!result->mapped)
+        {
+            result->content = result->file.readAll();
+            result->size = result->content.size();
+            result->data = reinterpret_cast<const uchar*>(result->content.constData());
+        }
+    }
+
+    // Changes with size or modification time
+    result->etag = "\"" + QByteArray::number(result->size, 16) + "-" + QByteArray::number(result->lastModified.toMSecsSinceEpoch(), 16) + "\"";
+    result->lastModifiedHttp = toHttpDate(result->lastModified);
+
+    static const QMimeDatabase mimeDatabase;
+    const QMimeType mimeType = mimeDatabase.mimeTypeForFile(info, QMimeDatabase::MatchExtension);
+
+    result->contentType = mimeType.isValid() ? mimeType.name().toLatin1() : QByteArrayLiteral("application/octet-stream");
+
+    if (result->contentType.startsWith("text/") || result->contentType == "application/javascript" || result->contentType == "application/json")
+        result->contentType += "; charset=utf-8";
+
+    return result;
+}
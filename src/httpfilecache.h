@@ -0,0 +1,80 @@
+#ifndef HTTPFILECACHE_H
+#define HTTPFILECACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QDateTime>
+#include <QFile>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+
+
+// Keeps hot files open and mapped, shared by all worker threads.
+// Entries are immutable, a changed file gets a new entry while responses still
+// being sent keep the old one alive.
+class HttpFileCache
+{
+public:
+    struct File
+    {
+        ~File();
+
+        QString path;
+        QFile file;
+
+        // Mapped file, or content if mapping is not possible
+        const uchar* data = nullptr;
+        QByteArray content;
+        bool mapped = false;
+
+        qint64 size = 0;
+        QDateTime lastModified;
+
+        // https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/ETag
+        QByteArray etag;
+        QByteArray lastModifiedHttp;
+        QByteArray contentType;
+
+        int getHandle() const { return file.handle(); }
+    };
+
+    typedef QSharedPointer<const File> FilePtr;
+
+    explicit HttpFileCache(qint64 maxSize = 64 * 1024 * 1024);
+
+    // Path has to be canonical, returns null if the file cannot be opened
+    FilePtr getFile(const QString& path);
+
+    // Bytes of mapped files kept open, files larger than this are not cached
+    void setMaxSize(qint64 size);
+    qint64 getMaxSize() const;
+
+    void clear();
+
+    static QByteArray toHttpDate(const QDateTime& dateTime);
+    static QDateTime fromHttpDate(QByteArrayView date);
+
+#ifdef Q_OS_LINUX
+    // Writes part of the file to a non-blocking socket, with sendfile() if the file is mapped.
+    // Returns the bytes written or -1 with errno set (EAGAIN if the socket is full).
+    static qint64 sendToSocket(int socketDescriptor, const File& file, qint64 offset, qint64 size);
+#endif
+
+private:
+    struct Item
+    {
+        FilePtr file;
+        qint64 checked = 0;
+    };
+
+    // Changes of a cached file are noticed within this interval
+    static constexpr qint64 CHECK_INTERVAL = 1000;
+
+    QCache<QString, Item> m_cache;
+    mutable QMutex m_mutex;
+
+    static FilePtr openFile(const QString& path);
+};
+
+#endif // HTTPFILECACHE_H
@@ -0,0 +1,143 @@
+#include "httpheaders.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+
+namespace
+{
+
+// Same order as HttpHeaders::HEADER
+constexpr const char* HEADER_NAMES[HttpHeaders::HEADER_COUNT] =
+{
+    "Accept",
+    "Accept-Encoding",
+    "Accept-Language",
+    "Accept-Ranges",
+    "Age",
+    "Allow",
+    "Authorization",
+    "Cache-Control",
+    "Connection",
+    "Content-Encoding",
+    "Content-Length",
+    "Content-Range",
+    "Content-Type",
+    "Cookie",
+    "Date",
+    "ETag",
+    "Expect",
+    "Host",
+    "If-Modified-Since",
+    "If-None-Match",
+    "If-Range",
+    "Keep-Alive",
+    "Last-Modified",
+    "Location",
+    "Origin",
+    "Pragma",
+    "Range",
+    "Referer",
+    "Retry-After",
+    "Sec-WebSocket-Accept",
+    "Sec-WebSocket-Extensions",
+    "Sec-WebSocket-Key",
+    "Sec-WebSocket-Protocol",
+    "Sec-WebSocket-Version",
+    "Server",
+    "Set-Cookie",
+    "Transfer-Encoding",
+    "Upgrade",
+    "User-Agent",
+    "Vary",
+};
+
+constexpr qsizetype MAX_NAME_SIZE = 24;
+
+// Candidates by name size, at most a handful each
+struct LookupTable
+{
+    QVarLengthArray<HttpHeaders::HEADER, 8> bySize[MAX_NAME_SIZE + 1];
+
+    LookupTable()
+    {
+        for (int i = 0; i < HttpHeaders::HEADER_COUNT; ++i)
+        {
+            const qsizetype size = qsizetype(strlen(HEADER_NAMES[i]));
+            Q_ASSERT(size <= MAX_NAME_SIZE);
+
+            bySize[size].append(HttpHeaders::HEADER(i));
+        }
+    }
+};
+
+const LookupTable g_lookupTable;
+
+inline char toLower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c;
+}
+
+}
+
+
+HttpHeaders::HEADER HttpHeaders::lookup(QByteArrayView name)
+{
+    if (name.isEmpty() || name.size() > MAX_NAME_SIZE)
+        return UNKNOWN;
+
+    const char first = toLower(name.front());
+
+    for (const HEADER header : g_lookupTable.bySize[name.size()])
+    {
+        const char* const candidate = HEADER_NAMES[header];
+
+        if (toLower(candidate[0]) == first && qstrnicmp(name.data() + 1, candidate + 1, name.size() - 1) == 0)
+            return header;
+    }
+
+    return UNKNOWN;
+}
+
+QByteArrayView HttpHeaders::getName(HEADER header)
+{
+    if (header <= UNKNOWN || header >= HEADER_COUNT)
+        return QByteArrayView();
+
+    return QByteArrayView(HEADER_NAMES[header]);
+}
+
+bool HttpHeaders::hasToken(QByteArrayView list, QByteArrayView token)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-5.6.1
+    qsizetype start = 0;
+
+    while (start < list.size())
+    {
+        qsizetype end = list.indexOf(',', start);
+
+        if (end < 0)
+            end = list.size();
+
+        if (list.sliced(start, end - start).trimmed().compare(token, Qt::CaseInsensitive) == 0)
+            return true;
+
+        start = end + 1;
+    }
+
+    return false;
+}
+
+void HttpHeaders::Index::clear()
+{
+    std::fill(std::begin(m_positions), std::end(m_positions), -1);
+}
+
+void HttpHeaders::Index::add(HEADER header, qsizetype position)
+{
+    if (header > UNKNOWN && header < HEADER_COUNT && m_positions[header] < 0)
+        m_positions[header] = qint32(position);
+}
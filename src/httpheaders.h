@@ -0,0 +1,88 @@
+#ifndef HTTPHEADERS_H
+#define HTTPHEADERS_H
+
+#include <QByteArrayView>
+#include <QtGlobal>
+
+
+// Header names used by the server, interned to enum values.
+// https://datatracker.ietf.org/doc/html/rfc9110#section-5.1
+// -> Names are case-insensitive, lookup() compares without allocating and only against names of the same length.
+class HttpHeaders
+{
+public:
+    enum HEADER
+    {
+        UNKNOWN = -1,
+
+        ACCEPT,
+        ACCEPT_ENCODING,
+        ACCEPT_LANGUAGE,
+        ACCEPT_RANGES,
+        AGE,
+        ALLOW,
+        AUTHORIZATION,
+        CACHE_CONTROL,
+        CONNECTION,
+        CONTENT_ENCODING,
+        CONTENT_LENGTH,
+        CONTENT_RANGE,
+        CONTENT_TYPE,
+        COOKIE,
+        DATE,
+        ETAG,
+        EXPECT,
+        HOST,
+        IF_MODIFIED_SINCE,
+        IF_NONE_MATCH,
+        IF_RANGE,
+        KEEP_ALIVE,
+        LAST_MODIFIED,
+        LOCATION,
+        ORIGIN,
+        PRAGMA,
+        RANGE,
+        REFERER,
+        RETRY_AFTER,
+        SEC_WEBSOCKET_ACCEPT,
+        SEC_WEBSOCKET_EXTENSIONS,
+        SEC_WEBSOCKET_KEY,
+        SEC_WEBSOCKET_PROTOCOL,
+        SEC_WEBSOCKET_VERSION,
+        SERVER,
+        SET_COOKIE,
+        TRANSFER_ENCODING,
+        UPGRADE,
+        USER_AGENT,
+        VARY,
+
+        HEADER_COUNT
+    };
+
+    static HEADER lookup(QByteArrayView name);
+
+    // As registered, e.g. "Content-Length"
+    static QByteArrayView getName(HEADER header);
+
+    // Whether a comma-separated list like "keep-alive, Upgrade" contains token, compared case-insensitively
+    static bool hasToken(QByteArrayView list, QByteArrayView token);
+
+    // Position of the first occurrence of each known header in a message, so these are found without a scan
+    class Index
+    {
+    public:
+        Index() { clear(); }
+
+        void clear();
+
+        // Keeps an earlier position
+        void add(HEADER header, qsizetype position);
+
+        qsizetype get(HEADER header) const { return header > UNKNOWN && header < HEADER_COUNT ? m_positions[header] : -1; }
+
+    private:
+        qint32 m_positions[HEADER_COUNT];
+    };
+};
+
+#endif // HTTPHEADERS_H
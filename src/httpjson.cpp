@@ -0,0 +1,936 @@
+#include "httpjson.h"
+
+#include <QLocale>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+namespace
+{
+
+// Eight bytes at a time: the scans only stop at bytes that need a closer look
+constexpr quint64 ONES = 0x0101010101010101ULL;
+constexpr quint64 HIGH = ONES * 0x80;
+
+inline quint64 loadWord(const char* data)
+{
+    quint64 word;
+    memcpy(&word, data, 8);
+
+    return word;
+}
+
+// Non-zero if a byte equals c (bytes above a match may be reported as well)
+inline quint64 matchByte(quint64 word, uchar c)
+{
+    const quint64 x = word ^ (ONES * c);
+
+    return (x - ONES) & ~x & HIGH;
+}
+
+// Non-zero for a quote, backslash or control character, all of which have to be escaped
+inline quint64 needsEscape(quint64 word)
+{
+    return matchByte(word, '"') | matchByte(word, '\\') | ((word - ONES * 0x20) & ~word & HIGH);
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool isHexDigit(char c)
+{
+    return isDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+char32_t hexValue(const char* data)
+{
+    char32_t value = 0;
+
+    for (int i = 0; i < 4; ++i)
+        value = value * 16 + (isDigit(data[i]) ? data[i] - '0' : (data[i] | 0x20) - 'a' + 10);
+
+    return value;
+}
+
+// https://datatracker.ietf.org/doc/html/rfc3629#section-4
+// Length of the sequence at data, 0 for overlong forms, surrogates and code points above U+10FFFF
+int utf8SequenceLength(const uchar* data, const uchar* end)
+{
+    const uchar c = data[0];
+    int length;
+    uchar min = 0x80;
+    uchar max = 0xBF;
+
+    if (c < 0xC2)
+        return 0;
+    else if (c < 0xE0)
+        length = 2;
+    else if (c < 0xF0)
+    {
+        length = 3;
+
+        if (c == 0xE0)
+            min = 0xA0;
+        else if (c == 0xED)
+            max = 0x9F;
+    }
+    else if (c < 0xF5)
+    {
+        length = 4;
+
+        if (c == 0xF0)
+            min = 0x90;
+        else if (c == 0xF4)
+            max = 0x8F;
+    }
+    else
+        return 0;
+
+    if (end - data < length || data[1] < min || data[1] > max)
+        return 0;
+
+    for (int i = 2; i < length; ++i)
+    {
+        if ((data[i] & 0xC0) != 0x80)
+            return 0;
+    }
+
+    return length;
+}
+
+char* writeUtf8(char* out, char32_t code)
+{
+    if (code < 0x80)
+        *out++ = char(code);
+    else if (code < 0x800)
+    {
+        *out++ = char(0xC0 | (code >> 6));
+        *out++ = char(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000)
+    {
+        *out++ = char(0xE0 | (code >> 12));
+        *out++ = char(0x80 | ((code >> 6) & 0x3F));
+        *out++ = char(0x80 | (code & 0x3F));
+    }
+    else
+    {
+        *out++ = char(0xF0 | (code >> 18));
+        *out++ = char(0x80 | ((code >> 12) & 0x3F));
+        *out++ = char(0x80 | ((code >> 6) & 0x3F));
+        *out++ = char(0x80 | (code & 0x3F));
+    }
+
+    return out;
+}
+
+// https://datatracker.ietf.org/doc/html/rfc8259#section-7
+char* writeEscape(char* out, char16_t c)
+{
+    static const char HEX[] = "0123456789abcdef";
+
+    *out++ = '\\';
+
+    switch (c)
+    {
+    case '"': *out++ = '"'; break;
+    case '\\': *out++ = '\\'; break;
+    case '\b': *out++ = 'b'; break;
+    case '\f': *out++ = 'f'; break;
+    case '\n': *out++ = 'n'; break;
+    case '\r': *out++ = 'r'; break;
+    case '\t': *out++ = 't'; break;
+    default:
+        *out++ = 'u';
+        *out++ = '0';
+        *out++ = '0';
+        *out++ = HEX[(c >> 4) & 0xF];
+        *out++ = HEX[c & 0xF];
+    }
+
+    return out;
+}
+
+qsizetype skipWhitespace(const char* json, qsizetype pos, qsizetype size)
+{
+    while (pos < size && (json[pos] == ' ' || json[pos] == '\n' || json[pos] == '\r' || json[pos] == '\t'))
+        ++pos;
+
+    return pos;
+}
+
+}
+
+
+HttpJsonDocument::HttpJsonDocument(const QByteArray& json) :
+    m_buffer(json),
+    m_json(m_buffer.constData()),
+    m_size(m_buffer.size())
+{
+    parse();
+}
+
+HttpJsonDocument::HttpJsonDocument(const QByteArray& buffer, qsizetype offset, qsizetype size) :
+    m_buffer(buffer),
+    m_json(m_buffer.constData() + offset),
+    m_size(size)
+{
+    Q_ASSERT(offset >= 0 && size >= 0 && offset + size <= buffer.size());
+
+    parse();
+}
+
+HttpJsonValue HttpJsonDocument::getRoot() const
+{
+    return isValid() ? HttpJsonValue(this, 0) : HttpJsonValue();
+}
+
+HttpJsonValue HttpJsonDocument::operator[](QByteArrayView key) const
+{
+    return getRoot()[key];
+}
+
+bool HttpJsonDocument::parse()
+{
+    // Offsets in the index are 32 bit
+    if (m_size >= qsizetype(std::numeric_limits<quint32>::max()))
+        return fail("Document too large", 0);
+
+    const char* const json = m_json;
+    const qsizetype size = m_size;
+    qsizetype pos = 0;
+
+    // Tokens of the open objects and arrays
+    QVarLengthArray<quint32, 64> open;
+
+    auto parseKey = [&]() -> bool
+    {
+        pos = skipWhitespace(json, pos, size);
+
+        if (pos == size || json[pos] != '"')
+            return fail("Expected a string as key", pos);
+
+        Token key;
+        key.start = quint32(pos);
+        key.type = HttpJsonValue::TYPE_STRING;
+        key.next = quint32(m_tokens.size() + 1);
+
+        pos = scanString(pos, key.escaped);
+
+        if (pos < 0)
+            return false;
+
+        key.end = quint32(pos);
+        m_tokens.append(key);
+
+        pos = skipWhitespace(json, pos, size);
+
+        if (pos == size || json[pos] != ':')
+            return fail("Expected :", pos);
+
+        ++pos;
+
+        return true;
+    };
+
+    auto isLiteral = [&](QByteArrayView literal)
+    {
+        return size - pos >= literal.size() && memcmp(json + pos, literal.data(), literal.size()) == 0;
+    };
+
+    forever
+    {
+        pos = skipWhitespace(json, pos, size);
+
+        if (pos == size)
+            return fail("Unexpected end of document", pos);
+
+        const char c = json[pos];
+
+        Token token;
+        token.start = quint32(pos);
+        token.next = quint32(m_tokens.size() + 1);
+
+        if (c == '{' || c == '[')
+        {
+            if (open.size() == MAX_DEPTH)
+                return fail("Nesting too deep", pos);
+
+            // End and next are set when it is closed
+            token.type = c == '{' ? HttpJsonValue::TYPE_OBJECT : HttpJsonValue::TYPE_ARRAY;
+            open.append(quint32(m_tokens.size()));
+            m_tokens.append(token);
+
+            pos = skipWhitespace(json, pos + 1, size);
+
+            // Empty ones are closed below, like after their last value
+            if (pos == size || json[pos] != (c == '{' ? '}' : ']'))
+            {
+                if (c == '{' && !parseKey())
+                    return false;
+
+                continue;
+            }
+        }
+        else
+        {
+            if (c == '"')
+            {
+                token.type = HttpJsonValue::TYPE_STRING;
+                pos = scanString(pos, token.escaped);
+            }
+            else if (c == '-' || isDigit(c))
+            {
+                token.type = HttpJsonValue::TYPE_NUMBER;
+                pos = scanNumber(pos);
+            }
+            else if (isLiteral("true"))
+            {
+                token.type = HttpJsonValue::TYPE_BOOL;
+                pos += 4;
+            }
+            else if (isLiteral("false"))
+            {
+                token.type = HttpJsonValue::TYPE_BOOL;
+                pos += 5;
+            }
+            else if (isLiteral("null"))
+            {
+                token.type = HttpJsonValue::TYPE_NULL;
+                pos += 4;
+            }
+            else
+                return fail("Unexpected character", pos);
+
+            if (pos < 0)
+                return false;
+
+            token.end = quint32(pos);
+            m_tokens.append(token);
+        }
+
+        // Behind a value: a separator or the end of the enclosing containers
+        forever
+        {
+            pos = skipWhitespace(json, pos, size);
+
+            if (open.isEmpty())
+            {
+                if (pos != size)
+                    return fail("Unexpected data behind the document", pos);
+
+                return true;
+            }
+
+            if (pos == size)
+                return fail("Unexpected end of document", pos);
+
+            Token& container = m_tokens[open.last()];
+            const bool object = container.type == HttpJsonValue::TYPE_OBJECT;
+
+            if (json[pos] == ',')
+            {
+                ++pos;
+
+                if (object && !parseKey())
+                    return false;
+
+                break;
+            }
+
+            if (json[pos] != (object ? '}' : ']'))
+                return fail(object ? "Expected , or }" : "Expected , or ]", pos);
+
+            container.end = quint32(++pos);
+            container.next = quint32(m_tokens.size());
+            open.removeLast();
+        }
+    }
+}
+
+bool HttpJsonDocument::fail(const char* error, qsizetype offset)
+{
+    m_tokens = QList<Token>();
+    m_errorString = QString::fromLatin1(error);
+    m_errorOffset = offset;
+
+    return false;
+}
+
+qsizetype HttpJsonDocument::scanString(qsizetype pos, bool& escaped)
+{
+    const uchar* const data = reinterpret_cast<const uchar*>(m_json);
+    const qsizetype start = pos++;
+
+    forever
+    {
+        // Plain ASCII is skipped up to the first quote, backslash, control character or multibyte sequence
+        while (m_size - pos >= 8)
+        {
+            const quint64 word = loadWord(m_json + pos);
+
+            if ((needsEscape(word) | (word & HIGH)) != 0)
+                break;
+
+            pos += 8;
+        }
+
+        if (pos == m_size)
+        {
+            fail("Unterminated string", start);
+            return -1;
+        }
+
+        const uchar c = data[pos];
+
+        if (c == '"')
+            return pos + 1;
+
+        if (c == '\\')
+        {
+            escaped = true;
+
+            const char next = pos + 1 < m_size ? m_json[pos + 1] : 0;
+
+            if (next == '"' || next == '\\' || next == '/' || next == 'b' || next == 'f' || next == 'n' || next == 'r' || next == 't')
+                pos += 2;
+            else if (next == 'u' && m_size - pos >= 6 && isHexDigit(m_json[pos + 2]) && isHexDigit(m_json[pos + 3])
+                     && isHexDigit(m_json[pos + 4]) && isHexDigit(m_json[pos + 5]))
+                pos += 6;
+            else
+            {
+                fail("Invalid escape sequence", pos);
+                return -1;
+            }
+        }
+        else if (c < 0x20)
+        {
+            fail("Control character in string", pos);
+            return -1;
+        }
+        else if (c >= 0x80)
+        {
+            const int length = utf8SequenceLength(data + pos, data + m_size);
+
+            if (length == 0)
+            {
+                fail("Invalid UTF-8", pos);
+                return -1;
+            }
+
+            pos += length;
+        }
+        else
+            ++pos;
+    }
+}
+
+qsizetype HttpJsonDocument::scanNumber(qsizetype pos)
+{
+    // https://datatracker.ietf.org/doc/html/rfc8259#section-6
+    const qsizetype start = pos;
+
+    if (m_json[pos] == '-')
+        ++pos;
+
+    if (pos < m_size && m_json[pos] == '0')
+        ++pos;
+    else if (pos < m_size && isDigit(m_json[pos]))
+    {
+        while (pos < m_size && isDigit(m_json[pos]))
+            ++pos;
+    }
+    else
+    {
+        fail("Invalid number", start);
+        return -1;
+    }
+
+    if (pos < m_size && m_json[pos] == '.')
+    {
+        if (++pos == m_size || !isDigit(m_json[pos]))
+        {
+            fail("Invalid number", start);
+            return -1;
+        }
+
+        while (pos < m_size && isDigit(m_json[pos]))
+            ++pos;
+    }
+
+    if (pos < m_size && (m_json[pos] == 'e' || m_json[pos] == 'E'))
+    {
+        if (++pos < m_size && (m_json[pos] == '+' || m_json[pos] == '-'))
+            ++pos;
+
+        if (pos == m_size || !isDigit(m_json[pos]))
+        {
+            fail("Invalid number", start);
+            return -1;
+        }
+
+        while (pos < m_size && isDigit(m_json[pos]))
+            ++pos;
+    }
+
+    return pos;
+}
+
+
+HttpJsonValue HttpJsonValue::operator[](QByteArrayView key) const
+{
+    if (getType() != TYPE_OBJECT)
+        return HttpJsonValue();
+
+    const QList<HttpJsonDocument::Token>& tokens = m_document->m_tokens;
+    const quint32 end = token().next;
+
+    // Keys are followed by their value, the value links to the next key
+    for (quint32 i = m_index + 1; i < end; i = tokens.at(i + 1).next)
+    {
+        if (HttpJsonValue(m_document, i).equals(key))
+            return HttpJsonValue(m_document, i + 1);
+    }
+
+    return HttpJsonValue();
+}
+
+HttpJsonValue HttpJsonValue::at(qsizetype index) const
+{
+    if (getType() != TYPE_ARRAY || index < 0)
+        return HttpJsonValue();
+
+    const QList<HttpJsonDocument::Token>& tokens = m_document->m_tokens;
+    const quint32 end = token().next;
+
+    for (quint32 i = m_index + 1; i < end; i = tokens.at(i).next)
+    {
+        if (index-- == 0)
+            return HttpJsonValue(m_document, i);
+    }
+
+    return HttpJsonValue();
+}
+
+qsizetype HttpJsonValue::size() const
+{
+    qsizetype count = 0;
+
+    for (auto it = begin(); it != end(); ++it)
+        ++count;
+
+    return count;
+}
+
+bool HttpJsonValue::toBool(bool defaultValue) const
+{
+    if (getType() != TYPE_BOOL)
+        return defaultValue;
+
+    return m_document->m_json[token().start] == 't';
+}
+
+qint64 HttpJsonValue::toInteger(qint64 defaultValue) const
+{
+    if (getType() != TYPE_NUMBER)
+        return defaultValue;
+
+    const QByteArrayView raw = getRawView();
+
+    bool ok = false;
+    const qint64 value = raw.toLongLong(&ok);
+
+    if (ok)
+        return value;
+
+    // Fractions and exponents, e.g. 1.0 or 1e3
+    const double number = raw.toDouble(&ok);
+
+    if (!ok || std::floor(number) != number || number < -9223372036854775808.0 || number >= 9223372036854775808.0)
+        return defaultValue;
+
+    return qint64(number);
+}
+
+int HttpJsonValue::toInt(int defaultValue) const
+{
+    const qint64 value = toInteger(defaultValue);
+
+    if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max())
+        return defaultValue;
+
+    return int(value);
+}
+
+double HttpJsonValue::toDouble(double defaultValue) const
+{
+    if (getType() != TYPE_NUMBER)
+        return defaultValue;
+
+    bool ok = false;
+    const double value = getRawView().toDouble(&ok);
+
+    return ok ? value : defaultValue;
+}
+
+QString HttpJsonValue::toString(const QString& defaultValue) const
+{
+    if (getType() != TYPE_STRING)
+        return defaultValue;
+
+    return token().escaped ? QString::fromUtf8(unescape(rawString())) : QString::fromUtf8(rawString());
+}
+
+QByteArray HttpJsonValue::toUtf8() const
+{
+    if (getType() != TYPE_STRING)
+        return QByteArray();
+
+    return token().escaped ? unescape(rawString()) : rawString().toByteArray();
+}
+
+bool HttpJsonValue::equals(QByteArrayView text) const
+{
+    if (getType() != TYPE_STRING)
+        return false;
+
+    return token().escaped ? unescape(rawString()) == text : rawString() == text;
+}
+
+QByteArrayView HttpJsonValue::getRawView() const
+{
+    if (!m_document)
+        return QByteArrayView();
+
+    const HttpJsonDocument::Token& t = token();
+
+    return QByteArrayView(m_document->m_json + t.start, t.end - t.start);
+}
+
+HttpJsonValue::const_iterator HttpJsonValue::begin() const
+{
+    switch (getType())
+    {
+    case TYPE_ARRAY:
+        return const_iterator(m_document, m_index + 1, false);
+    case TYPE_OBJECT:
+        return const_iterator(m_document, m_index + 2, true);
+    default:
+        return const_iterator(m_document, 0, false);
+    }
+}
+
+HttpJsonValue::const_iterator HttpJsonValue::end() const
+{
+    switch (getType())
+    {
+    case TYPE_ARRAY:
+        return const_iterator(m_document, token().next, false);
+    case TYPE_OBJECT:
+        return const_iterator(m_document, token().next + 1, true);
+    default:
+        return const_iterator(m_document, 0, false);
+    }
+}
+
+QByteArrayView HttpJsonValue::rawString() const
+{
+    const HttpJsonDocument::Token& t = token();
+
+    return QByteArrayView(m_document->m_json + t.start + 1, t.end - t.start - 2);
+}
+
+QByteArray HttpJsonValue::unescape(QByteArrayView raw)
+{
+    // Only called for validated strings
+    QByteArray result;
+    result.reserve(raw.size());
+
+    qsizetype pos = 0;
+
+    while (pos < raw.size())
+    {
+        const qsizetype backslash = raw.indexOf('\\', pos);
+
+        if (backslash < 0)
+        {
+            result.append(raw.sliced(pos));
+            break;
+        }
+
+        result.append(raw.sliced(pos, backslash - pos));
+
+        const char c = raw[backslash + 1];
+        pos = backslash + 2;
+
+        switch (c)
+        {
+        case 'b': result.append('\b'); break;
+        case 'f': result.append('\f'); break;
+        case 'n': result.append('\n'); break;
+        case 'r': result.append('\r'); break;
+        case 't': result.append('\t'); break;
+        case 'u':
+        {
+            // https://datatracker.ietf.org/doc/html/rfc8259#section-7
+            // -> Characters outside the BMP are escaped as surrogate pairs, lone surrogates become U+FFFD
+            char32_t code = hexValue(raw.data() + pos);
+            pos += 4;
+
+            if (QChar::isHighSurrogate(code) && raw.size() - pos >= 6 && raw[pos] == '\\' && raw[pos + 1] == 'u')
+            {
+                const char32_t low = hexValue(raw.data() + pos + 2);
+
+                if (QChar::isLowSurrogate(low))
+                {
+                    code = QChar::surrogateToUcs4(char16_t(code), char16_t(low));
+                    pos += 6;
+                }
+            }
+
+            if (QChar::isSurrogate(code))
+                code = QChar::ReplacementCharacter;
+
+            char buffer[4];
+            result.append(buffer, writeUtf8(buffer, code) - buffer);
+            break;
+        }
+        default:
+            result.append(c);
+        }
+    }
+
+    return result;
+}
+
+
+QString HttpJsonValue::const_iterator::key() const
+{
+    return m_object ? HttpJsonValue(m_document, m_index - 1).toString() : QString();
+}
+
+HttpJsonValue::const_iterator& HttpJsonValue::const_iterator::operator++()
+{
+    m_index = m_document->m_tokens.at(m_index).next + (m_object ? 1 : 0);
+
+    return *this;
+}
+
+
+void HttpJsonWriter::beginObject()
+{
+    beginContainer('{');
+}
+
+void HttpJsonWriter::endObject()
+{
+    endContainer('}');
+}
+
+void HttpJsonWriter::beginArray()
+{
+    beginContainer('[');
+}
+
+void HttpJsonWriter::endArray()
+{
+    endContainer(']');
+}
+
+void HttpJsonWriter::writeKey(QByteArrayView key)
+{
+    beforeValue();
+
+    m_target.append('"');
+    appendEscaped(key);
+    m_target.append("\":");
+
+    m_afterKey = true;
+}
+
+void HttpJsonWriter::writeKey(QStringView key)
+{
+    beforeValue();
+
+    m_target.append('"');
+    appendEscaped(key);
+    m_target.append("\":");
+
+    m_afterKey = true;
+}
+
+void HttpJsonWriter::writeString(QByteArrayView text)
+{
+    beforeValue();
+
+    m_target.append('"');
+    appendEscaped(text);
+    m_target.append('"');
+}
+
+void HttpJsonWriter::writeString(QStringView text)
+{
+    beforeValue();
+
+    m_target.append('"');
+    appendEscaped(text);
+    m_target.append('"');
+}
+
+void HttpJsonWriter::writeInteger(qint64 value)
+{
+    beforeValue();
+
+    char buffer[24];
+    const std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+    m_target.append(buffer, result.ptr - buffer);
+}
+
+void HttpJsonWriter::writeDouble(double value)
+{
+    beforeValue();
+
+    if (std::isfinite(value))
+        m_target.append(QByteArray::number(value, 'g', QLocale::FloatingPointShortest));
+    else
+        m_target.append("null");
+}
+
+void HttpJsonWriter::writeBool(bool value)
+{
+    beforeValue();
+
+    m_target.append(value ? "true" : "false");
+}
+
+void HttpJsonWriter::writeNull()
+{
+    beforeValue();
+
+    m_target.append("null");
+}
+
+void HttpJsonWriter::writeRaw(QByteArrayView json)
+{
+    beforeValue();
+
+    m_target.append(json);
+}
+
+void HttpJsonWriter::beforeValue()
+{
+    m_written = true;
+
+    // The value of a member follows its key without a comma
+    if (m_afterKey)
+        m_afterKey = false;
+    else if (!m_open.isEmpty())
+    {
+        if (m_open.last())
+            m_open.last() = false;
+        else
+            m_target.append(',');
+    }
+}
+
+void HttpJsonWriter::beginContainer(char bracket)
+{
+    beforeValue();
+
+    m_target.append(bracket);
+    m_open.append(true);
+}
+
+void HttpJsonWriter::endContainer(char bracket)
+{
+    Q_ASSERT(!m_open.isEmpty());
+
+    if (!m_open.isEmpty())
+        m_open.removeLast();
+
+    m_target.append(bracket);
+}
+
+void HttpJsonWriter::appendEscaped(QByteArrayView text)
+{
+    const char* const data = text.data();
+    const qsizetype size = text.size();
+
+    // Bytes not yet appended start at run, multibyte sequences are copied as they are
+    qsizetype run = 0;
+    qsizetype pos = 0;
+
+    forever
+    {
+        while (size - pos >= 8 && needsEscape(loadWord(data + pos)) == 0)
+            pos += 8;
+
+        if (pos == size)
+            break;
+
+        const uchar c = uchar(data[pos]);
+
+        if (c == '"' || c == '\\' || c < 0x20)
+        {
+            char buffer[6];
+
+            m_target.append(data + run, pos - run);
+            m_target.append(buffer, writeEscape(buffer, c) - buffer);
+
+            run = pos + 1;
+        }
+
+        ++pos;
+    }
+
+    m_target.append(data + run, size - run);
+}
+
+void HttpJsonWriter::appendEscaped(QStringView text)
+{
+    const char16_t* const data = text.utf16();
+    const qsizetype size = text.size();
+    qsizetype pos = 0;
+
+    // Encoded in place, in chunks sized for the worst case of 6 bytes per character (\u00XX)
+    while (pos < size)
+    {
+        const qsizetype end = qMin<qsizetype>(size, pos + 4096);
+        const qsizetype offset = m_target.size();
+
+        m_target.resize(offset + (end - pos) * 6);
+
+        char* const start = m_target.data() + offset;
+        char* out = start;
+
+        while (pos < end)
+        {
+            const char16_t c = data[pos++];
+
+            if (c < 0x80)
+            {
+                if (c == '"' || c == '\\' || c < 0x20)
+                    out = writeEscape(out, c);
+                else
+                    *out++ = char(c);
+            }
+            else if (QChar::isHighSurrogate(c) && pos < size && QChar::isLowSurrogate(data[pos]))
+            {
+                // The pair may end behind the chunk, its 4 bytes still fit
+                out = writeUtf8(out, QChar::surrogateToUcs4(c, data[pos++]));
+            }
+            else
+            {
+                // Lone surrogates are not representable in UTF-8
+                out = writeUtf8(out, QChar::isSurrogate(c) ? char32_t(QChar::ReplacementCharacter) : char32_t(c));
+            }
+        }
+
+        m_target.resize(offset + (out - start));
+    }
+}
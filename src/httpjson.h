@@ -0,0 +1,230 @@
+#ifndef HTTPJSON_H
+#define HTTPJSON_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+#include <QStringView>
+#include <QVarLengthArray>
+
+
+class HttpJsonValue;
+
+
+// https://datatracker.ietf.org/doc/html/rfc8259
+// JSON text validated and indexed in one pass, without building a DOM. The index is a flat list of tokens
+// (one per value and key) with the offsets of the value and a link behind its children, so lookups skip
+// nested values and strings and numbers are only decoded when a handler reads them. The text is shared,
+// not copied. Values are positions in the index and valid as long as the document they come from.
+class HttpJsonDocument
+{
+public:
+    // Deeper nesting is rejected, as is text of 4 GiB and more
+    static constexpr int MAX_DEPTH = 1024;
+
+    HttpJsonDocument() = default;
+    explicit HttpJsonDocument(const QByteArray& json);
+
+    // Part of a larger buffer, e.g. the body in the buffer of a request
+    HttpJsonDocument(const QByteArray& buffer, qsizetype offset, qsizetype size);
+
+    bool isValid() const { return !m_tokens.isEmpty(); }
+
+    // First error, with the byte offset into the text (-1 if valid)
+    const QString& getErrorString() const { return m_errorString; }
+    qsizetype getErrorOffset() const { return m_errorOffset; }
+
+    HttpJsonValue getRoot() const;
+    HttpJsonValue operator[](QByteArrayView key) const;
+
+    QByteArrayView getText() const { return QByteArrayView(m_json, m_size); }
+
+private:
+    friend class HttpJsonValue;
+
+    struct Token
+    {
+        quint32 start = 0;      // First byte, the quote of a string
+        quint32 end = 0;        // Behind the last byte
+        quint32 next = 0;       // Index of the token behind the value and all its children
+        quint8 type = 0;        // HttpJsonValue::TYPE
+        bool escaped = false;   // String with backslash escapes
+    };
+
+    QByteArray m_buffer;
+    const char* m_json = nullptr;
+    qsizetype m_size = 0;
+
+    QList<Token> m_tokens;
+
+    QString m_errorString;
+    qsizetype m_errorOffset = -1;
+
+    bool parse();
+    bool fail(const char* error, qsizetype offset);
+
+    // Offset behind the closing quote, -1 on errors
+    qsizetype scanString(qsizetype pos, bool& escaped);
+    qsizetype scanNumber(qsizetype pos);
+};
+
+
+// Value in an HttpJsonDocument, cheap to copy. Missing members and elements are TYPE_UNDEFINED,
+// conversions return the default value for other types.
+class HttpJsonValue
+{
+public:
+    enum TYPE
+    {
+        TYPE_UNDEFINED,
+        TYPE_NULL,
+        TYPE_BOOL,
+        TYPE_NUMBER,
+        TYPE_STRING,
+        TYPE_ARRAY,
+        TYPE_OBJECT,
+    };
+
+    HttpJsonValue() = default;
+
+    TYPE getType() const { return m_document ? TYPE(token().type) : TYPE_UNDEFINED; }
+
+    bool isUndefined() const { return getType() == TYPE_UNDEFINED; }
+    bool isNull() const { return getType() == TYPE_NULL; }
+    bool isBool() const { return getType() == TYPE_BOOL; }
+    bool isNumber() const { return getType() == TYPE_NUMBER; }
+    bool isString() const { return getType() == TYPE_STRING; }
+    bool isArray() const { return getType() == TYPE_ARRAY; }
+    bool isObject() const { return getType() == TYPE_OBJECT; }
+
+    // Member of an object, found by a scan over the keys that skips nested values. The first one for duplicate keys.
+    HttpJsonValue operator[](QByteArrayView key) const;
+
+    // Element of an array, found by a scan that skips nested values
+    HttpJsonValue at(qsizetype index) const;
+
+    // Elements of an array or members of an object, counted over the index
+    qsizetype size() const;
+
+    bool toBool(bool defaultValue = false) const;
+
+    // Only for numbers without fraction within the range, like QJsonValue::toInteger()
+    qint64 toInteger(qint64 defaultValue = 0) const;
+    int toInt(int defaultValue = 0) const;
+
+    double toDouble(double defaultValue = 0.0) const;
+
+    // Unescaped string
+    QString toString(const QString& defaultValue = QString()) const;
+    QByteArray toUtf8() const;
+
+    // String equal to the UTF-8 text, compared without decoding unless the string has escapes
+    bool equals(QByteArrayView text) const;
+
+    // JSON text of the value as it appears in the document, strings with quotes
+    QByteArrayView getRawView() const;
+
+    // Elements of an array or members of an object in document order
+    class const_iterator
+    {
+    public:
+        HttpJsonValue operator*() const { return HttpJsonValue(m_document, m_index); }
+
+        // Key of an object member, empty for array elements
+        QString key() const;
+
+        const_iterator& operator++();
+
+        bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const const_iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        friend class HttpJsonValue;
+
+        const HttpJsonDocument* m_document = nullptr;
+        quint32 m_index = 0;
+
+        // Positioned on the value, the key is the token before it
+        bool m_object = false;
+
+        const_iterator(const HttpJsonDocument* document, quint32 index, bool object) :
+            m_document(document), m_index(index), m_object(object) {}
+    };
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    friend class HttpJsonDocument;
+
+    const HttpJsonDocument* m_document = nullptr;
+    quint32 m_index = 0;
+
+    HttpJsonValue(const HttpJsonDocument* document, quint32 index) : m_document(document), m_index(index) {}
+
+    const HttpJsonDocument::Token& token() const { return m_document->m_tokens.at(m_index); }
+
+    // Contents of a string token without the quotes
+    QByteArrayView rawString() const;
+
+    static QByteArray unescape(QByteArrayView raw);
+};
+
+
+// https://datatracker.ietf.org/doc/html/rfc8259
+// Appends JSON text to a buffer, e.g. HttpResponse::getBodyBuffer(), without an intermediate QJsonObject.
+// Strings are escaped (and converted from UTF-16) in one pass, commas are inserted as needed.
+// The structure is not checked beyond that, isComplete() tells whether all containers are closed.
+class HttpJsonWriter
+{
+public:
+    explicit HttpJsonWriter(QByteArray& target) : m_target(target) {}
+
+    HttpJsonWriter(const HttpJsonWriter&) = delete;
+    HttpJsonWriter& operator=(const HttpJsonWriter&) = delete;
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    // Key of the next member of an object, the value follows
+    void writeKey(QByteArrayView key);
+    void writeKey(QStringView key);
+
+    // UTF-8 or UTF-16 text
+    void writeString(QByteArrayView text);
+    void writeString(QStringView text);
+
+    void writeInteger(qint64 value);
+
+    // NaN and infinity are not representable and written as null
+    void writeDouble(double value);
+
+    void writeBool(bool value);
+    void writeNull();
+
+    // Already valid JSON, e.g. HttpJsonValue::getRawView()
+    void writeRaw(QByteArrayView json);
+
+    bool isComplete() const { return m_written && m_open.isEmpty(); }
+
+private:
+    QByteArray& m_target;
+
+    // One per open container, true until its first element
+    QVarLengthArray<bool, 32> m_open;
+
+    bool m_afterKey = false;
+    bool m_written = false;
+
+    void beforeValue();
+    void beginContainer(char bracket);
+    void endContainer(char bracket);
+
+    void appendEscaped(QByteArrayView text);
+    void appendEscaped(QStringView text);
+};
+
+#endif // HTTPJSON_H
@@ -0,0 +1,60 @@
+#include "httploadshedder.h"
+
+
+HttpLoadShedder::HttpLoadShedder()
+{
+    m_clock.start();
+
+    setRetryAfter(m_retryAfter);
+}
+
+void HttpLoadShedder::setRetryAfter(int seconds)
+{
+    m_retryAfter = qMax(0, seconds);
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-10.2.3
+    m_response = HttpResponse(HttpResponse::SERVICE_UNAVAILABLE);
+    m_response.setRawHeader(HttpHeaders::CONTENT_TYPE, QByteArrayLiteral("text/plain; charset=utf-8"));
+    m_response.setRawHeader(HttpHeaders::RETRY_AFTER, QByteArray::number(m_retryAfter));
+    m_response.setBody(QByteArrayLiteral("503 Service Unavailable"));
+}
+
+bool HttpLoadShedder::shouldShed(qint64 delay, HttpRouteOptions::PRIORITY priority)
+{
+    if (m_target <= 0)
+        return false;
+
+    const qint64 target = qint64(m_target) * 1000;
+    const qint64 interval = qint64(m_interval) * 1000;
+    const qint64 now = m_clock.nsecsElapsed() / 1000;
+    const qint64 intervalEnd = m_intervalEnd.loadRelaxed();
+
+    if (now >= intervalEnd)
+    {
+        // One thread closes the interval, its delay starts the next one.
+        // Without any request for a whole interval the queue has drained.
+        if (m_intervalEnd.testAndSetRelaxed(intervalEnd, now + interval))
+        {
+            const qint64 minDelay = m_minDelay.fetchAndStoreRelaxed(delay);
+            m_overloaded.storeRelaxed(now < intervalEnd + interval && minDelay > target ? 1 : 0);
+        }
+    }
+    else
+    {
+        qint64 minDelay = m_minDelay.loadRelaxed();
+
+        while (delay < minDelay && !m_minDelay.testAndSetRelaxed(minDelay, delay, minDelay))
+        {
+        }
+    }
+
+    if (priority == HttpRouteOptions::CRITICAL || !m_overloaded.loadRelaxed())
+        return false;
+
+    if (delay <= (priority == HttpRouteOptions::LOW ? target : 2 * target))
+        return false;
+
+    m_shedCount.fetchAndAddRelaxed(1);
+
+    return true;
+}
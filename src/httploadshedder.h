@@ -0,0 +1,61 @@
+#ifndef HTTPLOADSHEDDER_H
+#define HTTPLOADSHEDDER_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+
+#include <limits>
+
+#include "httpresponse.h"
+#include "httprouter.h"
+
+
+// CoDel-style overload detection on the queueing delay of requests (first byte until the handler starts).
+// If even the shortest delay of an interval was above the target, the queue does not drain and the server
+// counts as overloaded for the next interval. Requests which waited too long by then are answered with
+// 503 and Retry-After instead of running their handler, the client has likely given up on them anyway.
+// https://queue.acm.org/detail.cfm?id=2209336
+// Thread-safe, shared by all workers. Settings have to be set before start().
+class HttpLoadShedder
+{
+public:
+    HttpLoadShedder();
+
+    // ms, 0 = disabled. Normal requests are shed above twice the target, low priority ones above the target.
+    void setTarget(int msec) { m_target = qMax(0, msec); }
+    int getTarget() const { return m_target; }
+
+    // ms, should be about the time a request takes when the server is not overloaded
+    void setInterval(int msec) { m_interval = qMax(1, msec); }
+    int getInterval() const { return m_interval; }
+
+    // Seconds
+    void setRetryAfter(int seconds);
+    int getRetryAfter() const { return m_retryAfter; }
+
+    // delay in µs, also records it. Critical requests are never shed.
+    bool shouldShed(qint64 delay, HttpRouteOptions::PRIORITY priority);
+
+    // Complete except for the connection headers, the body is shared by all copies
+    const HttpResponse& getResponse() const { return m_response; }
+
+    bool isOverloaded() const { return m_overloaded.loadRelaxed() != 0; }
+    quint64 getShedCount() const { return m_shedCount.loadRelaxed(); }
+
+private:
+    int m_target = 0;
+    int m_interval = 100;
+    int m_retryAfter = 1;
+
+    HttpResponse m_response;
+
+    // Times in µs since the clock was started
+    QElapsedTimer m_clock;
+    QAtomicInteger<qint64> m_intervalEnd = 0;
+    QAtomicInteger<qint64> m_minDelay = std::numeric_limits<qint64>::max();
+    QAtomicInt m_overloaded = 0;
+
+    QAtomicInteger<quint64> m_shedCount = 0;
+};
+
+#endif // HTTPLOADSHEDDER_H
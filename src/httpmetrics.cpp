@@ -0,0 +1,299 @@
+#include "httpmetrics.h"
+
+#include <QtAlgorithms>
+
+
+void HttpHistogram::Snapshot::add(const HttpHistogram& histogram)
+{
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        const quint64 value = histogram.m_buckets[i].loadRelaxed();
+
+        buckets[i] += value;
+        count += value;
+    }
+
+    sum += histogram.m_sum.loadRelaxed();
+}
+
+quint64 HttpHistogram::Snapshot::getCountBelow(quint64 limit) const
+{
+    quint64 result = 0;
+
+    // Integer values -> everything below limit + 1
+    for (int i = 0; i < BUCKET_COUNT && getUpperBound(i) <= limit + 1; ++i)
+        result += buckets[i];
+
+    return result;
+}
+
+void HttpHistogram::record(qint64 value)
+{
+    m_buckets[getBucket(value)].fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(quint64(qMax<qint64>(0, value)));
+}
+
+int HttpHistogram::getBucket(qint64 value)
+{
+    const quint64 v = quint64(qBound<qint64>(0, value, (qint64(1) << (MAX_EXPONENT + 1)) - 1));
+
+    if (v < SUB_BUCKETS)
+        return int(v);
+
+    // Position of the highest bit selects the power of 2, the bits below it the sub-bucket
+    const int exponent = 63 - qCountLeadingZeroBits(v);
+
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + int((v >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+quint64 HttpHistogram::getUpperBound(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return quint64(bucket) + 1;
+
+    const int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    const int subBucket = bucket % SUB_BUCKETS;
+
+    return quint64(SUB_BUCKETS + subBucket + 1) << (exponent - SUB_BUCKET_BITS);
+}
+
+
+HttpMetrics::HttpMetrics()
+{
+    for (int i = 0; i < METHOD_SLOTS; ++i)
+        m_unmatched[i] = new HttpRouteMetrics(static_cast<HttpRequest::METHOD>(i - 1), QString());
+}
+
+HttpMetrics::~HttpMetrics()
+{
+    qDeleteAll(m_routes);
+
+    for (HttpRouteMetrics* const route : m_unmatched)
+        delete route;
+}
+
+HttpRouteMetrics* HttpMetrics::getRoute(HttpRequest::METHOD method, const QString& pattern)
+{
+    const QString key = QString::number(method) + " " + pattern;
+
+    QMutexLocker locker(&m_mutex);
+
+    HttpRouteMetrics* route = m_routesByKey.value(key, nullptr);
+
+    if (!route)
+    {
+        route = new HttpRouteMetrics(method, pattern);
+
+        m_routes.append(route);
+        m_routesByKey.insert(key, route);
+    }
+
+    return route;
+}
+
+HttpRouteMetrics* HttpMetrics::getUnmatchedRoute(HttpRequest::METHOD method) const
+{
+    return m_unmatched[qBound(0, int(method) + 1, METHOD_SLOTS - 1)];
+}
+
+quint64 HttpMetrics::getConnectionCount() const
+{
+    quint64 result = 0;
+
+    for (const Counters& counters : m_counters)
+        result += counters.connectionsOpened.loadRelaxed();
+
+    return result;
+}
+
+quint64 HttpMetrics::getActiveConnectionCount() const
+{
+    quint64 closed = 0;
+
+    // Closed first, a connection cannot be closed before it is opened
+    for (const Counters& counters : m_counters)
+        closed += counters.connectionsClosed.loadAcquire();
+
+    const quint64 opened = getConnectionCount();
+
+    return opened > closed ? opened - closed : 0;
+}
+
+quint64 HttpMetrics::getBytesReceived() const
+{
+    quint64 result = 0;
+
+    for (const Counters& counters : m_counters)
+        result += counters.bytesReceived.loadRelaxed();
+
+    return result;
+}
+
+quint64 HttpMetrics::getBytesSent() const
+{
+    quint64 result = 0;
+
+    for (const Counters& counters : m_counters)
+        result += counters.bytesSent.loadRelaxed();
+
+    return result;
+}
+
+void HttpMetrics::appendPrometheus(QByteArray& text) const
+{
+    appendMetricHeader(text, "httpserver_connections_total", "counter", "Accepted connections.");
+    text += "httpserver_connections_total " + QByteArray::number(getConnectionCount()) + "\n";
+
+    appendMetricHeader(text, "httpserver_connections_active", "gauge", "Open connections.");
+    text += "httpserver_connections_active " + QByteArray::number(getActiveConnectionCount()) + "\n";
+
+    appendMetricHeader(text, "httpserver_received_bytes_total", "counter", "Bytes read from connections.");
+    text += "httpserver_received_bytes_total " + QByteArray::number(getBytesReceived()) + "\n";
+
+    appendMetricHeader(text, "httpserver_sent_bytes_total", "counter", "Bytes of responses written to connections.");
+    text += "httpserver_sent_bytes_total " + QByteArray::number(getBytesSent()) + "\n";
+
+    QList<const HttpRouteMetrics*> listRoutes;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        listRoutes.reserve(m_routes.size() + METHOD_SLOTS);
+
+        for (const HttpRouteMetrics* const route : m_routes)
+            listRoutes.append(route);
+    }
+
+    for (const HttpRouteMetrics* const route : m_unmatched)
+        listRoutes.append(route);
+
+    // Common latency boundaries, in µs for the snapshot
+    static const struct { const char* label; quint64 limit; } boundaries[] =
+    {
+        { "0.0001", 100 }, { "0.00025", 250 }, { "0.0005", 500 }, { "0.001", 1000 },
+        { "0.0025", 2500 }, { "0.005", 5000 }, { "0.01", 10000 }, { "0.025", 25000 },
+        { "0.05", 50000 }, { "0.1", 100000 }, { "0.25", 250000 }, { "0.5", 500000 },
+        { "1", 1000000 }, { "2.5", 2500000 }, { "5", 5000000 }, { "10", 10000000 },
+    };
+
+    appendMetricHeader(text, "httpserver_request_duration_seconds", "histogram",
+                       "Time from the complete request to the response being handed to the connection, by route and status class.");
+
+    for (const HttpRouteMetrics* const route : std::as_const(listRoutes))
+    {
+        for (int statusClass = 0; statusClass < HttpRouteMetrics::STATUS_CLASSES; ++statusClass)
+        {
+            HttpHistogram::Snapshot snapshot;
+
+            if (!route->getSnapshot(statusClass, snapshot))
+                continue;
+
+            // Requests without a route are labeled with route="", patterns always start with /
+            const QByteArray labels = "method=\"" + escapeLabel(HttpRequest::getStringFromMethod(route->getMethod()))
+                                    + "\",route=\"" + escapeLabel(route->getPattern())
+                                    + "\",status=\"" + QByteArray::number(statusClass + 1) + "xx\"";
+
+            for (const auto& boundary : boundaries)
+            {
+                text += "httpserver_request_duration_seconds_bucket{" + labels + ",le=\"" + boundary.label + "\"} "
+                      + QByteArray::number(snapshot.getCountBelow(boundary.limit)) + "\n";
+            }
+
+            text += "httpserver_request_duration_seconds_bucket{" + labels + ",le=\"+Inf\"} " + QByteArray::number(snapshot.count) + "\n";
+            text += "httpserver_request_duration_seconds_sum{" + labels + "} " + QByteArray::number(double(snapshot.sum) / 1000000.0, 'f', 6) + "\n";
+            text += "httpserver_request_duration_seconds_count{" + labels + "} " + QByteArray::number(snapshot.count) + "\n";
+        }
+    }
+}
+
+void HttpMetrics::appendMetricHeader(QByteArray& text, const char* name, const char* type, const char* help)
+{
+    text += "# HELP ";
+    text += name;
+    text += ' ';
+    text += help;
+    text += "\n# TYPE ";
+    text += name;
+    text += ' ';
+    text += type;
+    text += '\n';
+}
+
+QByteArray HttpMetrics::escapeLabel(QStringView value)
+{
+    QByteArray result = value.toUtf8();
+
+    if (result.contains('\\'))
+        result.replace("\\", "\\\\");
+
+    if (result.contains('"'))
+        result.replace("\"", "\\\"");
+
+    if (result.contains('\n'))
+        result.replace("\n", "\\n");
+
+    return result;
+}
+
+int HttpMetrics::getStripe()
+{
+    static QAtomicInt nextStripe = 0;
+    thread_local const int stripe = nextStripe.fetchAndAddRelaxed(1) % STRIPES;
+
+    return stripe;
+}
+
+
+HttpRouteMetrics::HttpRouteMetrics(HttpRequest::METHOD method, const QString& pattern) :
+    m_method(method),
+    m_pattern(pattern)
+{
+
+}
+
+HttpRouteMetrics::~HttpRouteMetrics()
+{
+    for (auto& stripe : m_histograms)
+    {
+        for (QAtomicPointer<HttpHistogram>& histogram : stripe)
+            delete histogram.loadRelaxed();
+    }
+}
+
+void HttpRouteMetrics::record(int status, qint64 latency)
+{
+    const int statusClass = qBound(0, status / 100 - 1, STATUS_CLASSES - 1);
+    QAtomicPointer<HttpHistogram>& slot = m_histograms[HttpMetrics::getStripe()][statusClass];
+
+    HttpHistogram* histogram = slot.loadAcquire();
+
+    if (!histogram)
+    {
+        // Another thread on the same stripe may be first
+        HttpHistogram* const created = new HttpHistogram();
+
+        if (slot.testAndSetOrdered(nullptr, created, histogram))
+            histogram = created;
+        else
+            delete created;
+    }
+
+    histogram->record(latency);
+}
+
+bool HttpRouteMetrics::getSnapshot(int statusClass, HttpHistogram::Snapshot& snapshot) const
+{
+    bool found = false;
+
+    for (const auto& stripe : m_histograms)
+    {
+        const HttpHistogram* const histogram = stripe[statusClass].loadAcquire();
+
+        if (histogram)
+        {
+            snapshot.add(*histogram);
+            found = true;
+        }
+    }
+
+    return found;
+}
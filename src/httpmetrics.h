@@ -0,0 +1,145 @@
+#ifndef HTTPMETRICS_H
+#define HTTPMETRICS_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include "httprequest.h"
+
+
+// Latency histogram in µs with log-linear buckets (HDR style): 4 buckets per power of 2,
+// so a bucket is at most 25% wider than its lower bound. Recording is one atomic increment.
+class HttpHistogram
+{
+public:
+    static constexpr int SUB_BUCKET_BITS = 2;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    // 2^36 µs = 19 h, larger values are counted in the last bucket
+    static constexpr int MAX_EXPONENT = 35;
+    static constexpr int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    // Plain copy for aggregation
+    struct Snapshot
+    {
+        quint64 buckets[BUCKET_COUNT] = {};
+        quint64 sum = 0;
+        quint64 count = 0;
+
+        void add(const HttpHistogram& histogram);
+
+        // Values <= limit, limit in µs
+        quint64 getCountBelow(quint64 limit) const;
+    };
+
+    void record(qint64 value);
+
+    static int getBucket(qint64 value);
+
+    // Exclusive
+    static quint64 getUpperBound(int bucket);
+
+private:
+    QAtomicInteger<quint64> m_buckets[BUCKET_COUNT] = {};
+    QAtomicInteger<quint64> m_sum = 0;
+};
+
+
+class HttpRouteMetrics;
+
+
+// Request, connection and traffic metrics of a server, exported in the Prometheus text format.
+// Counters are striped over threads (one stripe per worker thread or epoll loop as long as there are
+// no more than STRIPES), so recording only touches cache lines of the own thread and never locks.
+// The stripes are summed up when the metrics are read.
+class HttpMetrics
+{
+public:
+    static constexpr int STRIPES = 32;
+
+    HttpMetrics();
+    ~HttpMetrics();
+
+    // Created on first use and kept until the metrics are deleted, so the counters of a route
+    // continue when it is removed and added again. Locks, meant to be called when a route is added.
+    HttpRouteMetrics* getRoute(HttpRequest::METHOD method, const QString& pattern);
+
+    // Requests without a route (invalid, not found, redirected, ...)
+    HttpRouteMetrics* getUnmatchedRoute(HttpRequest::METHOD method) const;
+
+    void addConnection() { getCounters().connectionsOpened.fetchAndAddRelaxed(1); }
+    void removeConnection() { getCounters().connectionsClosed.fetchAndAddRelaxed(1); }
+
+    void addBytesReceived(qint64 bytes) { getCounters().bytesReceived.fetchAndAddRelaxed(bytes); }
+    void addBytesSent(qint64 bytes) { getCounters().bytesSent.fetchAndAddRelaxed(bytes); }
+
+    quint64 getConnectionCount() const;
+    quint64 getActiveConnectionCount() const;
+    quint64 getBytesReceived() const;
+    quint64 getBytesSent() const;
+
+    // https://prometheus.io/docs/instrumenting/exposition_formats/#text-based-format
+    void appendPrometheus(QByteArray& text) const;
+
+    static void appendMetricHeader(QByteArray& text, const char* name, const char* type, const char* help);
+    static QByteArray escapeLabel(QStringView value);
+
+    // Index of the calling thread
+    static int getStripe();
+
+private:
+    static constexpr int METHOD_SLOTS = HttpRequest::PATCH + 2;
+
+    struct alignas(64) Counters
+    {
+        QAtomicInteger<quint64> connectionsOpened = 0;
+        QAtomicInteger<quint64> connectionsClosed = 0;
+        QAtomicInteger<quint64> bytesReceived = 0;
+        QAtomicInteger<quint64> bytesSent = 0;
+    };
+
+    Counters m_counters[STRIPES];
+
+    // In the order of creation
+    QList<HttpRouteMetrics*> m_routes;
+    QHash<QString, HttpRouteMetrics*> m_routesByKey;
+    mutable QMutex m_mutex;
+
+    // Indexed by method + 1 (UNKNOWN = -1)
+    HttpRouteMetrics* m_unmatched[METHOD_SLOTS] = {};
+
+    Counters& getCounters() { return m_counters[getStripe()]; }
+};
+
+
+// Latency histograms of one route per status class (1xx - 5xx), allocated per stripe on first use
+class HttpRouteMetrics
+{
+public:
+    static constexpr int STATUS_CLASSES = 5;
+
+    HttpRouteMetrics(HttpRequest::METHOD method, const QString& pattern);
+    ~HttpRouteMetrics();
+
+    HttpRequest::METHOD getMethod() const { return m_method; }
+    const QString& getPattern() const { return m_pattern; }
+
+    // Latency in µs
+    void record(int status, qint64 latency);
+
+    // Summed over the stripes, false if nothing was recorded for the class
+    bool getSnapshot(int statusClass, HttpHistogram::Snapshot& snapshot) const;
+
+private:
+    HttpRequest::METHOD m_method;
+    QString m_pattern;
+
+    QAtomicPointer<HttpHistogram> m_histograms[HttpMetrics::STRIPES][STATUS_CLASSES];
+};
+
+#endif // HTTPMETRICS_H
@@ -1,7 +1,15 @@
 #include "httprequest.h"
 
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryFile>
 #include <QUrl>
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
 
 const QHash<HttpRequest::METHOD, QString> HttpRequest::m_methodTexts = initMethodTexts();
 
@@ -19,106 +27,457 @@ HttpRequest::HttpRequest(const QByteArray& data) :
 
 void HttpRequest::setData(const QByteArray& data)
 {
-    // https://developer.mozilla.org/en-US/docs/Web/HTTP/Messages#http_requests
+    reset();
+    appendData(data);
+
+    // The data is all there is -> a missing line end or empty line just ends the headers
+    if (m_parseState == REQUEST_LINE)
+    {
+        const QByteArrayView line = QByteArrayView(m_data).sliced(m_lineStart).trimmed();
+
+        if (!line.isEmpty())
+            parseRequestLine(line);
+
+        m_lineStart = m_data.size();
+    }
+
+    if (m_parseState == HEADERS)
+    {
+        const QByteArrayView line = QByteArrayView(m_data).sliced(m_lineStart).trimmed();
+
+        if (!line.isEmpty())
+            parseHeaderLine(line);
+
+        finishHeaders();
+    }
+
+    if (m_parseState == BODY)
+        m_parseState = ERROR;
+
+    m_valid = m_parseState == COMPLETE && m_method != UNKNOWN;
+}
+
+void HttpRequest::reset()
+{
+    // resize() instead of clear() keeps the capacity unless the buffer is still shared
+    m_data.resize(0);
+
+    m_parseState = REQUEST_LINE;
+    m_lineStart = 0;
+    m_bodyRemaining = 0;
+    m_startTimer.invalidate();
 
     m_method = UNKNOWN;
-    m_target = "";
-    m_protocol = "";
-    m_headers.clear();
+    m_methodRange = Range();
+    m_targetRange = Range();
+    m_protocolRange = Range();
+    m_bodyRange = Range();
+    m_headerRanges.clear();
+    m_headerIndex.clear();
+
+    m_bodyTooLarge = false;
+    m_continueAnswered = false;
+    m_bodySize = 0;
+    m_bodyFile.reset();
+
+    m_targetDecoded = false;
+    m_target.clear();
+    m_targetRaw.clear();
     m_targetParameters.clear();
-    m_body = "";
+    m_pathParameters.clear();
+
     m_valid = false;
+}
 
-    QByteArrayList lines = data.split('\n');
+qsizetype HttpRequest::appendData(const char* data, qsizetype size)
+{
+    // https://developer.mozilla.org/en-US/docs/Web/HTTP/Messages#http_requests
 
-    {
-        const QByteArrayList list = lines[0].split(' ');
+    qsizetype pos = 0;
 
-        if (list.size() < 3)
-            return;
+    if (m_data.isEmpty() && m_parseState == REQUEST_LINE && size > 0)
+        m_startTimer.start();
 
-        m_method = getMethodFromString(QString::fromLatin1(list[0]).trimmed());
-        m_targetRaw = QUrl::fromPercentEncoding(list[1]).trimmed();
+    // Request line and headers are processed as soon as a line is complete,
+    // only the new bytes are searched for the line end
+    while (pos < size && (m_parseState == REQUEST_LINE || m_parseState == HEADERS))
+    {
+        const char* const newline = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+        const qsizetype end = newline ? newline - data + 1 : size;
 
-        if (m_method == GET && m_targetRaw.contains('?'))
+        if (m_data.size() + end - pos > MAX_HEADER_SIZE)
         {
-            // Syntax: /target?par1=val1&par2=val2
+            m_parseState = ERROR;
+            return end;
+        }
 
-            const auto idx = m_targetRaw.indexOf('?');
-            m_target = m_targetRaw.mid(0, idx);
+        m_data.append(data + pos, end - pos);
+        pos = end;
 
-            const QStringList listPar = m_targetRaw.mid(idx + 1).split('&');
+        if (!newline)
+            break;
+
+        const QByteArrayView line = QByteArrayView(m_data).sliced(m_lineStart).trimmed();
+        m_lineStart = m_data.size();
+
+        if (m_parseState == REQUEST_LINE)
+        {
+            // Empty lines before the request line should be ignored
+            // https://datatracker.ietf.org/doc/html/rfc9112#section-2.2
+            if (!line.isEmpty())
+                parseRequestLine(line);
+        }
+        else if (line.isEmpty())
+            finishHeaders();
+        else
+            parseHeaderLine(line);
+    }
+
+    if (pos < size && m_parseState == BODY)
+    {
+        const qsizetype length = qMin(size - pos, m_bodyRemaining);
 
-            for (const auto& parPair : listPar)
+        if (m_bodyFile)
+        {
+            if (m_bodyFile->write(data + pos, length) != length)
             {
-                const QStringList par = parPair.split('=', Qt::KeepEmptyParts);
+                qWarning() << "Cannot write request body:" << m_bodyFile->errorString();
 
-                if (par.size() == 2 && par.at(0) != "")
-                    m_targetParameters.insert(par.at(0), par.at(1));
+                m_parseState = ERROR;
+                return size;
             }
         }
         else
-            m_target = m_targetRaw;
+        {
+            m_data.append(data + pos, length);
+            m_bodyRange.size += length;
+        }
 
-        m_protocol = QString::fromLatin1(list[2]).trimmed();
+        m_bodySize += length;
+        m_bodyRemaining -= length;
+        pos += length;
+
+        if (m_bodyRemaining == 0)
+        {
+            // Readers open the file by name -> the buffer of QFile has to be written
+            if (m_bodyFile && !m_bodyFile->flush())
+                m_parseState = ERROR;
+            else
+                m_parseState = COMPLETE;
+        }
     }
 
-    if (m_method != UNKNOWN)
-        m_valid = true;
+    m_valid = m_parseState == COMPLETE && m_method != UNKNOWN;
 
-    lines.pop_front();
+    return pos;
+}
 
-    bool isHeader = true;
+void HttpRequest::parseRequestLine(QByteArrayView line)
+{
+    // Syntax: <method> <target> <protocol>
 
-    for (const auto& line : lines)
+    const auto idxTarget = line.indexOf(' ');
+    const auto idxProtocol = idxTarget > 0 ? line.indexOf(' ', idxTarget + 1) : -1;
+
+    if (idxProtocol < 0)
     {
-        if (isHeader)
+        m_parseState = ERROR;
+        return;
+    }
+
+    const QByteArrayView method = line.first(idxTarget);
+    const QByteArrayView target = line.sliced(idxTarget + 1, idxProtocol - idxTarget - 1).trimmed();
+    QByteArrayView protocol = line.sliced(idxProtocol + 1).trimmed();
+
+    if (protocol.contains(' '))
+        protocol = protocol.first(protocol.indexOf(' '));
+
+    m_methodRange = range(method);
+    m_targetRange = range(target);
+    m_protocolRange = range(protocol);
+
+    m_method = getMethodFromString(method);
+
+    m_parseState = HEADERS;
+}
+
+void HttpRequest::parseHeaderLine(QByteArrayView line)
+{
+    const auto idx = line.indexOf(':');
+
+    if (idx > 0)
+    {
+        const QByteArrayView key = line.first(idx).trimmed();
+        const QByteArrayView value = line.sliced(idx + 1).trimmed();
+
+        if (!key.isEmpty() && !value.isEmpty())
         {
-            if (line.trimmed() == "")
-                isHeader = false;
-            else
-            {
-                const QString header = QString::fromLatin1(line.trimmed());
-                const auto idx = header.indexOf(':');
+            const HttpHeaders::HEADER header = HttpHeaders::lookup(key);
 
-                if (idx > 0)
-                {
-                    const QString key = header.mid(0, idx).trimmed();
-                    const QString value = header.mid(idx + 1).trimmed();
+            m_headerIndex.add(header, m_headerRanges.size());
+            m_headerRanges.append({ range(key), range(value), header });
+        }
+    }
+}
 
-                    if (key != "" && value != "")
-                        m_headers.insert(key, value);
-                }
-            }
+void HttpRequest::finishHeaders()
+{
+    // Only Content-Length framing is supported for request bodies
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-6.3
+
+    m_bodyRange = { m_data.size(), 0 };
+
+    if (!getHeaderView(HttpHeaders::TRANSFER_ENCODING).isEmpty())
+    {
+        m_parseState = ERROR;
+        return;
+    }
+
+    // The index only keeps the first field: all of them are checked, a proxy in front may use another one.
+    // Only digits, toLongLong() would also accept a sign and whitespace.
+    qlonglong contentLength = -1;
+
+    for (const HeaderRange& headerRange : std::as_const(m_headerRanges))
+    {
+        if (headerRange.header != HttpHeaders::CONTENT_LENGTH)
+            continue;
+
+        const QByteArrayView value = view(headerRange.value);
+        bool ok = std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; });
+        const qlonglong length = ok ? value.toLongLong(&ok) : -1;
+
+        if (!ok || (contentLength >= 0 && length != contentLength))
+        {
+            m_parseState = ERROR;
+            return;
         }
-        else
+
+        contentLength = length;
+    }
+
+    if (contentLength < 0)
+    {
+        m_parseState = COMPLETE;
+        return;
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-15.5.14
+    // -> Rejected before the body is read
+    if (m_maxBodySize > 0 && contentLength > m_maxBodySize)
+    {
+        m_bodyTooLarge = true;
+        m_parseState = ERROR;
+        return;
+    }
+
+    if (contentLength == 0)
+        m_parseState = COMPLETE;
+    else if (m_bodySpillThreshold > 0 && contentLength > m_bodySpillThreshold)
+    {
+        m_bodyFile = std::make_shared<QTemporaryFile>(QDir::tempPath() + "/HttpServer-XXXXXX.body");
+
+        if (!m_bodyFile->open())
         {
-            if (!m_body.isEmpty())
-                m_body.append("\r\n");
+            qWarning() << "Cannot create file for request body:" << m_bodyFile->errorString();
 
-            m_body.append(line.trimmed());
+            m_bodyFile.reset();
+            m_parseState = ERROR;
+            return;
         }
+
+        m_bodyRemaining = contentLength;
+        m_parseState = BODY;
+    }
+    else
+    {
+        // Body is appended to the same buffer, ranges are offsets and survive the reallocation
+        m_bodyRemaining = contentLength;
+        m_data.reserve(m_data.size() + qMin<qlonglong>(contentLength, MAX_BODY_RESERVE));
+        m_parseState = BODY;
     }
 }
 
-QString HttpRequest::getHeader(const QString& key, Qt::CaseSensitivity cs) const
+void HttpRequest::setBodyLimits(qint64 maxSize, qint64 spillThreshold)
 {
-    QString result = "";
+    m_maxBodySize = qMax<qint64>(0, maxSize);
+    m_bodySpillThreshold = qMax<qint64>(0, spillThreshold);
+}
 
-    if (cs == Qt::CaseInsensitive)
-        result = m_headers.value(key, "");
+bool HttpRequest::takeContinueExpectation()
+{
+    // Not for HTTP/1.0 clients, and not once the body is arriving anyway
+    if (m_continueAnswered || m_parseState != BODY || m_bodySize > 0 || getProtocolView() != "HTTP/1.1")
+        return false;
+
+    m_continueAnswered = true;
+
+    return getHeaderView(HttpHeaders::EXPECT).compare("100-continue", Qt::CaseInsensitive) == 0;
+}
+
+QByteArray HttpRequest::getBody() const
+{
+    if (!m_bodyFile)
+        return getBodyView().toByteArray();
+
+    const std::unique_ptr<QIODevice> device = getBodyDevice();
+
+    return device ? device->readAll() : QByteArray();
+}
+
+HttpJsonDocument HttpRequest::getJsonBody() const
+{
+    if (m_bodyFile)
+        return HttpJsonDocument(getBody());
+
+    return HttpJsonDocument(m_data, m_bodyRange.pos, m_bodyRange.size);
+}
+
+std::unique_ptr<QIODevice> HttpRequest::getBodyDevice() const
+{
+    if (m_bodyFile)
+    {
+        // Own descriptor, so every reader has its own position
+        auto file = std::make_unique<QFile>(m_bodyFile->fileName());
+
+        if (!file->open(QIODevice::ReadOnly))
+            return nullptr;
+
+        return file;
+    }
+
+    auto buffer = std::make_unique<QBuffer>();
+    buffer->setData(getBodyView().toByteArray());
+    buffer->open(QIODevice::ReadOnly);
+
+    return buffer;
+}
+
+HttpRequest::METHOD HttpRequest::getMethodFromString(QByteArrayView strMethod)
+{
+    static const QByteArrayView methods[] = { "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH" };
+
+    for (int i = 0; i < int(std::size(methods)); ++i)
+    {
+        if (strMethod == methods[i])
+            return static_cast<METHOD>(i);
+    }
+
+    return UNKNOWN;
+}
+
+const QString& HttpRequest::getTarget() const
+{
+    decodeTarget();
+
+    return m_target;
+}
+
+const QString& HttpRequest::getTargetRaw() const
+{
+    decodeTarget();
+
+    return m_targetRaw;
+}
+
+const QMultiHash<QString, QString>& HttpRequest::getTargetParameters() const
+{
+    decodeTarget();
+
+    return m_targetParameters;
+}
+
+void HttpRequest::decodeTarget() const
+{
+    if (m_targetDecoded)
+        return;
+
+    m_targetDecoded = true;
+    m_targetRaw = QUrl::fromPercentEncoding(getTargetView().toByteArray());
+
+    if (m_method == GET && m_targetRaw.contains('?'))
+    {
+        // Syntax: /target?par1=val1&par2=val2
+
+        const auto idx = m_targetRaw.indexOf('?');
+        m_target = m_targetRaw.mid(0, idx);
+
+        const QStringList listPar = m_targetRaw.mid(idx + 1).split('&');
+
+        for (const auto& parPair : listPar)
+        {
+            const QStringList par = parPair.split('=', Qt::KeepEmptyParts);
+
+            if (par.size() == 2 && par.at(0) != "")
+                m_targetParameters.insert(par.at(0), par.at(1));
+        }
+    }
     else
+        m_target = m_targetRaw;
+}
+
+QStringView HttpRequest::getPathParameterView(QStringView name) const
+{
+    for (const auto& parameter : m_pathParameters)
     {
-        const QStringList listKeys = m_headers.keys();
-        const auto idx = listKeys.indexOf(key, 0, cs);
+        if (parameter.first == name)
+            return parameter.second;
+    }
+
+    return QStringView();
+}
+
+QByteArrayView HttpRequest::getHeaderView(QByteArrayView key) const
+{
+    // Header names are case-insensitive
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-5.1
 
-        if (idx >= 0)
-            result = m_headers[listKeys[idx]];
+    const HttpHeaders::HEADER known = HttpHeaders::lookup(key);
+
+    if (known != HttpHeaders::UNKNOWN)
+        return getHeaderView(known);
+
+    for (const auto& header : m_headerRanges)
+    {
+        if (header.header == HttpHeaders::UNKNOWN && view(header.key).compare(key, Qt::CaseInsensitive) == 0)
+            return view(header.value);
     }
 
+    return QByteArrayView();
+}
+
+QByteArrayView HttpRequest::getHeaderView(HttpHeaders::HEADER header) const
+{
+    const qsizetype idx = m_headerIndex.get(header);
+
+    return idx >= 0 ? view(m_headerRanges.at(idx).value) : QByteArrayView();
+}
+
+QMultiHash<QString, QString> HttpRequest::getHeaders() const
+{
+    QMultiHash<QString, QString> result;
+
+    for (const auto& header : m_headerRanges)
+        result.insert(QString::fromLatin1(view(header.key)), QString::fromLatin1(view(header.value)));
+
     return result;
 }
 
+QString HttpRequest::getHeader(const QString& key, Qt::CaseSensitivity cs) const
+{
+    const QByteArray strKey = key.toLatin1();
+
+    if (cs == Qt::CaseInsensitive)
+        return QString::fromLatin1(getHeaderView(strKey));
+
+    for (const auto& header : m_headerRanges)
+    {
+        if (view(header.key).compare(strKey, cs) == 0)
+            return QString::fromLatin1(view(header.value));
+    }
+
+    return "";
+}
+
 QHash<HttpRequest::METHOD, QString> HttpRequest::initMethodTexts()
 {
     QHash<METHOD, QString> result;
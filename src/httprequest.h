@@ -2,7 +2,20 @@
 #define HTTPREQUEST_H
 
 #include <QByteArray>
+#include <QByteArrayView>
+#include <QElapsedTimer>
+#include <QIODevice>
 #include <QMultiHash>
+#include <QString>
+#include <QStringView>
+#include <QVarLengthArray>
+#include <memory>
+
+#include "httpheaders.h"
+#include "httpjson.h"
+
+
+class QTemporaryFile;
 
 
 class HttpRequest
@@ -11,8 +24,42 @@ public:
     HttpRequest();
     HttpRequest(const QByteArray& data);
 
+    // Parses a complete message in one go
     void setData(const QByteArray& data);
 
+    // Incremental parsing, data may be split at any byte.
+    // Returns the number of bytes consumed, which is less than size once the message is complete.
+    qsizetype appendData(const char* data, qsizetype size);
+    qsizetype appendData(QByteArrayView data) { return appendData(data.data(), data.size()); }
+
+    // Keeps the allocated buffer and the body limits for the next request on the same connection
+    void reset();
+
+    // Bodies larger than maxSize are rejected as soon as the headers are complete (isBodyTooLarge()), 0 = unlimited.
+    // Bodies larger than spillThreshold are written to a temporary file instead of memory, 0 = never.
+    void setBodyLimits(qint64 maxSize, qint64 spillThreshold);
+    qint64 getMaxBodySize() const { return m_maxBodySize; }
+    qint64 getBodySpillThreshold() const { return m_bodySpillThreshold; }
+
+    bool isBodyTooLarge() const { return m_bodyTooLarge; }
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-10.1.1
+    // True once after the headers, if the client waits for "100 Continue" before it sends the body
+    bool takeContinueExpectation();
+
+    enum PARSE_STATE
+    {
+        REQUEST_LINE,
+        HEADERS,
+        BODY,
+        COMPLETE,
+        ERROR,
+    };
+
+    PARSE_STATE getParseState() const { return m_parseState; }
+    bool isStarted() const { return m_parseState != REQUEST_LINE || !m_data.isEmpty(); }
+    bool isComplete() const { return m_parseState == COMPLETE; }
+
     // https://developer.mozilla.org/en-US/docs/Web/HTTP/Methods
     enum METHOD
     {
@@ -31,38 +78,119 @@ public:
 
     static QString getStringFromMethod(METHOD method) { return m_methodTexts.value(method, ""); }
     static METHOD getMethodFromString(const QString& strMethod) { return m_methodTexts.key(strMethod, UNKNOWN); }
+    static METHOD getMethodFromString(QByteArrayView strMethod);
+
+    // Views point into the request buffer and are valid as long as the request is not modified
+    QByteArrayView getMethodView() const { return view(m_methodRange); }
+    QByteArrayView getTargetView() const { return view(m_targetRange); }
+    QByteArrayView getProtocolView() const { return view(m_protocolRange); }
+    QByteArrayView getBodyView() const { return view(m_bodyRange); }   // Empty if the body is spilled
 
     METHOD getMethod() const { return m_method; }
-    const QString& getTarget() const { return m_target; }
-    const QString& getTargetRaw() const { return m_targetRaw; }
-    const QString& getProtocol() const { return m_protocol; }
+    const QString& getTarget() const;
+    const QString& getTargetRaw() const;
+    QString getProtocol() const { return QString::fromLatin1(getProtocolView()); }
 
     // https://developer.mozilla.org/en-US/docs/Glossary/Request_header
-    const QMultiHash<QString, QString>& getHeaders() const { return m_headers; }
-    QString getHeader(const QString& key, Qt::CaseSensitivity cs = Qt::CaseSensitive) const;
+    qsizetype getHeaderCount() const { return m_headerRanges.size(); }
+    QByteArrayView getHeaderKeyView(qsizetype idx) const { return view(m_headerRanges.at(idx).key); }
+    QByteArrayView getHeaderValueView(qsizetype idx) const { return view(m_headerRanges.at(idx).value); }
+    QByteArrayView getHeaderView(QByteArrayView key) const;
+    QByteArrayView getHeaderView(HttpHeaders::HEADER header) const;
+
+    QMultiHash<QString, QString> getHeaders() const;
+    QString getHeader(const QString& key, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+
+    const QMultiHash<QString, QString>& getTargetParameters() const;
+    QString getTargetParameter(const QString& key) const { return getTargetParameters().value(key, ""); }
+
+    // Loads a spilled body into memory, getBodyDevice() reads it in parts
+    QByteArray getBody() const;
+    qint64 getBodySize() const { return m_bodySize; }
+    bool isBodySpilled() const { return m_bodyFile != nullptr; }
+
+    // New reader positioned at the start of the body, for spilled bodies a file opened read-only
+    std::unique_ptr<QIODevice> getBodyDevice() const;
 
-    const QMultiHash<QString, QString>& getTargetParameters() const { return m_targetParameters; }
-    QString getTargetParameter(const QString& key) const { return m_targetParameters.value(key, ""); }
+    // Body validated and indexed as JSON, sharing the request buffer instead of copying it (see HttpJsonDocument)
+    HttpJsonDocument getJsonBody() const;
 
-    const QByteArray& getBody() const { return m_body; }
+    // Filled by the router for {name} and *name segments, values are views into getTarget()
+    void addPathParameter(const QString& name, QStringView value) { m_pathParameters.append(qMakePair(name, value)); }
+    QStringView getPathParameterView(QStringView name) const;
+    QString getPathParameter(QStringView name) const { return getPathParameterView(name).toString(); }
 
     bool isValid() const { return m_valid; }
 
+    // µs since the first byte of the request arrived, includes the time spent queued before the handler
+    qint64 getElapsed() const { return m_startTimer.isValid() ? m_startTimer.nsecsElapsed() / 1000 : 0; }
+
 private:
     static const QHash<METHOD, QString> m_methodTexts;
     static QHash<METHOD, QString> initMethodTexts();
 
+    static constexpr qsizetype MAX_HEADER_SIZE = 64 * 1024;
+    static constexpr qsizetype MAX_BODY_RESERVE = 1024 * 1024;
+
+    // Offsets into m_data, which may still be reallocated while parsing
+    struct Range
+    {
+        qsizetype pos = 0;
+        qsizetype size = 0;
+    };
+
+    struct HeaderRange
+    {
+        Range key;
+        Range value;
+        HttpHeaders::HEADER header;
+    };
+
+    QByteArrayView view(const Range& range) const { return QByteArrayView(m_data.constData() + range.pos, range.size); }
+    Range range(QByteArrayView view) const { return { view.data() - m_data.constData(), view.size() }; }
+
+    // Request line, headers and body in one buffer
+    QByteArray m_data;
+
+    PARSE_STATE m_parseState = REQUEST_LINE;
+    qsizetype m_lineStart = 0;
+    QElapsedTimer m_startTimer;
+    qsizetype m_bodyRemaining = 0;
+
     METHOD m_method = UNKNOWN;
-    QString m_target;
-    QString m_targetRaw;
-    QString m_protocol;
+    Range m_methodRange;
+    Range m_targetRange;
+    Range m_protocolRange;
+    Range m_bodyRange;
+
+    QVarLengthArray<HeaderRange, 32> m_headerRanges;
+    HttpHeaders::Index m_headerIndex;
+
+    qint64 m_maxBodySize = 0;
+    qint64 m_bodySpillThreshold = 0;
+    bool m_bodyTooLarge = false;
+    bool m_continueAnswered = false;
 
-    QMultiHash<QString, QString> m_headers;
-    QMultiHash<QString, QString> m_targetParameters;
+    qint64 m_bodySize = 0;
 
-    QByteArray m_body;
+    // Shared by copies of the request, removed with the last one
+    std::shared_ptr<QTemporaryFile> m_bodyFile;
+
+    // Decoded on first access
+    mutable bool m_targetDecoded = false;
+    mutable QString m_target;
+    mutable QString m_targetRaw;
+    mutable QMultiHash<QString, QString> m_targetParameters;
+
+    QVarLengthArray<QPair<QString, QStringView>, 8> m_pathParameters;
 
     bool m_valid = false;
+
+    void parseRequestLine(QByteArrayView line);
+    void parseHeaderLine(QByteArrayView line);
+    void finishHeaders();
+
+    void decodeTarget() const;
 };
 
 #endif // HTTPREQUEST_H
@@ -2,6 +2,8 @@
 
 #include <QDateTime>
 
+#include <cstring>
+
 #include "httpserver.h"
 
 
@@ -20,78 +22,345 @@ HttpResponse::HttpResponse(STATUS status) :
 
 }
 
-void HttpResponse::setBody(const QByteArray &body)
+void HttpResponse::setRawHeader(const QByteArray& key, const QByteArray& value)
 {
-    m_body = body;
+    const qsizetype idx = indexOfHeader(key);
 
-    if (m_body.size() > 0)
-        setHeader("Content-Length", QString::number(m_body.size()));
+    if (idx < 0)
+        addRawHeader(key, value);
     else
-        removeHeader("Content-Length");
+    {
+        m_headers[idx] = qMakePair(key, value);
+
+        // Same behaviour as the former hash: setHeader() replaces all previous values
+        bool removed = false;
+
+        for (qsizetype i = m_headers.size() - 1; i > idx; --i)
+        {
+            if (QByteArrayView(m_headers.at(i).first).compare(key, Qt::CaseInsensitive) == 0)
+            {
+                m_headers.removeAt(i);
+                removed = true;
+            }
+        }
+
+        if (removed)
+            rebuildHeaderIndex();
+    }
+}
+
+void HttpResponse::addRawHeader(const QByteArray& key, const QByteArray& value)
+{
+    m_headerIndex.add(HttpHeaders::lookup(key), m_headers.size());
+    m_headers.append(qMakePair(key, value));
+}
+
+void HttpResponse::setHeaders(const HeaderList& headers)
+{
+    m_headers = headers;
+    rebuildHeaderIndex();
+}
+
+void HttpResponse::setBodyFile(const HttpFileCache::FilePtr& file, qint64 offset, qint64 length)
+{
+    m_body.clear();
+    m_bodyProducer = nullptr;
+
+    m_bodyFile = file;
+    m_bodyFileOffset = offset;
+    m_bodyFileLength = length;
+}
+
+void HttpResponse::setBodyProducer(const BodyProducer& producer)
+{
+    m_body.clear();
+    m_bodyFile.reset();
+
+    m_bodyProducer = producer;
+}
+
+qint64 HttpResponse::getBodySize() const
+{
+    if (m_bodyProducer)
+        return -1;
+
+    return m_bodyFile.isNull() ? m_body.size() : m_bodyFileLength;
+}
+
+void HttpResponse::appendChunk(QByteArray& target, QByteArrayView data)
+{
+    // <size in hex>\r\n<data>\r\n, the last chunk is "0\r\n" followed by the empty line ending the (empty) trailers
+    char strSize[20];
+    const int sizeLength = qsnprintf(strSize, sizeof(strSize), "%llx\r\n", qulonglong(data.size()));
+
+    target.reserve(target.size() + sizeLength + data.size() + 2);
+    target.append(strSize, sizeLength);
+    target.append(data);
+    target.append("\r\n", 2);
+}
+
+void HttpResponse::removeHeader(QByteArrayView key)
+{
+    if (m_headers.removeIf([key](const QPair<QByteArray, QByteArray>& header) { return QByteArrayView(header.first).compare(key, Qt::CaseInsensitive) == 0; }) > 0)
+        rebuildHeaderIndex();
+}
+
+QByteArray HttpResponse::getHeader(QByteArrayView key) const
+{
+    const qsizetype idx = indexOfHeader(key);
+
+    return idx >= 0 ? m_headers.at(idx).second : QByteArray();
+}
+
+QByteArray HttpResponse::getHeader(HttpHeaders::HEADER header) const
+{
+    const qsizetype idx = m_headerIndex.get(header);
+
+    return idx >= 0 ? m_headers.at(idx).second : QByteArray();
+}
+
+qsizetype HttpResponse::indexOfHeader(QByteArrayView key) const
+{
+    const HttpHeaders::HEADER header = HttpHeaders::lookup(key);
+
+    if (header != HttpHeaders::UNKNOWN)
+        return m_headerIndex.get(header);
+
+    for (qsizetype i = 0; i < m_headers.size(); ++i)
+    {
+        if (QByteArrayView(m_headers.at(i).first).compare(key, Qt::CaseInsensitive) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+void HttpResponse::rebuildHeaderIndex()
+{
+    m_headerIndex.clear();
+
+    for (qsizetype i = 0; i < m_headers.size(); ++i)
+        m_headerIndex.add(HttpHeaders::lookup(m_headers.at(i).first), i);
+}
+
+QByteArray HttpResponse::getHeaderName(HttpHeaders::HEADER header)
+{
+    // The names are string literals
+    const QByteArrayView name = HttpHeaders::getName(header);
+
+    return QByteArray::fromRawData(name.data(), name.size());
 }
 
 QByteArray HttpResponse::getRawData() const
 {
-    // <protocol> <status-code> <status-text>
-    QByteArray result = m_protocol.toLatin1() + " " + QByteArray::number(m_status) + " " + getStringFromStatus(m_status).toLatin1();
-    result += "\r\n";
+    static const QByteArray strContentLength = "Content-Length: ";
+
+    const QByteArray statusLine = getStatusLine();
+
+    // Fetched once, the cached line may change in between
+    const QByteArray dateLine = m_addDate ? getDateLine() : QByteArray();
+    const QByteArray& serverLine = getServerLine();
+
+    // Content-Length is written directly from the body size, unless the handler set it (or chunked encoding, event streams).
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-15.4.5
+    // -> 304 has no body and would announce the size of the full representation, 1xx has no content at all
+    const bool addContentLength = m_status >= OK && m_status != NOT_MODIFIED && !m_bodyProducer && !m_eventSource && !hasHeader(HttpHeaders::CONTENT_LENGTH) && !hasHeader(HttpHeaders::TRANSFER_ENCODING);
+
+    char strLength[24];
+    const int lengthSize = addContentLength ? qsnprintf(strLength, sizeof(strLength), "%lld", qlonglong(getBodySize())) : 0;
 
-    // Headers
-    for (auto it = m_headers.cbegin(); it != m_headers.cend(); ++it)
+    const qsizetype bodySize = m_omitBody ? 0 : m_body.size();
+
+    // Compute the exact size first
+    qsizetype size = statusLine.size();
+
+    for (const auto& header : m_headers)
+        size += header.first.size() + 2 + header.second.size() + 2;
+
+    if (m_addDate)
+        size += dateLine.size();
+
+    if (m_addServer)
+        size += serverLine.size();
+
+    if (addContentLength)
+        size += strContentLength.size() + lengthSize + 2;
+
+    size += 2 + bodySize;
+
+    QByteArray result(size, Qt::Uninitialized);
+    char* out = result.data();
+
+    const auto write = [&out](const char* data, qsizetype length)
+    {
+        memcpy(out, data, length);
+        out += length;
+    };
+
+    write(statusLine.constData(), statusLine.size());
+
+    for (const auto& header : m_headers)
+    {
+        write(header.first.constData(), header.first.size());
+        write(": ", 2);
+        write(header.second.constData(), header.second.size());
+        write("\r\n", 2);
+    }
+
+    if (m_addDate)
+        write(dateLine.constData(), dateLine.size());
+
+    if (m_addServer)
+        write(serverLine.constData(), serverLine.size());
+
+    if (addContentLength)
     {
-        result += it.key().toLatin1() + ": " + it.value().toLatin1();
-        result += "\r\n";
+        write(strContentLength.constData(), strContentLength.size());
+        write(strLength, lengthSize);
+        write("\r\n", 2);
     }
 
-    result += "\r\n";
-    result += m_body;
+    write("\r\n", 2);
+    write(m_body.constData(), bodySize);
 
     return result;
 }
 
-void HttpResponse::checkHeaders()
+QByteArray HttpResponse::getRawHead() const
 {
-    const QStringList listHeaders = m_headers.keys();
+    QByteArray result = getStatusLine();
+
+    for (const auto& header : m_headers)
+        result += header.first + ": " + header.second + "\r\n";
+
+    if (!hasHeader(HttpHeaders::SERVER))
+        result += getServerLine();
 
-    if (!listHeaders.contains("Date", Qt::CaseInsensitive))
-        setHeader("Date", QDateTime::currentDateTimeUtc().toString("ddd, dd MMM yyyy hh:mm:ss") + " GMT");
+    if (!m_bodyProducer && !hasHeader(HttpHeaders::CONTENT_LENGTH) && !hasHeader(HttpHeaders::TRANSFER_ENCODING))
+        result += "Content-Length: " + QByteArray::number(getBodySize()) + "\r\n";
 
-    if (!listHeaders.contains("Server", Qt::CaseInsensitive))
-        setHeader("Server", HttpServer::getServerName() + "/" + HttpServer::getServerVersion());
+    return result;
+}
 
-    if (!listHeaders.contains("Connection", Qt::CaseInsensitive))
-        setHeader("Connection", "close");       // TODO: Persistent Connections for HTTP/1.1 with Connection: keep-alive
+HttpResponse::HeaderList HttpResponse::getFinalHeaders() const
+{
+    HeaderList result = m_headers;
 
-    if (m_status == METHOD_NOT_ALLOWED)
+    if (m_addDate)
     {
-        if (!listHeaders.contains("Allow", Qt::CaseInsensitive))
-            setHeader("Allow", "GET");
+        // "Date: " ... "\r\n"
+        const QByteArray& dateLine = getDateLine();
+        result.append(qMakePair(getHeaderName(HttpHeaders::DATE), dateLine.mid(6, dateLine.size() - 8)));
     }
-    else if (m_status == UNAUTHORIZED)
+
+    if (m_addServer)
+    {
+        const QByteArray& serverLine = getServerLine();
+        result.append(qMakePair(getHeaderName(HttpHeaders::SERVER), serverLine.mid(8, serverLine.size() - 10)));
+    }
+
+    // Same rules as getRawData()
+    if (m_status >= OK && m_status != NOT_MODIFIED && !m_bodyProducer && !m_eventSource && !hasHeader(HttpHeaders::CONTENT_LENGTH) && !hasHeader(HttpHeaders::TRANSFER_ENCODING))
+        result.append(qMakePair(getHeaderName(HttpHeaders::CONTENT_LENGTH), QByteArray::number(getBodySize())));
+
+    return result;
+}
+
+void HttpResponse::checkHeaders()
+{
+    m_addDate = !hasHeader(HttpHeaders::DATE);
+    m_addServer = !hasHeader(HttpHeaders::SERVER);
+
+    if (!hasHeader(HttpHeaders::CONNECTION))
+        setRawHeader(HttpHeaders::CONNECTION, "close");
+
+    // Allow for METHOD_NOT_ALLOWED is set by the router
+
+    if (m_status == UNAUTHORIZED)
     {
         // TODO
-        // if (!listHeaders.contains("WWW-Authenticate"))
+        // if (!hasHeader("WWW-Authenticate"))
             // setHeader("WWW-Authenticate", "");
     }
 
     // TODO: Other Headers?
 }
 
+QByteArray HttpResponse::getStatusLine() const
+{
+    // <protocol> <status-code> <status-text>
+    // Lines for HTTP/1.1 are built once per status
+    static const QHash<STATUS, QByteArray> statusLines = []()
+    {
+        QHash<STATUS, QByteArray> result;
+
+        for (auto it = m_statusTexts.cbegin(); it != m_statusTexts.cend(); ++it)
+            result.insert(it.key(), "HTTP/1.1 " + QByteArray::number(it.key()) + " " + it.value().toLatin1() + "\r\n");
+
+        return result;
+    }();
+
+    if (m_protocol == QLatin1String("HTTP/1.1"))
+    {
+        const auto it = statusLines.constFind(m_status);
+
+        if (it != statusLines.cend())
+            return it.value();
+    }
+
+    return m_protocol.toLatin1() + " " + QByteArray::number(m_status) + " " + getStringFromStatus(m_status).toLatin1() + "\r\n";
+}
+
+const QByteArray& HttpResponse::getDateLine()
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-6.6.1
+    // Only changes once per second -> formatted once per second and thread
+    thread_local qint64 cachedSecond = -1;
+    thread_local QByteArray cachedLine;
+
+    const qint64 second = QDateTime::currentSecsSinceEpoch();
+
+    if (second != cachedSecond)
+    {
+        cachedSecond = second;
+        cachedLine = "Date: " + QDateTime::fromSecsSinceEpoch(second, Qt::UTC).toString("ddd, dd MMM yyyy hh:mm:ss").toLatin1() + " GMT\r\n";
+    }
+
+    return cachedLine;
+}
+
+const QByteArray& HttpResponse::getServerLine()
+{
+    static const QByteArray line = "Server: " + (HttpServer::getServerName() + "/" + HttpServer::getServerVersion()).toLatin1() + "\r\n";
+
+    return line;
+}
+
 QHash<HttpResponse::STATUS, QString> HttpResponse::initStatusTexts()
 {
     QHash<STATUS, QString> result;
 
+    result.insert(SWITCHING_PROTOCOLS,      "Switching Protocols");
+
     result.insert(OK,                       "OK");
+    result.insert(PARTIAL_CONTENT,          "Partial Content");
 
     result.insert(MOVED_PERMANENTLY,        "Moved Permanently");
+    result.insert(NOT_MODIFIED,             "Not Modified");
 
     result.insert(BAD_REQUEST,              "Bad Request");
     result.insert(UNAUTHORIZED,             "Unauthorized");
     result.insert(FORBIDDEN,                "Forbidden");
     result.insert(NOT_FOUND,                "Not Found");
     result.insert(METHOD_NOT_ALLOWED,       "Method Not Allowed");
+    result.insert(REQUEST_TIMEOUT,          "Request Timeout");
+    result.insert(CONTENT_TOO_LARGE,        "Content Too Large");
+    result.insert(RANGE_NOT_SATISFIABLE,    "Range Not Satisfiable");
+    result.insert(UPGRADE_REQUIRED,         "Upgrade Required");
 
     result.insert(INTERNAL_SERVER_ERROR,    "Internal Server Error");
+    result.insert(NOT_IMPLEMENTED,          "Not Implemented");
+    result.insert(SERVICE_UNAVAILABLE,      "Service Unavailable");
 
     return result;
 }
@@ -2,8 +2,20 @@
 #define HTTPRESPONSE_H
 
 #include <QByteArray>
+#include <QByteArrayView>
 #include <QString>
-#include <QMultiHash>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <functional>
+#include <memory>
+
+#include "httpfilecache.h"
+#include "httpheaders.h"
+
+
+struct HttpWebSocketHandler;
+struct HttpEventSourceState;
 
 
 class HttpResponse
@@ -12,17 +24,27 @@ public:
     // https://developer.mozilla.org/en-US/docs/Web/HTTP/Status
     enum STATUS
     {
+        SWITCHING_PROTOCOLS = 101,
+
         OK = 200,
+        PARTIAL_CONTENT = 206,
 
         MOVED_PERMANENTLY = 301,
+        NOT_MODIFIED = 304,
 
         BAD_REQUEST = 400,
         UNAUTHORIZED = 401,
         FORBIDDEN = 403,
         NOT_FOUND = 404,
         METHOD_NOT_ALLOWED = 405,
+        REQUEST_TIMEOUT = 408,
+        CONTENT_TOO_LARGE = 413,
+        RANGE_NOT_SATISFIABLE = 416,
+        UPGRADE_REQUIRED = 426,
 
         INTERNAL_SERVER_ERROR = 500,
+        NOT_IMPLEMENTED = 501,
+        SERVICE_UNAVAILABLE = 503,
     };
 
     HttpResponse();
@@ -30,34 +52,125 @@ public:
 
     static QString getStringFromStatus(STATUS status) { return m_statusTexts.value(status, ""); }
 
+    void setProtocol(const QString& protocol) { m_protocol = protocol; }
+    const QString& getProtocol() const { return m_protocol; }
+
     void setStatus(STATUS status) { m_status = status; }
-    STATUS getStatus() { return m_status; }
+    STATUS getStatus() const { return m_status; }
 
     // https://developer.mozilla.org/en-US/docs/Glossary/Response_header
-    void setHeaders(const QMultiHash<QString, QString>& headers) { m_headers = headers; }
-    void setHeader(const QString& key, const QString& value) { m_headers[key] = value; }
-    void addHeader(const QString& key, const QString& value) { m_headers.insert(key, value); }
-    void removeHeader(const QString& key) { m_headers.remove(key); }
-
-    QMultiHash<QString, QString> getHeaders() { return m_headers; }
+    // Header names are compared case-insensitive, the order is kept for serialization.
+    // Known headers (HttpHeaders::HEADER) are found through an index, others by a scan.
+    typedef QList<QPair<QByteArray, QByteArray>> HeaderList;
+
+    void setHeaders(const HeaderList& headers);
+    void setHeader(const QString& key, const QString& value) { setRawHeader(key.toLatin1(), value.toLatin1()); }
+    void setRawHeader(const QByteArray& key, const QByteArray& value);
+    void setRawHeader(HttpHeaders::HEADER header, const QByteArray& value) { setRawHeader(getHeaderName(header), value); }
+    void addHeader(const QString& key, const QString& value) { addRawHeader(key.toLatin1(), value.toLatin1()); }
+    void addRawHeader(const QByteArray& key, const QByteArray& value);
+    void removeHeader(QByteArrayView key);
+
+    bool hasHeader(QByteArrayView key) const { return indexOfHeader(key) >= 0; }
+    bool hasHeader(HttpHeaders::HEADER header) const { return m_headerIndex.get(header) >= 0; }
+    QByteArray getHeader(QByteArrayView key) const;
+    QByteArray getHeader(HttpHeaders::HEADER header) const;
+    const HeaderList& getHeaders() const { return m_headers; }
+
+    // Content-Length is derived from the body when serializing, unless set explicitly
+    void setBody(const QByteArray& body) { m_body = body; m_bodyFile.reset(); m_bodyProducer = nullptr; }
+    const QByteArray& getBody() const { return m_body; }
+
+    // Body appended to in place, e.g. by HttpJsonWriter, instead of a body file or producer
+    QByteArray& getBodyBuffer() { m_bodyFile.reset(); m_bodyProducer = nullptr; return m_body; }
+
+    // Part of a cached file as body, sent by the connection after getRawData() (sendfile() if possible)
+    void setBodyFile(const HttpFileCache::FilePtr& file, qint64 offset, qint64 length);
+    const HttpFileCache::FilePtr& getBodyFile() const { return m_bodyFile; }
+    qint64 getBodyFileOffset() const { return m_bodyFileOffset; }
+    qint64 getBodyFileLength() const { return m_bodyFileLength; }
+    bool hasBodyFile() const { return !m_bodyFile.isNull() && !m_omitBody; }
+
+    // Body of unknown size, sent with chunked encoding (or until the connection is closed for HTTP/1.0).
+    // Called in the thread of the connection whenever the socket can take more data, an empty chunk ends the body.
+    typedef std::function<QByteArray()> BodyProducer;
+
+    void setBodyProducer(const BodyProducer& producer);
+    const BodyProducer& getBodyProducer() const { return m_bodyProducer; }
+    bool hasBodyProducer() const { return m_bodyProducer && !m_omitBody; }
+
+    // -1 for a producer
+    qint64 getBodySize() const;
+
+    // Accepted WebSocket handshake (101), the connection hands the socket over to an HttpWebSocket with the handler.
+    // See HttpWebSocket::upgrade().
+    void setWebSocketHandler(const std::shared_ptr<const HttpWebSocketHandler>& handler) { m_webSocketHandler = handler; }
+    const std::shared_ptr<const HttpWebSocketHandler>& getWebSocketHandler() const { return m_webSocketHandler; }
+
+    // Event stream (text/event-stream) without a length, the connection subscribes to the source once the headers are sent.
+    // See HttpEventSource::subscribe().
+    void setEventSource(const std::shared_ptr<HttpEventSourceState>& source) { m_eventSource = source; }
+    const std::shared_ptr<HttpEventSourceState>& getEventSource() const { return m_eventSource; }
+
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-7.1
+    // Appends data as one chunk, empty data as the last chunk
+    static void appendChunk(QByteArray& target, QByteArrayView data);
+
+    // Responses to HEAD: Content-Length of the body is sent, the body itself is not
+    void setOmitBody(bool omit) { m_omitBody = omit; }
+    bool getOmitBody() const { return m_omitBody; }
+
+    // Size is computed up front, so the data is written into a single allocation.
+    // Contains the body unless it is omitted or a file.
+    QByteArray getRawData() const;
 
-    void setBody(const QByteArray& body);
-    const QByteArray& getBody() { return m_body; }
+    // Status line, headers, Server and Content-Length without Date and the empty line, for HttpResponseCache
+    QByteArray getRawHead() const;
 
-    QByteArray getRawData() const;
+    // Headers as getRawData() writes them, including Date, Server and Content-Length, for HTTP/2
+    HeaderList getFinalHeaders() const;
 
+    // Adds the mandatory headers, Date and Server are written from cached lines
     void checkHeaders();
 
+    // "Date: ...\r\n", formatted once per second and thread
+    static const QByteArray& getDateLine();
+
 private:
     static const QHash<STATUS, QString> m_statusTexts;
     static QHash<STATUS, QString> initStatusTexts();
 
-    QString m_protocol = "HTTP/1.0";     // TODO: 1.1 -> Some Headers are mandatory!
+    QString m_protocol = "HTTP/1.1";
     STATUS m_status;
 
-    QMultiHash<QString, QString> m_headers;
+    HeaderList m_headers;
+    HttpHeaders::Index m_headerIndex;
 
     QByteArray m_body;
+
+    HttpFileCache::FilePtr m_bodyFile;
+    qint64 m_bodyFileOffset = 0;
+    qint64 m_bodyFileLength = 0;
+
+    BodyProducer m_bodyProducer;
+
+    std::shared_ptr<const HttpWebSocketHandler> m_webSocketHandler;
+    std::shared_ptr<HttpEventSourceState> m_eventSource;
+
+    bool m_omitBody = false;
+
+    bool m_addDate = false;
+    bool m_addServer = false;
+
+    qsizetype indexOfHeader(QByteArrayView key) const;
+    void rebuildHeaderIndex();
+
+    // Canonical name without a copy
+    static QByteArray getHeaderName(HttpHeaders::HEADER header);
+
+    QByteArray getStatusLine() const;
+
+    static const QByteArray& getServerLine();
 };
 
 #endif // HTTPRESPONSE_H
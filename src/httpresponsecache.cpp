@@ -0,0 +1,278 @@
+#include "httpresponsecache.h"
+
+#include <algorithm>
+
+
+HttpResponseCache::HttpResponseCache(qint64 maxSize)
+{
+    m_cache.setMaxCost(maxSize);
+}
+
+HttpResponseCache::EntryPtr HttpResponseCache::get(const HttpRequest& request, quint64 generation, qint64 now)
+{
+    if (request.getMethod() != HttpRequest::GET || !isLookupAllowed(request))
+        return EntryPtr();
+
+    const QByteArray key = getKey(request);
+
+    QMutexLocker locker(&m_mutex);
+
+    Item* const item = m_cache.object(key);
+
+    if (!item)
+        return EntryPtr();
+
+    const auto it = item->variants.constFind(getVariantKey(request, item->vary));
+
+    if (it == item->variants.cend())
+        return EntryPtr();
+
+    const EntryPtr entry = it.value();
+
+    if (entry->expires > now && entry->generation == generation)
+        return entry;
+
+    // Size of the item is corrected on the next insert
+    item->variants.erase(it);
+
+    if (item->variants.isEmpty())
+    {
+        m_cache.remove(key);
+        m_count.storeRelaxed(m_cache.count());
+    }
+
+    return EntryPtr();
+}
+
+bool HttpResponseCache::insert(const HttpRequest& request, const HttpResponse& response, const QList<QByteArray>& vary, int ttl, quint64 generation, qint64 now, HttpRouteMetrics* metrics)
+{
+    if (ttl <= 0 || request.getMethod() != HttpRequest::GET || !isStoreAllowed(request))
+        return false;
+
+    if (response.getStatus() != HttpResponse::OK && response.getStatus() != HttpResponse::MOVED_PERMANENTLY)
+        return false;
+
+    // Files are cached by HttpFileCache, streams are not stored, cookies belong to a single client
+    if (response.getBodyFile() || response.getBodyProducer() || response.hasHeader(HttpHeaders::SET_COOKIE) || response.hasHeader(HttpHeaders::TRANSFER_ENCODING))
+        return false;
+
+    // https://datatracker.ietf.org/doc/html/rfc9111#section-5.2.2
+    const QByteArray cacheControl = response.getHeader(HttpHeaders::CACHE_CONTROL);
+
+    if (hasDirective(cacheControl, "no-store") || hasDirective(cacheControl, "no-cache") || hasDirective(cacheControl, "private"))
+        return false;
+
+    qint64 timeToLive = ttl;
+    const qint64 maxAge = getMaxAge(cacheControl);
+
+    if (maxAge >= 0)
+        timeToLive = qMin(timeToLive, maxAge * 1000);
+
+    if (timeToLive <= 0)
+        return false;
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-12.5.5
+    QList<QByteArray> listVary;
+
+    for (const QByteArray& name : vary)
+        listVary.append(name.trimmed().toLower());
+
+    for (const QByteArray& name : response.getHeader(HttpHeaders::VARY).split(','))
+    {
+        const QByteArray value = name.trimmed().toLower();
+
+        if (value == "*")
+            return false;
+
+        if (!value.isEmpty())
+            listVary.append(value);
+    }
+
+    std::sort(listVary.begin(), listVary.end());
+    listVary.erase(std::unique(listVary.begin(), listVary.end()), listVary.end());
+
+    // Connection headers and Date are added for every hit
+    HttpResponse copy = response;
+    copy.removeHeader("Connection");
+    copy.removeHeader("Keep-Alive");
+    copy.removeHeader("Date");
+
+    QSharedPointer<Entry> entry = QSharedPointer<Entry>::create();
+    entry->head = copy.getRawHead();
+    entry->body = response.getBody();
+    entry->status = response.getStatus();
+    entry->metrics = metrics;
+    entry->created = now;
+    entry->expires = now + timeToLive;
+    entry->generation = generation;
+
+    const QByteArray key = getKey(request);
+    const QByteArray variantKey = getVariantKey(request, listVary);
+
+    QMutexLocker locker(&m_mutex);
+
+    // Reinserted, QCache cannot change the cost of an existing item
+    Item* const previous = m_cache.take(key);
+    Item* const item = new Item();
+    item->vary = listVary;
+
+    // Other variants are only valid as long as the response varies on the same headers
+    if (previous && previous->vary == listVary)
+    {
+        for (auto it = previous->variants.cbegin(); it != previous->variants.cend(); ++it)
+        {
+            if (it.value()->expires > now && it.value()->generation == generation)
+                item->variants.insert(it.key(), it.value());
+        }
+    }
+
+    delete previous;
+
+    item->variants.insert(variantKey, entry);
+
+    for (const EntryPtr& variant : std::as_const(item->variants))
+        item->size += variant->head.size() + variant->body.size();
+
+    // Deletes the item right away if it is too large
+    const bool result = m_cache.insert(key, item, item->size);
+
+    m_count.storeRelaxed(m_cache.count());
+
+    return result;
+}
+
+void HttpResponseCache::setMaxSize(qint64 size)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.setMaxCost(size);
+    m_count.storeRelaxed(m_cache.count());
+}
+
+qint64 HttpResponseCache::getMaxSize() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_cache.maxCost();
+}
+
+void HttpResponseCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.clear();
+    m_count.storeRelaxed(0);
+}
+
+bool HttpResponseCache::isLookupAllowed(const HttpRequest& request)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9111#section-5.2.1
+    // Responses may depend on the credentials, which are not part of the key
+    if (!request.getHeaderView(HttpHeaders::AUTHORIZATION).isEmpty())
+        return false;
+
+    const QByteArrayView cacheControl = request.getHeaderView(HttpHeaders::CACHE_CONTROL);
+
+    if (cacheControl.isEmpty())
+        return !hasDirective(request.getHeaderView(HttpHeaders::PRAGMA), "no-cache");
+
+    return !hasDirective(cacheControl, "no-cache") && !hasDirective(cacheControl, "no-store") && getMaxAge(cacheControl) != 0;
+}
+
+bool HttpResponseCache::isStoreAllowed(const HttpRequest& request)
+{
+    return request.getHeaderView(HttpHeaders::AUTHORIZATION).isEmpty() && !hasDirective(request.getHeaderView(HttpHeaders::CACHE_CONTROL), "no-store");
+}
+
+QByteArray HttpResponseCache::getKey(const HttpRequest& request)
+{
+    const QByteArrayView host = request.getHeaderView(HttpHeaders::HOST);
+    const QByteArrayView target = request.getTargetView();
+
+    QByteArray result;
+    result.reserve(host.size() + 1 + target.size());
+    result.append(host);
+    result.append(' ');
+    result.append(target);
+
+    return result;
+}
+
+QByteArray HttpResponseCache::getVariantKey(const HttpRequest& request, const QList<QByteArray>& vary)
+{
+    QByteArray result;
+
+    for (const QByteArray& name : vary)
+    {
+        result.append(request.getHeaderView(name));
+        result.append('\n');
+    }
+
+    return result;
+}
+
+bool HttpResponseCache::hasDirective(QByteArrayView header, QByteArrayView directive)
+{
+    qsizetype pos = 0;
+
+    while (pos < header.size())
+    {
+        qsizetype end = header.indexOf(',', pos);
+
+        if (end < 0)
+            end = header.size();
+
+        QByteArrayView token = header.sliced(pos, end - pos).trimmed();
+        pos = end + 1;
+
+        const qsizetype idxEqual = token.indexOf('=');
+
+        if (idxEqual >= 0)
+            token = token.first(idxEqual).trimmed();
+
+        if (token.compare(directive, Qt::CaseInsensitive) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+qint64 HttpResponseCache::getMaxAge(QByteArrayView header)
+{
+    // s-maxage takes precedence for shared caches
+    qint64 result = -1;
+    qsizetype pos = 0;
+
+    while (pos < header.size())
+    {
+        qsizetype end = header.indexOf(',', pos);
+
+        if (end < 0)
+            end = header.size();
+
+        const QByteArrayView token = header.sliced(pos, end - pos).trimmed();
+        pos = end + 1;
+
+        const qsizetype idxEqual = token.indexOf('=');
+
+        if (idxEqual < 0)
+            continue;
+
+        const QByteArrayView name = token.first(idxEqual).trimmed();
+        const QByteArrayView value = token.sliced(idxEqual + 1).trimmed();
+
+        bool ok = false;
+        const qint64 seconds = value.toLongLong(&ok);
+
+        if (!ok || seconds < 0)
+            continue;
+
+        if (name.compare("s-maxage", Qt::CaseInsensitive) == 0)
+            return seconds;
+
+        if (name.compare("max-age", Qt::CaseInsensitive) == 0)
+            result = seconds;
+    }
+
+    return result;
+}
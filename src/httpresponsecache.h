@@ -0,0 +1,85 @@
+#ifndef HTTPRESPONSECACHE_H
+#define HTTPRESPONSECACHE_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+class HttpRouteMetrics;
+
+
+// Serialized GET responses of routes with HttpRouteOptions::cacheTtl, shared by all worker threads.
+// Keyed by Host and target, variants by the values of the Vary headers.
+// LRU over the targets, bounded by the bytes of all variants.
+class HttpResponseCache
+{
+public:
+    struct Entry
+    {
+        // Status line and headers except Date, Connection and Keep-Alive, without the empty line
+        QByteArray head;
+        QByteArray body;
+
+        // For the access log and metrics
+        int status = 0;
+        HttpRouteMetrics* metrics = nullptr;
+
+        qint64 created = 0;
+        qint64 expires = 0;
+
+        // Entries of previous routers are not served anymore
+        quint64 generation = 0;
+    };
+
+    typedef QSharedPointer<const Entry> EntryPtr;
+
+    explicit HttpResponseCache(qint64 maxSize = 16 * 1024 * 1024);
+
+    // Without locking, so requests are not slowed down while no route uses the cache
+    bool isEmpty() const { return m_count.loadRelaxed() == 0; }
+
+    EntryPtr get(const HttpRequest& request, quint64 generation, qint64 now);
+
+    // Returns false if the request or response must not be cached (Cache-Control, Set-Cookie, Vary: *, ...)
+    bool insert(const HttpRequest& request, const HttpResponse& response, const QList<QByteArray>& vary, int ttl, quint64 generation, qint64 now, HttpRouteMetrics* metrics = nullptr);
+
+    void setMaxSize(qint64 size);
+    qint64 getMaxSize() const;
+
+    void clear();
+
+    // https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/Cache-Control
+    // Request directives, no-cache still allows to store the fresh response
+    static bool isLookupAllowed(const HttpRequest& request);
+    static bool isStoreAllowed(const HttpRequest& request);
+
+private:
+    struct Item
+    {
+        // Lower case header names, values are joined in this order
+        QList<QByteArray> vary;
+        QHash<QByteArray, EntryPtr> variants;
+
+        qint64 size = 0;
+    };
+
+    QCache<QByteArray, Item> m_cache;
+    QAtomicInteger<int> m_count = 0;
+    mutable QMutex m_mutex;
+
+    static QByteArray getKey(const HttpRequest& request);
+    static QByteArray getVariantKey(const HttpRequest& request, const QList<QByteArray>& vary);
+
+    static bool hasDirective(QByteArrayView header, QByteArrayView directive);
+    static qint64 getMaxAge(QByteArrayView header);
+};
+
+#endif // HTTPRESPONSECACHE_H
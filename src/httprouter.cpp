@@ -0,0 +1,273 @@
+#include "httprouter.h"
+
+#include <algorithm>
+
+#include "httpmetrics.h"
+
+
+HttpRouter::HttpRouter()
+{
+
+}
+
+bool HttpRouter::addRoute(HttpRequest::METHOD method, const QString& pattern, const Callback& callback, const HttpRouteOptions& options)
+{
+    Route route;
+    route.callback = callback;
+    route.options = options;
+
+    return addRoute(method, pattern, route);
+}
+
+bool HttpRouter::addAsyncRoute(HttpRequest::METHOD method, const QString& pattern, const AsyncCallback& callback, const HttpRouteOptions& options)
+{
+    Route route;
+    route.asyncCallback = callback;
+    route.options = options;
+
+    return addRoute(method, pattern, route);
+}
+
+bool HttpRouter::addRoute(HttpRequest::METHOD method, const QString& pattern, const Route& route)
+{
+    if (method < 0 || method >= METHOD_COUNT)
+        return false;
+
+    Node* const node = findNode(pattern, true);
+
+    if (!node)
+        return false;
+
+    node->routes[method] = route;
+    node->methods |= 1u << method;
+
+    if (route.options.maxConcurrency > 0)
+        node->routes[method].active = std::make_shared<QAtomicInt>(0);
+
+    if (m_metrics)
+        node->routes[method].metrics = m_metrics->getRoute(method, pattern);
+
+    return true;
+}
+
+bool HttpRouter::removeRoute(HttpRequest::METHOD method, const QString& pattern)
+{
+    if (method < 0 || method >= METHOD_COUNT)
+        return false;
+
+    Node* const node = findNode(pattern, false);
+
+    if (!node || !(node->methods & (1u << method)))
+        return false;
+
+    // Empty nodes are kept, they do not match anything
+    node->routes[method] = Route();
+    node->methods &= ~(1u << method);
+
+    return true;
+}
+
+bool HttpRouter::match(HttpRequest::METHOD method, QStringView path, Match& match) const
+{
+    match.route = nullptr;
+    match.allowedMethods = 0;
+    match.parameters.clear();
+
+    if (method < 0 || method >= METHOD_COUNT || !path.startsWith('/'))
+        return false;
+
+    const QStringView rest = path.sliced(1);
+
+    return matchNode(m_root, method, rest, rest.isEmpty(), match);
+}
+
+bool HttpRouter::Route::tryAcquire() const
+{
+    if (!active)
+        return true;
+
+    if (active->fetchAndAddAcquire(1) < options.maxConcurrency)
+        return true;
+
+    active->fetchAndAddRelease(-1);
+    return false;
+}
+
+void HttpRouter::Route::release() const
+{
+    if (active)
+        active->fetchAndAddRelease(-1);
+}
+
+QString HttpRouter::getAllowHeader(quint32 allowedMethods)
+{
+    QString result;
+
+    for (int method = 0; method < METHOD_COUNT; ++method)
+    {
+        if (allowedMethods & (1u << method))
+        {
+            if (!result.isEmpty())
+                result += ", ";
+
+            result += HttpRequest::getStringFromMethod(static_cast<HttpRequest::METHOD>(method));
+        }
+    }
+
+    return result;
+}
+
+const HttpRouter::Node* HttpRouter::Node::findStatic(QStringView segment) const
+{
+    const auto it = std::lower_bound(staticChildren.cbegin(), staticChildren.cend(), segment,
+                                     [](const Node& node, QStringView value) { return QStringView(node.segment) < value; });
+
+    if (it == staticChildren.cend() || QStringView(it->segment) != segment)
+        return nullptr;
+
+    return &*it;
+}
+
+HttpRouter::Node* HttpRouter::findNode(const QString& pattern, bool create)
+{
+    if (!pattern.startsWith('/'))
+        return nullptr;
+
+    Node* node = &m_root;
+
+    if (pattern == "/")
+        return node;
+
+    const QStringList segments = pattern.mid(1).split('/');
+
+    for (int i = 0; i < segments.size(); ++i)
+    {
+        const QString& segment = segments.at(i);
+
+        std::vector<Node>* children = nullptr;
+        QString name;
+
+        if (segment.startsWith('*'))
+        {
+            // Wildcard has to be the last segment
+            if (i != segments.size() - 1)
+                return nullptr;
+
+            children = &node->wildcardChildren;
+            name = segment.size() > 1 ? segment.mid(1) : "*";
+        }
+        else if (segment.size() > 2 && segment.startsWith('{') && segment.endsWith('}'))
+        {
+            children = &node->paramChildren;
+            name = segment.mid(1, segment.size() - 2);
+        }
+
+        if (children)
+        {
+            if (children->empty())
+            {
+                if (!create)
+                    return nullptr;
+
+                Node child;
+                child.name = name;
+                children->push_back(child);
+            }
+
+            // Different names for the same position would be ambiguous
+            else if (children->front().name != name)
+                return nullptr;
+
+            node = &children->front();
+        }
+        else
+        {
+            auto it = std::lower_bound(node->staticChildren.begin(), node->staticChildren.end(), segment,
+                                       [](const Node& child, const QString& value) { return child.segment < value; });
+
+            if (it == node->staticChildren.end() || it->segment != segment)
+            {
+                if (!create)
+                    return nullptr;
+
+                Node child;
+                child.segment = segment;
+                it = node->staticChildren.insert(it, child);
+            }
+
+            node = &*it;
+        }
+    }
+
+    return node;
+}
+
+bool HttpRouter::matchNode(const Node& node, HttpRequest::METHOD method, QStringView path, bool end, Match& match)
+{
+    const quint32 methodBit = 1u << method;
+
+    if (end)
+    {
+        match.allowedMethods |= node.methods;
+
+        if (node.methods & methodBit)
+        {
+            match.route = &node.routes[method];
+            return true;
+        }
+
+        // "/static/" has an empty rest, which a wildcard still matches
+        if (!node.wildcardChildren.empty())
+        {
+            const Node& wildcard = node.wildcardChildren.front();
+            match.allowedMethods |= wildcard.methods;
+
+            if (wildcard.methods & methodBit)
+            {
+                match.parameters.append({ &wildcard.name, path });
+                match.route = &wildcard.routes[method];
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    const qsizetype idxSlash = path.indexOf('/');
+    const QStringView segment = idxSlash < 0 ? path : path.first(idxSlash);
+    const QStringView rest = idxSlash < 0 ? QStringView() : path.sliced(idxSlash + 1);
+    const bool restEnd = idxSlash < 0;
+
+    const Node* const staticChild = node.findStatic(segment);
+
+    if (staticChild && matchNode(*staticChild, method, rest, restEnd, match))
+        return true;
+
+    if (!node.paramChildren.empty() && !segment.isEmpty())
+    {
+        const Node& param = node.paramChildren.front();
+        const qsizetype parameterCount = match.parameters.size();
+
+        match.parameters.append({ &param.name, segment });
+
+        if (matchNode(param, method, rest, restEnd, match))
+            return true;
+
+        match.parameters.resize(parameterCount);
+    }
+
+    if (!node.wildcardChildren.empty())
+    {
+        const Node& wildcard = node.wildcardChildren.front();
+        match.allowedMethods |= wildcard.methods;
+
+        if (wildcard.methods & methodBit)
+        {
+            match.parameters.append({ &wildcard.name, path });
+            match.route = &wildcard.routes[method];
+            return true;
+        }
+    }
+
+    return false;
+}
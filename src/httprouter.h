@@ -0,0 +1,141 @@
+#ifndef HTTPROUTER_H
+#define HTTPROUTER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFuture>
+#include <QList>
+#include <QString>
+#include <QStringView>
+#include <QVarLengthArray>
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+class HttpMetrics;
+class HttpRouteMetrics;
+
+
+// Per route settings, see HttpServer::setCallback()
+struct HttpRouteOptions
+{
+    // GET responses are cached for this long (ms), 0 = disabled.
+    // Cache-Control of the request or response can bypass the cache or shorten the time.
+    int cacheTtl = 0;
+
+    // Request headers the response depends on, in addition to the Vary header of the response
+    QList<QByteArray> cacheVary;
+
+    // Runs a synchronous callback in the thread pool of the server instead of the thread of the connection
+    bool offload = false;
+
+    // Requests handled by the route at the same time, including async ones still running, 0 = unlimited.
+    // Further requests are answered with 503 Service Unavailable.
+    int maxConcurrency = 0;
+
+    // Load shedding (HttpLoadShedder) drops low priority requests first, critical ones like health checks never
+    enum PRIORITY
+    {
+        LOW,
+        NORMAL,
+        CRITICAL
+    };
+
+    PRIORITY priority = NORMAL;
+};
+
+
+// Trie over path segments. Patterns consist of:
+//  - static segments:      /users/list
+//  - parameters:           /users/{id}        -> matches exactly one non-empty segment
+//  - trailing wildcards:   /static/*path      -> matches the rest of the path (name is optional)
+// Static segments take precedence over parameters, parameters over wildcards.
+class HttpRouter
+{
+public:
+    typedef std::function<HttpResponse(const HttpRequest&, const QString&)> Callback;
+
+    // The request is only valid during the call, the future may finish in any thread
+    typedef std::function<QFuture<HttpResponse>(const HttpRequest&, const QString&)> AsyncCallback;
+
+    static constexpr int METHOD_COUNT = HttpRequest::PATCH + 1;
+
+    struct Route
+    {
+        Callback callback;
+        AsyncCallback asyncCallback;
+        HttpRouteOptions options;
+
+        // Requests in progress for options.maxConcurrency, shared by all copies of the router
+        std::shared_ptr<QAtomicInt> active;
+
+        // Latency histograms, owned by the HttpMetrics of the router
+        HttpRouteMetrics* metrics = nullptr;
+
+        bool isAsync() const { return asyncCallback || options.offload; }
+
+        // False if the route is busy, every successful call has to be followed by release()
+        bool tryAcquire() const;
+        void release() const;
+    };
+
+    struct Match
+    {
+        const Route* route = nullptr;
+
+        // Methods of all routes matching the path, bit per HttpRequest::METHOD
+        quint32 allowedMethods = 0;
+
+        // Parameter names of the router and views into the matched path
+        QVarLengthArray<QPair<const QString*, QStringView>, 8> parameters;
+    };
+
+    HttpRouter();
+
+    // Routes added afterwards record into the metrics, which have to outlive the router
+    void setMetrics(HttpMetrics* metrics) { m_metrics = metrics; }
+
+    bool addRoute(HttpRequest::METHOD method, const QString& pattern, const Callback& callback, const HttpRouteOptions& options = HttpRouteOptions());
+    bool addAsyncRoute(HttpRequest::METHOD method, const QString& pattern, const AsyncCallback& callback, const HttpRouteOptions& options = HttpRouteOptions());
+    bool removeRoute(HttpRequest::METHOD method, const QString& pattern);
+
+    // Does not allocate as long as there are no more than 8 parameters
+    bool match(HttpRequest::METHOD method, QStringView path, Match& match) const;
+
+    static QString getAllowHeader(quint32 allowedMethods);
+
+private:
+    struct Node
+    {
+        QString segment;
+        QString name;
+
+        // Sorted by segment
+        std::vector<Node> staticChildren;
+
+        // At most one element each
+        std::vector<Node> paramChildren;
+        std::vector<Node> wildcardChildren;
+
+        std::array<Route, METHOD_COUNT> routes;
+        quint32 methods = 0;
+
+        const Node* findStatic(QStringView segment) const;
+    };
+
+    Node m_root;
+    HttpMetrics* m_metrics = nullptr;
+
+    bool addRoute(HttpRequest::METHOD method, const QString& pattern, const Route& route);
+
+    Node* findNode(const QString& pattern, bool create);
+
+    static bool matchNode(const Node& node, HttpRequest::METHOD method, QStringView path, bool end, Match& match);
+};
+
+#endif // HTTPROUTER_H
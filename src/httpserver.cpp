@@ -1,5 +1,16 @@
 #include "httpserver.h"
+#include <QDateTime>
 #include <QFile>
+#include <QPromise>
+#include <QTcpSocket>
+
+#include "httpworker.h"
+#include "httpepollbackend.h"
+#include "httpstaticfiles.h"
+
+#ifdef HTTPSERVER_HAVE_OPENSSL
+#include "httptlscontext.h"
+#endif
 
 
 const quint8 VERSION_MAJOR = 1;
@@ -7,17 +18,47 @@ const quint8 VERSION_MINOR = 0;
 const quint8 VERSION_FIX = 0;
 
 
+QAtomicInteger<quint64> HttpServer::m_nextRouterGeneration = 0;
+
+
 HttpServer::HttpServer(const QHostAddress &address, quint16 port, QObject* parent) :
     QTcpServer(parent),
     m_listenAddress(address),
     m_listenPort(port)
 {
-    connect(this, &QTcpServer::newConnection, this, &HttpServer::clientConnected);
+    auto router = std::make_shared<HttpRouter>();
+    router->setMetrics(&m_metrics);
+
+    m_router = router;
+}
+
+HttpServer::HttpServer(const QHostAddress& address, quint16 port, BACKEND backend, QObject* parent) :
+    HttpServer(address, port, parent)
+{
+    if (backend == BACKEND_EPOLL && !HttpEpollBackend::isSupported())
+        qWarning() << "epoll backend not supported, using Qt backend";
+    else
+        m_backend = backend;
+
+    if (m_backend == BACKEND_EPOLL)
+        m_epollBackend = new HttpEpollBackend(this);
 }
 
 HttpServer::~HttpServer()
 {
     stop();
+    stopWorkers();
+
+    // Offloaded callbacks may still use the caches
+    m_threadPool.waitForDone();
+
+    delete m_epollBackend;
+    m_epollBackend = nullptr;
+
+#ifdef HTTPSERVER_HAVE_OPENSSL
+    delete m_tlsContext;
+    m_tlsContext = nullptr;
+#endif
 }
 
 QString HttpServer::getServerName()
@@ -33,6 +74,21 @@ QString HttpServer::getServerVersion()
 void HttpServer::setSslConfig(const QSslConfiguration& sslConf)
 {
     m_sslConfig = sslConf;
+
+    // Protocols set by the caller are kept, otherwise they follow setEnableHttp2()
+    // https://datatracker.ietf.org/doc/html/rfc9113#section-3.2
+    m_sslDefaultNextProtocols = sslConf.allowedNextProtocols().isEmpty();
+
+    if (m_sslDefaultNextProtocols)
+        setDefaultNextProtocols();
+}
+
+void HttpServer::setDefaultNextProtocols()
+{
+    if (m_enableHttp2)
+        m_sslConfig.setAllowedNextProtocols({ QSslConfiguration::ALPNProtocolHTTP2, QSslConfiguration::ALPNProtocolHTTP1_1 });
+    else
+        m_sslConfig.setAllowedNextProtocols({ QSslConfiguration::ALPNProtocolHTTP1_1 });
 }
 
 void HttpServer::setSslConfig(const QSslCertificate& sslCert, const QSslKey& sslKey, QSsl::SslProtocol sslProtocol)
@@ -53,6 +109,15 @@ void HttpServer::setEnableHttp(bool enable)
         m_enableHttpRedirection = false;
 }
 
+void HttpServer::setEnableHttp2(bool enable)
+{
+    m_enableHttp2 = enable;
+
+    // Offered protocols
+    if (!m_sslConfig.isNull() && m_sslDefaultNextProtocols)
+        setDefaultNextProtocols();
+}
+
 void HttpServer::setEnableHttpRedirection(bool enable)
 {
     m_enableHttpRedirection = enable;
@@ -61,237 +126,711 @@ void HttpServer::setEnableHttpRedirection(bool enable)
         m_enableHttp = false;
 }
 
-void HttpServer::setCallback(HttpRequest::METHOD method, const QString& target, const std::function<HttpResponse (const HttpRequest &, const QString&)> &function)
-{    
-    m_hashCallbacks.insert(qMakePair(method, target), function);
+bool HttpServer::setCallback(HttpRequest::METHOD method, const QString& target, const Callback& function, const HttpRouteOptions& options)
+{
+    QMutexLocker locker(&m_routerMutex);
+
+    auto router = std::make_shared<HttpRouter>(*m_router);
+
+    if (!router->addRoute(method, target, function, options))
+    {
+        qWarning() << "Invalid route:" << HttpRequest::getStringFromMethod(method) << target;
+        return false;
+    }
+
+    m_router = router;
+    m_routerGeneration.storeRelease(m_nextRouterGeneration.fetchAndAddRelaxed(1) + 1);
+
+    return true;
+}
+
+bool HttpServer::setAsyncCallback(HttpRequest::METHOD method, const QString& target, const AsyncCallback& function, const HttpRouteOptions& options)
+{
+    QMutexLocker locker(&m_routerMutex);
+
+    auto router = std::make_shared<HttpRouter>(*m_router);
+
+    if (!router->addAsyncRoute(method, target, function, options))
+    {
+        qWarning() << "Invalid route:" << HttpRequest::getStringFromMethod(method) << target;
+        return false;
+    }
+
+    m_router = router;
+    m_routerGeneration.storeRelease(m_nextRouterGeneration.fetchAndAddRelaxed(1) + 1);
+
+    return true;
+}
+
+bool HttpServer::setWebSocketCallback(const QString& target, const HttpWebSocketHandler& handler, const HttpRouteOptions& options)
+{
+    if (m_backend == BACKEND_EPOLL)
+    {
+        qCWarning(lcHttpServer) << "WebSocket route" << target << "needs the Qt backend";
+        return false;
+    }
+
+    // Shared by all sessions of the route
+    const auto shared = std::make_shared<const HttpWebSocketHandler>(handler);
+
+    const Callback callback = [shared](const HttpRequest& request, const QString&)
+    {
+        return HttpWebSocket::upgrade(request, shared);
+    };
+
+    return setCallback(HttpRequest::GET, target, callback, options);
 }
 
-void HttpServer::removeCallback(HttpRequest::METHOD method, const QString &target)
+bool HttpServer::setEventSourceCallback(const QString& target, const HttpEventSource* source, const HttpRouteOptions& options)
 {
-    m_hashCallbacks.remove(qMakePair(method, target));
+    if (m_backend == BACKEND_EPOLL)
+    {
+        qCWarning(lcHttpServer) << "Event source route" << target << "needs the Qt backend";
+        return false;
+    }
+
+    const Callback callback = [source](const HttpRequest& request, const QString&)
+    {
+        return source->subscribe(request);
+    };
+
+    return setCallback(HttpRequest::GET, target, callback, options);
+}
+
+bool HttpServer::removeCallback(HttpRequest::METHOD method, const QString &target)
+{
+    QMutexLocker locker(&m_routerMutex);
+
+    auto router = std::make_shared<HttpRouter>(*m_router);
+
+    if (!router->removeRoute(method, target))
+        return false;
+
+    m_router = router;
+    m_routerGeneration.storeRelease(m_nextRouterGeneration.fetchAndAddRelaxed(1) + 1);
+
+    return true;
+}
+
+bool HttpServer::addStaticDirectory(const QString& prefix, const QString& directory)
+{
+    const auto files = std::make_shared<const HttpStaticFiles>(directory, &m_fileCache);
+
+    if (!files->isValid())
+        return false;
+
+    QString target = prefix;
+
+    while (target.endsWith('/'))
+        target.chop(1);
+
+    target += "/*path";
+
+    const Callback callback = [files](const HttpRequest& request, const QString&)
+    {
+        return files->handleRequest(request, request.getPathParameterView(u"path"));
+    };
+
+    return setCallback(HttpRequest::GET, target, callback) && setCallback(HttpRequest::HEAD, target, callback);
+}
+
+QByteArray HttpServer::getMetricsText() const
+{
+    QByteArray text;
+    m_metrics.appendPrometheus(text);
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_tls_handshakes_total", "counter", "Completed TLS handshakes.");
+    text += "httpserver_tls_handshakes_total{resumed=\"false\"} " + QByteArray::number(getFullHandshakeCount()) + "\n";
+    text += "httpserver_tls_handshakes_total{resumed=\"true\"} " + QByteArray::number(getResumedHandshakeCount()) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_connections_rejected_total", "counter", "Connections closed with 503 because of the connection limit.");
+    text += "httpserver_connections_rejected_total " + QByteArray::number(getRejectedConnectionCount()) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_requests_shed_total", "counter", "Requests answered with 503 because they were queued too long while overloaded.");
+    text += "httpserver_requests_shed_total " + QByteArray::number(m_loadShedder.getShedCount()) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_overloaded", "gauge", "1 while the queueing delay stays above the load shedding target.");
+    text += "httpserver_overloaded " + QByteArray::number(m_loadShedder.isOverloaded() ? 1 : 0) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_access_log_dropped_total", "counter", "Access log records dropped because the writer fell behind.");
+    text += "httpserver_access_log_dropped_total " + QByteArray::number(m_accessLog.getDroppedCount()) + "\n";
+
+    const int webSockets = getWebSocketCount();
+    const qint64 webSocketMemory = getWebSocketMemory();
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_websocket_connections", "gauge", "Open WebSocket sessions.");
+    text += "httpserver_websocket_connections " + QByteArray::number(webSockets) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_websocket_memory_bytes", "gauge", "Memory held by WebSocket sessions, without the sockets.");
+    text += "httpserver_websocket_memory_bytes " + QByteArray::number(webSocketMemory) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_websocket_memory_per_connection_bytes", "gauge", "Average memory held by a WebSocket session, without the socket.");
+    text += "httpserver_websocket_memory_per_connection_bytes " + QByteArray::number(webSockets > 0 ? webSocketMemory / webSockets : 0) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_sse_subscribers", "gauge", "Open Server-Sent Events streams.");
+    text += "httpserver_sse_subscribers " + QByteArray::number(getEventSubscriberCount()) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_sse_events_dropped_total", "counter", "Events skipped for subscribers above the high-water mark.");
+    text += "httpserver_sse_events_dropped_total " + QByteArray::number(m_eventsDropped.loadRelaxed()) + "\n";
+
+    HttpMetrics::appendMetricHeader(text, "httpserver_sse_subscribers_disconnected_total", "counter", "Subscribers closed for staying above the high-water mark.");
+    text += "httpserver_sse_subscribers_disconnected_total " + QByteArray::number(m_eventSubscribersDisconnected.loadRelaxed()) + "\n";
+
+    return text;
+}
+
+bool HttpServer::addMetricsRoute(const QString& target)
+{
+    const Callback callback = [this](const HttpRequest&, const QString&)
+    {
+        // https://prometheus.io/docs/instrumenting/exposition_formats/#basic-info
+        HttpResponse response(HttpResponse::OK);
+        response.setRawHeader(QByteArrayLiteral("Content-Type"), QByteArrayLiteral("text/plain; version=0.0.4; charset=utf-8"));
+        response.setRawHeader(QByteArrayLiteral("Cache-Control"), QByteArrayLiteral("no-store"));
+        response.setBody(getMetricsText());
+
+        return response;
+    };
+
+    // Monitoring matters most while overloaded
+    HttpRouteOptions options;
+    options.priority = HttpRouteOptions::CRITICAL;
+
+    return setCallback(HttpRequest::GET, target, callback, options);
+}
+
+const HttpRouter& HttpServer::getRouter() const
+{
+    // Generations are unique over all servers, so a thread switching between servers
+    // (or a server reusing the address of a deleted one) always reloads its snapshot
+    thread_local quint64 cachedGeneration = 0;
+    thread_local std::shared_ptr<const HttpRouter> cachedRouter;
+
+    const quint64 generation = m_routerGeneration.loadAcquire();
+
+    if (!cachedRouter || generation != cachedGeneration)
+    {
+        QMutexLocker locker(&m_routerMutex);
+
+        cachedRouter = m_router;
+        cachedGeneration = m_routerGeneration.loadRelaxed();
+    }
+
+    return *cachedRouter;
 }
 
 void HttpServer::start()
 {
+    if (m_epollBackend)
+    {
+#ifdef HTTPSERVER_HAVE_OPENSSL
+        if (!m_sslConfig.isNull() && !m_tlsContext)
+        {
+            m_tlsContext = new HttpTlsContext();
+            m_tlsContext->setSessionCacheSize(m_tlsSessionCacheSize);
+            m_tlsContext->setSessionLifetime(m_tlsSessionLifetime);
+            m_tlsContext->setTicketKeyRotation(m_tlsTicketKeyRotation);
+
+            if (!m_tlsContext->setConfiguration(m_sslConfig))
+            {
+                qWarning() << "Invalid SSL Config, epoll backend serves HTTP only!";
+
+                delete m_tlsContext;
+                m_tlsContext = nullptr;
+            }
+        }
+#else
+        if (!m_sslConfig.isNull())
+            qWarning() << "epoll backend is built without OpenSSL, HTTPS is not available!";
+#endif
+
+        if (!m_epollBackend->start(m_listenAddress, m_listenPort, m_workerCount))
+            qWarning() << "Cannot start epoll backend!";
+
+        return;
+    }
+
+    startWorkers();
+
     if (!this->isListening())
         this->listen(m_listenAddress, m_listenPort);
 }
 
 void HttpServer::stop()
 {
+    // The epoll backend closes all of its connections as well
+    if (m_epollBackend)
+        m_epollBackend->stop();
+
     if (this->isListening())
         this->close();
 }
 
-void HttpServer::clientConnected()
+QString HttpServer::getLogInfo(QTcpSocket* const socket)
+{
+    QString result = "";
+
+    if (socket)
+        result = QString::number(socket->localPort()) + ":" + socket->peerAddress().toString() + ":" + QString::number(socket->peerPort());
+
+    return result;
+}
+
+void HttpServer::countHandshake(bool resumed)
+{
+    if (resumed)
+        m_resumedHandshakes.fetchAndAddRelaxed(1);
+    else
+        m_fullHandshakes.fetchAndAddRelaxed(1);
+}
+
+bool HttpServer::acquireConnection()
+{
+    const int count = m_connectionCount.fetchAndAddRelaxed(1) + 1;
+
+    if (m_maxConnections > 0 && count > m_maxConnections)
+    {
+        m_connectionCount.deref();
+        m_rejectedConnections.fetchAndAddRelaxed(1);
+
+        return false;
+    }
+
+    return true;
+}
+
+void HttpServer::releaseConnection()
 {
-    while (this->hasPendingConnections())
+    const int count = m_connectionCount.fetchAndAddRelaxed(-1) - 1;
+
+    // Only once the count drops below the limit, the epoll loops check on their own
+    if (m_backend == BACKEND_QT && m_overflowPolicy == PAUSE_ACCEPTING && count + 1 == m_maxConnections)
+        QMetaObject::invokeMethod(this, &HttpServer::resumeAcceptingBelowLimit, Qt::QueuedConnection);
+}
+
+const HttpResponse& HttpServer::getRouteBusyResponse()
+{
+    // Not the response of the load shedder: the server is not overloaded, only this route is at its limit
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-15.6.4
+    static const HttpResponse response = []()
     {
-        QTcpSocket* const socket = this->nextPendingConnection();
+        HttpResponse result(HttpResponse::SERVICE_UNAVAILABLE);
+        result.setRawHeader(HttpHeaders::CONTENT_TYPE, QByteArrayLiteral("text/plain; charset=utf-8"));
+        result.setRawHeader(HttpHeaders::RETRY_AFTER, QByteArrayLiteral("1"));
+        result.setBody(QByteArrayLiteral("503 Service Unavailable: route busy"));
+
+        return result;
+    }();
 
-        if (!socket)
+    return response;
+}
+
+QByteArray HttpServer::getOverloadResponse()
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-15.6.4
+    HttpResponse response(HttpResponse::SERVICE_UNAVAILABLE);
+    response.setRawHeader(HttpHeaders::CONTENT_TYPE, QByteArrayLiteral("text/plain; charset=utf-8"));
+    response.setRawHeader(HttpHeaders::RETRY_AFTER, QByteArrayLiteral("1"));
+    response.setRawHeader(HttpHeaders::CONNECTION, QByteArrayLiteral("close"));
+    response.setBody(QByteArrayLiteral("503 Service Unavailable"));
+    response.checkHeaders();
+
+    return response.getRawData();
+}
+
+void HttpServer::resumeAcceptingBelowLimit()
+{
+    if (isListening() && !isAtConnectionLimit())
+        resumeAccepting();
+}
+
+void HttpServer::incomingConnection(qintptr handle)
+{
+    // Connections already accepted while the limit was reached.
+    // Plain text, a TLS client only sees the connection closed.
+    if (!acquireConnection())
+    {
+        QTcpSocket socket;
+
+        if (socket.setSocketDescriptor(handle))
         {
-            qDebug() << "Socket invalid!";
-            continue;
+            socket.write(getOverloadResponse());
+            socket.flush();
         }
 
-        const QString logInfo = getLogInfo(socket);
+        return;
+    }
+
+    if (m_overflowPolicy == PAUSE_ACCEPTING && isAtConnectionLimit())
+        pauseAccepting();
 
-        qDebug() << logInfo << "Connected";
+    if (m_workers.isEmpty())
+        startWorkers();
 
-        connect(socket, &QTcpSocket::readyRead, this, &HttpServer::dataReceived);
-        connect(socket, &QTcpSocket::disconnected, socket, &QSslSocket::deleteLater);
+    HttpWorker* const worker = m_workers.at(selectWorker());
 
-        connect(socket, &QTcpSocket::disconnected, [logInfo]() { qDebug() << logInfo << "Disconnected"; });
-        connect(socket, &QTcpSocket::destroyed, [logInfo]() { qDebug() << logInfo << "Destroyed"; });
-        connect(socket, &QSslSocket::errorOccurred, [logInfo, socket](QAbstractSocket::SocketError error) { qDebug() << logInfo << "Socket Error:" << error << socket->errorString(); });
+    // The worker counts the connection once its queued addConnection() runs, until then it is pending.
+    // Here and not in selectWorker(), which may be overridden. Otherwise a burst of accepts all goes to one worker.
+    worker->addPendingConnection();
 
-        QSslSocket* const sslSocket = qobject_cast<QSslSocket*>(socket);
+    // Socket has to be created in the thread of the worker
+    QMetaObject::invokeMethod(worker, [worker, handle]() { worker->addConnection(handle); }, Qt::QueuedConnection);
+}
+
+int HttpServer::selectWorker()
+{
+    int result = 0;
 
-        if (sslSocket)
+    if (m_balancingPolicy == LEAST_CONNECTIONS)
+    {
+        int minConnections = m_workers.at(0)->getConnectionCount();
+
+        for (int i = 1; i < m_workers.size(); ++i)
         {
-            connect(sslSocket, &QSslSocket::encrypted, [logInfo]() { qDebug() << logInfo << "Encrypted"; });
-            connect(sslSocket, &QSslSocket::handshakeInterruptedOnError, [logInfo](const QSslError& error) { qDebug() << logInfo << "Handhshake Error:" << error; });
-            connect(sslSocket, &QSslSocket::peerVerifyError, [logInfo](const QSslError& error) { qDebug() << logInfo << "Peer Verify Error:" << error; });
-            connect(sslSocket, &QSslSocket::sslErrors, [logInfo](const QList<QSslError>& errors) { qDebug() << logInfo << "SSL Errors:" << errors; });
+            const int connections = m_workers.at(i)->getConnectionCount();
+
+            if (connections < minConnections)
+            {
+                minConnections = connections;
+                result = i;
+            }
         }
     }
+    else
+    {
+        result = m_nextWorker;
+        m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+    }
+
+    return result;
 }
 
-void HttpServer::dataReceived()
+void HttpServer::startWorkers()
 {
-    QSslSocket* const socket = qobject_cast<QSslSocket*>(sender());
+    if (!m_workers.isEmpty())
+        return;
 
-    if (!socket)
+    for (int i = 0; i < m_workerCount; ++i)
     {
-        qDebug() << "Socket invalid!";
-        return;
+        QThread* const thread = new QThread();
+        thread->setObjectName("HttpWorker" + QString::number(i));
+
+        HttpWorker* const worker = new HttpWorker(this);
+        worker->moveToThread(thread);
+
+        m_workerThreads.append(thread);
+        m_workers.append(worker);
+
+        thread->start();
     }
 
-    const QString logInfo = getLogInfo(socket);
+    m_nextWorker = 0;
+}
 
-    // Socket is encrypted -> Handle HTTPS request
-    if (socket->isEncrypted())
+void HttpServer::stopWorkers()
+{
+    for (QThread* const thread : m_workerThreads)
     {
-        qDebug() << logInfo << "Encrypted -> HTTPS";
+        thread->quit();
+        thread->wait();
+    }
 
-        const HttpRequest request(socket->readAll());
-        HttpResponse response = handleHttpRequest(request, logInfo);
+    // Event loops are stopped -> workers and their connections can be deleted from here
+    qDeleteAll(m_workers);
+    qDeleteAll(m_workerThreads);
 
-        if (response.getStatus() != HttpResponse::OK && response.getBody() == "")
-        {
-            QString strBody = QString::number(response.getStatus()) + " " + response.getStringFromStatus(response.getStatus());
+    m_workers.clear();
+    m_workerThreads.clear();
+}
 
-            response.setHeader("Content-Type", "text/plain; charset=utf-8");
-            response.setBody(strBody.toUtf8());
-        }
+bool HttpServer::handleHttpRequest(HttpRequest& request, const QString& logInfo, HttpResponse& response, QFuture<HttpResponse>& pending, HttpRouteMetrics*& routeMetrics) const
+{
+    qCDebug(lcHttpServer) << logInfo << "Method:" << request.getMethod() << HttpRequest::getStringFromMethod(request.getMethod()) << "Target:" << request.getTarget();
+    qCDebug(lcHttpServer) << logInfo << "Parameters:" << request.getTargetParameters();
+    qCDebug(lcHttpServer) << logInfo << "Data:" << request.getBodyView();
 
-        response.checkHeaders();
-        socket->write(response.getRawData());
-        socket->close();
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-3.2
+    // -> Host header is mandatory for HTTP/1.1
+    if (request.isValid() && request.getProtocolView() == "HTTP/1.1" && request.getHeaderView(HttpHeaders::HOST).isEmpty())
+    {
+        qCDebug(lcHttpServer) << logInfo << "Host header missing!";
+        response.setStatus(HttpResponse::BAD_REQUEST);
     }
-
-    // TLS Handshakes always starts with 22
-    // https://datatracker.ietf.org/doc/html/rfc5246
-    // -> enum ContentType is 22 for Handshake
-    else if (socket->peek(1).startsWith(22))
+    else if (request.isValid())
     {
-        qDebug() << logInfo << "TLS Handshake";
+        HttpRouter::Match match;
+
+        // Read before the router, so a cached response is never newer than its route
+        const quint64 generation = m_routerGeneration.loadAcquire();
+
+        if (getRouter().match(request.getMethod(), request.getTarget(), match))
+        {
+            qCDebug(lcHttpServer) << logInfo << "Callback found";
+
+            for (const auto& parameter : std::as_const(match.parameters))
+                request.addPathParameter(*parameter.first, parameter.second);
+
+            // Copy, the snapshot may be replaced if the callback changes the callbacks
+            const HttpRouter::Route route = *match.route;
+            routeMetrics = route.metrics;
+
+            if (m_loadShedder.shouldShed(request.getElapsed(), route.options.priority))
+            {
+                qCDebug(lcHttpServer) << logInfo << "Shedding load, queued for" << request.getElapsed() << "us";
+                response = m_loadShedder.getResponse();
+            }
+            else if (!route.tryAcquire())
+            {
+                qCDebug(lcHttpServer) << logInfo << "Route busy";
+                response = getRouteBusyResponse();
+            }
+            else if (route.isAsync())
+            {
+                pending = startAsyncCallback(request, logInfo, route, generation);
+                return false;
+            }
+            else
+            {
+                response = route.callback(request, logInfo);
+                route.release();
 
-        if (m_sslConfig.isNull())
+                processCallbackResponse(request, route, generation, response);
+            }
+        }
+        else if (match.allowedMethods != 0)
         {
-            qWarning() << logInfo << "SSL Config is invalid!";
-            socket->close();
+            qCDebug(lcHttpServer) << logInfo << "Method not allowed";
+            response.setStatus(HttpResponse::METHOD_NOT_ALLOWED);
+            response.setHeader("Allow", HttpRouter::getAllowHeader(match.allowedMethods));
         }
         else
-            socket->startServerEncryption();
+        {
+            qCDebug(lcHttpServer) << logInfo << "Request valid, but no Callback set";
+            response.setStatus(HttpResponse::NOT_FOUND);
+        }
     }
-
-    // Socket is not encrypted and no TLS Handshake -> Handle HTTP request
     else
     {
-        qDebug() << logInfo << "Unencrypted -> HTTP";
+        qCDebug(lcHttpServer) << logInfo << "Request invalid!";
+        response.setStatus(HttpResponse::BAD_REQUEST);
+    }
+
+    return true;
+}
+
+QFuture<HttpResponse> HttpServer::startAsyncCallback(const HttpRequest& request, const QString& logInfo, const HttpRouter::Route& route, quint64 generation) const
+{
+    // The connection reuses its request for the next one -> one copy, shared by the task and the continuation
+    const std::shared_ptr<const HttpRequest> sharedRequest = std::make_shared<const HttpRequest>(request);
 
-        const HttpRequest request(socket->readAll());
+    QFuture<HttpResponse> future;
 
-        bool writeResponse = false;
-        HttpResponse response;
+    if (route.asyncCallback)
+        future = route.asyncCallback(*sharedRequest, logInfo);
+    else
+    {
+        const auto promise = std::make_shared<QPromise<HttpResponse>>();
+        future = promise->future();
 
-        // Redirect HTTP to HTTPS
-        if (m_enableHttpRedirection)
+        m_threadPool.start([promise, callback = route.callback, priority = route.options.priority, shedder = &m_loadShedder, sharedRequest, logInfo]()
         {
-            qDebug() << logInfo << "Redirecting HTTP to HTTPS";
+            promise->start();
 
-            if (m_sslConfig.isNull())
-                qWarning() << logInfo << "SSL Config is invalid!";
+            // The queue of the pool adds to the delay
+            if (shedder->shouldShed(sharedRequest->getElapsed(), priority))
+                promise->addResult(shedder->getResponse());
             else
-            {
-                const QString host = request.getHeader("Host");
-
-                if (host != "")
-                {
-                    response.setStatus(HttpResponse::MOVED_PERMANENTLY);
-                    response.setHeader("Location", "https://" + host + request.getTargetRaw());
-                    response.setHeader("Content-Type", "text/plain; charset=utf-8");
+                promise->addResult(callback(*sharedRequest, logInfo));
 
-                    QString strBody = "Permanently Moved to https://" + host + request.getTarget();
-                    response.setBody(strBody.toUtf8());
-                }
-                else
-                    response.setStatus(HttpResponse::BAD_REQUEST);
-
-                writeResponse = true;
-            }
-        }
+            promise->finish();
+        });
+    }
 
-        // Handle HTTP Request
-        else if (m_enableHttp)
-        {
-            qDebug() << logInfo << "Handling HTTP Request";
+    // Runs in the thread finishing the future, so compression is done there as well
+    return future.onCanceled([]() { return HttpResponse(HttpResponse::INTERNAL_SERVER_ERROR); })
+#ifndef QT_NO_EXCEPTIONS
+                 .onFailed([]() { return HttpResponse(HttpResponse::INTERNAL_SERVER_ERROR); })
+#endif
+                 .then(QtFuture::Launch::Sync, [this, sharedRequest, route, generation](HttpResponse response)
+                 {
+                     route.release();
+                     processCallbackResponse(*sharedRequest, route, generation, response);
+
+                     return response;
+                 });
+}
 
-            response = handleHttpRequest(request, logInfo);
-            writeResponse = true;
-        }
+void HttpServer::processCallbackResponse(const HttpRequest& request, const HttpRouter::Route& route, quint64 generation, HttpResponse& response) const
+{
+    // Before the response cache, so every variant is only compressed once
+    m_compression.compressResponse(request, response);
 
-        if (writeResponse)
-        {
-            if (response.getStatus() != HttpResponse::OK && response.getBody() == "")
-            {
-                const QString strBody = QString::number(response.getStatus()) + " " + response.getStringFromStatus(response.getStatus());
+    if (route.options.cacheTtl > 0)
+        m_responseCache.insert(request, response, route.options.cacheVary, route.options.cacheTtl, generation, QDateTime::currentMSecsSinceEpoch(), route.metrics);
+}
 
-                response.setHeader("Content-Type", "text/plain; charset=utf-8");
-                response.setBody(strBody.toUtf8());
-            }
+HttpResponse HttpServer::getRedirectResponse(const HttpRequest& request) const
+{
+    HttpResponse response;
+    const QString host = QString::fromLatin1(request.getHeaderView(HttpHeaders::HOST));
 
-            response.checkHeaders();
-            socket->write(response.getRawData());
-        }
+    if (host != "")
+    {
+        response.setStatus(HttpResponse::MOVED_PERMANENTLY);
+        response.setHeader("Location", "https://" + host + request.getTargetRaw());
+        response.setHeader("Content-Type", "text/plain; charset=utf-8");
 
-        socket->close();
+        QString strBody = "Permanently Moved to https://" + host + request.getTarget();
+        response.setBody(strBody.toUtf8());
     }
+    else
+        response.setStatus(HttpResponse::BAD_REQUEST);
+
+    return response;
 }
 
-QString HttpServer::getLogInfo(QTcpSocket* const socket)
+void HttpServer::recordResponse(const HttpAccessLog::Peer& peer, const HttpRequest& request, HttpRouteMetrics* routeMetrics, int status, qint64 bytes, const QElapsedTimer& timer)
 {
-    QString result = "";
+    const qint64 latency = timer.nsecsElapsed() / 1000;
 
-    if (socket)
-        result = QString::number(socket->localPort()) + ":" + socket->peerAddress().toString() + ":" + QString::number(socket->peerPort());
+    if (!routeMetrics)
+        routeMetrics = m_metrics.getUnmatchedRoute(request.getMethod());
 
-    return result;
+    routeMetrics->record(status, latency);
+
+    if (m_accessLog.isOpen())
+        m_accessLog.log(peer, request, status, bytes, latency);
 }
 
-void HttpServer::incomingConnection(qintptr handle)
+HttpResponse HttpServer::getParseErrorResponse(const HttpRequest& request)
 {
-    QSslSocket* const socket = new QSslSocket(this);
+    return HttpResponse(request.isBodyTooLarge() ? HttpResponse::CONTENT_TOO_LARGE : HttpResponse::BAD_REQUEST);
+}
 
-    if (!socket->setSocketDescriptor(handle))
-    {
-        qDebug() << "SocketDescriptor invalid!";
-        socket->deleteLater();
-        return;
-    }
+HttpResponseCache::EntryPtr HttpServer::getCachedResponse(const HttpRequest& request, int requestCount, QByteArray& data, bool& keepAlive) const
+{
+    // Missing Host is answered by handleHttpRequest()
+    if (m_responseCache.isEmpty() || !request.isValid() || request.getHeaderView(HttpHeaders::HOST).isEmpty())
+        return HttpResponseCache::EntryPtr();
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const HttpResponseCache::EntryPtr entry = m_responseCache.get(request, m_routerGeneration.loadAcquire(), now);
+
+    if (!entry)
+        return entry;
+
+    keepAlive = isKeepAlive(request, requestCount);
 
-    const QString logInfo = getLogInfo(socket);
+    // https://datatracker.ietf.org/doc/html/rfc9111#section-5.1
+    char strAge[32];
+    const int ageSize = qsnprintf(strAge, sizeof(strAge), "Age: %lld\r\n", qlonglong((now - entry->created) / 1000));
 
-    qDebug() << logInfo << "Connection opened";
+    const QByteArray dateLine = HttpResponse::getDateLine();
+    QByteArray strConnection = QByteArrayLiteral("Connection: close\r\n");
 
-    if (!m_sslConfig.isNull())
-        socket->setSslConfiguration(m_sslConfig);
+    if (keepAlive)
+        strConnection = "Connection: keep-alive\r\nKeep-Alive: " + getKeepAliveValue(requestCount) + "\r\n";
 
-    this->addPendingConnection(socket);
+    data.reserve(data.size() + entry->head.size() + ageSize + dateLine.size() + strConnection.size() + 2 + entry->body.size());
+    data.append(entry->head);
+    data.append(strAge, ageSize);
+    data.append(dateLine);
+    data.append(strConnection);
+    data.append("\r\n", 2);
+    data.append(entry->body);
+
+    return entry;
 }
 
-HttpResponse HttpServer::handleHttpRequest(const HttpRequest& request, const QString &logInfo)
+bool HttpServer::finishResponse(const HttpRequest& request, HttpResponse& response, int requestCount) const
 {
-    HttpResponse response;
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-4.2.2
+    // -> The connection belongs to the WebSocket session afterwards
+    if (response.getStatus() == HttpResponse::SWITCHING_PROTOCOLS)
+    {
+        response.checkHeaders();
+        return true;
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-6.3
+    // -> Event streams have no length, they end with the connection
+    if (response.getEventSource())
+    {
+        response.setRawHeader(QByteArrayLiteral("Connection"), QByteArrayLiteral("close"));
+        response.checkHeaders();
+        return false;
+    }
 
-    qDebug() << logInfo << "Method:" << request.getMethod() << HttpRequest::getStringFromMethod(request.getMethod()) << "Target:" << request.getTarget();
-    qDebug() << logInfo << "Parameters:" << request.getTargetParameters();
-    qDebug() << logInfo << "Data:" << request.getBody();
+    bool keepAlive = isKeepAlive(request, requestCount);
 
-    if (request.isValid())
+    if (response.getStatus() >= HttpResponse::BAD_REQUEST && response.getBodySize() == 0)
     {
-        const auto cbKey = qMakePair(request.getMethod(), request.getTarget());
+        const QString strBody = QString::number(response.getStatus()) + " " + response.getStringFromStatus(response.getStatus());
 
-        if (m_hashCallbacks.contains(cbKey))
-        {
-            qDebug() << logInfo << "Callback found";
+        response.setHeader("Content-Type", "text/plain; charset=utf-8");
+        response.setBody(strBody.toUtf8());
+    }
 
-            const auto& cb = m_hashCallbacks[cbKey];
-            response = cb(request, logInfo);
-        }
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-6.3
+    // -> Without a known length, HTTP/1.0 clients read the body until the connection is closed
+    if (response.getBodyProducer())
+    {
+        if (request.getProtocolView() == "HTTP/1.1")
+            response.setRawHeader(QByteArrayLiteral("Transfer-Encoding"), QByteArrayLiteral("chunked"));
         else
-        {
-            qDebug() << logInfo << "Request valid, but no Callback set";
-            response.setStatus(HttpResponse::NOT_FOUND);
-        }
+            keepAlive = false;
     }
-    else
+
+    if (keepAlive)
     {
-        qDebug() << logInfo << "Request invalid!";
-        response.setStatus(HttpResponse::BAD_REQUEST);
+        response.setRawHeader(QByteArrayLiteral("Connection"), QByteArrayLiteral("keep-alive"));
+
+        response.setRawHeader(QByteArrayLiteral("Keep-Alive"), getKeepAliveValue(requestCount));
     }
+    else
+        response.setRawHeader(QByteArrayLiteral("Connection"), QByteArrayLiteral("close"));
 
-    return response;
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-9.3.2
+    // -> Same headers as GET, but no body
+    response.setOmitBody(request.getMethod() == HttpRequest::HEAD);
+
+    response.checkHeaders();
+
+    return keepAlive;
+}
+
+bool HttpServer::isKeepAlive(const HttpRequest& request, int requestCount) const
+{
+    return request.isValid()
+           && isKeepAliveRequested(request)
+           && (m_maxRequestsPerConnection <= 0 || requestCount < m_maxRequestsPerConnection);
+}
+
+QByteArray HttpServer::getKeepAliveValue(int requestCount) const
+{
+    // Only informational for HTTP/1.1, but required by HTTP/1.0 clients
+    QByteArray result = "timeout=" + QByteArray::number(m_keepAliveTimeout / 1000);
+
+    if (m_maxRequestsPerConnection > 0)
+        result += ", max=" + QByteArray::number(m_maxRequestsPerConnection - requestCount);
+
+    return result;
+}
+
+bool HttpServer::isKeepAliveRequested(const HttpRequest& request)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-9.3
+    // HTTP/1.1 is persistent unless "close" is sent, HTTP/1.0 only with explicit "keep-alive"
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-7.6.1
+    // -> List of options, e.g. "keep-alive, Upgrade"
+    const QByteArrayView connection = request.getHeaderView(HttpHeaders::CONNECTION);
+
+    if (request.getProtocolView() == "HTTP/1.1")
+        return !HttpHeaders::hasToken(connection, "close");
+
+    if (request.getProtocolView() == "HTTP/1.0")
+        return HttpHeaders::hasToken(connection, "keep-alive");
+
+    return false;
 }
@@ -4,18 +4,68 @@
 #include <QObject>
 #include <QTcpServer>
 #include <QSslConfiguration>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
 #include <functional>
+#include <memory>
 
+#include "httpaccesslog.h"
+#include "httpcompression.h"
+#include "httpeventsource.h"
+#include "httpfilecache.h"
+#include "httploadshedder.h"
+#include "httpmetrics.h"
 #include "httprequest.h"
 #include "httpresponse.h"
+#include "httpresponsecache.h"
+#include "httprouter.h"
+#include "httpwebsocket.h"
 
 
+class HttpWorker;
+class HttpEpollBackend;
+class HttpTlsContext;
+
 class HttpServer : public QTcpServer
 {
     Q_OBJECT
 
+    friend class HttpConnection;
+    friend class HttpWorker;
+    friend class HttpEpollBackend;
+    friend class Http2Session;
+    friend class HttpWebSocket;
+    friend class HttpEventSubscriber;
+
 public:
+    typedef HttpRouter::Callback Callback;
+    typedef HttpRouter::AsyncCallback AsyncCallback;
+
+    enum BACKEND
+    {
+        BACKEND_QT,         // QTcpServer / QSslSocket, HTTP and HTTPS
+        BACKEND_EPOLL,      // Linux only, HTTP and HTTPS (needs OpenSSL). HTTP/1.1 only: no HTTP/2, and WebSocket
+                            // upgrades and Server-Sent Events are answered with 501 Not Implemented.
+    };
+
+    enum BALANCING_POLICY
+    {
+        ROUND_ROBIN,
+        LEAST_CONNECTIONS,
+    };
+
+    // What happens to new connections once getMaxConnections() are open
+    enum OVERFLOW_POLICY
+    {
+        PAUSE_ACCEPTING,    // Left in the listen backlog of the kernel until connections are closed
+        REJECT,             // Accepted, answered with 503 and closed right away
+    };
+
     explicit HttpServer(const QHostAddress& address, quint16 port, QObject* parent = nullptr);
+    explicit HttpServer(const QHostAddress& address, quint16 port, BACKEND backend, QObject* parent = nullptr);
     ~HttpServer();
 
     static QString getServerName();
@@ -27,34 +77,269 @@ public:
     void setEnableHttp(bool enable);
     void setEnableHttpRedirection(bool enable);
 
-    void setCallback(HttpRequest::METHOD method, const QString& target, const std::function<HttpResponse(const HttpRequest&, const QString&)>& function);
-    void removeCallback(HttpRequest::METHOD method, const QString& target);
+    // HTTP/2 for the Qt backend: negotiated by ALPN over TLS, or with prior knowledge over plain HTTP (h2c)
+    void setEnableHttp2(bool enable);
+    bool getEnableHttp2() const { return m_enableHttp2; }
+
+    // TLS session resumption (session cache and rotating session tickets), has to be set before start().
+    // Only used by the epoll backend with OpenSSL, QSsl::SslOptionDisableSessionTickets of the configuration
+    // turns the tickets off. QSslSocket sets up a TLS context per server socket and offers no way to share
+    // a session cache or ticket keys between connections, the Qt backend does not resume sessions.
+    void setTlsSessionCacheSize(int sessions) { m_tlsSessionCacheSize = sessions; }
+    int getTlsSessionCacheSize() const { return m_tlsSessionCacheSize; }
+
+    // Seconds
+    void setTlsSessionLifetime(int seconds) { m_tlsSessionLifetime = seconds; }
+    int getTlsSessionLifetime() const { return m_tlsSessionLifetime; }
+
+    void setTlsTicketKeyRotation(int seconds) { m_tlsTicketKeyRotation = seconds; }
+    int getTlsTicketKeyRotation() const { return m_tlsTicketKeyRotation; }
+
+    // Completed handshakes, resumed ones are abbreviated (no certificate, no key exchange with TLS 1.2).
+    // The Qt backend counts every handshake as full, see above.
+    quint64 getFullHandshakeCount() const { return m_fullHandshakes.loadRelaxed(); }
+    quint64 getResumedHandshakeCount() const { return m_resumedHandshakes.loadRelaxed(); }
+
+    // Admission control over all workers, 0 = unlimited
+    void setMaxConnections(int max) { m_maxConnections = qMax(0, max); }
+    int getMaxConnections() const { return m_maxConnections; }
+
+    void setOverflowPolicy(OVERFLOW_POLICY policy) { m_overflowPolicy = policy; }
+    OVERFLOW_POLICY getOverflowPolicy() const { return m_overflowPolicy; }
+
+    int getConnectionCount() const { return m_connectionCount.loadRelaxed(); }
+    quint64 getRejectedConnectionCount() const { return m_rejectedConnections.loadRelaxed(); }
+
+    // Timeouts in ms, driven by one timer wheel per worker (or epoll loop), 0 = none.
+    // Time for the first byte of a new connection, and the longest stall while a response is written
+    void setIdleTimeout(int msec) { m_idleTimeout = msec; }
+    int getIdleTimeout() const { return m_idleTimeout; }
+
+    // Request line and headers (and the TLS handshake) have to arrive within the time after their first byte.
+    // Not restarted by further data, so trickled headers do not keep a connection open. Answered with 408.
+    void setHeaderTimeout(int msec) { m_headerTimeout = msec; }
+    int getHeaderTimeout() const { return m_headerTimeout; }
+
+    // Longest pause between two reads of a request body, answered with 408
+    void setBodyTimeout(int msec) { m_bodyTimeout = msec; }
+    int getBodyTimeout() const { return m_bodyTimeout; }
+
+    // Idle time in ms after which a persistent connection is closed
+    void setKeepAliveTimeout(int msec) { m_keepAliveTimeout = msec; }
+    int getKeepAliveTimeout() const { return m_keepAliveTimeout; }
+
+    // Request bodies above the size are answered with 413 before they are read, 0 = unlimited.
+    // Has to be set before start(), like the spill threshold.
+    void setMaxBodySize(qint64 bytes) { m_maxBodySize = bytes; }
+    qint64 getMaxBodySize() const { return m_maxBodySize; }
+
+    // Request bodies above the size are written to a temporary file, see HttpRequest::getBodyDevice(), 0 = never
+    void setBodySpillThreshold(qint64 bytes) { m_bodySpillThreshold = bytes; }
+    qint64 getBodySpillThreshold() const { return m_bodySpillThreshold; }
+
+    // Requests served on one connection before it is closed, 0 = unlimited
+    void setMaxRequestsPerConnection(int max) { m_maxRequestsPerConnection = max; }
+    int getMaxRequestsPerConnection() const { return m_maxRequestsPerConnection; }
+
+    BACKEND getBackend() const { return m_backend; }
+
+    // Connections are distributed over worker threads (or epoll loops), each running its own event loop.
+    // Has to be set before start(), default is one worker per core.
+    void setWorkerCount(int count) { m_workerCount = qMax(1, count); }
+    int getWorkerCount() const { return m_workerCount; }
+
+    void setBalancingPolicy(BALANCING_POLICY policy) { m_balancingPolicy = policy; }
+    BALANCING_POLICY getBalancingPolicy() const { return m_balancingPolicy; }
+
+    // Thread-safe, may also be called while the server is running.
+    // Targets may contain {name} parameters and a trailing *name wildcard, see HttpRouter.
+    bool setCallback(HttpRequest::METHOD method, const QString& target, const Callback& function, const HttpRouteOptions& options = HttpRouteOptions());
+    bool removeCallback(HttpRequest::METHOD method, const QString& target);
+
+    // The response is delivered by the future, e.g. QtConcurrent::run(getThreadPool(), ...).
+    // The connection waits for it without blocking its thread, later requests on it are read afterwards.
+    // A canceled or failed future is answered with 500. Futures have to finish before the server is deleted.
+    bool setAsyncCallback(HttpRequest::METHOD method, const QString& target, const AsyncCallback& function, const HttpRouteOptions& options = HttpRouteOptions());
+
+    // GET route accepting WebSocket handshakes (HTTP/1.1, Qt backend), see HttpWebSocket. False with BACKEND_EPOLL.
+    // Other routes may accept them as well by returning HttpWebSocket::upgrade().
+    bool setWebSocketCallback(const QString& target, const HttpWebSocketHandler& handler, const HttpRouteOptions& options = HttpRouteOptions());
+
+    // Open WebSocket sessions and the memory they hold, see HttpWebSocket::getMemoryUsage()
+    int getWebSocketCount() const { return m_webSocketCount.loadRelaxed(); }
+    qint64 getWebSocketMemory() const { return m_webSocketMemory.loadRelaxed(); }
+
+    // GET route subscribing to the Server-Sent Events of source (HTTP/1.1, Qt backend), which has to outlive the route.
+    // False with BACKEND_EPOLL. Other routes may subscribe as well by returning HttpEventSource::subscribe().
+    bool setEventSourceCallback(const QString& target, const HttpEventSource* source, const HttpRouteOptions& options = HttpRouteOptions());
+
+    int getEventSubscriberCount() const { return m_eventSubscriberCount.loadRelaxed(); }
+
+    // Runs callbacks with HttpRouteOptions::offload, default is one thread per core
+    QThreadPool* getThreadPool() { return &m_threadPool; }
+
+    // Serves the files below directory for GET and HEAD on prefix, e.g. "/static" -> /static/css/main.css.
+    // Files are kept open and mapped in the file cache, which is shared by all static directories.
+    bool addStaticDirectory(const QString& prefix, const QString& directory);
+
+    HttpFileCache* getFileCache() { return &m_fileCache; }
+
+    // Responses of routes with HttpRouteOptions::cacheTtl, hits bypass the callback and serialization
+    HttpResponseCache* getResponseCache() { return &m_responseCache; }
+
+    // Compression of callback responses (including static files) by Accept-Encoding, settings have to be set before start()
+    HttpCompression* getCompression() { return &m_compression; }
+
+    // 503 for requests queued too long while overloaded, disabled until a target is set. Settings have to be set before start().
+    HttpLoadShedder* getLoadShedder() { return &m_loadShedder; }
+
+    // Structured access log, written by a background thread once opened
+    HttpAccessLog* getAccessLog() { return &m_accessLog; }
+
+    // Always recorded, read on demand
+    HttpMetrics* getMetrics() { return &m_metrics; }
+
+    // Prometheus text format: metrics, TLS handshakes, rejected connections, shed requests and dropped access log records
+    QByteArray getMetricsText() const;
+
+    // GET route answering with getMetricsText(), never shed
+    bool addMetricsRoute(const QString& target = "/metrics");
 
 public slots:
     void start();
     void stop();
 
-private slots:
-    void clientConnected();
-    void dataReceived();
-
 protected:
     virtual void incomingConnection(qintptr handle);
 
+    // Override for custom balancing, index into the worker list
+    virtual int selectWorker();
+
+    const QList<HttpWorker*>& getWorkers() const { return m_workers; }
+
+private slots:
+    // Paused by incomingConnection() at the connection limit
+    void resumeAcceptingBelowLimit();
+
 private:
     QHostAddress m_listenAddress;
     quint16 m_listenPort;
 
+    BACKEND m_backend = BACKEND_QT;
+    HttpEpollBackend* m_epollBackend = nullptr;
+
     QSslConfiguration m_sslConfig = QSslConfiguration();
+    bool m_sslDefaultNextProtocols = false;
+
+    HttpTlsContext* m_tlsContext = nullptr;
+    int m_tlsSessionCacheSize = 20480;
+    int m_tlsSessionLifetime = 3600;
+    int m_tlsTicketKeyRotation = 3600;
+
+    QAtomicInteger<quint64> m_fullHandshakes = 0;
+    QAtomicInteger<quint64> m_resumedHandshakes = 0;
 
     bool m_enableHttp = true;
     bool m_enableHttpRedirection = false;
+    bool m_enableHttp2 = true;
+
+    int m_maxConnections = 10000;
+    OVERFLOW_POLICY m_overflowPolicy = PAUSE_ACCEPTING;
+
+    QAtomicInt m_connectionCount = 0;
+    QAtomicInteger<quint64> m_rejectedConnections = 0;
+
+    QAtomicInt m_webSocketCount = 0;
+    QAtomicInteger<qint64> m_webSocketMemory = 0;
+
+    QAtomicInt m_eventSubscriberCount = 0;
+    QAtomicInteger<quint64> m_eventsDropped = 0;
+    QAtomicInteger<quint64> m_eventSubscribersDisconnected = 0;
+
+    int m_idleTimeout = 10000;
+    int m_headerTimeout = 10000;
+    int m_bodyTimeout = 30000;
+    int m_keepAliveTimeout = 5000;
+    int m_maxRequestsPerConnection = 100;
+
+    qint64 m_maxBodySize = 64 * 1024 * 1024;
+    qint64 m_bodySpillThreshold = 1024 * 1024;
+
+    int m_workerCount = QThread::idealThreadCount();
+    BALANCING_POLICY m_balancingPolicy = ROUND_ROBIN;
+    int m_nextWorker = 0;
+
+    QList<QThread*> m_workerThreads;
+    QList<HttpWorker*> m_workers;
+
+    // Copy-on-write: readers keep a per-thread snapshot and only lock after a change
+    std::shared_ptr<const HttpRouter> m_router = std::make_shared<const HttpRouter>();
+    QAtomicInteger<quint64> m_routerGeneration = 0;
+    mutable QMutex m_routerMutex;
 
-    QHash<QPair<HttpRequest::METHOD, QString>, std::function<HttpResponse(const HttpRequest&, const QString&)> > m_hashCallbacks;
+    static QAtomicInteger<quint64> m_nextRouterGeneration;
+
+    HttpFileCache m_fileCache;
+
+    // Thread-safe, filled from the const request handling
+    mutable HttpResponseCache m_responseCache;
+    mutable HttpCompression m_compression;
+    mutable HttpLoadShedder m_loadShedder;
+
+    mutable QThreadPool m_threadPool;
+
+    HttpAccessLog m_accessLog;
+    HttpMetrics m_metrics;
 
     static QString getLogInfo(QTcpSocket* const socket);
 
-    HttpResponse handleHttpRequest(const HttpRequest& request, const QString& logInfo);
+    // ALPN of m_sslConfig by setEnableHttp2(), used if the caller's configuration offers no protocols
+    void setDefaultNextProtocols();
+
+    void countHandshake(bool resumed);
+
+    // Counts a new connection, false (and not counted) if it would exceed the limit
+    bool acquireConnection();
+    void releaseConnection();
+    bool isAtConnectionLimit() const { return m_maxConnections > 0 && m_connectionCount.loadRelaxed() >= m_maxConnections; }
+
+    // Complete 503 with "Connection: close", for connections over the limit
+    static QByteArray getOverloadResponse();
+
+    // 503 for routes at their maxConcurrency, complete except for the connection headers
+    static const HttpResponse& getRouteBusyResponse();
+
+    const HttpRouter& getRouter() const;
+
+    void startWorkers();
+    void stopWorkers();
+
+    // False for async and offloaded callbacks, the response is delivered by pending then.
+    // routeMetrics is set if a route matched.
+    bool handleHttpRequest(HttpRequest& request, const QString& logInfo, HttpResponse& response, QFuture<HttpResponse>& pending, HttpRouteMetrics*& routeMetrics) const;
+    QFuture<HttpResponse> startAsyncCallback(const HttpRequest& request, const QString& logInfo, const HttpRouter::Route& route, quint64 generation) const;
+
+    // Compression and response cache
+    void processCallbackResponse(const HttpRequest& request, const HttpRouter::Route& route, quint64 generation, HttpResponse& response) const;
+    HttpResponse getRedirectResponse(const HttpRequest& request) const;
+
+    // Metrics and access log, once the response is handed to the connection. Without routeMetrics
+    // the request is counted as unmatched. Latency since the request was read completely.
+    void recordResponse(const HttpAccessLog::Peer& peer, const HttpRequest& request, HttpRouteMetrics* routeMetrics, int status, qint64 bytes, const QElapsedTimer& timer);
+
+    // Response to a request which could not be parsed
+    static HttpResponse getParseErrorResponse(const HttpRequest& request);
+
+    // Appends the complete response including connection headers, null if the response is not cached
+    HttpResponseCache::EntryPtr getCachedResponse(const HttpRequest& request, int requestCount, QByteArray& data, bool& keepAlive) const;
+
+    // Adds error body and connection headers, returns whether the connection is kept alive
+    bool finishResponse(const HttpRequest& request, HttpResponse& response, int requestCount) const;
+
+    bool isKeepAlive(const HttpRequest& request, int requestCount) const;
+    QByteArray getKeepAliveValue(int requestCount) const;
+
+    static bool isKeepAliveRequested(const HttpRequest& request);
 };
 
 #endif // HTTPSERVER_H
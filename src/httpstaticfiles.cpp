@@ -0,0 +1,254 @@
+#include "httpstaticfiles.h"
+
+#include <QFileInfo>
+
+#include <algorithm>
+
+
+HttpStaticFiles::HttpStaticFiles(const QString& directory, HttpFileCache* cache) :
+    m_cache(cache)
+{
+    const QFileInfo info(directory);
+
+    if (info.isDir())
+        m_root = info.canonicalFilePath();
+    else
+        qWarning() << "Static directory does not exist:" << directory;
+}
+
+HttpResponse HttpStaticFiles::handleRequest(const HttpRequest& request, QStringView path) const
+{
+    HttpResponse response;
+
+    const QString filePath = resolvePath(path);
+    const HttpFileCache::FilePtr file = filePath.isEmpty() ? HttpFileCache::FilePtr() : m_cache->getFile(filePath);
+
+    if (!file)
+    {
+        response.setStatus(HttpResponse::NOT_FOUND);
+        return response;
+    }
+
+    response.setRawHeader(QByteArrayLiteral("ETag"), file->etag);
+    response.setRawHeader(QByteArrayLiteral("Last-Modified"), file->lastModifiedHttp);
+    response.setRawHeader(QByteArrayLiteral("Accept-Ranges"), QByteArrayLiteral("bytes"));
+
+    if (isNotModified(request, *file))
+    {
+        response.setStatus(HttpResponse::NOT_MODIFIED);
+        return response;
+    }
+
+    qint64 start = 0;
+    qint64 length = file->size;
+
+    switch (parseRange(request, *file, start, length))
+    {
+    case RANGE_NOT_SATISFIABLE:
+        response.setStatus(HttpResponse::RANGE_NOT_SATISFIABLE);
+        response.setRawHeader(QByteArrayLiteral("Content-Range"), "bytes */" + QByteArray::number(file->size));
+        return response;
+
+    case RANGE_SATISFIABLE:
+        response.setStatus(HttpResponse::PARTIAL_CONTENT);
+        response.setRawHeader(QByteArrayLiteral("Content-Range"), "bytes " + QByteArray::number(start) + "-" + QByteArray::number(start + length - 1)
+                                                                   + "/" + QByteArray::number(file->size));
+        break;
+
+    case RANGE_NONE:
+        response.setStatus(HttpResponse::OK);
+        break;
+    }
+
+    response.setRawHeader(QByteArrayLiteral("Content-Type"), file->contentType);
+    response.setBodyFile(file, start, length);
+
+    return response;
+}
+
+QString HttpStaticFiles::resolvePath(QStringView path) const
+{
+    if (!isValid())
+        return QString();
+
+    // The path is already percent-decoded -> "%2e%2e" and "%00" end up here as well
+    if (path.contains(QChar(0)) || path.contains('\\'))
+        return QString();
+
+    for (const QStringView segment : path.tokenize(u'/'))
+    {
+        if (segment == u"..")
+            return QString();
+    }
+
+    QString filePath = m_root;
+    filePath += u'/';
+    filePath += path;
+
+    QFileInfo info(filePath);
+
+    if (info.isDir())
+        info.setFile(info.filePath() + "/" + m_indexFile);
+
+    // Resolves symlinks, so links pointing outside of the directory are rejected as well
+    const QString result = info.canonicalFilePath();
+
+    if (result.isEmpty() || !result.startsWith(m_root + "/"))
+        return QString();
+
+    return result;
+}
+
+bool HttpStaticFiles::isNotModified(const HttpRequest& request, const HttpFileCache::File& file)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-13.2.2
+    // -> If-Modified-Since is ignored if If-None-Match is present
+    if (request.getMethod() != HttpRequest::GET && request.getMethod() != HttpRequest::HEAD)
+        return false;
+
+    const QByteArrayView ifNoneMatch = request.getHeaderView(HttpHeaders::IF_NONE_MATCH);
+
+    if (!ifNoneMatch.isEmpty())
+        return matchesETag(ifNoneMatch, file.etag, true);
+
+    const QByteArrayView ifModifiedSince = request.getHeaderView(HttpHeaders::IF_MODIFIED_SINCE);
+
+    if (ifModifiedSince.isEmpty())
+        return false;
+
+    const QDateTime date = HttpFileCache::fromHttpDate(ifModifiedSince);
+
+    // HTTP dates have a resolution of one second
+    return date.isValid() && file.lastModified.toSecsSinceEpoch() <= date.toSecsSinceEpoch();
+}
+
+HttpStaticFiles::RANGE_RESULT HttpStaticFiles::parseRange(const HttpRequest& request, const HttpFileCache::File& file, qint64& start, qint64& length)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-14.2
+    // Only for GET, multiple ranges are answered with the full file, which is allowed as well
+    if (request.getMethod() != HttpRequest::GET)
+        return RANGE_NONE;
+
+    const QByteArrayView range = request.getHeaderView(HttpHeaders::RANGE).trimmed();
+
+    if (!range.startsWith("bytes=") || range.contains(','))
+        return RANGE_NONE;
+
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-13.1.5
+    // -> Range only applies if the representation did not change
+    const QByteArrayView ifRange = request.getHeaderView(HttpHeaders::IF_RANGE).trimmed();
+
+    if (!ifRange.isEmpty())
+    {
+        if (ifRange.startsWith('"') || ifRange.startsWith("W/"))
+        {
+            if (!matchesETag(ifRange, file.etag, false))
+                return RANGE_NONE;
+        }
+        else
+        {
+            const QDateTime date = HttpFileCache::fromHttpDate(ifRange);
+
+            if (!date.isValid() || date.toSecsSinceEpoch() != file.lastModified.toSecsSinceEpoch())
+                return RANGE_NONE;
+        }
+    }
+
+    const QByteArrayView spec = range.sliced(6).trimmed();
+    const qsizetype idxDash = spec.indexOf('-');
+
+    if (idxDash < 0)
+        return RANGE_NONE;
+
+    const QByteArrayView strFirst = spec.first(idxDash).trimmed();
+    const QByteArrayView strLast = spec.sliced(idxDash + 1).trimmed();
+
+    const auto isNumber = [](QByteArrayView value)
+    {
+        return !value.isEmpty() && std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; });
+    };
+
+    if ((!strFirst.isEmpty() && !isNumber(strFirst)) || (!strLast.isEmpty() && !isNumber(strLast)) || (strFirst.isEmpty() && strLast.isEmpty()))
+        return RANGE_NONE;
+
+    bool ok = true;
+
+    // Suffix range: last N bytes
+    if (strFirst.isEmpty())
+    {
+        const qint64 suffix = strLast.toLongLong(&ok);
+
+        if (!ok)
+            return RANGE_NONE;
+
+        if (suffix == 0 || file.size == 0)
+            return RANGE_NOT_SATISFIABLE;
+
+        start = qMax<qint64>(0, file.size - suffix);
+        length = file.size - start;
+
+        return RANGE_SATISFIABLE;
+    }
+
+    const qint64 first = strFirst.toLongLong(&ok);
+
+    if (!ok)
+        return RANGE_NONE;
+
+    qint64 last = file.size - 1;
+
+    if (!strLast.isEmpty())
+    {
+        last = strLast.toLongLong(&ok);
+
+        // Invalid ranges are ignored, only unsatisfiable ones are an error
+        if (!ok || last < first)
+            return RANGE_NONE;
+
+        last = qMin(last, file.size - 1);
+    }
+
+    if (first >= file.size)
+        return RANGE_NOT_SATISFIABLE;
+
+    start = first;
+    length = last - first + 1;
+
+    return RANGE_SATISFIABLE;
+}
+
+bool HttpStaticFiles::matchesETag(QByteArrayView list, const QByteArray& etag, bool weak)
+{
+    // https://datatracker.ietf.org/doc/html/rfc9110#section-8.8.3.2
+    // Weak comparison ignores the W/ prefix, strong comparison never matches weak tags
+    list = list.trimmed();
+
+    if (weak && list == "*")
+        return true;
+
+    qsizetype pos = 0;
+
+    while (pos < list.size())
+    {
+        qsizetype end = list.indexOf(',', pos);
+
+        if (end < 0)
+            end = list.size();
+
+        QByteArrayView tag = list.sliced(pos, end - pos).trimmed();
+        pos = end + 1;
+
+        if (tag.startsWith("W/"))
+        {
+            if (!weak)
+                continue;
+
+            tag = tag.sliced(2);
+        }
+
+        if (tag == etag)
+            return true;
+    }
+
+    return false;
+}
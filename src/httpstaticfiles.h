@@ -0,0 +1,51 @@
+#ifndef HTTPSTATICFILES_H
+#define HTTPSTATICFILES_H
+
+#include <QString>
+#include <QStringView>
+
+#include "httpfilecache.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+// Serves the files below a directory, see HttpServer::addStaticDirectory().
+// Supports conditional requests (ETag / Last-Modified -> 304) and single byte ranges (206).
+class HttpStaticFiles
+{
+public:
+    HttpStaticFiles(const QString& directory, HttpFileCache* cache);
+
+    bool isValid() const { return !m_root.isEmpty(); }
+
+    // Served for requests to a directory
+    void setIndexFile(const QString& fileName) { m_indexFile = fileName; }
+    const QString& getIndexFile() const { return m_indexFile; }
+
+    // Path is relative to the directory, as matched by the wildcard of the route
+    HttpResponse handleRequest(const HttpRequest& request, QStringView path) const;
+
+private:
+    enum RANGE_RESULT
+    {
+        RANGE_NONE,
+        RANGE_SATISFIABLE,
+        RANGE_NOT_SATISFIABLE,
+    };
+
+    // Canonical, without trailing slash
+    QString m_root;
+    QString m_indexFile = "index.html";
+
+    HttpFileCache* m_cache = nullptr;
+
+    // Canonical path of the file, empty if it does not exist or is not below the directory
+    QString resolvePath(QStringView path) const;
+
+    static bool isNotModified(const HttpRequest& request, const HttpFileCache::File& file);
+    static RANGE_RESULT parseRange(const HttpRequest& request, const HttpFileCache::File& file, qint64& start, qint64& length);
+
+    static bool matchesETag(QByteArrayView list, const QByteArray& etag, bool weak);
+};
+
+#endif // HTTPSTATICFILES_H
@@ -0,0 +1,204 @@
+#include "httptimerwheel.h"
+
+#include <QtAlgorithms>
+
+
+void HttpTimerWheel::Timer::stop()
+{
+    if (!m_wheel)
+        return;
+
+    m_wheel->unlink(this);
+    --m_wheel->m_count;
+
+    m_wheel = nullptr;
+}
+
+HttpTimerWheel::HttpTimerWheel(qint64 now) :
+    m_tick(quint64(qMax<qint64>(0, now)) / RESOLUTION)
+{
+
+}
+
+HttpTimerWheel::~HttpTimerWheel()
+{
+    // Timers outliving the wheel must not unlink from it later
+    while (m_expired)
+        m_expired->stop();
+
+    for (int level = 0; level < LEVELS; ++level)
+    {
+        for (int slot = 0; slot < SLOTS; ++slot)
+        {
+            while (m_slots[level][slot])
+                m_slots[level][slot]->stop();
+        }
+    }
+}
+
+void HttpTimerWheel::start(Timer* timer, qint64 msec, qint64 now)
+{
+    if (timer->m_wheel)
+        timer->stop();
+
+    // Rounded up, a timer never fires early
+    const qint64 expiry = (qMax<qint64>(0, now + qMax<qint64>(0, msec)) + RESOLUTION - 1) / RESOLUTION;
+
+    timer->m_expiry = qMax(quint64(expiry), m_tick);
+    timer->m_wheel = this;
+    ++m_count;
+
+    insert(timer);
+}
+
+void HttpTimerWheel::advance(qint64 now)
+{
+    const quint64 target = quint64(qMax<qint64>(0, now)) / RESOLUTION;
+
+    if (m_count == 0)
+    {
+        m_tick = qMax(m_tick, target + 1);
+        return;
+    }
+
+    while (m_tick <= target)
+    {
+        const int slot = int(m_tick & (SLOTS - 1));
+
+        // Coarser levels move down once the finer level wraps
+        if (slot == 0)
+        {
+            for (int level = 1; level < LEVELS; ++level)
+            {
+                if (cascade(level) != 0)
+                    break;
+            }
+        }
+
+        // Moved aside, so timers started by the callbacks cannot land in the list being fired
+        m_expired = m_slots[0][slot];
+        m_slots[0][slot] = nullptr;
+        m_occupied[0] &= ~(quint64(1) << slot);
+
+        for (Timer* timer = m_expired; timer; timer = timer->m_next)
+            timer->m_level = -1;
+
+        ++m_tick;
+
+        while (m_expired)
+        {
+            Timer* const timer = m_expired;
+            timer->stop();
+
+            // May delete the owner of the timer
+            if (timer->m_callback)
+                timer->m_callback();
+        }
+
+        // Nothing left -> skip the empty ticks
+        if (m_count == 0)
+            m_tick = qMax(m_tick, target + 1);
+    }
+}
+
+qint64 HttpTimerWheel::getNextTimeout(qint64 now) const
+{
+    if (m_count == 0)
+        return -1;
+
+    quint64 best = ~quint64(0);
+
+    for (int level = 0; level < LEVELS; ++level)
+    {
+        const quint64 occupied = m_occupied[level];
+
+        if (!occupied)
+            continue;
+
+        const int shift = level * SLOT_BITS;
+        const int current = int((m_tick >> shift) & (SLOTS - 1));
+        const quint64 lower = m_tick & ((quint64(1) << shift) - 1);
+
+        // Bit 0 is the current slot of the level
+        quint64 rotated = current ? (occupied >> current) | (occupied << (SLOTS - current)) : occupied;
+
+        // The current slot of a coarser level is only due after a full cycle, unless the finer levels are at 0
+        if (level > 0 && lower != 0)
+            rotated &= ~quint64(1);
+
+        const quint64 distance = rotated ? (quint64(qCountTrailingZeroBits(rotated)) << shift) - lower
+                                         : (quint64(SLOTS) << shift) - lower;
+
+        best = qMin(best, distance);
+    }
+
+    return qMax<qint64>(0, qint64((m_tick + best) * RESOLUTION) - now);
+}
+
+void HttpTimerWheel::insert(Timer* timer)
+{
+    quint64 delta = timer->m_expiry - m_tick;
+
+    int level = 0;
+
+    while (level < LEVELS - 1 && (delta >> ((level + 1) * SLOT_BITS)) != 0)
+        ++level;
+
+    // Beyond the range of the wheel
+    if ((delta >> (LEVELS * SLOT_BITS)) != 0)
+    {
+        delta = (quint64(1) << (LEVELS * SLOT_BITS)) - 1;
+        timer->m_expiry = m_tick + delta;
+    }
+
+    const int slot = int((timer->m_expiry >> (level * SLOT_BITS)) & (SLOTS - 1));
+
+    timer->m_level = level;
+    timer->m_slot = slot;
+    timer->m_prev = nullptr;
+    timer->m_next = m_slots[level][slot];
+
+    if (timer->m_next)
+        timer->m_next->m_prev = timer;
+
+    m_slots[level][slot] = timer;
+    m_occupied[level] |= quint64(1) << slot;
+}
+
+void HttpTimerWheel::unlink(Timer* timer)
+{
+    Timer** const head = timer->m_level < 0 ? &m_expired : &m_slots[timer->m_level][timer->m_slot];
+
+    if (timer->m_prev)
+        timer->m_prev->m_next = timer->m_next;
+    else
+        *head = timer->m_next;
+
+    if (timer->m_next)
+        timer->m_next->m_prev = timer->m_prev;
+
+    if (!*head && timer->m_level >= 0)
+        m_occupied[timer->m_level] &= ~(quint64(1) << timer->m_slot);
+
+    timer->m_prev = nullptr;
+    timer->m_next = nullptr;
+}
+
+int HttpTimerWheel::cascade(int level)
+{
+    const int slot = int((m_tick >> (level * SLOT_BITS)) & (SLOTS - 1));
+
+    Timer* timer = m_slots[level][slot];
+
+    m_slots[level][slot] = nullptr;
+    m_occupied[level] &= ~(quint64(1) << slot);
+
+    while (timer)
+    {
+        Timer* const next = timer->m_next;
+        insert(timer);
+        timer = next;
+    }
+
+    return slot;
+}
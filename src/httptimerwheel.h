@@ -0,0 +1,89 @@
+#ifndef HTTPTIMERWHEEL_H
+#define HTTPTIMERWHEEL_H
+
+#include <QtGlobal>
+#include <functional>
+
+
+// Hierarchical timing wheel for the timeouts of many connections in one event loop.
+// Starting and stopping a timer is O(1), a timer is moved to a finer level at most LEVELS - 1 times.
+// Not thread-safe, all timers of a wheel are used in the thread driving it with advance().
+// http://www.cs.columbia.edu/~nahum/w6998/papers/sosp87-timing-wheels.pdf
+class HttpTimerWheel
+{
+public:
+    static constexpr qint64 RESOLUTION = 10;   // ms per tick
+
+    // Embedded in the object it belongs to, stopped when deleted
+    class Timer
+    {
+    public:
+        typedef std::function<void()> Callback;
+
+        Timer() = default;
+        explicit Timer(const Callback& callback) : m_callback(callback) {}
+        ~Timer() { stop(); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        void setCallback(const Callback& callback) { m_callback = callback; }
+
+        bool isActive() const { return m_wheel != nullptr; }
+        void stop();
+
+    private:
+        friend class HttpTimerWheel;
+
+        Callback m_callback;
+
+        HttpTimerWheel* m_wheel = nullptr;
+        Timer* m_prev = nullptr;
+        Timer* m_next = nullptr;
+
+        quint64 m_expiry = 0;   // Tick
+        int m_level = 0;
+        int m_slot = 0;
+    };
+
+    // now is the time of the event loop in ms, e.g. from a QElapsedTimer
+    explicit HttpTimerWheel(qint64 now = 0);
+    ~HttpTimerWheel();
+
+    HttpTimerWheel(const HttpTimerWheel&) = delete;
+    HttpTimerWheel& operator=(const HttpTimerWheel&) = delete;
+
+    // (Re)starts the timer to fire msec after now, rounded up to the resolution
+    void start(Timer* timer, qint64 msec, qint64 now);
+
+    // Fires all timers expired at now. Callbacks may start, stop or delete any timer.
+    void advance(qint64 now);
+
+    // ms until advance() has work to do (firing or moving timers to a finer level), -1 without timers
+    qint64 getNextTimeout(qint64 now) const;
+
+    int getTimerCount() const { return m_count; }
+
+private:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = 4;   // 64^4 ticks, ~46 hours
+
+    Timer* m_slots[LEVELS][SLOTS] = {};
+    quint64 m_occupied[LEVELS] = {};
+
+    // Due timers while their callbacks run
+    Timer* m_expired = nullptr;
+
+    // Next tick to process
+    quint64 m_tick = 0;
+    int m_count = 0;
+
+    void insert(Timer* timer);
+    void unlink(Timer* timer);
+
+    // Moves the current slot of level to the finer levels, returns its index
+    int cascade(int level);
+};
+
+#endif // HTTPTIMERWHEEL_H
@@ -0,0 +1,331 @@
+#include "httptlscontext.h"
+
+#include <QDateTime>
+#include <QSslCertificate>
+#include <QSslKey>
+
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+
+HttpTlsContext::HttpTlsContext()
+{
+
+}
+
+HttpTlsContext::~HttpTlsContext()
+{
+    SSL_CTX_free(m_context);
+}
+
+bool HttpTlsContext::setConfiguration(const QSslConfiguration& configuration)
+{
+    SSL_CTX_free(m_context);
+    m_context = nullptr;
+
+    SSL_CTX* const context = SSL_CTX_new(TLS_server_method());
+
+    if (!context)
+        return false;
+
+    const auto readPem = [](const QByteArray& pem, auto function)
+    {
+        BIO* const bio = BIO_new_mem_buf(pem.constData(), pem.size());
+        auto* const result = function(bio, nullptr, nullptr, nullptr);
+        BIO_free(bio);
+
+        return result;
+    };
+
+    X509* const certificate = readPem(configuration.localCertificate().toPem(), PEM_read_bio_X509);
+    EVP_PKEY* const privateKey = readPem(configuration.privateKey().toPem(), PEM_read_bio_PrivateKey);
+
+    bool ok = certificate && privateKey
+              && SSL_CTX_use_certificate(context, certificate) == 1
+              && SSL_CTX_use_PrivateKey(context, privateKey) == 1
+              && SSL_CTX_check_private_key(context) == 1;
+
+    X509_free(certificate);
+    EVP_PKEY_free(privateKey);
+
+    // The first certificate of the chain is the local certificate
+    const QList<QSslCertificate> chain = configuration.localCertificateChain();
+
+    for (qsizetype i = 1; ok && i < chain.size(); ++i)
+    {
+        X509* const chainCertificate = readPem(chain.at(i).toPem(), PEM_read_bio_X509);
+        ok = chainCertificate && SSL_CTX_add1_chain_cert(context, chainCertificate) == 1;
+        X509_free(chainCertificate);
+    }
+
+    if (!ok)
+    {
+        qWarning() << "Invalid TLS certificate or key:" << ERR_error_string(ERR_get_error(), nullptr);
+
+        SSL_CTX_free(context);
+        return false;
+    }
+
+    switch (configuration.protocol())
+    {
+    case QSsl::TlsV1_3:
+    case QSsl::TlsV1_3OrLater:
+        SSL_CTX_set_min_proto_version(context, TLS1_3_VERSION);
+        break;
+
+    default:
+        SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+        break;
+    }
+
+    // Response buffers may be appended to while a write is pending
+    SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    // https://docs.openssl.org/3.0/man3/SSL_CTX_set_session_cache_mode/
+    static const unsigned char sessionIdContext[] = "HttpServer";
+
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(context, m_sessionCacheSize);
+    SSL_CTX_set_timeout(context, m_sessionLifetime);
+    SSL_CTX_set_session_id_context(context, sessionIdContext, sizeof(sessionIdContext) - 1);
+
+    if (configuration.testSslOption(QSsl::SslOptionDisableSessionTickets))
+        SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
+    else
+        SSL_CTX_clear_options(context, SSL_OP_NO_TICKET);
+
+    SSL_CTX_set_app_data(context, this);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(context, ticketKeyCallback);
+
+    m_context = context;
+
+    return true;
+}
+
+void HttpTlsContext::setSessionCacheSize(int sessions)
+{
+    m_sessionCacheSize = qMax(0, sessions);
+
+    if (m_context)
+        SSL_CTX_sess_set_cache_size(m_context, m_sessionCacheSize);
+}
+
+void HttpTlsContext::setSessionLifetime(int seconds)
+{
+    m_sessionLifetime = qMax(1, seconds);
+
+    if (m_context)
+        SSL_CTX_set_timeout(m_context, m_sessionLifetime);
+}
+
+HttpTlsSession* HttpTlsContext::createSession(int socketDescriptor) const
+{
+    if (!m_context)
+        return nullptr;
+
+    SSL* const ssl = SSL_new(m_context);
+
+    if (!ssl)
+        return nullptr;
+
+    if (SSL_set_fd(ssl, socketDescriptor) != 1)
+    {
+        SSL_free(ssl);
+        return nullptr;
+    }
+
+    SSL_set_accept_state(ssl);
+
+    return new HttpTlsSession(ssl);
+}
+
+HttpTlsContext::TicketKey HttpTlsContext::getCurrentTicketKey()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker locker(&m_ticketKeyMutex);
+
+    TicketKey& current = m_ticketKeys[0];
+
+    if (current.created == 0 || now - current.created >= qint64(m_ticketKeyRotation) * 1000)
+    {
+        m_ticketKeys[1] = current;
+
+        TicketKey key;
+        key.created = now;
+
+        if (RAND_bytes(key.name, sizeof(key.name)) != 1
+            || RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1
+            || RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1)
+        {
+            qWarning() << "Cannot create session ticket key!";
+        }
+
+        current = key;
+    }
+
+    return current;
+}
+
+bool HttpTlsContext::findTicketKey(const unsigned char* name, TicketKey& key, bool& current)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker locker(&m_ticketKeyMutex);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        const TicketKey& candidate = m_ticketKeys[i];
+
+        // Keys are valid for two rotation intervals
+        if (candidate.created == 0 || now - candidate.created >= 2 * qint64(m_ticketKeyRotation) * 1000)
+            continue;
+
+        if (memcmp(candidate.name, name, sizeof(candidate.name)) == 0)
+        {
+            key = candidate;
+            current = i == 0 && now - candidate.created < qint64(m_ticketKeyRotation) * 1000;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int HttpTlsContext::ticketKeyCallback(ssl_st* ssl, unsigned char* name, unsigned char* iv, evp_cipher_ctx_st* cipher, evp_mac_ctx_st* mac, int encrypt)
+{
+    // https://docs.openssl.org/3.0/man3/SSL_CTX_set_tlsext_ticket_key_cb/
+    HttpTlsContext* const context = static_cast<HttpTlsContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+    TicketKey key;
+    bool current = true;
+
+    if (encrypt)
+    {
+        key = context->getCurrentTicketKey();
+        memcpy(name, key.name, sizeof(key.name));
+
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1
+            || EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aesKey, iv) != 1)
+            return -1;
+    }
+    else
+    {
+        // Unknown or expired key -> full handshake
+        if (!context->findTicketKey(name, key, current))
+            return 0;
+
+        if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aesKey, iv) != 1)
+            return -1;
+    }
+
+    char digest[] = "SHA256";
+
+    OSSL_PARAM params[] =
+    {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey, sizeof(key.hmacKey)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end(),
+    };
+
+    if (EVP_MAC_CTX_set_params(mac, params) != 1)
+        return -1;
+
+    // 2 -> ticket of the previous key is accepted, but a new one is issued
+    return current ? 1 : 2;
+}
+
+
+HttpTlsSession::HttpTlsSession(ssl_st* ssl) :
+    m_ssl(ssl)
+{
+
+}
+
+HttpTlsSession::~HttpTlsSession()
+{
+    SSL_free(m_ssl);
+}
+
+int HttpTlsSession::handshake()
+{
+    if (m_handshakeDone)
+        return 1;
+
+    ERR_clear_error();
+    errno = 0;
+
+    const int result = SSL_do_handshake(m_ssl);
+
+    if (result == 1)
+    {
+        m_handshakeDone = true;
+        return 1;
+    }
+
+    return int(getResult(result));
+}
+
+bool HttpTlsSession::isResumed() const
+{
+    return SSL_session_reused(m_ssl) == 1;
+}
+
+qint64 HttpTlsSession::read(char* data, qint64 size)
+{
+    ERR_clear_error();
+    errno = 0;
+
+    const int result = SSL_read(m_ssl, data, int(qMin<qint64>(size, INT_MAX)));
+
+    return result > 0 ? result : getResult(result);
+}
+
+qint64 HttpTlsSession::write(const char* data, qint64 size)
+{
+    ERR_clear_error();
+    errno = 0;
+
+    const int result = SSL_write(m_ssl, data, int(qMin<qint64>(size, INT_MAX)));
+
+    return result > 0 ? result : getResult(result);
+}
+
+void HttpTlsSession::shutdown()
+{
+    if (m_handshakeDone)
+        SSL_shutdown(m_ssl);
+}
+
+qint64 HttpTlsSession::getResult(int result)
+{
+    switch (SSL_get_error(m_ssl, result))
+    {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0)
+            errno = ECONNRESET;
+
+        return -1;
+
+    default:
+        errno = EPROTO;
+        return -1;
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef HTTPTLSCONTEXT_H
+#define HTTPTLSCONTEXT_H
+
+#include <QMutex>
+#include <QSslConfiguration>
+
+
+struct ssl_st;
+struct ssl_ctx_st;
+struct evp_cipher_ctx_st;
+struct evp_mac_ctx_st;
+
+class HttpTlsSession;
+
+
+// OpenSSL server context of the epoll backend, shared by all connections and loops.
+// Sessions are resumed by session ID (server-side cache) and by session tickets,
+// whose keys rotate: tickets of the previous key are still accepted and replaced.
+// Only built with HTTPSERVER_HAVE_OPENSSL (OpenSSL 3).
+class HttpTlsContext
+{
+public:
+    HttpTlsContext();
+    ~HttpTlsContext();
+
+    // Certificate, chain, private key and minimum protocol are taken from the configuration
+    bool setConfiguration(const QSslConfiguration& configuration);
+    bool isValid() const { return m_context != nullptr; }
+
+    void setSessionCacheSize(int sessions);
+    int getSessionCacheSize() const { return m_sessionCacheSize; }
+
+    // Lifetime of cached sessions and tickets in seconds
+    void setSessionLifetime(int seconds);
+    int getSessionLifetime() const { return m_sessionLifetime; }
+
+    void setTicketKeyRotation(int seconds) { m_ticketKeyRotation = qMax(1, seconds); }
+    int getTicketKeyRotation() const { return m_ticketKeyRotation; }
+
+    // Server side of a TLS connection on the socket, has to be deleted before the context
+    HttpTlsSession* createSession(int socketDescriptor) const;
+
+private:
+    struct TicketKey
+    {
+        unsigned char name[16] = {};
+        unsigned char aesKey[32] = {};
+        unsigned char hmacKey[32] = {};
+        qint64 created = 0;
+    };
+
+    ssl_ctx_st* m_context = nullptr;
+
+    int m_sessionCacheSize = 20480;
+    int m_sessionLifetime = 3600;
+    int m_ticketKeyRotation = 3600;
+
+    // Current and previous key
+    TicketKey m_ticketKeys[2];
+    QMutex m_ticketKeyMutex;
+
+    TicketKey getCurrentTicketKey();
+    bool findTicketKey(const unsigned char* name, TicketKey& key, bool& current);
+
+    static int ticketKeyCallback(ssl_st* ssl, unsigned char* name, unsigned char* iv, evp_cipher_ctx_st* cipher, evp_mac_ctx_st* mac, int encrypt);
+};
+
+
+// Non-blocking TLS on a socket. Same conventions as read() / write():
+// -1 with errno EAGAIN if the call has to be repeated once the socket is ready, 0 if the peer closed the connection.
+class HttpTlsSession
+{
+public:
+    explicit HttpTlsSession(ssl_st* ssl);
+    ~HttpTlsSession();
+
+    // Returns 1 once the handshake is done
+    int handshake();
+    bool isHandshakeDone() const { return m_handshakeDone; }
+
+    // Abbreviated handshake with a cached session or ticket
+    bool isResumed() const;
+
+    qint64 read(char* data, qint64 size);
+    qint64 write(const char* data, qint64 size);
+
+    // Sends close_notify, without waiting for the answer
+    void shutdown();
+
+private:
+    ssl_st* m_ssl = nullptr;
+    bool m_handshakeDone = false;
+
+    qint64 getResult(int result);
+};
+
+#endif // HTTPTLSCONTEXT_H
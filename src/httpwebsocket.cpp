@@ -0,0 +1,878 @@
+#include "httpwebsocket.h"
+
+#include <QCryptographicHash>
+#include <QSslSocket>
+#include <QtEndian>
+
+#include <cstring>
+#include <zlib.h>
+
+#include "httpserver.h"
+
+
+HttpResponse HttpWebSocket::upgrade(const HttpRequest& request, const std::shared_ptr<const HttpWebSocketHandler>& handler)
+{
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-4.2.1
+    const QByteArrayView key = request.getHeaderView(HttpHeaders::SEC_WEBSOCKET_KEY).trimmed();
+
+    if (!handler || request.getMethod() != HttpRequest::GET || request.getProtocolView() != "HTTP/1.1"
+        || !HttpHeaders::hasToken(request.getHeaderView(HttpHeaders::UPGRADE), "websocket")
+        || !HttpHeaders::hasToken(request.getHeaderView(HttpHeaders::CONNECTION), "upgrade")
+        || QByteArray::fromBase64(key.toByteArray()).size() != 16)
+        return HttpResponse(HttpResponse::BAD_REQUEST);
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-4.4
+    if (request.getHeaderView(HttpHeaders::SEC_WEBSOCKET_VERSION).trimmed() != "13")
+    {
+        HttpResponse response(HttpResponse::UPGRADE_REQUIRED);
+        response.setRawHeader(HttpHeaders::SEC_WEBSOCKET_VERSION, QByteArrayLiteral("13"));
+
+        return response;
+    }
+
+    const QByteArray accept = QCryptographicHash::hash(key.toByteArray() + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", QCryptographicHash::Sha1).toBase64();
+
+    HttpResponse response(HttpResponse::SWITCHING_PROTOCOLS);
+    response.setRawHeader(HttpHeaders::UPGRADE, QByteArrayLiteral("websocket"));
+    response.setRawHeader(HttpHeaders::CONNECTION, QByteArrayLiteral("Upgrade"));
+    response.setRawHeader(HttpHeaders::SEC_WEBSOCKET_ACCEPT, accept);
+
+    const QByteArrayView protocols = request.getHeaderView(HttpHeaders::SEC_WEBSOCKET_PROTOCOL);
+
+    for (const QByteArray& protocol : handler->protocols)
+    {
+        if (HttpHeaders::hasToken(protocols, protocol))
+        {
+            response.setRawHeader(HttpHeaders::SEC_WEBSOCKET_PROTOCOL, protocol);
+            break;
+        }
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc7692#section-7.1.1
+    // -> Neither side keeps its window between messages, so a session needs no zlib stream of its own
+    //    and a broadcast is compressed once for all sessions
+    if (handler->compression && acceptDeflate(request.getHeaderView(HttpHeaders::SEC_WEBSOCKET_EXTENSIONS)))
+        response.setRawHeader(HttpHeaders::SEC_WEBSOCKET_EXTENSIONS, QByteArrayLiteral("permessage-deflate; server_no_context_takeover; client_no_context_takeover"));
+
+    response.setWebSocketHandler(handler);
+
+    return response;
+}
+
+HttpWebSocket::Frame HttpWebSocket::encodeMessage(QByteArrayView message, bool binary, bool compress)
+{
+    const OPCODE opcode = binary ? BINARY : TEXT;
+
+    Frame frame;
+    frame.plain = encodeFrame(opcode, message);
+
+    QByteArray compressed;
+
+    if (compress && message.size() >= MIN_COMPRESS_SIZE && deflateMessage(message, compressed) && compressed.size() < message.size())
+        frame.compressed = encodeFrame(opcode, compressed, true);
+
+    return frame;
+}
+
+QByteArray HttpWebSocket::encodeFrame(OPCODE opcode, QByteArrayView payload, bool compressed)
+{
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-5.2
+    // -> Server frames are not masked, header and payload go into one allocation
+    const qsizetype size = payload.size();
+    const qsizetype headerSize = size < 126 ? 2 : (size <= 0xffff ? 4 : 10);
+
+    QByteArray frame(headerSize + size, Qt::Uninitialized);
+    uchar* out = reinterpret_cast<uchar*>(frame.data());
+
+    out[0] = uchar(0x80 | (compressed ? 0x40 : 0) | opcode);
+
+    if (size < 126)
+        out[1] = uchar(size);
+    else if (size <= 0xffff)
+    {
+        out[1] = 126;
+        qToBigEndian<quint16>(quint16(size), out + 2);
+    }
+    else
+    {
+        out[1] = 127;
+        qToBigEndian<quint64>(quint64(size), out + 2);
+    }
+
+    if (size > 0)
+        memcpy(out + headerSize, payload.data(), size);
+
+    return frame;
+}
+
+HttpWebSocket::HttpWebSocket(QSslSocket* socket, HttpServer* server, QObject* context, const HttpResponse& response) :
+    m_socket(socket),
+    m_server(server),
+    m_context(context),
+    m_handler(response.getWebSocketHandler()),
+    m_protocol(response.getHeader(HttpHeaders::SEC_WEBSOCKET_PROTOCOL)),
+    m_compression(response.hasHeader(HttpHeaders::SEC_WEBSOCKET_EXTENSIONS))
+{
+    m_server->m_webSocketCount.fetchAndAddRelaxed(1);
+
+    updateMemoryUsage();
+}
+
+HttpWebSocket::~HttpWebSocket()
+{
+    notifyClose(ABNORMAL_CLOSURE, QByteArray());
+
+    m_server->m_webSocketCount.fetchAndSubRelaxed(1);
+    m_server->m_webSocketMemory.fetchAndSubRelaxed(m_reportedMemory);
+}
+
+void HttpWebSocket::sendMessage(QByteArrayView message, bool binary)
+{
+    if (m_closeSent)
+        return;
+
+    const OPCODE opcode = binary ? BINARY : TEXT;
+    QByteArray compressed;
+
+    if (m_compression && message.size() >= MIN_COMPRESS_SIZE && deflateMessage(message, compressed) && compressed.size() < message.size())
+        write(encodeFrame(opcode, compressed, true));
+    else
+        write(encodeFrame(opcode, message));
+}
+
+void HttpWebSocket::sendFrame(const Frame& frame)
+{
+    if (m_closeSent)
+        return;
+
+    write(m_compression && !frame.compressed.isEmpty() ? frame.compressed : frame.plain);
+}
+
+void HttpWebSocket::ping(QByteArrayView payload)
+{
+    if (m_closeSent)
+        return;
+
+    write(encodeFrame(PING, payload.first(qMin(payload.size(), MAX_CONTROL_SIZE))));
+}
+
+void HttpWebSocket::close(int code, QByteArrayView reason)
+{
+    if (m_closeSent)
+        return;
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-5.5.1
+    QByteArray payload(2, Qt::Uninitialized);
+    qToBigEndian<quint16>(quint16(code), payload.data());
+    payload.append(reason.first(qMin(reason.size(), MAX_CONTROL_SIZE - 2)));
+
+    write(encodeFrame(CLOSE, payload));
+    m_closeSent = true;
+}
+
+bool HttpWebSocket::isOpen() const
+{
+    return !m_closeSent && !m_closeReceived && !m_closeNotified && m_socket->state() == QAbstractSocket::ConnectedState;
+}
+
+qint64 HttpWebSocket::getMemoryUsage() const
+{
+    return qint64(sizeof(HttpWebSocket)) + m_input.capacity() + m_message.capacity() + m_control.capacity()
+           + m_groups.capacity() * qint64(sizeof(std::shared_ptr<HttpWebSocketGroupState>));
+}
+
+void HttpWebSocket::start(const HttpRequest& request, QByteArrayView buffered)
+{
+    if (m_handler->onOpen)
+        m_handler->onOpen(this, request);
+
+    // Sent right behind the handshake and read along with it
+    if (!buffered.isEmpty())
+        receive(buffered.data(), buffered.size());
+
+    updateMemoryUsage();
+}
+
+void HttpWebSocket::readFrames()
+{
+    // Payloads are unmasked from here into the message, only a split frame header is kept by the session
+    thread_local QByteArray buffer(READ_BUFFER_SIZE, Qt::Uninitialized);
+
+    while (!m_closeReceived && !m_closeNotified)
+    {
+        const qint64 size = m_socket->read(buffer.data(), buffer.size());
+
+        if (size <= 0)
+            break;
+
+        m_server->m_metrics.addBytesReceived(size);
+        m_pingSent = false;
+
+        receive(buffer.constData(), size);
+    }
+
+    updateMemoryUsage();
+}
+
+bool HttpWebSocket::checkAlive()
+{
+    if (!isOpen() || m_pingSent)
+        return false;
+
+    ping();
+    m_pingSent = true;
+
+    return true;
+}
+
+void HttpWebSocket::receive(const char* data, qsizetype size)
+{
+    qsizetype pos = 0;
+
+    while (pos < size && !m_closeReceived && !m_closeNotified)
+    {
+        if (!m_inFrame)
+        {
+            qsizetype headerSize = 0;
+
+            if (m_input.isEmpty())
+            {
+                headerSize = parseHeader(reinterpret_cast<const uchar*>(data + pos), size - pos);
+
+                if (headerSize < 0)
+                    return;
+
+                if (headerSize == 0)
+                {
+                    m_input.append(data + pos, size - pos);
+                    return;
+                }
+
+                pos += headerSize;
+            }
+            else
+            {
+                // The header is complete within MAX_HEADER_SIZE bytes
+                const qsizetype buffered = m_input.size();
+                m_input.append(data + pos, qMin(MAX_HEADER_SIZE - buffered, size - pos));
+
+                headerSize = parseHeader(reinterpret_cast<const uchar*>(m_input.constData()), m_input.size());
+
+                if (headerSize <= 0)
+                    return;
+
+                pos += headerSize - buffered;
+                m_input = QByteArray();
+            }
+
+            if (m_frameRemaining == 0)
+            {
+                finishFrame();
+                continue;
+            }
+        }
+
+        // https://datatracker.ietf.org/doc/html/rfc6455#section-5.3
+        // -> Unmasked 8 bytes at a time, with the mask rotated to the position in the frame
+        const qsizetype count = qsizetype(qMin(m_frameRemaining, quint64(size - pos)));
+
+        QByteArray& target = (m_frameOpcode & 0x8) ? m_control : m_message;
+        const qsizetype offset = target.size();
+        target.resize(offset + count);
+
+        const uchar* in = reinterpret_cast<const uchar*>(data + pos);
+        uchar* out = reinterpret_cast<uchar*>(target.data() + offset);
+
+        uchar mask[8];
+
+        for (int i = 0; i < 8; ++i)
+            mask[i] = m_mask[(m_maskOffset + i) & 3];
+
+        quint64 mask64;
+        memcpy(&mask64, mask, 8);
+
+        qsizetype i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            quint64 word;
+            memcpy(&word, in + i, 8);
+            word ^= mask64;
+            memcpy(out + i, &word, 8);
+        }
+
+        for (; i < count; ++i)
+            out[i] = in[i] ^ mask[i & 7];
+
+        m_maskOffset = int((m_maskOffset + count) & 3);
+        m_frameRemaining -= count;
+        pos += count;
+
+        if (m_frameRemaining == 0)
+            finishFrame();
+    }
+}
+
+qsizetype HttpWebSocket::parseHeader(const uchar* data, qsizetype size)
+{
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-5.2
+    // 0 while incomplete, -1 if the connection failed
+    if (size < 2)
+        return 0;
+
+    const bool final = data[0] & 0x80;
+    const bool compressed = data[0] & 0x40;
+    const quint8 opcode = data[0] & 0x0f;
+    const bool masked = data[1] & 0x80;
+
+    quint64 length = data[1] & 0x7f;
+    qsizetype headerSize = 2;
+
+    if (length == 126)
+    {
+        if (size < 4)
+            return 0;
+
+        length = qFromBigEndian<quint16>(data + 2);
+        headerSize = 4;
+    }
+    else if (length == 127)
+    {
+        if (size < 10)
+            return 0;
+
+        length = qFromBigEndian<quint64>(data + 2);
+        headerSize = 10;
+    }
+
+    if (size < headerSize + 4)
+        return 0;
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-5.1
+    // -> Clients have to mask every frame
+    if (!masked)
+    {
+        fail(PROTOCOL_ERROR, "Unmasked frame");
+        return -1;
+    }
+
+    // RSV1 marks a compressed message (first frame only), RSV2 and RSV3 are not negotiated
+    if (data[0] & 0x30)
+    {
+        fail(PROTOCOL_ERROR, "Reserved bits set");
+        return -1;
+    }
+
+    if (opcode & 0x8)
+    {
+        // https://datatracker.ietf.org/doc/html/rfc6455#section-5.5
+        if (opcode > PONG || !final || compressed || length > quint64(MAX_CONTROL_SIZE))
+        {
+            fail(PROTOCOL_ERROR, "Invalid control frame");
+            return -1;
+        }
+    }
+    else
+    {
+        // https://datatracker.ietf.org/doc/html/rfc6455#section-5.4
+        if (opcode > BINARY || (opcode == CONTINUATION) != m_messageStarted)
+        {
+            fail(PROTOCOL_ERROR, "Unexpected data frame");
+            return -1;
+        }
+
+        if (compressed && (opcode == CONTINUATION || !m_compression))
+        {
+            fail(PROTOCOL_ERROR, "Unexpected compressed frame");
+            return -1;
+        }
+
+        if (length > quint64(m_handler->maxMessageSize) - quint64(m_message.size()))
+        {
+            fail(MESSAGE_TOO_BIG, "Message too large");
+            return -1;
+        }
+
+        if (opcode != CONTINUATION)
+        {
+            m_messageStarted = true;
+            m_messageBinary = opcode == BINARY;
+            m_messageCompressed = compressed;
+        }
+
+        // Grown along with the frame for larger ones
+        m_message.reserve(m_message.size() + qsizetype(qMin(length, quint64(READ_BUFFER_SIZE))));
+    }
+
+    memcpy(m_mask, data + headerSize, 4);
+
+    m_inFrame = true;
+    m_frameOpcode = opcode;
+    m_frameFinal = final;
+    m_frameRemaining = length;
+    m_maskOffset = 0;
+
+    return headerSize + 4;
+}
+
+void HttpWebSocket::finishFrame()
+{
+    m_inFrame = false;
+
+    switch (m_frameOpcode)
+    {
+    case PING:
+        // https://datatracker.ietf.org/doc/html/rfc6455#section-5.5.2
+        if (!m_closeSent)
+            write(encodeFrame(PONG, m_control));
+        break;
+
+    case PONG:
+        break;
+
+    case CLOSE:
+        handleClose();
+        break;
+
+    default:
+        if (m_frameFinal)
+            finishMessage();
+
+        return;
+    }
+
+    m_control.clear();
+}
+
+void HttpWebSocket::finishMessage()
+{
+    // Handed over, so an idle session keeps no buffer
+    QByteArray message;
+    message.swap(m_message);
+
+    m_messageStarted = false;
+
+    // https://datatracker.ietf.org/doc/html/rfc7692#section-7.2.2
+    if (m_messageCompressed)
+    {
+        QByteArray inflated;
+
+        if (!inflateMessage(message, m_handler->maxMessageSize, inflated))
+        {
+            if (inflated.size() > m_handler->maxMessageSize)
+                fail(MESSAGE_TOO_BIG, "Message too large");
+            else
+                fail(INVALID_PAYLOAD, "Cannot decompress message");
+
+            return;
+        }
+
+        message.swap(inflated);
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-8.1
+    if (!m_messageBinary && !QByteArrayView(message).isValidUtf8())
+    {
+        fail(INVALID_PAYLOAD, "Invalid UTF-8");
+        return;
+    }
+
+    if (m_handler->onMessage)
+        m_handler->onMessage(this, message, m_messageBinary);
+}
+
+void HttpWebSocket::handleClose()
+{
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-5.5.1
+    int code = NO_STATUS_RECEIVED;
+    QByteArray reason;
+
+    if (m_control.size() == 1)
+    {
+        fail(PROTOCOL_ERROR, "Invalid close frame");
+        return;
+    }
+
+    if (m_control.size() >= 2)
+    {
+        code = qFromBigEndian<quint16>(m_control.constData());
+        reason = m_control.sliced(2);
+
+        // https://datatracker.ietf.org/doc/html/rfc6455#section-7.4.1
+        const bool valid = (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) || (code >= 3000 && code <= 4999);
+
+        if (!valid || !QByteArrayView(reason).isValidUtf8())
+        {
+            fail(PROTOCOL_ERROR, "Invalid close frame");
+            return;
+        }
+    }
+
+    m_closeReceived = true;
+
+    // Echoed, unless this answers our own close
+    if (!m_closeSent)
+    {
+        QByteArray payload;
+
+        if (code != NO_STATUS_RECEIVED)
+        {
+            payload.resize(2);
+            qToBigEndian<quint16>(quint16(code), payload.data());
+        }
+
+        write(encodeFrame(CLOSE, payload));
+        m_closeSent = true;
+    }
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-7.1.1
+    // -> The server closes the TCP connection first
+    m_socket->close();
+
+    notifyClose(code, reason);
+}
+
+void HttpWebSocket::write(const QByteArray& data)
+{
+    if (m_socket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    if (m_socket->bytesToWrite() > MAX_WRITE_BUFFER)
+    {
+        qCDebug(lcHttpServer) << "WebSocket receiver too slow, closing";
+
+        m_socket->abort();
+        notifyClose(ABNORMAL_CLOSURE, QByteArray());
+        return;
+    }
+
+    m_socket->write(data);
+
+    m_server->m_metrics.addBytesSent(data.size());
+}
+
+void HttpWebSocket::fail(int code, const char* reason)
+{
+    qCDebug(lcHttpServer) << "WebSocket error:" << reason;
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-7.1.7
+    if (!m_closeSent)
+    {
+        QByteArray payload(2, Qt::Uninitialized);
+        qToBigEndian<quint16>(quint16(code), payload.data());
+
+        write(encodeFrame(CLOSE, payload));
+        m_closeSent = true;
+    }
+
+    m_socket->close();
+
+    notifyClose(code, QByteArray());
+}
+
+void HttpWebSocket::notifyClose(int code, const QByteArray& reason)
+{
+    if (m_closeNotified)
+        return;
+
+    m_closeNotified = true;
+
+    // Broadcasts stop here
+    for (const auto& state : std::as_const(m_groups))
+        HttpWebSocketGroup::remove(state.get(), this);
+
+    m_groups.clear();
+
+    if (m_handler->onClose)
+        m_handler->onClose(this, code, reason);
+}
+
+void HttpWebSocket::updateMemoryUsage()
+{
+    const qint64 usage = getMemoryUsage();
+
+    m_server->m_webSocketMemory.fetchAndAddRelaxed(usage - m_reportedMemory);
+    m_reportedMemory = usage;
+}
+
+bool HttpWebSocket::acceptDeflate(QByteArrayView offers)
+{
+    // https://datatracker.ietf.org/doc/html/rfc7692#section-7.1
+    // Offers are separated by ",", parameters by ";". An offer is accepted if all its parameters can be met:
+    // the client's window size does not matter for inflating, our own window cannot be reduced.
+    qsizetype start = 0;
+
+    while (start < offers.size())
+    {
+        qsizetype end = offers.indexOf(',', start);
+
+        if (end < 0)
+            end = offers.size();
+
+        const QByteArrayView offer = offers.sliced(start, end - start);
+        start = end + 1;
+
+        bool first = true;
+        bool valid = true;
+        qsizetype pos = 0;
+
+        while (valid && pos <= offer.size())
+        {
+            qsizetype next = offer.indexOf(';', pos);
+
+            if (next < 0)
+                next = offer.size();
+
+            const QByteArrayView parameter = offer.sliced(pos, next - pos).trimmed();
+            pos = next + 1;
+
+            if (first)
+            {
+                valid = parameter.compare("permessage-deflate", Qt::CaseInsensitive) == 0;
+                first = false;
+                continue;
+            }
+
+            const qsizetype idx = parameter.indexOf('=');
+            const QByteArrayView name = idx < 0 ? parameter : parameter.first(idx).trimmed();
+            QByteArrayView value = idx < 0 ? QByteArrayView() : parameter.sliced(idx + 1).trimmed();
+
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                value = value.sliced(1, value.size() - 2);
+
+            if (name == "server_no_context_takeover" || name == "client_no_context_takeover")
+                valid = idx < 0;
+            else if (name == "client_max_window_bits")
+                valid = idx < 0 || (value.toInt() >= 8 && value.toInt() <= 15);
+            else if (name == "server_max_window_bits")
+                valid = value == "15";
+            else
+                valid = false;
+        }
+
+        if (valid)
+            return true;
+    }
+
+    return false;
+}
+
+bool HttpWebSocket::deflateMessage(QByteArrayView message, QByteArray& result)
+{
+    // https://datatracker.ietf.org/doc/html/rfc7692#section-7.2.1
+    // -> Raw deflate, flushed, without the trailing 00 00 ff ff. Without context takeover one stream per thread is enough.
+    struct Deflater
+    {
+        z_stream stream = {};
+        bool valid = false;
+
+        Deflater() { valid = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK; }
+        ~Deflater() { if (valid) deflateEnd(&stream); }
+    };
+
+    thread_local Deflater deflater;
+    z_stream& stream = deflater.stream;
+
+    if (!deflater.valid || deflateReset(&stream) != Z_OK)
+        return false;
+
+    // The sync flush adds an empty block to the bound
+    result.resize(qsizetype(deflateBound(&stream, uLong(message.size()))) + 16);
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+    stream.avail_in = uInt(message.size());
+    stream.next_out = reinterpret_cast<Bytef*>(result.data());
+    stream.avail_out = uInt(result.size());
+
+    if (deflate(&stream, Z_SYNC_FLUSH) != Z_OK || stream.avail_in != 0 || stream.avail_out == 0)
+        return false;
+
+    const qsizetype size = result.size() - stream.avail_out;
+
+    if (size < 4)
+        return false;
+
+    result.truncate(size - 4);
+
+    return true;
+}
+
+bool HttpWebSocket::inflateMessage(QByteArrayView data, qint64 maxSize, QByteArray& result)
+{
+    // https://datatracker.ietf.org/doc/html/rfc7692#section-7.2.2
+    // -> The removed 00 00 ff ff is appended again. Stops once more than maxSize would be produced.
+    struct Inflater
+    {
+        z_stream stream = {};
+        bool valid = false;
+
+        Inflater() { valid = inflateInit2(&stream, -15) == Z_OK; }
+        ~Inflater() { if (valid) inflateEnd(&stream); }
+    };
+
+    static const char TAIL[4] = { 0x00, 0x00, char(0xff), char(0xff) };
+
+    thread_local Inflater inflater;
+    z_stream& stream = inflater.stream;
+
+    if (!inflater.valid || inflateReset(&stream) != Z_OK)
+        return false;
+
+    qsizetype produced = 0;
+    bool ended = false;
+
+    for (const QByteArrayView input : { data, QByteArrayView(TAIL, 4) })
+    {
+        if (ended)
+            break;
+
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream.avail_in = uInt(input.size());
+
+        forever
+        {
+            if (produced == result.size())
+            {
+                if (produced > maxSize)
+                    return false;
+
+                result.resize(qsizetype(qMin<qint64>(qMax<qint64>(2 * result.size(), 4096), maxSize + 1)));
+            }
+
+            stream.next_out = reinterpret_cast<Bytef*>(result.data() + produced);
+            stream.avail_out = uInt(result.size() - produced);
+
+            const int status = inflate(&stream, Z_SYNC_FLUSH);
+            produced = result.size() - stream.avail_out;
+
+            // A final block ends the message early
+            if (status == Z_STREAM_END)
+            {
+                ended = true;
+                break;
+            }
+
+            // All input consumed and nothing left to write
+            if (status == Z_BUF_ERROR && stream.avail_in == 0)
+                break;
+
+            if (status != Z_OK)
+                return false;
+
+            if (stream.avail_in == 0 && stream.avail_out > 0)
+                break;
+        }
+    }
+
+    if (produced > maxSize)
+        return false;
+
+    result.truncate(produced);
+
+    return true;
+}
+
+
+HttpWebSocketGroup::HttpWebSocketGroup() :
+    m_state(std::make_shared<HttpWebSocketGroupState>())
+{
+
+}
+
+void HttpWebSocketGroup::join(HttpWebSocket* socket)
+{
+    if (socket->m_closeNotified)
+        return;
+
+    {
+        QMutexLocker locker(&m_state->mutex);
+        QList<HttpWebSocket*>& members = m_state->members[socket->m_context];
+
+        if (members.contains(socket))
+            return;
+
+        members.append(socket);
+
+        ++m_state->size;
+
+        if (socket->m_compression)
+            ++m_state->compressedSize;
+    }
+
+    socket->m_groups.append(m_state);
+}
+
+void HttpWebSocketGroup::leave(HttpWebSocket* socket)
+{
+    remove(m_state.get(), socket);
+
+    socket->m_groups.removeOne(m_state);
+}
+
+int HttpWebSocketGroup::getSize() const
+{
+    QMutexLocker locker(&m_state->mutex);
+
+    return m_state->size;
+}
+
+void HttpWebSocketGroup::broadcast(QByteArrayView message, bool binary, const HttpWebSocket* except)
+{
+    bool compress = false;
+
+    {
+        QMutexLocker locker(&m_state->mutex);
+
+        if (m_state->size == 0)
+            return;
+
+        compress = m_state->compressedSize > 0;
+    }
+
+    // Once for all receivers, each socket only references the buffers
+    const HttpWebSocket::Frame frame = HttpWebSocket::encodeMessage(message, binary, compress);
+
+    QMutexLocker locker(&m_state->mutex);
+
+    // One event per thread. Posted while locked: a context with members is alive,
+    // its sessions have to take the lock to leave before it can be deleted.
+    for (auto it = m_state->members.cbegin(); it != m_state->members.cend(); ++it)
+    {
+        QObject* const context = it.key();
+
+        QMetaObject::invokeMethod(context, [state = m_state, context, frame, except]()
+                                  {
+                                      QList<HttpWebSocket*> members;
+
+                                      {
+                                          QMutexLocker locker(&state->mutex);
+                                          members = state->members.value(context);
+                                      }
+
+                                      // Sessions are only deleted by the event loop of this thread
+                                      for (HttpWebSocket* const socket : std::as_const(members))
+                                      {
+                                          if (socket != except)
+                                              socket->sendFrame(frame);
+                                      }
+                                  }, Qt::QueuedConnection);
+    }
+}
+
+void HttpWebSocketGroup::remove(HttpWebSocketGroupState* state, HttpWebSocket* socket)
+{
+    QMutexLocker locker(&state->mutex);
+
+    const auto it = state->members.find(socket->m_context);
+
+    if (it == state->members.end() || !it->removeOne(socket))
+        return;
+
+    if (it->isEmpty())
+        state->members.erase(it);
+
+    --state->size;
+
+    if (socket->m_compression)
+        --state->compressedSize;
+}
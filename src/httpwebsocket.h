@@ -0,0 +1,239 @@
+#ifndef HTTPWEBSOCKET_H
+#define HTTPWEBSOCKET_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <functional>
+#include <memory>
+
+#include "httprequest.h"
+#include "httpresponse.h"
+
+
+class QSslSocket;
+class HttpServer;
+class HttpWebSocket;
+struct HttpWebSocketGroupState;
+
+
+// Callbacks of a WebSocket route, called in the thread of the connection.
+// Shared by all sessions of the route, see HttpServer::setWebSocketCallback().
+struct HttpWebSocketHandler
+{
+    // After the handshake, the request is only valid during the call
+    std::function<void(HttpWebSocket*, const HttpRequest&)> onOpen;
+
+    // Complete message: fragments are joined, permessage-deflate is undone and text is valid UTF-8
+    std::function<void(HttpWebSocket*, const QByteArray&, bool binary)> onMessage;
+
+    // Once, after the close handshake or when the connection is lost (ABNORMAL_CLOSURE).
+    // The session is deleted afterwards.
+    std::function<void(HttpWebSocket*, int code, const QByteArray& reason)> onClose;
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-1.9
+    // Subprotocols in order of preference, the first one offered by the client is selected
+    QList<QByteArray> protocols;
+
+    // Larger messages close the connection with MESSAGE_TOO_BIG, after decompression
+    qint64 maxMessageSize = 16 * 1024 * 1024;
+
+    // https://datatracker.ietf.org/doc/html/rfc7692
+    bool compression = true;
+
+    // ms without any frame from the client until a ping is sent, closed if the next interval passes as well. 0 = never.
+    int pingInterval = 30000;
+};
+
+
+// https://datatracker.ietf.org/doc/html/rfc6455
+// Server side of a WebSocket connection. A route accepts the handshake by returning upgrade(),
+// the connection then hands its socket over to a session. Frames are unmasked straight from a
+// read buffer shared by the thread, and permessage-deflate runs without context takeover in both
+// directions with zlib streams shared by the thread, so an idle session holds no buffers.
+// Not thread-safe: send from the callbacks, or from other threads through HttpWebSocketGroup.
+class HttpWebSocket
+{
+public:
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-5.2
+    enum OPCODE
+    {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xa,
+    };
+
+    // https://datatracker.ietf.org/doc/html/rfc6455#section-7.4.1
+    enum CLOSE_CODE
+    {
+        NORMAL_CLOSURE = 1000,
+        GOING_AWAY = 1001,
+        PROTOCOL_ERROR = 1002,
+        UNSUPPORTED_DATA = 1003,
+        NO_STATUS_RECEIVED = 1005,
+        ABNORMAL_CLOSURE = 1006,
+        INVALID_PAYLOAD = 1007,
+        POLICY_VIOLATION = 1008,
+        MESSAGE_TOO_BIG = 1009,
+        INTERNAL_ERROR = 1011,
+    };
+
+    // 101 Switching Protocols, or 400 / 426 if the request is not a valid handshake.
+    // May be returned by any GET route, e.g. after checking the origin or a session cookie.
+    static HttpResponse upgrade(const HttpRequest& request, const std::shared_ptr<const HttpWebSocketHandler>& handler);
+
+    // Message encoded once and shared by all receivers. The compressed frame is empty unless it saves space.
+    struct Frame
+    {
+        QByteArray plain;
+        QByteArray compressed;
+    };
+
+    static Frame encodeMessage(QByteArrayView message, bool binary, bool compress);
+    static QByteArray encodeFrame(OPCODE opcode, QByteArrayView payload, bool compressed = false);
+
+    HttpWebSocket(QSslSocket* socket, HttpServer* server, QObject* context, const HttpResponse& response);
+    ~HttpWebSocket();
+
+    void sendText(const QString& message) { sendMessage(message.toUtf8(), false); }
+    void sendBinary(QByteArrayView message) { sendMessage(message, true); }
+    void sendMessage(QByteArrayView message, bool binary);
+    void sendFrame(const Frame& frame);
+
+    void ping(QByteArrayView payload = QByteArrayView());
+
+    // Starts the close handshake, the socket is closed once the client answers
+    void close(int code = NORMAL_CLOSURE, QByteArrayView reason = QByteArrayView());
+
+    // Neither side has started the close handshake
+    bool isOpen() const;
+
+    const QByteArray& getProtocol() const { return m_protocol; }
+    bool isCompressed() const { return m_compression; }
+
+    // Bytes held by the session (object, partial frames and messages, group memberships), without the socket
+    qint64 getMemoryUsage() const;
+
+private:
+    friend class HttpConnection;
+    friend class HttpWebSocketGroup;
+
+    static constexpr qsizetype READ_BUFFER_SIZE = 64 * 1024;
+    static constexpr qsizetype MAX_HEADER_SIZE = 14;
+    static constexpr qsizetype MAX_CONTROL_SIZE = 125;
+
+    // Smaller messages are not compressed
+    static constexpr qsizetype MIN_COMPRESS_SIZE = 128;
+
+    // Receivers that do not keep up with broadcasts are dropped instead of buffering without limit
+    static constexpr qint64 MAX_WRITE_BUFFER = 4 * 1024 * 1024;
+
+    QSslSocket* m_socket = nullptr;
+    HttpServer* m_server = nullptr;
+
+    // Lives in the thread of the session, broadcasts are posted to it
+    QObject* m_context = nullptr;
+
+    std::shared_ptr<const HttpWebSocketHandler> m_handler;
+    QByteArray m_protocol;
+    bool m_compression = false;
+
+    // Frame header split over two reads
+    QByteArray m_input;
+
+    // Frame being read
+    bool m_inFrame = false;
+    quint8 m_frameOpcode = 0;
+    bool m_frameFinal = false;
+    quint64 m_frameRemaining = 0;
+    uchar m_mask[4] = {};
+    int m_maskOffset = 0;
+
+    // Fragmented data message, control frames may arrive in between
+    bool m_messageStarted = false;
+    bool m_messageBinary = false;
+    bool m_messageCompressed = false;
+    QByteArray m_message;
+    QByteArray m_control;
+
+    bool m_closeSent = false;
+    bool m_closeReceived = false;
+    bool m_closeNotified = false;
+    bool m_pingSent = false;
+
+    QList<std::shared_ptr<HttpWebSocketGroupState>> m_groups;
+
+    qint64 m_reportedMemory = 0;
+
+    // Called by the connection
+    void start(const HttpRequest& request, QByteArrayView buffered);
+    void readFrames();
+    int getPingInterval() const { return m_handler->pingInterval; }
+
+    // Pings a silent client once, false if it did not answer the last ping
+    bool checkAlive();
+
+    void receive(const char* data, qsizetype size);
+    qsizetype parseHeader(const uchar* data, qsizetype size);
+    void finishFrame();
+    void finishMessage();
+    void handleClose();
+
+    void write(const QByteArray& data);
+    void fail(int code, const char* reason);
+    void notifyClose(int code, const QByteArray& reason);
+    void updateMemoryUsage();
+
+    static bool acceptDeflate(QByteArrayView offers);
+
+    static bool deflateMessage(QByteArrayView message, QByteArray& result);
+    static bool inflateMessage(QByteArrayView data, qint64 maxSize, QByteArray& result);
+};
+
+
+// Members of one group, shared with the broadcasts still queued in other threads
+struct HttpWebSocketGroupState
+{
+    QMutex mutex;
+
+    // By the context (worker) of the sessions, so a broadcast posts one event per thread
+    QHash<QObject*, QList<HttpWebSocket*>> members;
+    int size = 0;
+    int compressedSize = 0;
+};
+
+
+// Broadcast to sessions in any thread: the message is encoded (and compressed) once, the frame buffers
+// are shared by all receivers through implicit sharing. Thread-safe, except that sessions have to join
+// and leave in their own thread. Closed sessions leave automatically.
+class HttpWebSocketGroup
+{
+public:
+    HttpWebSocketGroup();
+
+    HttpWebSocketGroup(const HttpWebSocketGroup&) = delete;
+    HttpWebSocketGroup& operator=(const HttpWebSocketGroup&) = delete;
+
+    void join(HttpWebSocket* socket);
+    void leave(HttpWebSocket* socket);
+
+    int getSize() const;
+
+    // Sent in order within each thread, except is skipped (e.g. the sender)
+    void broadcast(QByteArrayView message, bool binary, const HttpWebSocket* except = nullptr);
+    void broadcastText(const QString& message, const HttpWebSocket* except = nullptr) { broadcast(message.toUtf8(), false, except); }
+
+private:
+    std::shared_ptr<HttpWebSocketGroupState> m_state;
+
+    static void remove(HttpWebSocketGroupState* state, HttpWebSocket* socket);
+};
+
+#endif // HTTPWEBSOCKET_H
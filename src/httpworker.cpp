@@ -0,0 +1,102 @@
+#include "httpworker.h"
+
+#include <QSslSocket>
+#include <QTimer>
+
+#include "httpserver.h"
+#include "httpconnection.h"
+
+
+HttpWorker::HttpWorker(HttpServer* server, QObject* parent) :
+    QObject(parent),
+    m_server(server)
+{
+    m_clock.start();
+
+    // Moved to the thread of the worker along with it
+    m_wheelTimer = new QTimer(this);
+    m_wheelTimer->setSingleShot(true);
+
+    connect(m_wheelTimer, &QTimer::timeout, this, &HttpWorker::advanceTimers);
+}
+
+HttpWorker::~HttpWorker()
+{
+
+}
+
+void HttpWorker::addConnection(qintptr handle)
+{
+    m_pendingConnections.deref();
+
+    // Socket is created here, so it lives in the thread of this worker
+    QSslSocket* const socket = new QSslSocket();
+
+    if (!socket->setSocketDescriptor(handle))
+    {
+        qCDebug(lcHttpServer) << "SocketDescriptor invalid!";
+        delete socket;
+
+        m_server->releaseConnection();
+        return;
+    }
+
+    const QString logInfo = HttpServer::getLogInfo(socket);
+
+    qCDebug(lcHttpServer) << logInfo << "Connected";
+
+    if (!m_server->m_sslConfig.isNull())
+        socket->setSslConfiguration(m_server->m_sslConfig);
+
+    // QSslSocket does not report resumption, with a TLS context per socket sessions are not resumed
+    connect(socket, &QSslSocket::encrypted, this, [this]() { m_server->countHandshake(false); });
+
+    // Only connected for debug output, the signals are emitted for every connection
+    if (lcHttpServer().isDebugEnabled())
+    {
+        connect(socket, &QSslSocket::disconnected, [logInfo]() { qCDebug(lcHttpServer) << logInfo << "Disconnected"; });
+        connect(socket, &QSslSocket::destroyed, [logInfo]() { qCDebug(lcHttpServer) << logInfo << "Destroyed"; });
+        connect(socket, &QSslSocket::errorOccurred, [logInfo, socket](QAbstractSocket::SocketError error) { qCDebug(lcHttpServer) << logInfo << "Socket Error:" << error << socket->errorString(); });
+
+        connect(socket, &QSslSocket::encrypted, [logInfo]() { qCDebug(lcHttpServer) << logInfo << "Encrypted"; });
+        connect(socket, &QSslSocket::handshakeInterruptedOnError, [logInfo](const QSslError& error) { qCDebug(lcHttpServer) << logInfo << "Handhshake Error:" << error; });
+        connect(socket, &QSslSocket::peerVerifyError, [logInfo](const QSslError& error) { qCDebug(lcHttpServer) << logInfo << "Peer Verify Error:" << error; });
+        connect(socket, &QSslSocket::sslErrors, [logInfo](const QList<QSslError>& errors) { qCDebug(lcHttpServer) << logInfo << "SSL Errors:" << errors; });
+    }
+
+    // Takes ownership of the socket
+    HttpConnection* const connection = new HttpConnection(socket, m_server, this);
+
+    m_connectionCount.ref();
+    connect(connection, &HttpConnection::destroyed, this, [this]() { m_connectionCount.deref(); });
+}
+
+void HttpWorker::startTimeout(HttpTimerWheel::Timer* timer, qint64 msec)
+{
+    if (msec <= 0)
+    {
+        timer->stop();
+        return;
+    }
+
+    m_timerWheel.start(timer, msec, m_clock.elapsed());
+    scheduleTimers();
+}
+
+void HttpWorker::advanceTimers()
+{
+    m_timerWheel.advance(m_clock.elapsed());
+    scheduleTimers();
+}
+
+void HttpWorker::scheduleTimers()
+{
+    const qint64 timeout = m_timerWheel.getNextTimeout(m_clock.elapsed());
+
+    if (timeout < 0)
+        m_wheelTimer->stop();
+
+    // Most timers are restarted long before they fire, so the QTimer is only moved forward
+    else if (!m_wheelTimer->isActive() || m_wheelTimer->remainingTime() > timeout)
+        m_wheelTimer->start(int(timeout));
+}
@@ -0,0 +1,52 @@
+#ifndef HTTPWORKER_H
+#define HTTPWORKER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+#include "httptimerwheel.h"
+
+
+class HttpServer;
+class QTimer;
+
+
+// Runs in its own thread and owns all connections handed over to it
+class HttpWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HttpWorker(HttpServer* server, QObject* parent = nullptr);
+    ~HttpWorker();
+
+    // Thread-safe, used for balancing. Includes connections assigned by the server, but not yet taken over.
+    int getConnectionCount() const { return m_connectionCount.loadRelaxed() + m_pendingConnections.loadRelaxed(); }
+
+    // Thread-safe, counted until addConnection() runs
+    void addPendingConnection() { m_pendingConnections.ref(); }
+
+    // Timeouts of the connections of this worker, only used in its thread.
+    // msec <= 0 stops the timer.
+    void startTimeout(HttpTimerWheel::Timer* timer, qint64 msec);
+
+public slots:
+    void addConnection(qintptr handle);
+
+private:
+    HttpServer* m_server = nullptr;
+
+    QAtomicInt m_connectionCount = 0;
+    QAtomicInt m_pendingConnections = 0;
+
+    // One QTimer for all connections, set to the next timer of the wheel
+    QElapsedTimer m_clock;
+    HttpTimerWheel m_timerWheel;
+    QTimer* m_wheelTimer = nullptr;
+
+    void advanceTimers();
+    void scheduleTimers();
+};
+
+#endif // HTTPWORKER_H
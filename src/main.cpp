@@ -1,3 +1,4 @@
+#include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QThread>
 
@@ -8,10 +9,28 @@ int main(int argc, char *argv[])
 {   
     QCoreApplication a(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({ "backend", "Connection handling: qt (default) or epoll (Linux).", "backend", "qt" });
+    parser.addOption({ "port", "Listen port, 8080 by default.", "port", "8080" });
+    parser.addOption({ "http", "Serve plain HTTP instead of redirecting it to HTTPS, e.g. for benchmarks." });
+    parser.process(a);
+
+    const QString backendName = parser.value("backend");
+    const quint16 port = parser.value("port").toUShort();
+
+    if (backendName != "qt" && backendName != "epoll")
+        parser.showHelp(1);
+
+    if (port == 0)
+        parser.showHelp(1);
+
+    const HttpServer::BACKEND backend = backendName == "epoll" ? HttpServer::BACKEND_EPOLL : HttpServer::BACKEND_QT;
+
     QThread* thr = new QThread();
     thr->setObjectName("HttpAPI");
 
-    HttpAPI* api = new HttpAPI();
+    HttpAPI* api = new HttpAPI(backend, port, !parser.isSet("http"));
     api->moveToThread(thr);
 
     QObject::connect(thr, &QThread::started, api, &HttpAPI::start);
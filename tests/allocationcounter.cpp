@@ -0,0 +1,42 @@
+#include "allocationcounter.h"
+
+#include <cstdlib>
+#include <new>
+
+
+static thread_local quint64 t_allocationCount = 0;
+
+
+quint64 getAllocationCount()
+{
+    return t_allocationCount;
+}
+
+// https://en.cppreference.com/w/cpp/memory/new/operator_new#Global_replacements
+// -> The array forms call these
+void* operator new(std::size_t size)
+{
+    ++t_allocationCount;
+
+    if (void* const pointer = std::malloc(size ? size : 1))
+        return pointer;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    ++t_allocationCount;
+
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
@@ -0,0 +1,12 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+
+// Calls of the global operator new (new[] included) in the calling thread, counted by the replacement
+// in allocationcounter.cpp. Qt containers (QByteArray, QString, QList, QVarLengthArray) allocate with
+// malloc() and are not included, QHash and std:: containers are.
+quint64 getAllocationCount();
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,99 @@
+// Request parser: message framing that a proxy in front of the server could read differently,
+// and time and operator new calls for parsing a GET on a reused request (QBENCHMARK)
+
+#include <QTest>
+
+#include "allocationcounter.h"
+#include "httprequest.h"
+
+
+class HttpRequestTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void contentLength_data();
+    void contentLength();
+
+    void parseSixHeaders();
+};
+
+
+void HttpRequestTest::contentLength_data()
+{
+    QTest::addColumn<QByteArray>("headers");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<qint64>("bodySize");
+
+    QTest::newRow("single") << QByteArray("Content-Length: 5\r\n") << true << qint64(5);
+    QTest::newRow("zero") << QByteArray("Content-Length: 0\r\n") << true << qint64(0);
+    QTest::newRow("repeated, same value") << QByteArray("Content-Length: 5\r\nContent-Length: 5\r\n") << true << qint64(5);
+
+    // https://datatracker.ietf.org/doc/html/rfc9112#section-6.3
+    QTest::newRow("repeated, different values") << QByteArray("Content-Length: 5\r\nContent-Length: 100\r\n") << false << qint64(0);
+    QTest::newRow("repeated, different case") << QByteArray("content-length: 5\r\nCONTENT-LENGTH: 100\r\n") << false << qint64(0);
+    QTest::newRow("repeated, not adjacent") << QByteArray("Content-Length: 5\r\nAccept: */*\r\nContent-Length: 6\r\n") << false << qint64(0);
+    QTest::newRow("plus sign") << QByteArray("Content-Length: +5\r\n") << false << qint64(0);
+    QTest::newRow("minus sign") << QByteArray("Content-Length: -0\r\n") << false << qint64(0);
+    QTest::newRow("list") << QByteArray("Content-Length: 5, 5\r\n") << false << qint64(0);
+    QTest::newRow("inner whitespace") << QByteArray("Content-Length: 5 0\r\n") << false << qint64(0);
+    QTest::newRow("hex") << QByteArray("Content-Length: 0x5\r\n") << false << qint64(0);
+    QTest::newRow("overflow") << QByteArray("Content-Length: 99999999999999999999\r\n") << false << qint64(0);
+}
+
+void HttpRequestTest::contentLength()
+{
+    QFETCH(QByteArray, headers);
+    QFETCH(bool, valid);
+    QFETCH(qint64, bodySize);
+
+    const QByteArray data = "POST /test HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n" + QByteArray(100, 'x');
+
+    HttpRequest request;
+    request.appendData(data);
+
+    QCOMPARE(request.getParseState() != HttpRequest::ERROR, valid);
+
+    if (valid)
+    {
+        QVERIFY(request.isComplete());
+        QCOMPARE(qint64(request.getBody().size()), bodySize);
+    }
+}
+
+void HttpRequestTest::parseSixHeaders()
+{
+    const QByteArray data =
+        "GET /api/v1/status HTTP/1.1\r\n"
+        "Host: localhost:8080\r\n"
+        "User-Agent: httpload/1.0\r\n"
+        "Accept: application/json\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: no-cache\r\n"
+        "\r\n";
+
+    // Reused like on a keep-alive connection, the first request sizes the buffers
+    HttpRequest request;
+    request.appendData(data);
+
+    const quint64 allocations = getAllocationCount();
+
+    request.reset();
+    request.appendData(data);
+
+    qInfo() << "operator new calls per parse:" << getAllocationCount() - allocations;
+
+    QBENCHMARK
+    {
+        request.reset();
+        request.appendData(data);
+    }
+
+    QVERIFY(request.isComplete());
+}
+
+
+QTEST_APPLESS_MAIN(HttpRequestTest)
+
+#include "httprequesttest.moc"
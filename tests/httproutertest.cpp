@@ -0,0 +1,120 @@
+// Route lookup with 3000 routes: the trie against the QHash<QPair<METHOD, QString>> the server used before,
+// which only found exact matches (QBENCHMARK). Lookups in the trie must not call operator new.
+
+#include <QHash>
+#include <QPair>
+#include <QTest>
+
+#include "allocationcounter.h"
+#include "httprouter.h"
+
+
+class HttpRouterTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void lookup_data();
+    void lookupTrie();
+    void lookupHash();
+    void lookupAllocations_data();
+    void lookupAllocations();
+
+private:
+    HttpRouter m_router;
+    QHash<QPair<HttpRequest::METHOD, QString>, HttpRouter::Callback> m_hashCallbacks;
+};
+
+
+void HttpRouterTest::initTestCase()
+{
+    const HttpRouter::Callback callback = [](const HttpRequest&, const QString&) { return HttpResponse(HttpResponse::OK); };
+
+    const QList<QPair<HttpRequest::METHOD, QString>> listSuffixes = {
+        { HttpRequest::GET, "" }, { HttpRequest::POST, "" }, { HttpRequest::GET, "/{id}" },
+        { HttpRequest::PUT, "/{id}" }, { HttpRequest::DELETE, "/{id}" }, { HttpRequest::GET, "/{id}/posts/{postId}" }
+    };
+
+    for (int i = 0; i < 500; ++i)
+    {
+        for (const auto& suffix : listSuffixes)
+        {
+            const QString pattern = QString("/api/v1/resource%1").arg(i) + suffix.second;
+
+            QVERIFY(m_router.addRoute(suffix.first, pattern, callback));
+            m_hashCallbacks.insert(qMakePair(suffix.first, pattern), callback);
+        }
+    }
+}
+
+void HttpRouterTest::lookup_data()
+{
+    QTest::addColumn<QString>("path");
+    QTest::addColumn<bool>("trieFound");
+    QTest::addColumn<bool>("hashFound");
+
+    // The hash has no parameters, a path with values in it is a miss there
+    QTest::newRow("static") << QString("/api/v1/resource250") << true << true;
+    QTest::newRow("param") << QString("/api/v1/resource250/12345/posts/42") << true << false;
+    QTest::newRow("miss") << QString("/api/v1/resource250/12345/unknown") << false << false;
+}
+
+void HttpRouterTest::lookupTrie()
+{
+    QFETCH(QString, path);
+    QFETCH(bool, trieFound);
+
+    bool found = false;
+
+    QBENCHMARK
+    {
+        HttpRouter::Match match;
+        found = m_router.match(HttpRequest::GET, path, match);
+    }
+
+    QCOMPARE(found, trieFound);
+}
+
+void HttpRouterTest::lookupHash()
+{
+    QFETCH(QString, path);
+    QFETCH(bool, hashFound);
+
+    bool found = false;
+
+    // Like HttpServer before the trie: contains(), then operator[] for the callback
+    QBENCHMARK
+    {
+        const auto key = qMakePair(HttpRequest::GET, path);
+        found = m_hashCallbacks.contains(key) && m_hashCallbacks[key];
+    }
+
+    QCOMPARE(found, hashFound);
+}
+
+void HttpRouterTest::lookupAllocations_data()
+{
+    lookup_data();
+}
+
+void HttpRouterTest::lookupAllocations()
+{
+    QFETCH(QString, path);
+
+    const quint64 allocations = getAllocationCount();
+
+    for (int i = 0; i < 100; ++i)
+    {
+        HttpRouter::Match match;
+        m_router.match(HttpRequest::GET, path, match);
+    }
+
+    QCOMPARE(getAllocationCount() - allocations, quint64(0));
+}
+
+
+QTEST_APPLESS_MAIN(HttpRouterTest)
+
+#include "httproutertest.moc"